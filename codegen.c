@@ -4,102 +4,142 @@
 void gen_compound_assign(Node* node, const char* operation, bool is_div) {
 	gen_lval(node->lhs);  // 左辺のアドレスをスタックに積む
 	gen_lval(node->lhs);  // 左辺のアドレスをもう一度積む（値取得用）
-	printf("	lw $t0, 0($sp)\n");  // アドレスを取得
-	printf("	lw $t0, 0($t0)\n");  // 現在の値を取得
-	printf("	sw $t0, 0($sp)\n");  // 現在の値をスタックに格納
+	emit("	lw $t0, 0($sp)\n");  // アドレスを取得
+	emit("	lw $t0, 0($t0)\n");  // 現在の値を取得
+	emit("	sw $t0, 0($sp)\n");  // 現在の値をスタックに格納
 	gen(node->rhs);       // 右辺を評価
-	printf("	lw $t1, 0($sp)\n");  // 右辺の値
-	printf("	addiu $sp, $sp, 4\n");
-	printf("	lw $t0, 0($sp)\n");  // 左辺の現在値
-	printf("	addiu $sp, $sp, 4\n");
+	emit("	lw $t1, 0($sp)\n");  // 右辺の値
+	emit("	addiu $sp, $sp, 4\n");
+	emit("	lw $t0, 0($sp)\n");  // 左辺の現在値
+	emit("	addiu $sp, $sp, 4\n");
 	
 	if (is_div) {
-		printf("	div $t0, $t1\n");       // 除算
-		printf("	mflo $t1\n");           // 商を取得
+		emit("	div $zero, $t0, $t1\n"); // 除算
+		emit("	mflo $t1\n");            // 商を取得
 	} else {
-		printf("	%s $t1, $t0, $t1\n", operation);  // 演算
+		emit("	%s $t1, $t0, $t1\n", operation);  // 演算
 	}
 	
-	printf("	lw $t0, 0($sp)\n");  // 左辺のアドレス
-	printf("	addiu $sp, $sp, 4\n");
-	printf("	sw $t1, 0($t0)\n");  // 結果を格納
-	printf("	addiu $sp, $sp, -4\n");
-	printf("	sw $t1, 0($sp)\n");  // 結果をスタックに残す
+	emit("	lw $t0, 0($sp)\n");  // 左辺のアドレス
+	emit("	addiu $sp, $sp, 4\n");
+	emit("	sw $t1, 0($t0)\n");  // 結果を格納
+	emit("	addiu $sp, $sp, -4\n");
+	emit("	sw $t1, 0($sp)\n");  // 結果をスタックに残す
 }
 
 // インクリメント/デクリメント演算子の共通処理
 void gen_inc_dec(Node* node, int delta, bool is_prefix) {
 	gen_lval(node->lhs);  // 変数のアドレスをスタックに積む
-	printf("	lw $t0, 0($sp)\n");  // アドレスを取得
-	printf("	lw $t1, 0($t0)\n");  // 現在の値を取得
+	emit("	lw $t0, 0($sp)\n");  // アドレスを取得
+	emit("	lw $t1, 0($t0)\n");  // 現在の値を取得
 	
 	if (is_prefix) {
 		// 前置: 先に値を更新
-		printf("	addiu $t1, $t1, %d\n", delta);  // 値を更新
-		printf("	sw $t1, 0($t0)\n");  // 新しい値を格納
-		printf("	sw $t1, 0($sp)\n");  // 新しい値をスタックに残す
+		emit("	addiu $t1, $t1, %d\n", delta);  // 値を更新
+		emit("	sw $t1, 0($t0)\n");  // 新しい値を格納
+		emit("	sw $t1, 0($sp)\n");  // 新しい値をスタックに残す
 	} else {
 		// 後置: 元の値を残して値を更新
-		printf("	addiu $t2, $t1, %d\n", delta);  // 新しい値を$t2に計算
-		printf("	sw $t2, 0($t0)\n");  // 新しい値を格納
-		printf("	sw $t1, 0($sp)\n");  // 元の値をスタックに残す
+		emit("	addiu $t2, $t1, %d\n", delta);  // 新しい値を$t2に計算
+		emit("	sw $t2, 0($t0)\n");  // 新しい値を格納
+		emit("	sw $t1, 0($sp)\n");  // 元の値をスタックに残す
 	}
 }
 
-// 変数アクセスの共通処理（配列判定含む）
-void gen_variable_access(Node* node, bool is_local) {
-	bool is_array = false;
-	
-	// 型情報を確認して配列かどうか判定
-	if (is_local) {
+// 変数が配列型かどうかを判定する（配列はアドレスとして扱う）
+bool is_array_var(Node* node) {
+	if (node->kind == ND_LVAR) {
 		for (LVar* var = locals; var; var = var->next) {
 			if (var->offset == node->offset) {
-				is_array = (var->type->ty == TY_ARRAY);
-				break;
+				return var->type->ty == TY_ARRAY;
 			}
 		}
 	} else {
 		for (GVar* var = globals; var; var = var->next) {
 			if (strcmp(var->name, node->name) == 0) {
-				is_array = (var->type->ty == TY_ARRAY);
-				break;
+				return var->type->ty == TY_ARRAY;
 			}
 		}
 	}
+	return false;
+}
+
+// ローカル変数（$s8からのオフセット）のメモリオペランド
+// フレームポインタを使わない関数では、出力する時点の$spからの位置に読み替える
+void frame_operand(char* buf, int offset) {
+	if (frame_uses_fp) {
+		sprintf(buf, "%d($s8)", offset);
+	} else {
+		sprintf(buf, "%d($sp)", frame_top + offset + sp_offset);
+	}
+}
+
+// ローカル変数のアドレスをレジスタrdに求める
+void gen_frame_addr(char* rd, int offset) {
+	if (frame_uses_fp) {
+		emit("	addiu %s, $s8, %d\n", rd, offset);
+	} else {
+		emit("	addiu %s, $sp, %d\n", rd, frame_top + offset + sp_offset);
+	}
+}
+
+// 変数アクセスの共通処理（配列判定含む）
+void gen_variable_access(Node* node, bool is_local) {
+	bool is_array = is_array_var(node);
 	
 	if (is_array) {
 		// 配列の場合はアドレス（配列→ポインタ変換）
 		if (is_local) {
-			printf("	addiu $t0, $s8, %d\n", node->offset);
+			gen_frame_addr("$t0", node->offset);
 		} else {
-			printf("	la $t0, %s\n", node->name);
+			emit("	la $t0, %s\n", node->name);
 		}
 	} else {
 		// 通常の変数の場合は値を読み込み
 		if (is_local) {
-			printf("	lw $t0, %d($s8)\n", node->offset);
+			char mem[32];
+			frame_operand(mem, node->offset);
+			emit("	lw $t0, %s\n", mem);
 		} else {
-			printf("	lw $t0, %s\n", node->name);
+			emit("	lw $t0, %s\n", node->name);
 		}
 	}
 	
-	printf("	addiu $sp, $sp, -4\n");
-	printf("	sw $t0, 0($sp)\n");
+	emit("	addiu $sp, $sp, -4\n");
+	emit("	sw $t0, 0($sp)\n");
+}
+
+// ND_MEMBERノードが参照するメンバを求める
+Member* lookup_member(Node* node) {
+	Type* struct_type = get_type(node->lhs);
+	if (struct_type->ty != TY_STRUCT) {
+		error("member access on non-struct type");
+	}
+	
+	// メンバを検索
+	Token member_tok;
+	member_tok.str = node->name;
+	member_tok.len = strlen(node->name);
+	Member* member = find_member(struct_type->struct_def, &member_tok);
+	if (!member) {
+		error("undefined member");
+	}
+	return member;
 }
 
 void gen_lval(Node* node) {
 	switch (node->kind) {
 	case ND_LVAR:
 		// 変数のアドレスを計算
-		printf("	addiu $t0, $s8, %d\n", node->offset);
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t0, 0($sp)\n");
+		gen_frame_addr("$t0", node->offset);
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
 		return;
 	case ND_GVAR:
 		// グローバル変数のアドレスを計算
-		printf("	la $t0, %s\n", node->name);
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t0, 0($sp)\n");
+		emit("	la $t0, %s\n", node->name);
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
 		return;
 	case ND_DEREF:
 		// *ptr の左辺値は ptr の値（アドレス）
@@ -110,24 +150,12 @@ void gen_lval(Node* node) {
 		gen_lval(node->lhs);  // 構造体オブジェクトのアドレスを取得
 		
 		// 構造体の型を取得してメンバオフセットを計算
-		Type* struct_type = get_type(node->lhs);
-		if (struct_type->ty != TY_STRUCT) {
-			error("member access on non-struct type");
-		}
-		
-		// メンバを検索
-		Token member_tok;
-		member_tok.str = node->name;
-		member_tok.len = strlen(node->name);
-		Member* member = find_member(struct_type->struct_def, &member_tok);
-		if (!member) {
-			error("undefined member");
-		}
+		Member* member = lookup_member(node);
 		
 		// ベースアドレス + メンバオフセット
-		printf("	lw $t0, 0($sp)\n");           // ベースアドレスを$t0に
-		printf("	addiu $t0, $t0, %d\n", member->offset);  // メンバオフセットを追加
-		printf("	sw $t0, 0($sp)\n");           // 結果をスタックに格納
+		emit("	lw $t0, 0($sp)\n");           // ベースアドレスを$t0に
+		emit("	addiu $t0, $t0, %d\n", member->offset);  // メンバオフセットを追加
+		emit("	sw $t0, 0($sp)\n");           // 結果をスタックに格納
 		return;
 	}
 	default:
@@ -135,61 +163,121 @@ void gen_lval(Node* node) {
 	}
 }
 
-void gen(Node* node) {
-	switch (node->kind) {
-	case ND_FUNC: {
-		// 現在の関数名を設定
-		current_func_name = node->name;
-		
-		// 関数の開始ラベル
-		printf("%s:\n", node->name);
-		
-		// 対応する関数のローカル変数情報を取得
-		Function* func = NULL;
-		for (Function* f = functions; f; f = f->next) {
-			if (strcmp(f->name, node->name) == 0) {
-				func = f;
-				break;
-			}
-		}
-		
-		// 現在の関数のローカル変数を設定
-		LVar* saved_locals = locals;
-		if (func) {
-			locals = func->locals;
+// 名前から関数定義を探す
+Function* lookup_function(char* name) {
+	for (Function* f = functions; f; f = f->next) {
+		if (strcmp(f->name, name) == 0) {
+			return f;
 		}
-		
-		// ローカル変数のサイズ計算
-		int local_size = 0;
-		if (func && func->locals) {
-			for (LVar* var = func->locals; var; var = var->next) {
-				if (var->offset < 0) {
-					local_size = (-var->offset > local_size) ? -var->offset : local_size;
-				}
-			}
-		}
-		
-		// MIPS ABI準拠のスタックフレームサイズ計算
-		// レイアウト: [$ra, $s8, 引数領域, ローカル変数領域]（すべて$s8からの正のオフセット）
-		int arg_save_size = node->argc > 0 ? node->argc * 4 : 0;
-		int frame_size = 8 + arg_save_size + local_size;  // $ra(4) + $s8(4) + 引数 + ローカル変数
-		if (frame_size % 8 != 0) {
-			frame_size = ((frame_size + 7) / 8) * 8;
+	}
+	return NULL;
+}
+
+// 文字列リテラルをリストに登録してラベル番号を返す
+int add_string_literal(Node* node) {
+	int id = string_count++;
+	StringLiteral* str_lit = calloc(1, sizeof(StringLiteral));
+	str_lit->data = calloc(node->str_len + 1, sizeof(char));
+	memcpy(str_lit->data, node->str, node->str_len);
+	str_lit->data[node->str_len] = '\0';
+	str_lit->len = node->str_len;
+	str_lit->id = id;
+	str_lit->next = string_literals;
+	string_literals = str_lit;
+	return id;
+}
+
+// 関数の開始ラベルを出力し、その関数のローカル変数を有効にする
+// 呼び出し側で復元できるよう、それまでのローカル変数リストを返す
+LVar* gen_func_label(Node* node) {
+	// 現在の関数名を設定
+	current_func_name = node->name;
+	
+	// 関数の開始ラベル
+	emit("%s:\n", node->name);
+	
+	// 対応する関数のローカル変数情報を取得
+	Function* func = lookup_function(node->name);
+	
+	// 現在の関数のローカル変数を設定
+	LVar* saved_locals = locals;
+	if (func) {
+		locals = func->locals;
+	}
+	return saved_locals;
+}
+
+// 関数の開始ラベルとプロローグを出力し、その関数のローカル変数を有効にする
+// 呼び出し側で復元できるよう、それまでのローカル変数リストを返す
+LVar* gen_func_prologue(Node* node) {
+	LVar* saved_locals = gen_func_label(node);
+	
+	// ローカル変数のサイズ計算
+	int local_size = 0;
+	for (LVar* var = locals; var; var = var->next) {
+		if (var->offset < 0) {
+			local_size = (-var->offset > local_size) ? -var->offset : local_size;
 		}
-		current_frame_size = frame_size;
-		
-		// 統一された関数プロローグ
-		printf("	addiu $sp, $sp, -%d\n", frame_size);
-		printf("	sw $ra, %d($sp)\n", frame_size - 4);  // フレーム最上部に$ra
-		printf("	sw $s8, %d($sp)\n", frame_size - 8);  // その下に$s8
-		printf("	addiu $s8, $sp, %d\n", frame_size - 8);  // $s8をフレームポインタ基準に
-		
-		// 引数をローカル領域に保存（$s8からの正のオフセット）
-		if (node->argc > 0) {
-			for (int i = 0; i < node->argc && i < 4; i++) {
-				printf("	sw $a%d, %d($s8)\n", i, -8 - (i + 1) * 4);  // 引数を$s8の下に配置
-			}
+	}
+	
+	// MIPS ABI準拠のスタックフレームサイズ計算
+	// レイアウト: [$ra, $s8, 引数領域, ローカル変数領域]（すべて$s8からの正のオフセット）
+	int arg_save_size = node->argc > 0 ? node->argc * 4 : 0;
+	int frame_size = 8 + arg_save_size + local_size;  // $ra(4) + $s8(4) + 引数 + ローカル変数
+	if (frame_size % 8 != 0) {
+		frame_size = ((frame_size + 7) / 8) * 8;
+	}
+	current_frame_size = frame_size;
+	
+	// 統一された関数プロローグ
+	emit("	addiu $sp, $sp, -%d\n", frame_size);
+	emit("	sw $ra, %d($sp)\n", frame_size - 4);  // フレーム最上部に$ra
+	emit("	sw $s8, %d($sp)\n", frame_size - 8);  // その下に$s8
+	emit("	addiu $s8, $sp, %d\n", frame_size - 8);  // $s8をフレームポインタ基準に
+	
+	// 引数をローカル領域に保存（$s8からの正のオフセット）
+	if (node->argc > 0) {
+		for (int i = 0; i < node->argc && i < 4; i++) {
+			emit("	sw $a%d, %d($s8)\n", i, -8 - (i + 1) * 4);  // 引数を$s8の下に配置
 		}
+	}
+	frame_uses_fp = true;
+	sp_offset = 0;
+	return saved_locals;
+}
+
+// 統一された関数エピローグ（戻り値は$v0に設定済み）
+void gen_func_epilogue(void) {
+	int saved_sp_offset = sp_offset;  // return文の後に続くコードのために戻す
+	emit("	lw $ra, %d($s8)\n", 4);  // $s8+4から$ra復元
+	emit("	lw $s8, 0($s8)\n");      // $s8+0から旧$s8復元
+	emit("	addiu $sp, $sp, %d\n", current_frame_size);
+	emit("	jr $ra\n");
+	emit("	nop\n");
+	sp_offset = saved_sp_offset;
+}
+
+// 文の実行後に値がスタックに残るか（式文）
+static bool leaves_value(Node* node) {
+	switch (node->kind) {
+	case ND_RETURN:
+	case ND_IF:
+	case ND_WHILE:
+	case ND_FOR:
+	case ND_BLOCK:
+	case ND_SWITCH:
+	case ND_CASE:
+	case ND_DEFAULT:
+		return false;
+	default:
+		return true;
+	}
+}
+
+void gen(Node* node) {
+	switch (node->kind) {
+	case ND_FUNC: {
+		LVar* saved_locals = gen_func_prologue(node);
 		
 		// 関数本体の実行
 		bool has_return = false;
@@ -200,24 +288,17 @@ void gen(Node* node) {
 				break;
 			}
 			// 各文の結果をスタックから除去
-			if (node->body[i]->kind != ND_IF && 
-			    node->body[i]->kind != ND_WHILE && 
-			    node->body[i]->kind != ND_FOR && 
-			    node->body[i]->kind != ND_BLOCK) {
-				printf("	lw $t0, 0($sp)\n");
-				printf("	addiu $sp, $sp, 4\n");
+			if (leaves_value(node->body[i])) {
+				emit("	lw $t0, 0($sp)\n");
+				emit("	addiu $sp, $sp, 4\n");
 			}
 		}
 		
 		// デフォルトの戻り値とエピローグ
 		if (!has_return) {
-			printf(".L_func_end_%s:\n", node->name);
-			printf("	li $v0, 0\n");
-			printf("	lw $ra, %d($s8)\n", 4);  // $s8+4から$ra復元
-			printf("	lw $s8, 0($s8)\n");      // $s8+0から旧$s8復元
-			printf("	addiu $sp, $sp, %d\n", current_frame_size);
-			printf("	jr $ra\n");
-			printf("	nop\n");
+			emit(".L_func_end_%s:\n", node->name);
+			emit("	li $v0, 0\n");
+			gen_func_epilogue();
 		}
 		
 		// ローカル変数を復元
@@ -244,49 +325,47 @@ void gen(Node* node) {
 		
 		// スタックから引数をレジスタに移動（正しい順序）
 		for (int i = 0; i < node->argc && i < 4; i++) {
-			printf("	lw $a%d, %d($sp)\n", i, (node->argc - 1 - i) * 4);
+			emit("	lw $a%d, %d($sp)\n", i, (node->argc - 1 - i) * 4);
 		}
-		printf("	addiu $sp, $sp, %d\n", node->argc * 4);
+		emit("	addiu $sp, $sp, %d\n", node->argc * 4);
 		
 		// 関数呼び出し
-		printf("	jal %s\n", node->name);
-		printf("	nop\n");
+		emit("	jal %s\n", node->name);
+		emit("	nop\n");
 		
 		// 戻り値をスタックにプッシュ
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $v0, 0($sp)\n");
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $v0, 0($sp)\n");
 		return;
 	}
 	case ND_BLOCK:
 		for (int i = 0; node->body[i]; i++) {
 			gen(node->body[i]);
 			// ブロック内の各文の結果をスタックから除去
-			if (node->body[i]->kind != ND_RETURN && node->body[i]->kind != ND_IF && 
-			    node->body[i]->kind != ND_WHILE && node->body[i]->kind != ND_FOR && 
-			    node->body[i]->kind != ND_BLOCK) {
-				printf("	lw $t0, 0($sp)\n");
-				printf("	addiu $sp, $sp, 4\n");
+			if (leaves_value(node->body[i])) {
+				emit("	lw $t0, 0($sp)\n");
+				emit("	addiu $sp, $sp, 4\n");
 			}
 		}
 		return;
 	case ND_IF: {
 		int seq = label_count++;
 		gen(node->cond);
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
 		if (node->els) {
 			// else節がある場合
-			printf("	beq $t0, $zero, .L_else_%d\n", seq);
+			emit("	beq $t0, $zero, .L_else_%d\n", seq);
 			gen(node->then);
-			printf("	j .L_end_%d\n", seq);
-			printf(".L_else_%d:\n", seq);
+			emit("	j .L_end_%d\n", seq);
+			emit(".L_else_%d:\n", seq);
 			gen(node->els);
-			printf(".L_end_%d:\n", seq);
+			emit(".L_end_%d:\n", seq);
 		} else {
 			// else節がない場合（従来通り）
-			printf("	beq $t0, $zero, .L_end_%d\n", seq);
+			emit("	beq $t0, $zero, .L_end_%d\n", seq);
 			gen(node->then);
-			printf(".L_end_%d:\n", seq);
+			emit(".L_end_%d:\n", seq);
 		}
 		return;
 	}
@@ -298,15 +377,15 @@ void gen(Node* node) {
 		// ループラベルをスタックにプッシュ
 		push_loop_labels(break_label, continue_label);
 		
-		printf(".L_begin_%d:\n", seq);
-		printf(".Lcontinue%d:\n", continue_label);  // continue先
+		emit(".L_begin_%d:\n", seq);
+		emit(".Lcontinue%d:\n", continue_label);  // continue先
 		gen(node->cond);
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	beq $t0, $zero, .Lbreak%d\n", break_label);  // break先
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	beq $t0, $zero, .Lbreak%d\n", break_label);  // break先
 		gen(node->then);
-		printf("	j .L_begin_%d\n", seq);
-		printf(".Lbreak%d:\n", break_label);  // break先ラベル
+		emit("	j .L_begin_%d\n", seq);
+		emit(".Lbreak%d:\n", break_label);  // break先ラベル
 		
 		// ループラベルをスタックからポップ
 		pop_loop_labels();
@@ -323,74 +402,84 @@ void gen(Node* node) {
 		// 初期化
 		if (node->init) {
 			gen(node->init);
-			printf("	lw $t0, 0($sp)\n");
-			printf("	addiu $sp, $sp, 4\n");
+			emit("	lw $t0, 0($sp)\n");
+			emit("	addiu $sp, $sp, 4\n");
 		}
-		printf(".L_begin_%d:\n", seq);
+		emit(".L_begin_%d:\n", seq);
 		// 条件チェック
 		if (node->cond) {
 			gen(node->cond);
-			printf("	lw $t0, 0($sp)\n");
-			printf("	addiu $sp, $sp, 4\n");
-			printf("	beq $t0, $zero, .Lbreak%d\n", break_label);
+			emit("	lw $t0, 0($sp)\n");
+			emit("	addiu $sp, $sp, 4\n");
+			emit("	beq $t0, $zero, .Lbreak%d\n", break_label);
 		}
 		// ボディ実行
 		gen(node->then);
 		// continue先ラベル（インクリメント処理）
-		printf(".Lcontinue%d:\n", continue_label);
+		emit(".Lcontinue%d:\n", continue_label);
 		if (node->inc) {
 			gen(node->inc);
-			printf("	lw $t0, 0($sp)\n");
-			printf("	addiu $sp, $sp, 4\n");
+			emit("	lw $t0, 0($sp)\n");
+			emit("	addiu $sp, $sp, 4\n");
 		}
-		printf("	j .L_begin_%d\n", seq);
-		printf(".Lbreak%d:\n", break_label);
+		emit("	j .L_begin_%d\n", seq);
+		emit(".Lbreak%d:\n", break_label);
 		
 		// ループラベルをスタックからポップ
 		pop_loop_labels();
 		return;
 	}
+	case ND_SWITCH: {
+		int seq = label_count++;
+		gen(node->cond);
+		emit("	lw $v0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		// breakはswitch文の後ろへ、continueは外側のループへ
+		push_loop_labels(seq, loop_stack ? loop_stack->continue_label : -1);
+		gen_switch_branch(node, seq);
+		gen(node->then);
+		if (leaves_value(node->then)) {
+			emit("	lw $t0, 0($sp)\n");
+			emit("	addiu $sp, $sp, 4\n");
+		}
+		emit(".Lbreak%d:\n", seq);
+		pop_loop_labels();
+		return;
+	}
+	case ND_CASE:
+	case ND_DEFAULT:
+		emit(".L_case_%d:\n", node->case_label);
+		gen(node->then);
+		if (leaves_value(node->then)) {
+			emit("	lw $t0, 0($sp)\n");
+			emit("	addiu $sp, $sp, 4\n");
+		}
+		return;
 	case ND_RETURN: {
 		if (node->lhs) {
 			// 戻り値がある場合
 			gen(node->lhs);
-			printf("	lw $v0, 0($sp)\n");
-			printf("	addiu $sp, $sp, 4\n");
+			emit("	lw $v0, 0($sp)\n");
+			emit("	addiu $sp, $sp, 4\n");
 		} else {
 			// void関数のreturn;の場合
-			printf("	li $v0, 0\n");
+			emit("	li $v0, 0\n");
 		}
 		
-		// 統一された関数エピローグ
-		printf("	lw $ra, %d($s8)\n", 4);  // $s8+4から$ra復元
-		printf("	lw $s8, 0($s8)\n");      // $s8+0から旧$s8復元
-		printf("	addiu $sp, $sp, %d\n", current_frame_size);
-		printf("	jr $ra\n");
-		printf("	nop\n");
+		gen_func_epilogue();
 		return;
 	}
 	case ND_NUM:
-		printf("	li $t0, %d\n", node->val);
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t0, 0($sp)\n");
+		emit("	li $t0, %d\n", node->val);
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
 		return;
 	case ND_STR: {
 		// 文字列リテラルのラベルを生成
-		int id = string_count++;
-		printf("	la $t0, .L_str_%d\n", id);
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t0, 0($sp)\n");
-		
-		// 文字列データをリストに登録
-		StringLiteral* str_lit = calloc(1, sizeof(StringLiteral));
-		str_lit->data = calloc(node->str_len + 1, sizeof(char));
-		memcpy(str_lit->data, node->str, node->str_len);
-		str_lit->data[node->str_len] = '\0';
-		str_lit->len = node->str_len;
-		str_lit->id = id;
-		str_lit->next = string_literals;
-		string_literals = str_lit;
-		
+		int id = add_string_literal(node);
+		emit("	la $t0, .L_str_%d\n", id);
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
 		return;
 	}
 	case ND_LVAR: {
@@ -404,13 +493,13 @@ void gen(Node* node) {
 	case ND_ASSIGN:
 		gen_lval(node->lhs);
 		gen(node->rhs);
-		printf("	lw $t1, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	sw $t1, 0($t0)\n");
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t1, 0($sp)\n");
+		emit("	lw $t1, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	sw $t1, 0($t0)\n");
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t1, 0($sp)\n");
 		return;
 	case ND_ADD_ASSIGN:
 		gen_compound_assign(node, "add", false);
@@ -431,9 +520,9 @@ void gen(Node* node) {
 	case ND_DEREF:
 		// *ptr: ポインタが指す値をロード
 		gen(node->lhs);  // ポインタの値（アドレス）を取得
-		printf("	lw $t0, 0($sp)\n");        // アドレスを$t0に取得
-		printf("	lw $t0, 0($t0)\n");        // そのアドレスの内容を$t0に取得
-		printf("	sw $t0, 0($sp)\n");        // 結果をスタックに格納
+		emit("	lw $t0, 0($sp)\n");        // アドレスを$t0に取得
+		emit("	lw $t0, 0($t0)\n");        // そのアドレスの内容を$t0に取得
+		emit("	sw $t0, 0($sp)\n");        // 結果をスタックに格納
 		return;
 	case ND_PRE_INC:
 		gen_inc_dec(node, 1, true);
@@ -451,16 +540,16 @@ void gen(Node* node) {
 		// 論理NOT (単項演算子)
 		int label = label_count++;
 		gen(node->lhs);
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	beqz $t0, .Ltrue%d\n", label);
-		printf("	li $t0, 0\n");  // 値が0でない場合は0を返す
-		printf("	j .Lend%d\n", label);
-		printf(".Ltrue%d:\n", label);
-		printf("	li $t0, 1\n");  // 値が0の場合は1を返す
-		printf(".Lend%d:\n", label);
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t0, 0($sp)\n");
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	beqz $t0, .Ltrue%d\n", label);
+		emit("	li $t0, 0\n");  // 値が0でない場合は0を返す
+		emit("	j .Lend%d\n", label);
+		emit(".Ltrue%d:\n", label);
+		emit("	li $t0, 1\n");  // 値が0の場合は1を返す
+		emit(".Lend%d:\n", label);
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
 		return;
 	}
 	case ND_TERNARY: {
@@ -469,19 +558,21 @@ void gen(Node* node) {
 		
 		// 条件式を評価
 		gen(node->cond);
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	beqz $t0, .Lelse%d\n", label);  // 条件が偽なら else_expr へ
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	beqz $t0, .Lelse%d\n", label);  // 条件が偽なら else_expr へ
 		
 		// then_expr を評価
+		int saved_sp_offset = sp_offset;
 		gen(node->then);
-		printf("	j .Lend%d\n", label);  // 評価後は終了へ
+		emit("	j .Lend%d\n", label);  // 評価後は終了へ
 		
-		// else_expr を評価
-		printf(".Lelse%d:\n", label);
+		// else_expr を評価（条件分岐直後の$spから）
+		emit(".Lelse%d:\n", label);
+		sp_offset = saved_sp_offset;
 		gen(node->els);
 		
-		printf(".Lend%d:\n", label);
+		emit(".Lend%d:\n", label);
 		return;
 	}
 	case ND_BREAK: {
@@ -489,23 +580,23 @@ void gen(Node* node) {
 		if (!loop_stack) {
 			error("break statement not within a loop");
 		}
-		printf("	j .Lbreak%d\n", loop_stack->break_label);
+		emit("	j .Lbreak%d\n", loop_stack->break_label);
 		return;
 	}
 	case ND_CONTINUE: {
 		// 現在のループのcontinue先にジャンプ
-		if (!loop_stack) {
+		if (!loop_stack || loop_stack->continue_label < 0) {
 			error("continue statement not within a loop");
 		}
-		printf("	j .Lcontinue%d\n", loop_stack->continue_label);
+		emit("	j .Lcontinue%d\n", loop_stack->continue_label);
 		return;
 	}
 	case ND_MEMBER: {
 		// メンバアクセス: obj.member
 		gen_lval(node);  // メンバのアドレスを取得
-		printf("	lw $t0, 0($sp)\n");     // アドレスを$t0に
-		printf("	lw $t0, 0($t0)\n");     // メンバの値を$t0に読み込み
-		printf("	sw $t0, 0($sp)\n");     // 結果をスタックに格納
+		emit("	lw $t0, 0($sp)\n");     // アドレスを$t0に
+		emit("	lw $t0, 0($t0)\n");     // メンバの値を$t0に読み込み
+		emit("	sw $t0, 0($sp)\n");     // 結果をスタックに格納
 		return;
 	}
 	}
@@ -513,10 +604,10 @@ void gen(Node* node) {
 	// 二項演算子の処理
 	gen(node->lhs);
 	gen(node->rhs);
-	printf("	lw $t1, 0($sp)\n");
-	printf("	addiu $sp, $sp, 4\n");
-	printf("	lw $t0, 0($sp)\n");
-	printf("	addiu $sp, $sp, 4\n");
+	emit("	lw $t1, 0($sp)\n");
+	emit("	addiu $sp, $sp, 4\n");
+	emit("	lw $t0, 0($sp)\n");
+	emit("	addiu $sp, $sp, 4\n");
 	
 	switch (node->kind) {
 	case ND_ADD: {
@@ -528,65 +619,65 @@ void gen(Node* node) {
 			// 左がポインタ/配列: ptr + int => ptr + (int * sizeof(pointee))
 			int elem_size = size_of(left_type->ptr_to);
 			if (elem_size > 1) {
-				printf("	li $t2, %d\n", elem_size);
-				printf("	mul $t1, $t1, $t2\n");
+				emit("	li $t2, %d\n", elem_size);
+				emit("	mul $t1, $t1, $t2\n");
 			}
 		} else if (right_type->ty == TY_PTR || right_type->ty == TY_ARRAY) {
 			// 右がポインタ/配列: int + ptr => (int * sizeof(pointee)) + ptr
 			int elem_size = size_of(right_type->ptr_to);
 			if (elem_size > 1) {
-				printf("	li $t2, %d\n", elem_size);
-				printf("	mul $t0, $t0, $t2\n");
+				emit("	li $t2, %d\n", elem_size);
+				emit("	mul $t0, $t0, $t2\n");
 			}
 		}
 		
-		printf("	add $t0, $t0, $t1\n");
+		emit("	add $t0, $t0, $t1\n");
 		break;
 	}
 	case ND_SUB:
-		printf("	sub $t0, $t0, $t1\n");
+		emit("	sub $t0, $t0, $t1\n");
 		break;
 	case ND_MUL:
-		printf("	mul $t0, $t0, $t1\n");
+		emit("	mul $t0, $t0, $t1\n");
 		break;
 	case ND_DIV:
-		printf("	div $t0, $t1\n");
-		printf("	mflo $t0\n");
+		emit("	div $zero, $t0, $t1\n");
+		emit("	mflo $t0\n");
 		break;
 	case ND_MOD:
-		printf("	div $t0, $t1\n");
-		printf("	mfhi $t0\n");
+		emit("	div $zero, $t0, $t1\n");
+		emit("	mfhi $t0\n");
 		break;
 	case ND_EQ:
-		printf("	seq $t0, $t0, $t1\n");
+		emit("	seq $t0, $t0, $t1\n");
 		break;
 	case ND_NE:
-		printf("	sne $t0, $t0, $t1\n");
+		emit("	sne $t0, $t0, $t1\n");
 		break;
 	case ND_LT:
-		printf("	slt $t0, $t0, $t1\n");
+		emit("	slt $t0, $t0, $t1\n");
 		break;
 	case ND_LE:
-		printf("	sle $t0, $t0, $t1\n");
+		emit("	sle $t0, $t0, $t1\n");
 		break;
 	case ND_AND: {
 		// 論理AND (短絡評価)
 		// 左辺が偽なら右辺を評価せずに0を返す
 		int label = label_count++;
 		gen(node->lhs);
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	beqz $t0, .Lfalse%d\n", label);
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	beqz $t0, .Lfalse%d\n", label);
 		gen(node->rhs);
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	sltu $t0, $zero, $t0\n"); // 0 < $t0 なら1, それ以外なら0
-		printf("	j .Lend%d\n", label);
-		printf(".Lfalse%d:\n", label);
-		printf("	li $t0, 0\n");
-		printf(".Lend%d:\n", label);
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t0, 0($sp)\n");
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	sltu $t0, $zero, $t0\n"); // 0 < $t0 なら1, それ以外なら0
+		emit("	j .Lend%d\n", label);
+		emit(".Lfalse%d:\n", label);
+		emit("	li $t0, 0\n");
+		emit(".Lend%d:\n", label);
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
 		return;
 	}
 	case ND_OR: {
@@ -594,200 +685,703 @@ void gen(Node* node) {
 		// 左辺が真なら右辺を評価せずに1を返す
 		int label = label_count++;
 		gen(node->lhs);
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	bnez $t0, .Ltrue%d\n", label);
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	bnez $t0, .Ltrue%d\n", label);
 		gen(node->rhs);
-		printf("	lw $t0, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		printf("	sltu $t0, $zero, $t0\n"); // 0 < $t0 なら1, それ以外なら0
-		printf("	j .Lend%d\n", label);
-		printf(".Ltrue%d:\n", label);
-		printf("	li $t0, 1\n");
-		printf(".Lend%d:\n", label);
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t0, 0($sp)\n");
+		emit("	lw $t0, 0($sp)\n");
+		emit("	addiu $sp, $sp, 4\n");
+		emit("	sltu $t0, $zero, $t0\n"); // 0 < $t0 なら1, それ以外なら0
+		emit("	j .Lend%d\n", label);
+		emit(".Ltrue%d:\n", label);
+		emit("	li $t0, 1\n");
+		emit(".Lend%d:\n", label);
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
 		return;
 	}
 	}
 
-	printf("	addiu $sp, $sp, -4\n");
-	printf("	sw $t0, 0($sp)\n");
+	emit("	addiu $sp, $sp, -4\n");
+	emit("	sw $t0, 0($sp)\n");
+}
+
+// =============================================================================
+// switch文の分岐
+// =============================================================================
+//
+// caseの値を昇順に並べ、値が密に並ぶ範囲はジャンプテーブルで、残りは比較の
+// 二分木で分岐する。テーブルは値の範囲の下限と上限を確かめてから引き、
+// プログラムの最後に.rdataへまとめて出力する。
+// 分岐する値は$v0に置いてから呼ぶ。作業用に$v1を使い、$v0も壊す。
+
+#define SWITCH_TABLE_MIN_CASES 4   // ジャンプテーブルにするcaseの数の下限
+#define SWITCH_TABLE_DENSITY 40    // テーブルの要素のうちcaseが占める割合（%）の下限
+#define SWITCH_TABLE_MAX_SIZE 1024 // テーブルの要素数の上限
+#define SWITCH_LINEAR_MAX 3        // 二分木にせず順に比較するcaseの数の上限
+
+typedef struct JumpTable JumpTable;
+struct JumpTable {
+	JumpTable* next;
+	int id;
+	char** labels; // 範囲の下限から順の分岐先
+	int size;
+};
+
+static JumpTable* jump_tables;
+
+typedef struct {
+	int val;
+	char* label;
+} CaseTarget;
+
+// テーブルにするか、1つずつ比較するcaseの並び
+typedef struct {
+	int first; // 最初のcaseの番号
+	int last;  // 最後のcaseの番号
+} CaseCluster;
+
+static void add_switch_case(SwitchCases* sc, Node* node) {
+	sc->cases = realloc(sc->cases, sizeof(Node*) * (sc->num_cases + 1));
+	sc->cases[sc->num_cases++] = node;
+}
+
+// switch文の本体nodeからcase/defaultラベルを集める（入れ子のswitch文のものは除く）
+void collect_switch_cases(Node* node, SwitchCases* sc) {
+	if (!node || node->kind == ND_SWITCH) {
+		return;
+	}
+	if (node->kind == ND_CASE) {
+		add_switch_case(sc, node);
+	} else if (node->kind == ND_DEFAULT) {
+		sc->default_case = node;
+	}
+	collect_switch_cases(node->then, sc);
+	collect_switch_cases(node->els, sc);
+	for (int i = 0; node->body && node->body[i]; i++) {
+		collect_switch_cases(node->body[i], sc);
+	}
+}
+
+static int compare_case(const void* a, const void* b) {
+	int x = ((CaseTarget*)a)->val;
+	int y = ((CaseTarget*)b)->val;
+	return x < y ? -1 : x > y;
+}
+
+static char* copy_label(char* label) {
+	char* copy = malloc(strlen(label) + 1);
+	strcpy(copy, label);
+	return copy;
+}
+
+// 昇順のcasesを、先頭から貪欲に最も長いテーブルの範囲と単独のcaseに分ける
+static int cluster_cases(CaseTarget* cases, int n, CaseCluster* clusters) {
+	int num = 0;
+	for (int i = 0; i < n;) {
+		int last = i;
+		for (int j = n - 1; j >= i + SWITCH_TABLE_MIN_CASES - 1; j--) {
+			long long range = (long long)cases[j].val - cases[i].val + 1;
+			if (range <= SWITCH_TABLE_MAX_SIZE && (j - i + 1) * 100LL >= range * SWITCH_TABLE_DENSITY) {
+				last = j;
+				break;
+			}
+		}
+		clusters[num].first = i;
+		clusters[num].last = last;
+		num++;
+		i = last + 1;
+	}
+	return num;
+}
+
+// $v0 < val なら$v1を1にする
+static void gen_less_than(int val) {
+	if (val >= -32768 && val <= 32767) {
+		emit("	slti $v1, $v0, %d\n", val);
+	} else {
+		emit("	li $v1, %d\n", val);
+		emit("	slt $v1, $v0, $v1\n");
+	}
+}
+
+static void gen_case_compare(CaseTarget* target) {
+	if (target->val == 0) {
+		emit("	beq $v0, $zero, %s\n", target->label);
+		return;
+	}
+	emit("	li $v1, %d\n", target->val);
+	emit("	beq $v0, $v1, %s\n", target->label);
+}
+
+// cases[first..last]をジャンプテーブルで分岐する
+static void gen_jump_table(CaseTarget* cases, int first, int last, char* default_label) {
+	JumpTable* table = calloc(1, sizeof(JumpTable));
+	int lo = cases[first].val;
+	table->id = label_count++;
+	table->size = cases[last].val - lo + 1;
+	table->labels = calloc(table->size, sizeof(char*));
+	for (int i = 0; i < table->size; i++) {
+		table->labels[i] = default_label;
+	}
+	for (int i = first; i <= last; i++) {
+		table->labels[cases[i].val - lo] = cases[i].label;
+	}
+	table->next = jump_tables;
+	jump_tables = table;
+
+	if (lo >= -32767 && lo <= 32768) {
+		if (lo != 0) {
+			emit("	addiu $v0, $v0, %d\n", -lo);
+		}
+	} else {
+		emit("	li $v1, %d\n", lo);
+		emit("	subu $v0, $v0, $v1\n");
+	}
+	// 下限より小さい値は符号なしで大きな値になる
+	emit("	sltiu $v1, $v0, %d\n", table->size);
+	emit("	beq $v1, $zero, %s\n", default_label);
+	emit("	sll $v0, $v0, 2\n");
+	emit("	lw $v0, .L_switch_%d($v0)\n", table->id);
+	emit("	jr $v0\n");
+}
+
+// clusters[lo..hi)のどれかへ分岐する（どれにも当たらなければdefault_labelへ）
+static void gen_case_tree(CaseTarget* cases, CaseCluster* clusters, int lo, int hi, char* default_label) {
+	bool linear = hi - lo <= SWITCH_LINEAR_MAX;
+	for (int i = lo; i < hi && linear; i++) {
+		if (clusters[i].first != clusters[i].last) {
+			linear = false;
+		}
+	}
+	if (linear) {
+		for (int i = lo; i < hi; i++) {
+			gen_case_compare(&cases[clusters[i].first]);
+		}
+		emit("	j %s\n", default_label);
+		return;
+	}
+	if (hi - lo == 1) {
+		gen_jump_table(cases, clusters[lo].first, clusters[lo].last, default_label);
+		return;
+	}
+	int mid = (lo + hi) / 2;
+	int left = label_count++;
+	gen_less_than(cases[clusters[mid].first].val);
+	emit("	bne $v1, $zero, .L_switch_left_%d\n", left);
+	gen_case_tree(cases, clusters, mid, hi, default_label);
+	emit(".L_switch_left_%d:\n", left);
+	gen_case_tree(cases, clusters, lo, mid, default_label);
+}
+
+// $v0の値がvals[i]ならlabels[i]へ、どれでもなければdefault_labelへ分岐する
+void gen_switch_dispatch(int* vals, char** labels, int n, char* default_label) {
+	CaseTarget* cases = calloc(n + 1, sizeof(CaseTarget));
+	for (int i = 0; i < n; i++) {
+		cases[i].val = vals[i];
+		cases[i].label = copy_label(labels[i]);
+	}
+	qsort(cases, n, sizeof(CaseTarget), compare_case);
+	CaseCluster* clusters = calloc(n + 1, sizeof(CaseCluster));
+	int num_clusters = cluster_cases(cases, n, clusters);
+	gen_case_tree(cases, clusters, 0, num_clusters, copy_label(default_label));
+	free(clusters);
+	free(cases);
+}
+
+// switch文の式の値（$v0）でcase/defaultラベルへ分岐する。ラベルの番号をここで割り当てる
+void gen_switch_branch(Node* node, int break_label) {
+	SwitchCases sc = {0};
+	collect_switch_cases(node->then, &sc);
+	int* vals = calloc(sc.num_cases + 1, sizeof(int));
+	char** labels = calloc(sc.num_cases + 1, sizeof(char*));
+	for (int i = 0; i < sc.num_cases; i++) {
+		sc.cases[i]->case_label = label_count++;
+		vals[i] = sc.cases[i]->val;
+		labels[i] = calloc(32, sizeof(char));
+		sprintf(labels[i], ".L_case_%d", sc.cases[i]->case_label);
+	}
+	char default_label[32];
+	if (sc.default_case) {
+		sc.default_case->case_label = label_count++;
+		sprintf(default_label, ".L_case_%d", sc.default_case->case_label);
+	} else {
+		sprintf(default_label, ".Lbreak%d", break_label);
+	}
+	gen_switch_dispatch(vals, labels, sc.num_cases, default_label);
+	for (int i = 0; i < sc.num_cases; i++) {
+		free(labels[i]);
+	}
+	free(labels);
+	free(vals);
+	free(sc.cases);
+}
+
+// labelがジャンプテーブルから参照されているか
+bool jump_table_refers(char* label) {
+	for (JumpTable* table = jump_tables; table; table = table->next) {
+		for (int i = 0; i < table->size; i++) {
+			if (strcmp(table->labels[i], label) == 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// ジャンプテーブルを出力する
+void print_jump_tables(void) {
+	if (!jump_tables) {
+		return;
+	}
+	printf("\n# Jump tables\n");
+	printf(".rdata\n");
+	printf(".align 2\n");
+	for (JumpTable* table = jump_tables; table; table = table->next) {
+		printf(".L_switch_%d:\n", table->id);
+		for (int i = 0; i < table->size; i++) {
+			printf("	.word %s\n", table->labels[i]);
+		}
+	}
 }
 
 // =============================================================================
 // printf実装の補助関数群
 // =============================================================================
 
-// writeシステムコール（1文字出力）
-void gen_write_syscall(void) {
-	printf("	li $a0, 1\n");              // stdout
-	printf("	la $a1, .L_char_buffer\n"); // バッファアドレス
-	printf("	li $a2, 1\n");              // 1バイト
-	printf("	li $v0, 4004\n");           // writeシステムコール
-	printf("	syscall\n");
+#define PRINTF_CHUNK 64 // 書式の文字列を出力バッファへまとめて書き込む最大の文字数
+
+// 出力バッファの内容を書き出すwriteシステムコール（$a2に書き出すバイト数）
+static void gen_write_buffer(void) {
+	emit("	li $a0, 1\n");                 // stdout
+	emit("	la $a1, .L_out_buffer\n");     // バッファアドレス
+	emit("	li $v0, 4004\n");              // writeシステムコール
+	emit("	syscall\n");
+	emit("	sw $zero, .L_out_len\n");
+}
+
+// regの下位8ビットを1文字として出力バッファに追加する
+// 端末なら改行で、そうでなければバッファが満ちたときに書き出す（残りは__startが終了前に書き出す）
+// $a0-$a2を使い、書き出すときは$v0/$a3も壊す（1文字ずつのwriteと同じ）
+void gen_write_char(char* reg) {
+	int id = label_count++;
+	emit("	lw $a2, .L_out_len\n");
+	emit("	sb %s, .L_out_buffer($a2)\n", reg);
+	emit("	addiu $a2, $a2, 1\n");
+	emit("	sw $a2, .L_out_len\n");
+	emit("	lw $a1, .L_out_flush_char\n"); // 端末なら'\n'、そうでなければ文字にならない256
+	emit("	beq %s, $a1, .L_out_flush_%d\n", reg, id);
+	emit("	slti $a0, $a2, %d\n", OUT_BUFFER_SIZE);
+	emit("	bnez $a0, .L_out_done_%d\n", id);
+	emit(".L_out_flush_%d:\n", id);
+	gen_write_buffer();
+	emit(".L_out_done_%d:\n", id);
+}
+
+// 出力バッファに溜まった文字があれば書き出す
+void gen_flush_output(void) {
+	int id = label_count++;
+	emit("	lw $a2, .L_out_len\n");
+	emit("	beqz $a2, .L_out_done_%d\n", id);
+	gen_write_buffer();
+	emit(".L_out_done_%d:\n", id);
 }
 
 // 1文字出力
 void gen_printf_char(int printf_id) {
-	printf(".printf_normal_char_%d:\n", printf_id);
-	printf("	sb $t3, .L_char_buffer\n");  // バイト単位で格納
-	gen_write_syscall();
+	emit(".printf_normal_char_%d:\n", printf_id);
+	gen_write_char("$t3");
 }
 
-// 整数出力（32bit対応）
-void gen_printf_integer(int printf_id, int arg_index) {
-	printf("	move $t6, $a1\n");           // 整数値を$t6に保存
-	
-	// 負数チェック
-	printf("	bgez $t6, .printf_positive_%d_%d\n", printf_id, arg_index);
-	
-	// マイナス符号を出力
-	printf("	li $t4, 45\n");             // '-' のASCII値
-	printf("	sb $t4, .L_char_buffer\n");
-	gen_write_syscall();
-	printf("	sub $t6, $zero, $t6\n");    // 絶対値を取得
-	
-	printf(".printf_positive_%d_%d:\n", printf_id, arg_index);
-	
-	// 0の特別処理
-	printf("	bnez $t6, .printf_nonzero_%d_%d\n", printf_id, arg_index);
-	printf("	li $t4, 48\n");             // '0' のASCII値
-	printf("	sb $t4, .L_char_buffer\n");
-	gen_write_syscall();
-	printf("	j .printf_int_done_%d_%d\n", printf_id, arg_index);
-	
-	printf(".printf_nonzero_%d_%d:\n", printf_id, arg_index);
-	
-	// 桁を逆順でスタックに積む
-	printf("	li $t7, 0\n");              // 桁数カウンタ
-	printf("	move $t5, $t6\n");          // 作業用コピー
-	
-	printf(".printf_digit_loop_%d_%d:\n", printf_id, arg_index);
-	printf("	beqz $t5, .printf_print_digits_%d_%d\n", printf_id, arg_index);
-	printf("	li $t9, 10\n");
-	printf("	div $t5, $t9\n");
-	printf("	mfhi $t4\n");               // 余り
-	printf("	mflo $t5\n");               // 商
-	printf("	addiu $t4, $t4, 48\n");     // ASCII変換
-	printf("	addiu $sp, $sp, -4\n");     // スタックに積む
-	printf("	sw $t4, 0($sp)\n");
-	printf("	addiu $t7, $t7, 1\n");      // 桁数増加
-	printf("	j .printf_digit_loop_%d_%d\n", printf_id, arg_index);
-	
-	// スタックから桁を取り出して出力
-	printf(".printf_print_digits_%d_%d:\n", printf_id, arg_index);
-	printf("	beqz $t7, .printf_int_done_%d_%d\n", printf_id, arg_index);
-	printf("	lw $t4, 0($sp)\n");         // 桁を取得
-	printf("	addiu $sp, $sp, 4\n");
-	printf("	sb $t4, .L_char_buffer\n");
-	gen_write_syscall();
-	printf("	addiu $t7, $t7, -1\n");     // 桁数減少
-	printf("	j .printf_print_digits_%d_%d\n", printf_id, arg_index);
-	
-	printf(".printf_int_done_%d_%d:\n", printf_id, arg_index);
+// 変換指定子ごとの出力ルーチン（print_printf_runtimeが関数の後に出力する）
+static bool printf_runtime_used;
+
+static void gen_printf_runtime_call(char* routine) {
+	printf_runtime_used = true;
+	emit("	jal %s\n", routine);
+	emit("	nop\n");
+}
+
+// $a1の値を変換指定子convに従って出力バッファに追加する（%c以外は共通ルーチンを呼ぶ）
+// 呼び出し先は$t0-$t7/$a0-$a3/$v0を壊すが、汎用の展開が使う$t8/$t9は残す
+static void gen_printf_value(char conv) {
+	if (conv == 'c') {
+		emit("	move $t3, $a1\n");
+		gen_write_char("$t3");
+		return;
+	}
+	gen_printf_runtime_call(conv == 'd' ? ".L_print_dec" : conv == 'u' ? ".L_print_udec" :
+	                        conv == 'x' ? ".L_print_hex" : ".L_print_str");
+}
+
+static bool is_printf_conv(char c) {
+	return c == 'd' || c == 'u' || c == 'x' || c == 'c' || c == 's';
+}
+
+// printfの引数を評価して$a1に取り出す
+// 関数呼び出しと組み込み関数は$t8/$t9を壊すので、書式の位置と引数番号を退避しておく
+static void gen_printf_arg(Node* arg) {
+	bool has_call = tree_any(arg, is_call_node, NULL);
+	if (has_call) {
+		emit("	addiu $sp, $sp, -8\n");
+		emit("	sw $t8, 4($sp)\n");
+		emit("	sw $t9, 0($sp)\n");
+	}
+	gen(arg);
+	emit("	lw $a1, 0($sp)\n");
+	emit("	addiu $sp, $sp, 4\n");
+	if (has_call) {
+		emit("	lw $t9, 0($sp)\n");
+		emit("	lw $t8, 4($sp)\n");
+		emit("	addiu $sp, $sp, 8\n");
+	}
+}
+
+// 書式の文字列のうちn文字（PRINTF_CHUNK以下）を出力バッファへ直接書き込む
+// 入りきらなければ先に書き出し、改行を含むときは端末なら書き込んだ後に書き出す
+// gen_write_charは空きがある前提で書き込むので、書き込み後も1バイト以上の空きを残す
+static void gen_write_literal(char* text, int n) {
+	int id = label_count++;
+	emit("	lw $a2, .L_out_len\n");
+	emit("	slti $a0, $a2, %d\n", OUT_BUFFER_SIZE - n);
+	emit("	bnez $a0, .L_out_room_%d\n", id);
+	gen_write_buffer();
+	emit("	move $a2, $zero\n");
+	emit(".L_out_room_%d:\n", id);
+	emit("	la $a1, .L_out_buffer\n");
+	emit("	addu $a1, $a1, $a2\n");
+	bool has_newline = false;
+	for (int i = 0; i < n; i++) {
+		if (i == 0 || text[i] != text[i - 1]) {
+			emit("	li $t3, %d\n", (unsigned char)text[i]);
+		}
+		emit("	sb $t3, %d($a1)\n", i);
+		if (text[i] == '\n') {
+			has_newline = true;
+		}
+	}
+	emit("	addiu $a2, $a2, %d\n", n);
+	emit("	sw $a2, .L_out_len\n");
+	if (!has_newline) {
+		return;
+	}
+	emit("	lw $a1, .L_out_flush_char\n");
+	emit("	li $a0, 10\n");
+	emit("	bne $a1, $a0, .L_out_done_%d\n", id);
+	gen_write_buffer();
+	emit(".L_out_done_%d:\n", id);
+}
+
+// 書式が文字列リテラルのprintf
+// コンパイル時に書式を解釈し、文字の書き込みと変換指定子ごとの値の出力を順に並べる
+// 実行時の書式の走査はしない。解釈は汎用の展開と同じで、%d/%u/%x/%c/%sは次の引数
+// （引数が尽きていれば0）、%の後のそれ以外の文字はその文字、末尾の%は何も出力しない
+static void gen_printf_literal(Node* node) {
+	Node* format = node->args[0];
+	int next_arg = 1;
+	char text[PRINTF_CHUNK];
+	int n = 0;  // textに溜めたまだ書き込んでいない文字数
+	for (int i = 0; i < format->str_len && format->str[i]; i++) {
+		char c = format->str[i];
+		if (c == '%') {
+			c = format->str[++i];
+			if (i >= format->str_len || !c) {
+				break;
+			}
+			if (is_printf_conv(c)) {
+				if (n > 0) {
+					gen_write_literal(text, n);
+					n = 0;
+				}
+				if (next_arg < node->argc) {
+					gen(node->args[next_arg++]);
+					emit("	lw $a1, 0($sp)\n");
+					emit("	addiu $sp, $sp, 4\n");
+					gen_printf_value(c);
+				} else {
+					emit("	li $t4, 48\n");  // 引数がない場合は'0'
+					gen_write_char("$t4");
+				}
+				continue;
+			}
+		}
+		text[n++] = c;
+		if (n == PRINTF_CHUNK) {
+			gen_write_literal(text, n);
+			n = 0;
+		}
+	}
+	if (n > 0) {
+		gen_write_literal(text, n);
+	}
 }
 
 // printf関数呼び出しの生成（リファクタリング版）
 void gen_printf_call(Node* node) {
 	if (node->argc < 1) {
-		printf("	li $t0, 0\n");
-		printf("	addiu $sp, $sp, -4\n");
-		printf("	sw $t0, 0($sp)\n");
+		emit("	li $t0, 0\n");
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
 		return;
 	}
+	if (node->args[0]->kind == ND_STR) {
+		gen_printf_literal(node);
+		emit("	li $t0, 0\n");
+		emit("	addiu $sp, $sp, -4\n");
+		emit("	sw $t0, 0($sp)\n");
+		return;
+	}
+	
+	// 書式が実行時に決まる場合は1文字ずつ解釈するループを出力する
 	
 	// フォーマット文字列を取得
 	gen(node->args[0]);
-	printf("	lw $t8, 0($sp)\n");          // 文字列アドレス
-	printf("	addiu $sp, $sp, 4\n");
+	emit("	lw $t8, 0($sp)\n");          // 文字列アドレス
+	emit("	addiu $sp, $sp, 4\n");
 	
 	int printf_id = label_count++;
 	
 	// 引数インデックスをレジスタで管理（$t9を使用）
-	printf("	li $t9, 1\n");               // 引数インデックス（1から開始）
+	emit("	li $t9, 1\n");               // 引数インデックス（1から開始）
 	
-	printf(".printf_loop_%d:\n", printf_id);
-	printf("	lb $t3, 0($t8)\n");          // 1文字読み込み
-	printf("	beq $t3, $zero, .printf_end_%d\n", printf_id);
+	emit(".printf_loop_%d:\n", printf_id);
+	emit("	lb $t3, 0($t8)\n");          // 1文字読み込み
+	emit("	beq $t3, $zero, .printf_end_%d\n", printf_id);
 	
 	// '%'文字をチェック
-	printf("	li $t4, 37\n");              // '%' のASCII値
-	printf("	bne $t3, $t4, .printf_normal_char_%d\n", printf_id);
+	emit("	li $t4, 37\n");              // '%' のASCII値
+	emit("	bne $t3, $t4, .printf_normal_char_%d\n", printf_id);
 	
 	// '%'の次の文字をチェック
-	printf("	addiu $t8, $t8, 1\n");
-	printf("	lb $t3, 0($t8)\n");
-	printf("	beq $t3, $zero, .printf_end_%d\n", printf_id);
-	
-	// 'd'かチェック（整数出力）
-	printf("	li $t4, 100\n");             // 'd' のASCII値
-	printf("	bne $t3, $t4, .printf_normal_char_%d\n", printf_id);
+	emit("	addiu $t8, $t8, 1\n");
+	emit("	lb $t3, 0($t8)\n");
+	emit("	beq $t3, $zero, .printf_end_%d\n", printf_id);
+	
+	// 変換指定子（d/u/x/c/s）かチェック
+	for (char* conv = "duxcs"; *conv; conv++) {
+		emit("	li $t4, %d\n", *conv);
+		emit("	beq $t3, $t4, .printf_conv_%d\n", printf_id);
+	}
+	emit("	j .printf_normal_char_%d\n", printf_id);
 	
-	// %d が見つかった場合：対応する引数があるかチェック
-	printf("	li $t4, %d\n", node->argc);  // 総引数数
-	printf("	bge $t9, $t4, .printf_no_more_args_%d\n", printf_id);
+	// 変換指定子が見つかった場合：対応する引数があるかチェック
+	emit(".printf_conv_%d:\n", printf_id);
+	emit("	li $t4, %d\n", node->argc);  // 総引数数
+	emit("	bge $t9, $t4, .printf_no_more_args_%d\n", printf_id);
 	
 	// 引数を動的に取得（簡易版：最大4つまで対応）
-	printf("	li $t4, 1\n");
-	printf("	beq $t9, $t4, .printf_arg1_%d\n", printf_id);
-	printf("	li $t4, 2\n");
-	printf("	beq $t9, $t4, .printf_arg2_%d\n", printf_id);
-	printf("	li $t4, 3\n");
-	printf("	beq $t9, $t4, .printf_arg3_%d\n", printf_id);
-	printf("	j .printf_no_more_args_%d\n", printf_id);
+	emit("	li $t4, 1\n");
+	emit("	beq $t9, $t4, .printf_arg1_%d\n", printf_id);
+	emit("	li $t4, 2\n");
+	emit("	beq $t9, $t4, .printf_arg2_%d\n", printf_id);
+	emit("	li $t4, 3\n");
+	emit("	beq $t9, $t4, .printf_arg3_%d\n", printf_id);
+	emit("	j .printf_no_more_args_%d\n", printf_id);
 	
 	// 各引数を個別に処理
-	printf(".printf_arg1_%d:\n", printf_id);
+	emit(".printf_arg1_%d:\n", printf_id);
 	if (node->argc > 1) {
-		gen(node->args[1]);
-		printf("	lw $a1, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		gen_printf_integer(printf_id, 1);
+		gen_printf_arg(node->args[1]);
+		emit("	lb $a0, 0($t8)\n");      // 変換指定子
+		gen_printf_runtime_call(".L_print_arg");
 	}
-	printf("	addiu $t9, $t9, 1\n");       // 引数インデックス増加
-	printf("	j .printf_continue_%d\n", printf_id);
+	emit("	addiu $t9, $t9, 1\n");       // 引数インデックス増加
+	emit("	j .printf_continue_%d\n", printf_id);
 	
-	printf(".printf_arg2_%d:\n", printf_id);
+	emit(".printf_arg2_%d:\n", printf_id);
 	if (node->argc > 2) {
-		gen(node->args[2]);
-		printf("	lw $a1, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		gen_printf_integer(printf_id, 2);
+		gen_printf_arg(node->args[2]);
+		emit("	lb $a0, 0($t8)\n");      // 変換指定子
+		gen_printf_runtime_call(".L_print_arg");
 	}
-	printf("	addiu $t9, $t9, 1\n");
-	printf("	j .printf_continue_%d\n", printf_id);
+	emit("	addiu $t9, $t9, 1\n");
+	emit("	j .printf_continue_%d\n", printf_id);
 	
-	printf(".printf_arg3_%d:\n", printf_id);
+	emit(".printf_arg3_%d:\n", printf_id);
 	if (node->argc > 3) {
-		gen(node->args[3]);
-		printf("	lw $a1, 0($sp)\n");
-		printf("	addiu $sp, $sp, 4\n");
-		gen_printf_integer(printf_id, 3);
+		gen_printf_arg(node->args[3]);
+		emit("	lb $a0, 0($t8)\n");      // 変換指定子
+		gen_printf_runtime_call(".L_print_arg");
 	}
-	printf("	addiu $t9, $t9, 1\n");
-	printf("	j .printf_continue_%d\n", printf_id);
+	emit("	addiu $t9, $t9, 1\n");
+	emit("	j .printf_continue_%d\n", printf_id);
 	
-	printf(".printf_no_more_args_%d:\n", printf_id);
+	emit(".printf_no_more_args_%d:\n", printf_id);
 	// 引数がない場合は'0'を出力
-	printf("	li $t4, 48\n");              // '0' のASCII値
-	printf("	sb $t4, .L_char_buffer\n");
-	gen_write_syscall();
-	printf("	j .printf_continue_%d\n", printf_id);
+	emit("	li $t4, 48\n");              // '0' のASCII値
+	gen_write_char("$t4");
+	emit("	j .printf_continue_%d\n", printf_id);
 	
 	// 通常文字出力
 	gen_printf_char(printf_id);
 	
-	printf(".printf_continue_%d:\n", printf_id);
-	printf("	addiu $t8, $t8, 1\n");       // 次の文字へ
-	printf("	j .printf_loop_%d\n", printf_id);
+	emit(".printf_continue_%d:\n", printf_id);
+	emit("	addiu $t8, $t8, 1\n");       // 次の文字へ
+	emit("	j .printf_loop_%d\n", printf_id);
 	
-	printf(".printf_end_%d:\n", printf_id);
+	emit(".printf_end_%d:\n", printf_id);
 	
 	// 戻り値をスタックにプッシュ
-	printf("	li $t0, 0\n");
-	printf("	addiu $sp, $sp, -4\n");
-	printf("	sw $t0, 0($sp)\n");
+	emit("	li $t0, 0\n");
+	emit("	addiu $sp, $sp, -4\n");
+	emit("	sw $t0, 0($sp)\n");
+}
+
+// [$t2, $t1)の文字列を出力バッファに追加して戻る（入りきらなければ先に書き出す）
+// .L_print_strは空きを確かめる前に1文字書き込むので、追加した後も1バイト以上の空きを残す
+static void gen_print_copy(void) {
+	emit(".L_print_copy:\n");
+	emit("	subu $t3, $t1, $t2\n");
+	emit("	lw $a2, .L_out_len\n");
+	emit("	addu $t4, $a2, $t3\n");
+	emit("	slti $t4, $t4, %d\n", OUT_BUFFER_SIZE);
+	emit("	bnez $t4, .L_print_copy_room\n");
+	gen_write_buffer();
+	emit("	move $a2, $zero\n");
+	emit(".L_print_copy_room:\n");
+	emit("	la $t4, .L_out_buffer\n");
+	emit("	addu $t4, $t4, $a2\n");
+	emit("	addu $a2, $a2, $t3\n");
+	emit("	sw $a2, .L_out_len\n");
+	emit(".L_print_copy_loop:\n");
+	emit("	lbu $t6, 0($t2)\n");
+	emit("	sb $t6, 0($t4)\n");
+	emit("	addiu $t2, $t2, 1\n");
+	emit("	addiu $t4, $t4, 1\n");
+	emit("	bne $t2, $t1, .L_print_copy_loop\n");
+	emit("	jr $ra\n");
+}
+
+// $t5の2桁の表から$t0（0〜99）の2桁を$t2の直前に書き、$t2を2つ戻す
+static void gen_print_two_digits(void) {
+	emit("	sll $t0, $t0, 1\n");
+	emit("	addu $t0, $t5, $t0\n");
+	emit("	lbu $t6, 1($t0)\n");
+	emit("	sb $t6, -1($t2)\n");
+	emit("	lbu $t6, 0($t0)\n");
+	emit("	sb $t6, -2($t2)\n");
+	emit("	addiu $t2, $t2, -2\n");
+}
+
+// printfの変換指定子の出力ルーチン（どれも$a1の値を出力バッファに追加して$raへ戻る）
+// 整数は作業領域.L_itoa_bufferの末尾から前へ向かって桁を書き、最後にまとめて追加する
+// 10進は100で割る（0x51eb851fを掛けた上位32ビットを5ビット右シフト）ごとに2桁の表から2桁を書く
+void print_printf_runtime(void) {
+	if (!printf_runtime_used) {
+		return;
+	}
+	printf("\n# printf runtime\n");
+	printf(".text\n");
+	printf(".align 2\n");
+
+	// %d/%u/%x/%c/%s（$a0の変換指定子で選ぶ。汎用の展開が使う）
+	emit(".L_print_arg:\n");
+	emit("	li $t0, 100\n");
+	emit("	beq $a0, $t0, .L_print_dec\n");
+	emit("	li $t0, 117\n");
+	emit("	beq $a0, $t0, .L_print_udec\n");
+	emit("	li $t0, 120\n");
+	emit("	beq $a0, $t0, .L_print_hex\n");
+	emit("	li $t0, 115\n");
+	emit("	beq $a0, $t0, .L_print_str\n");
+	emit("	move $t3, $a1\n");
+	gen_write_char("$t3");
+	emit("	jr $ra\n");
+
+	// %d: 負なら絶対値を符号なしで変換し、最後に'-'を付ける
+	emit(".L_print_dec:\n");
+	emit("	move $t7, $a1\n");
+	emit("	bgez $a1, .L_print_digits\n");
+	emit("	subu $a1, $zero, $a1\n");
+	emit("	j .L_print_digits\n");
+	// %u
+	emit(".L_print_udec:\n");
+	emit("	li $t7, 0\n");
+	emit(".L_print_digits:\n");
+	emit("	la $t1, .L_itoa_buffer\n");
+	emit("	addiu $t1, $t1, %d\n", ITOA_BUFFER_SIZE);
+	emit("	move $t2, $t1\n");
+	emit("	la $t5, .L_digit_pairs\n");
+	emit("	li $t3, 0x51eb851f\n");
+	emit(".L_print_digits_loop:\n");
+	emit("	sltiu $t4, $a1, 100\n");
+	emit("	bnez $t4, .L_print_digits_last\n");
+	emit("	multu $a1, $t3\n");
+	emit("	mfhi $t4\n");
+	emit("	srl $t4, $t4, 5\n");          // 商
+	emit("	li $t0, 100\n");
+	emit("	mul $t0, $t4, $t0\n");
+	emit("	subu $t0, $a1, $t0\n");       // 余り
+	gen_print_two_digits();
+	emit("	move $a1, $t4\n");
+	emit("	j .L_print_digits_loop\n");
+	emit(".L_print_digits_last:\n");      // 残りは100未満
+	emit("	sltiu $t4, $a1, 10\n");
+	emit("	bnez $t4, .L_print_digits_one\n");
+	emit("	move $t0, $a1\n");
+	gen_print_two_digits();
+	emit("	j .L_print_sign\n");
+	emit(".L_print_digits_one:\n");
+	emit("	addiu $t6, $a1, 48\n");
+	emit("	sb $t6, -1($t2)\n");
+	emit("	addiu $t2, $t2, -1\n");
+	emit(".L_print_sign:\n");
+	emit("	bgez $t7, .L_print_copy\n");
+	emit("	li $t6, 45\n");               // '-'
+	emit("	sb $t6, -1($t2)\n");
+	emit("	addiu $t2, $t2, -1\n");
+	emit("	j .L_print_copy\n");
+
+	// %x: 下位4ビットずつ
+	emit(".L_print_hex:\n");
+	emit("	la $t1, .L_itoa_buffer\n");
+	emit("	addiu $t1, $t1, %d\n", ITOA_BUFFER_SIZE);
+	emit("	move $t2, $t1\n");
+	emit("	la $t5, .L_hex_digits\n");
+	emit(".L_print_hex_loop:\n");
+	emit("	andi $t0, $a1, 15\n");
+	emit("	addu $t0, $t5, $t0\n");
+	emit("	lbu $t6, 0($t0)\n");
+	emit("	sb $t6, -1($t2)\n");
+	emit("	addiu $t2, $t2, -1\n");
+	emit("	srl $a1, $a1, 4\n");
+	emit("	bnez $a1, .L_print_hex_loop\n");
+	gen_print_copy();
+
+	// %s: 終端まで1文字ずつ追加する（バッファが満ちるか端末で改行なら書き出す）
+	emit(".L_print_str:\n");
+	emit("	move $t2, $a1\n");
+	emit("	lw $t7, .L_out_flush_char\n");
+	emit("	la $t5, .L_out_buffer\n");
+	emit("	lw $a2, .L_out_len\n");
+	emit(".L_print_str_loop:\n");
+	emit("	lb $t6, 0($t2)\n");
+	emit("	beqz $t6, .L_print_str_done\n");
+	emit("	addu $t4, $t5, $a2\n");
+	emit("	sb $t6, 0($t4)\n");
+	emit("	addiu $a2, $a2, 1\n");
+	emit("	addiu $t2, $t2, 1\n");
+	emit("	beq $t6, $t7, .L_print_str_flush\n");
+	emit("	slti $t4, $a2, %d\n", OUT_BUFFER_SIZE);
+	emit("	bnez $t4, .L_print_str_loop\n");
+	emit(".L_print_str_flush:\n");
+	gen_write_buffer();
+	emit("	move $a2, $zero\n");
+	emit("	j .L_print_str_loop\n");
+	emit(".L_print_str_done:\n");
+	emit("	sw $a2, .L_out_len\n");
+	emit("	jr $ra\n");
+	flush_insts();
+
+	printf(".rdata\n");
+	printf(".L_digit_pairs:\n");
+	printf("	.ascii \"");
+	for (int i = 0; i < 100; i++) {
+		printf("%02d", i);
+	}
+	printf("\"\n");
+	printf(".L_hex_digits:\n");
+	printf("	.ascii \"0123456789abcdef\"\n");
 }
 
 // =============================================================================
@@ -828,18 +1422,15 @@ void gen_putchar(Node* node) {
 	
 	// 引数を評価
 	gen(node->args[0]);
-	printf("\tlw $t0, 0($sp)\n");      // 文字コードを取得
-	printf("\taddiu $sp, $sp, 4\n");
+	emit("\tlw $t0, 0($sp)\n");      // 文字コードを取得
+	emit("\taddiu $sp, $sp, 4\n");
 	
-	// 文字をバッファに格納
-	printf("\tsb $t0, .L_char_buffer\n");
-	
-	// writeシステムコール
-	gen_write_syscall();
+	// 出力バッファに追加
+	gen_write_char("$t0");
 	
 	// 戻り値として文字コードをスタックにプッシュ
-	printf("\taddiu $sp, $sp, -4\n");
-	printf("\tsw $t0, 0($sp)\n");
+	emit("\taddiu $sp, $sp, -4\n");
+	emit("\tsw $t0, 0($sp)\n");
 }
 
 // int puts(const char* s) - 文字列出力
@@ -850,35 +1441,49 @@ void gen_puts(Node* node) {
 	
 	// 文字列ポインタを評価
 	gen(node->args[0]);
-	printf("\tlw $t8, 0($sp)\n");          // 文字列アドレス
-	printf("\taddiu $sp, $sp, 4\n");
+	emit("\tlw $t8, 0($sp)\n");          // 文字列アドレス
+	emit("\taddiu $sp, $sp, 4\n");
 	
 	int puts_id = label_count++;
 	
 	// 文字列の各文字を出力
-	printf(".puts_loop_%d:\n", puts_id);
-	printf("\tlb $t3, 0($t8)\n");          // 1文字読み込み
-	printf("\tbeq $t3, $zero, .puts_newline_%d\n", puts_id);
+	emit(".puts_loop_%d:\n", puts_id);
+	emit("\tlb $t3, 0($t8)\n");          // 1文字読み込み
+	emit("\tbeq $t3, $zero, .puts_newline_%d\n", puts_id);
 	
 	// 文字をバッファに格納して出力
-	printf("\tsb $t3, .L_char_buffer\n");
-	gen_write_syscall();
-	printf("\taddiu $t8, $t8, 1\n");       // 次の文字へ
-	printf("\tj .puts_loop_%d\n", puts_id);
+	gen_write_char("$t3");
+	emit("\taddiu $t8, $t8, 1\n");       // 次の文字へ
+	emit("\tj .puts_loop_%d\n", puts_id);
 	
 	// 改行文字を出力
-	printf(".puts_newline_%d:\n", puts_id);
-	printf("\tli $t3, 10\n");              // n のASCII値
-	printf("\tsb $t3, .L_char_buffer\n");
-	gen_write_syscall();
+	emit(".puts_newline_%d:\n", puts_id);
+	emit("\tli $t3, 10\n");              // n のASCII値
+	gen_write_char("$t3");
 	
 	// 戻り値として0をスタックにプッシュ
-	printf("\tli $t0, 0\n");
-	printf("\taddiu $sp, $sp, -4\n");
-	printf("\tsw $t0, 0($sp)\n");
+	emit("\tli $t0, 0\n");
+	emit("\taddiu $sp, $sp, -4\n");
+	emit("\tsw $t0, 0($sp)\n");
+}
+
+// 4バイト単位の文字列処理（語の中に0のバイトがあるかを分岐なしで調べる）
+// $t5=0x01010101、$t6=0x80808080 のとき、xのどれかのバイトが0なら$t1を0以外にする
+// (x - 0x01010101) & ~x & 0x80808080
+static void gen_zero_byte_test(char* x) {
+	emit("\tsubu $t1, %s, $t5\n", x);
+	emit("\tnor $t2, %s, $zero\n", x);
+	emit("\tand $t1, $t1, $t2\n");
+	emit("\tand $t1, $t1, $t6\n");
+}
+
+static void gen_zero_byte_masks(void) {
+	emit("\tli $t5, 0x01010101\n");
+	emit("\tli $t6, 0x80808080\n");
 }
 
 // int strlen(const char* s) - 文字列長計算  
+// 4バイト境界までと0を含む語の中は1バイトずつ、その間は1語ずつ調べる
 void gen_strlen(Node* node) {
 	if (node->argc != 1) {
 		error("strlen requires exactly 1 argument");
@@ -886,49 +1491,106 @@ void gen_strlen(Node* node) {
 	
 	// 文字列ポインタを評価
 	gen(node->args[0]);
-	printf("\tlw $t8, 0($sp)\n");          // 文字列アドレス
-	printf("\taddiu $sp, $sp, 4\n");
+	emit("\tlw $t8, 0($sp)\n");          // 文字列アドレス
+	emit("\taddiu $sp, $sp, 4\n");
 	
 	int strlen_id = label_count++;
-	
-	// 長さカウンタを初期化
-	printf("\tli $t7, 0\n");               // 長さカウンタ
-	printf("\tmove $t9, $t8\n");           // 作業用ポインタ
-	
-	// 文字列をスキャンしてヌル文字を探す
-	printf(".strlen_loop_%d:\n", strlen_id);
-	printf("\tlb $t3, 0($t9)\n");          // 1文字読み込み
-	printf("\tbeq $t3, $zero, .strlen_done_%d\n", strlen_id);
-	printf("\taddiu $t7, $t7, 1\n");       // 長さ増加
-	printf("\taddiu $t9, $t9, 1\n");       // 次の文字へ
-	printf("\tj .strlen_loop_%d\n", strlen_id);
-	
-	printf(".strlen_done_%d:\n", strlen_id);
+	emit("\tmove $t9, $t8\n");           // 作業用ポインタ
+	
+	// 4バイト境界まで1バイトずつ
+	emit(".strlen_head_%d:\n", strlen_id);
+	emit("\tandi $t3, $t9, 3\n");
+	emit("\tbeqz $t3, .strlen_words_%d\n", strlen_id);
+	emit("\tlb $t3, 0($t9)\n");
+	emit("\tbeq $t3, $zero, .strlen_done_%d\n", strlen_id);
+	emit("\taddiu $t9, $t9, 1\n");
+	emit("\tj .strlen_head_%d\n", strlen_id);
+	
+	// 0のバイトを含む語まで1語ずつ進める
+	emit(".strlen_words_%d:\n", strlen_id);
+	gen_zero_byte_masks();
+	emit("\taddiu $t9, $t9, -4\n");
+	emit(".strlen_word_loop_%d:\n", strlen_id);
+	emit("\taddiu $t9, $t9, 4\n");
+	emit("\tlw $t3, 0($t9)\n");
+	gen_zero_byte_test("$t3");
+	emit("\tbeqz $t1, .strlen_word_loop_%d\n", strlen_id);
+	
+	// その語の中でヌル文字を探す
+	emit(".strlen_loop_%d:\n", strlen_id);
+	emit("\tlb $t3, 0($t9)\n");          // 1文字読み込み
+	emit("\tbeq $t3, $zero, .strlen_done_%d\n", strlen_id);
+	emit("\taddiu $t9, $t9, 1\n");       // 次の文字へ
+	emit("\tj .strlen_loop_%d\n", strlen_id);
+	
+	emit(".strlen_done_%d:\n", strlen_id);
+	emit("\tsubu $t7, $t9, $t8\n");      // 長さ
 	
 	// 戻り値をスタックにプッシュ
-	printf("\taddiu $sp, $sp, -4\n");
-	printf("\tsw $t7, 0($sp)\n");
+	emit("\taddiu $sp, $sp, -4\n");
+	emit("\tsw $t7, 0($sp)\n");
 }
 
 // int getchar(void) - 1文字入力
+// 入力バッファに残りがあればそこから1バイト返し、空になったときだけreadで詰め直す
+// 入力が終わった（readが0以下を返した）ときは-1を返す
 void gen_getchar(Node* node) {
 	if (node->argc != 0) {
 		error("getchar requires no arguments");
 	}
 	
-	// readシステムコール（stdin=0, buffer=.L_char_buffer, count=1）
-	printf("\tli $a0, 0\n");               // stdin
-	printf("\tla $a1, .L_char_buffer\n");  // バッファアドレス
-	printf("\tli $a2, 1\n");               // 1バイト
-	printf("\tli $v0, 4003\n");            // readシステムコール
-	printf("\tsyscall\n");
+	int getchar_id = label_count++;
+	emit("\tlw $a1, .L_in_pos\n");
+	emit("\tlw $a2, .L_in_len\n");
+	emit("\tbne $a1, $a2, .getchar_ready_%d\n", getchar_id);
+	
+	// 端末への出力なら、入力を待つ前に出力バッファを書き出す（プロンプトを表示するため）
+	emit("\tlw $a1, .L_out_flush_char\n");
+	emit("\tli $a0, 10\n");
+	emit("\tbne $a1, $a0, .getchar_read_%d\n", getchar_id);
+	gen_flush_output();
+	emit(".getchar_read_%d:\n", getchar_id);
+	
+	// readシステムコール（stdin=0, buffer=.L_in_buffer, count=IN_BUFFER_SIZE）
+	emit("\tli $a0, 0\n");               // stdin
+	emit("\tla $a1, .L_in_buffer\n");    // バッファアドレス
+	emit("\tli $a2, %d\n", IN_BUFFER_SIZE);
+	emit("\tli $v0, 4003\n");            // readシステムコール
+	emit("\tsyscall\n");
+	emit("\tli $t0, -1\n");              // EOFかエラーなら-1
+	emit("\tbnez $a3, .getchar_done_%d\n", getchar_id);
+	emit("\tblez $v0, .getchar_done_%d\n", getchar_id);
+	emit("\tsw $v0, .L_in_len\n");
+	emit("\tli $a1, 0\n");
 	
 	// バッファから文字を読み込み
-	printf("\tlb $t0, .L_char_buffer\n");  // バイト単位で読み込み
+	emit(".getchar_ready_%d:\n", getchar_id);
+	emit("\tlbu $t0, .L_in_buffer($a1)\n");
+	emit("\taddiu $a1, $a1, 1\n");
+	emit("\tsw $a1, .L_in_pos\n");
+	emit(".getchar_done_%d:\n", getchar_id);
 	
 	// 戻り値をスタックにプッシュ
-	printf("\taddiu $sp, $sp, -4\n");
-	printf("\tsw $t0, 0($sp)\n");
+	emit("\taddiu $sp, $sp, -4\n");
+	emit("\tsw $t0, 0($sp)\n");
+}
+
+// strcmpの1文字の比較。同じ文字ならどちらも次の文字へ進めて.strcmp_<next>へ戻る
+static void gen_strcmp_char(int strcmp_id, char* next) {
+	emit("\tlb $t3, 0($t8)\n");          // s1の文字
+	emit("\tlb $t4, 0($t9)\n");          // s2の文字
+	
+	// どちらかがヌル文字か
+	emit("\tbeq $t3, $zero, .strcmp_check_s2_%d\n", strcmp_id);
+	emit("\tbeq $t4, $zero, .strcmp_s1_longer_%d\n", strcmp_id);
+	
+	// 文字が異なるか
+	emit("\tbne $t3, $t4, .strcmp_different_%d\n", strcmp_id);
+	
+	// 次の文字へ
+	emit("\taddiu $t8, $t8, 1\n");
+	emit("\taddiu $t9, $t9, 1\n");
+	emit("\tj .strcmp_%s_%d\n", next, strcmp_id);
 }
 
 // int strcmp(const char* s1, const char* s2) - 文字列比較
@@ -940,57 +1602,68 @@ void gen_strcmp(Node* node) {
 	// 引数を評価
 	gen(node->args[0]);                     // s1
 	gen(node->args[1]);                     // s2
-	printf("\tlw $t9, 0($sp)\n");          // s2
-	printf("\taddiu $sp, $sp, 4\n");
-	printf("\tlw $t8, 0($sp)\n");          // s1
-	printf("\taddiu $sp, $sp, 4\n");
+	emit("\tlw $t9, 0($sp)\n");          // s2
+	emit("\taddiu $sp, $sp, 4\n");
+	emit("\tlw $t8, 0($sp)\n");          // s1
+	emit("\taddiu $sp, $sp, 4\n");
 	
 	int strcmp_id = label_count++;
 	
-	// 文字列を1文字ずつ比較
-	printf(".strcmp_loop_%d:\n", strcmp_id);
-	printf("\tlb $t3, 0($t8)\n");          // s1の文字
-	printf("\tlb $t4, 0($t9)\n");          // s2の文字
-	
-	// どちらかがヌル文字か
-	printf("\tbeq $t3, $zero, .strcmp_check_s2_%d\n", strcmp_id);
-	printf("\tbeq $t4, $zero, .strcmp_s1_longer_%d\n", strcmp_id);
-	
-	// 文字が異なるか
-	printf("\tbne $t3, $t4, .strcmp_different_%d\n", strcmp_id);
+	// 2つの文字列の4バイト境界からのずれが同じなら、境界まで1文字ずつ比べてから1語ずつ比べる
+	emit("\txor $t3, $t8, $t9\n");
+	emit("\tandi $t3, $t3, 3\n");
+	emit("\tbnez $t3, .strcmp_loop_%d\n", strcmp_id);
+	emit(".strcmp_head_%d:\n", strcmp_id);
+	emit("\tandi $t3, $t8, 3\n");
+	emit("\tbeqz $t3, .strcmp_words_%d\n", strcmp_id);
+	gen_strcmp_char(strcmp_id, "head");
+	
+	// 異なる語かヌル文字を含む語まで1語ずつ進める（等しくヌル文字を含めば等しい文字列）
+	emit(".strcmp_words_%d:\n", strcmp_id);
+	gen_zero_byte_masks();
+	emit("\taddiu $t8, $t8, -4\n");
+	emit("\taddiu $t9, $t9, -4\n");
+	emit(".strcmp_word_loop_%d:\n", strcmp_id);
+	emit("\taddiu $t8, $t8, 4\n");
+	emit("\taddiu $t9, $t9, 4\n");
+	emit("\tlw $t3, 0($t8)\n");
+	emit("\tlw $t4, 0($t9)\n");
+	emit("\tbne $t3, $t4, .strcmp_loop_%d\n", strcmp_id);
+	gen_zero_byte_test("$t3");
+	emit("\tbeqz $t1, .strcmp_word_loop_%d\n", strcmp_id);
+	emit("\tj .strcmp_equal_%d\n", strcmp_id);
 	
-	// 次の文字へ
-	printf("\taddiu $t8, $t8, 1\n");
-	printf("\taddiu $t9, $t9, 1\n");
-	printf("\tj .strcmp_loop_%d\n", strcmp_id);
+	// 文字列を1文字ずつ比較
+	emit(".strcmp_loop_%d:\n", strcmp_id);
+	gen_strcmp_char(strcmp_id, "loop");
 	
 	// s1がヌル文字の場合
-	printf(".strcmp_check_s2_%d:\n", strcmp_id);
-	printf("\tbeq $t4, $zero, .strcmp_equal_%d\n", strcmp_id);
+	emit(".strcmp_check_s2_%d:\n", strcmp_id);
+	emit("\tbeq $t4, $zero, .strcmp_equal_%d\n", strcmp_id);
 	
 	// s2が長い場合
-	printf("\tli $t0, -1\n");
-	printf("\tj .strcmp_done_%d\n", strcmp_id);
+	emit("\tli $t0, -1\n");
+	emit("\tj .strcmp_done_%d\n", strcmp_id);
 	
 	// s1が長い場合
-	printf(".strcmp_s1_longer_%d:\n", strcmp_id);
-	printf("\tli $t0, 1\n");
-	printf("\tj .strcmp_done_%d\n", strcmp_id);
+	emit(".strcmp_s1_longer_%d:\n", strcmp_id);
+	emit("\tli $t0, 1\n");
+	emit("\tj .strcmp_done_%d\n", strcmp_id);
 	
 	// 文字が異なる場合
-	printf(".strcmp_different_%d:\n", strcmp_id);
-	printf("\tsub $t0, $t3, $t4\n");       // s1[i] - s2[i]
-	printf("\tj .strcmp_done_%d\n", strcmp_id);
+	emit(".strcmp_different_%d:\n", strcmp_id);
+	emit("\tsub $t0, $t3, $t4\n");       // s1[i] - s2[i]
+	emit("\tj .strcmp_done_%d\n", strcmp_id);
 	
 	// 等しい場合
-	printf(".strcmp_equal_%d:\n", strcmp_id);
-	printf("\tli $t0, 0\n");
+	emit(".strcmp_equal_%d:\n", strcmp_id);
+	emit("\tli $t0, 0\n");
 	
-	printf(".strcmp_done_%d:\n", strcmp_id);
+	emit(".strcmp_done_%d:\n", strcmp_id);
 	
 	// 戻り値をスタックにプッシュ
-	printf("\taddiu $sp, $sp, -4\n");
-	printf("\tsw $t0, 0($sp)\n");
+	emit("\taddiu $sp, $sp, -4\n");
+	emit("\tsw $t0, 0($sp)\n");
 }
 
 // char* strcpy(char* dest, const char* src) - 文字列コピー
@@ -1002,31 +1675,57 @@ void gen_strcpy(Node* node) {
 	// 引数を評価
 	gen(node->args[0]);                     // dest
 	gen(node->args[1]);                     // src
-	printf("\tlw $t9, 0($sp)\n");          // src
-	printf("\taddiu $sp, $sp, 4\n");
-	printf("\tlw $t8, 0($sp)\n");          // dest
-	printf("\taddiu $sp, $sp, 4\n");
+	emit("\tlw $t9, 0($sp)\n");          // src
+	emit("\taddiu $sp, $sp, 4\n");
+	emit("\tlw $t8, 0($sp)\n");          // dest
+	emit("\taddiu $sp, $sp, 4\n");
 	
 	int strcpy_id = label_count++;
 	
 	// destの元の値を保存（戻り値用）
-	printf("\tmove $t7, $t8\n");           // destの元のアドレス
-	
-	// 文字列を1文字ずつコピー
-	printf(".strcpy_loop_%d:\n", strcpy_id);
-	printf("\tlb $t3, 0($t9)\n");          // srcから1文字読み込み
-	printf("\tsb $t3, 0($t8)\n");          // destに1文字書き込み
-	printf("\tbeq $t3, $zero, .strcpy_done_%d\n", strcpy_id);  // ヌル文字で終了
+	emit("\tmove $t7, $t8\n");           // destの元のアドレス
+	
+	// 2つの文字列の4バイト境界からのずれが同じなら、境界まで1文字ずつ写してから1語ずつ写す
+	emit("\txor $t3, $t8, $t9\n");
+	emit("\tandi $t3, $t3, 3\n");
+	emit("\tbnez $t3, .strcpy_loop_%d\n", strcpy_id);
+	emit(".strcpy_head_%d:\n", strcpy_id);
+	emit("\tandi $t3, $t9, 3\n");
+	emit("\tbeqz $t3, .strcpy_words_%d\n", strcpy_id);
+	emit("\tlb $t3, 0($t9)\n");
+	emit("\tsb $t3, 0($t8)\n");
+	emit("\tbeq $t3, $zero, .strcpy_done_%d\n", strcpy_id);
+	emit("\taddiu $t8, $t8, 1\n");
+	emit("\taddiu $t9, $t9, 1\n");
+	emit("\tj .strcpy_head_%d\n", strcpy_id);
+	
+	// ヌル文字を含む語の手前まで1語ずつ写す
+	emit(".strcpy_words_%d:\n", strcpy_id);
+	gen_zero_byte_masks();
+	emit(".strcpy_word_loop_%d:\n", strcpy_id);
+	emit("\tlw $t3, 0($t9)\n");
+	gen_zero_byte_test("$t3");
+	emit("\tbnez $t1, .strcpy_loop_%d\n", strcpy_id);
+	emit("\tsw $t3, 0($t8)\n");
+	emit("\taddiu $t8, $t8, 4\n");
+	emit("\taddiu $t9, $t9, 4\n");
+	emit("\tj .strcpy_word_loop_%d\n", strcpy_id);
+	
+	// 残りを1文字ずつコピー
+	emit(".strcpy_loop_%d:\n", strcpy_id);
+	emit("\tlb $t3, 0($t9)\n");          // srcから1文字読み込み
+	emit("\tsb $t3, 0($t8)\n");          // destに1文字書き込み
+	emit("\tbeq $t3, $zero, .strcpy_done_%d\n", strcpy_id);  // ヌル文字で終了
 	
 	// 次の文字へ
-	printf("\taddiu $t8, $t8, 1\n");
-	printf("\taddiu $t9, $t9, 1\n");
-	printf("\tj .strcpy_loop_%d\n", strcpy_id);
+	emit("\taddiu $t8, $t8, 1\n");
+	emit("\taddiu $t9, $t9, 1\n");
+	emit("\tj .strcpy_loop_%d\n", strcpy_id);
 	
-	printf(".strcpy_done_%d:\n", strcpy_id);
+	emit(".strcpy_done_%d:\n", strcpy_id);
 	
 	// destのアドレスを戻り値としてスタックにプッシュ
-	printf("\taddiu $sp, $sp, -4\n");
-	printf("\tsw $t7, 0($sp)\n");
+	emit("\taddiu $sp, $sp, -4\n");
+	emit("\tsw $t7, 0($sp)\n");
 }
 
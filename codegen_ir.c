@@ -0,0 +1,853 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 中間表現からのコード生成（-O2）
+// =============================================================================
+//
+// 値の生存範囲を逆後順に並べた命令の番号で表し、線形走査でレジスタを割り当てる
+// （Poletto, Sarkar）。関数呼び出しをまたいで生きる値は呼び出し先保存の$s0-$s7に置き
+// （使ったものだけプロローグで退避する）、レジスタが足りない値はフレーム上に置く。
+// 定数は使う場所で即値にするか$t8/$t9に読み込む。フレームは常に$sp基準で参照する。
+
+#define NUM_ALLOC_REGS 16
+#define FIRST_SAVED_REG 8  // これより後ろは呼び出し先保存のレジスタ
+
+static char* alloc_regs[NUM_ALLOC_REGS] = {
+	"$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+	"$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+};
+
+// -----------------------------------------------------------------------------
+// レジスタ割り当て
+// -----------------------------------------------------------------------------
+
+typedef struct {
+	int value;
+	int start;  // 最初に定義されるか生き始める位置
+	int end;    // 最後に使われるか生きている位置
+} Interval;
+
+static int compare_start(const void* a, const void* b) {
+	const Interval* x = a;
+	const Interval* y = b;
+	if (x->start != y->start) {
+		return x->start - y->start;
+	}
+	return x->value - y->value;
+}
+
+static int new_slot(IrFunc* f) {
+	LVar var = {NULL, "", 0, 0, new_type(TY_INT)};
+	return add_frame_var(f->func, &var);
+}
+
+static void spill(IrFunc* f, int v) {
+	f->regs[v] = REG_SPILLED;
+	f->spill_slots[v] = new_slot(f);
+}
+
+// 命令の位置は2倍の番号で表し、読む値はその位置、定義する値は次の位置から生きるものとする
+void allocate_registers(IrFunc* f) {
+	compute_cfg(f);
+	compute_liveness(f);
+
+	int n = f->num_values;
+	Interval* intervals = malloc(sizeof(Interval) * n);
+	bool* is_const = malloc(sizeof(bool) * n);
+	bool* used = calloc(n, sizeof(bool));
+	int* hint = malloc(sizeof(int) * n);  // 同じレジスタにしたいコピー元
+	for (int v = 0; v < n; v++) {
+		intervals[v] = (Interval){v, INT_MAX, -1};
+		is_const[v] = true;
+		hint[v] = -1;
+	}
+	f->regs = malloc(sizeof(int) * n);
+	f->spill_slots = calloc(n, sizeof(int));
+	for (int v = 0; v < n; v++) {
+		f->regs[v] = REG_NONE;
+	}
+
+	int num_calls = 0;
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			num_calls++;
+		}
+	}
+	int* calls = malloc(sizeof(int) * (num_calls + 1));  // 関数呼び出しの位置
+	num_calls = 0;
+
+	int pos = 0;
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		int block_start = pos;
+		for (IrInst* inst = bb->first; inst; inst = inst->next, pos += 2) {
+			int* ops[3 + inst->num_args];
+			int num_ops = inst_operands(inst, ops);
+			for (int j = 0; j < num_ops; j++) {
+				Interval* it = &intervals[*ops[j]];
+				used[*ops[j]] = true;
+				if (it->start > pos) {
+					it->start = pos;
+				}
+				if (it->end < pos) {
+					it->end = pos;
+				}
+			}
+			if (inst->dst >= 0) {
+				Interval* it = &intervals[inst->dst];
+				if (it->start > pos + 1) {
+					it->start = pos + 1;
+				}
+				if (it->end < pos + 1) {
+					it->end = pos + 1;
+				}
+				if (inst->op != IR_CONST) {
+					is_const[inst->dst] = false;
+				}
+				if (inst->op == IR_COPY) {
+					hint[inst->dst] = inst->a;
+				}
+			}
+			if (inst->op == IR_CALL || inst->op == IR_STACK) {
+				calls[num_calls++] = pos;
+			}
+		}
+		for (int v = 0; v < n; v++) {
+			if (set_has(f->live_in[i], v) && intervals[v].start > block_start) {
+				intervals[v].start = block_start;
+			}
+			if (set_has(f->live_out[i], v) && intervals[v].end < pos - 1) {
+				intervals[v].end = pos - 1;
+			}
+		}
+	}
+
+	// 割り当てる値を生き始める順に並べる
+	Interval* order = malloc(sizeof(Interval) * n);
+	int num_order = 0;
+	for (int v = 0; v < n; v++) {
+		if (is_const[v]) {
+			f->regs[v] = REG_CONST;
+		} else if (!used[v]) {
+			f->regs[v] = REG_NONE;
+		} else {
+			order[num_order++] = intervals[v];
+		}
+	}
+	qsort(order, num_order, sizeof(Interval), compare_start);
+
+	int active[NUM_ALLOC_REGS];  // レジスタを使っている値（なければ-1）
+	for (int r = 0; r < NUM_ALLOC_REGS; r++) {
+		active[r] = -1;
+	}
+	int k = 0;
+	for (int i = 0; i < num_order; i++) {
+		Interval* it = &order[i];
+		int v = it->value;
+
+		// 関数呼び出しをまたぐ値は$t0-$t7に置けない
+		while (k < num_calls && calls[k] < it->start) {
+			k++;
+		}
+		bool crosses_call = k < num_calls && calls[k] + 1 <= it->end;
+		int first_reg = crosses_call ? FIRST_SAVED_REG : 0;
+		int free_reg = -1;
+		for (int r = 0; r < NUM_ALLOC_REGS; r++) {
+			if (active[r] >= 0 && intervals[active[r]].end < it->start) {
+				active[r] = -1;
+			}
+			if (r >= first_reg && active[r] < 0 &&
+			    (free_reg < 0 || (hint[v] >= 0 && f->regs[hint[v]] == r))) {
+				free_reg = r;
+			}
+		}
+		if (free_reg >= 0) {
+			f->regs[v] = free_reg;
+			active[free_reg] = v;
+			continue;
+		}
+		// 最も遠くまで生きる値をフレームに置く
+		int victim = first_reg;
+		for (int r = first_reg + 1; r < NUM_ALLOC_REGS; r++) {
+			if (intervals[active[r]].end > intervals[active[victim]].end) {
+				victim = r;
+			}
+		}
+		if (intervals[active[victim]].end > it->end) {
+			spill(f, active[victim]);
+			f->regs[v] = victim;
+			active[victim] = v;
+		} else {
+			spill(f, v);
+		}
+	}
+	for (int v = 0; v < n; v++) {
+		int r = f->regs[v] - FIRST_SAVED_REG;
+		if (r >= 0 && !f->save_slots[r]) {
+			f->save_slots[r] = new_slot(f);
+		}
+	}
+	locals = f->func->locals;
+
+	free(intervals);
+	free(is_const);
+	free(used);
+	free(hint);
+	free(calls);
+	free(order);
+}
+
+// -----------------------------------------------------------------------------
+// 命令選択
+// -----------------------------------------------------------------------------
+//
+// レジスタに載らない値は、読むときは$t8（1つ目）と$t9（2つ目）に読み込み、
+// 定義するときは$t8で計算してからフレームに書き戻す。
+
+static char* arg_regs[] = {"$a0", "$a1", "$a2", "$a3"};
+
+static IrFunc* fn;
+static int* const_value;      // 定数の値
+static bool is_leaf;          // 関数呼び出しを含まない（$raを退避しない）
+
+static bool is_const(int v) {
+	return fn->regs[v] == REG_CONST;
+}
+
+static bool fits_simm16(long long val) {
+	return val >= -32768 && val <= 32767;
+}
+
+// 値vを読むレジスタ名（必要ならscratchに読み込む）
+static char* use_value(int v, char* scratch) {
+	switch (fn->regs[v]) {
+	case REG_CONST:
+		if (const_value[v] == 0) {
+			return "$zero";
+		}
+		emit("\tli %s, %d\n", scratch, const_value[v]);
+		return scratch;
+	case REG_SPILLED: {
+		char mem[64];
+		frame_operand(mem, fn->spill_slots[v]);
+		emit("\tlw %s, %s\n", scratch, mem);
+		return scratch;
+	}
+	default:
+		return alloc_regs[fn->regs[v]];
+	}
+}
+
+// 値vを定義するときに書き込むレジスタ名
+static char* def_reg(int v) {
+	return fn->regs[v] >= 0 ? alloc_regs[fn->regs[v]] : "$t8";
+}
+
+// def_regに求めた値をフレーム上の置き場所に書き戻す
+static void finish_def(int v, char* r) {
+	if (fn->regs[v] == REG_SPILLED) {
+		char mem[64];
+		frame_operand(mem, fn->spill_slots[v]);
+		emit("\tsw %s, %s\n", r, mem);
+	}
+}
+
+// 値vをレジスタrdに置く
+static void load_value(char* rd, int v) {
+	switch (fn->regs[v]) {
+	case REG_CONST:
+		emit("\tli %s, %d\n", rd, const_value[v]);
+		return;
+	case REG_SPILLED: {
+		char mem[64];
+		frame_operand(mem, fn->spill_slots[v]);
+		emit("\tlw %s, %s\n", rd, mem);
+		return;
+	}
+	default:
+		if (strcmp(rd, alloc_regs[fn->regs[v]]) != 0) {
+			emit("\tmove %s, %s\n", rd, alloc_regs[fn->regs[v]]);
+		}
+		return;
+	}
+}
+
+// レジスタrsの値を値vとして定義する
+static void store_value(int v, char* rs) {
+	if (fn->regs[v] == REG_NONE) {
+		return;
+	}
+	if (fn->regs[v] == REG_SPILLED) {
+		finish_def(v, rs);
+		return;
+	}
+	if (strcmp(rs, def_reg(v)) != 0) {
+		emit("\tmove %s, %s\n", def_reg(v), rs);
+	}
+}
+
+static void mem_operand(char* buf, MemRef* mem, char* scratch) {
+	switch (mem->kind) {
+	case MEM_FRAME:
+		frame_operand(buf, mem->offset);
+		return;
+	case MEM_GLOBAL:
+		if (mem->offset) {
+			sprintf(buf, "%s+%d", mem->name, mem->offset);
+		} else {
+			sprintf(buf, "%s", mem->name);
+		}
+		return;
+	case MEM_POINTER:
+		sprintf(buf, "%d(%s)", mem->offset, use_value(mem->base, scratch));
+		return;
+	}
+}
+
+// rd = ra / c（is_modなら余り）。cは0とINT_MIN以外
+static void gen_div_by_const(char* rd, char* ra, int c, bool is_mod) {
+	int ac = c < 0 ? -c : c;
+	if (ac == 1) {
+		if (is_mod) {
+			emit("\tli %s, 0\n", rd);
+		} else if (c < 0) {
+			emit("\tsubu %s, $zero, %s\n", rd, ra);
+		} else if (strcmp(rd, ra) != 0) {
+			emit("\tmove %s, %s\n", rd, ra);
+		}
+		return;
+	}
+	if (!is_mod) {
+		gen_div_positive(rd, ra, ac);
+		if (c < 0) {
+			emit("\tsubu %s, $zero, %s\n", rd, rd);
+		}
+		return;
+	}
+	// 余り: x - (x / |c|) * |c|（符号は被除数に従う）
+	gen_div_positive("$t9", ra, ac);
+	gen_mul_const("$t9", "$t9", ac);
+	emit("\tsubu %s, %s, $t9\n", rd, ra);
+}
+
+static void gen_binary(IrInst* inst) {
+	char* rd = def_reg(inst->dst);
+	int a = inst->a;
+	int b = inst->b;
+	bool commutative = inst->op == IR_ADD || inst->op == IR_MUL || inst->op == IR_EQ || inst->op == IR_NE;
+	if (commutative && is_const(a) && !is_const(b)) {
+		a = inst->b;
+		b = inst->a;
+	}
+	char* ra = use_value(a, "$t8");
+	if (is_const(b)) {
+		int c = const_value[b];
+		switch (inst->op) {
+		case IR_ADD:
+			if (fits_simm16(c)) {
+				emit("\taddiu %s, %s, %d\n", rd, ra, c);
+				finish_def(inst->dst, rd);
+				return;
+			}
+			break;
+		case IR_SUB:
+			if (fits_simm16(-(long long)c)) {
+				emit("\taddiu %s, %s, %d\n", rd, ra, -c);
+				finish_def(inst->dst, rd);
+				return;
+			}
+			break;
+		case IR_MUL:
+			gen_mul_const(rd, ra, c);
+			finish_def(inst->dst, rd);
+			return;
+		case IR_DIV:
+		case IR_MOD:
+			if (c != 0 && c != INT_MIN) {
+				gen_div_by_const(rd, ra, c, inst->op == IR_MOD);
+				finish_def(inst->dst, rd);
+				return;
+			}
+			break;
+		case IR_EQ:
+		case IR_NE:
+			// 0との比較はsltiu/sltu、16ビットの定数はxoriで0との比較にする
+			if (c == 0 || (c > 0 && c <= 0xffff)) {
+				char* r = ra;
+				if (c) {
+					emit("\txori %s, %s, %d\n", rd, ra, c);
+					r = rd;
+				}
+				if (inst->op == IR_EQ) {
+					emit("\tsltiu %s, %s, 1\n", rd, r);
+				} else {
+					emit("\tsltu %s, $zero, %s\n", rd, r);
+				}
+				finish_def(inst->dst, rd);
+				return;
+			}
+			break;
+		case IR_LT:
+		case IR_LE: {
+			long long imm = (long long)c + (inst->op == IR_LE);
+			if (fits_simm16(imm)) {
+				emit("\tslti %s, %s, %d\n", rd, ra, (int)imm);
+				finish_def(inst->dst, rd);
+				return;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	char* rb = use_value(b, "$t9");
+	switch (inst->op) {
+	case IR_ADD:
+		emit("\taddu %s, %s, %s\n", rd, ra, rb);
+		break;
+	case IR_SUB:
+		emit("\tsubu %s, %s, %s\n", rd, ra, rb);
+		break;
+	case IR_MUL:
+		emit("\tmul %s, %s, %s\n", rd, ra, rb);
+		break;
+	case IR_DIV:
+		emit("\tdiv $zero, %s, %s\n", ra, rb);
+		emit("\tmflo %s\n", rd);
+		break;
+	case IR_MOD:
+		emit("\tdiv $zero, %s, %s\n", ra, rb);
+		emit("\tmfhi %s\n", rd);
+		break;
+	case IR_EQ:
+		emit("\tseq %s, %s, %s\n", rd, ra, rb);
+		break;
+	case IR_NE:
+		emit("\tsne %s, %s, %s\n", rd, ra, rb);
+		break;
+	case IR_LT:
+		emit("\tslt %s, %s, %s\n", rd, ra, rb);
+		break;
+	case IR_LE:
+		emit("\tsle %s, %s, %s\n", rd, ra, rb);
+		break;
+	default:
+		error("unsupported IR instruction");
+	}
+	finish_def(inst->dst, rd);
+}
+
+// a cmp b ならlabelへ分岐する
+static void gen_branch(IrOp cmp, int a, int b, char* label) {
+	if (cmp == IR_EQ || cmp == IR_NE) {
+		if (is_const(a) && !is_const(b)) {
+			int t = a;
+			a = b;
+			b = t;
+		}
+		char* ra = use_value(a, "$t8");
+		if (is_const(b) && const_value[b] == 0) {
+			emit("\t%s %s, %s\n", cmp == IR_EQ ? "beqz" : "bnez", ra, label);
+			return;
+		}
+		char* rb = use_value(b, "$t9");
+		emit("\t%s %s, %s, %s\n", cmp == IR_EQ ? "beq" : "bne", ra, rb, label);
+		return;
+	}
+
+	bool is_le = cmp == IR_LE;
+	// 0との比較は専用の分岐命令を使う
+	if (is_const(a) && const_value[a] == 0) {
+		// 0 < b は b > 0、0 <= b は b >= 0
+		emit("\t%s %s, %s\n", is_le ? "bgez" : "bgtz", use_value(b, "$t9"), label);
+		return;
+	}
+	// c < b は !(b < c + 1)、c <= b は !(b < c)
+	if (is_const(a) && !is_const(b) && fits_simm16((long long)const_value[a] + !is_le)) {
+		emit("\tslti $v1, %s, %d\n", use_value(b, "$t9"), const_value[a] + !is_le);
+		emit("\tbeqz $v1, %s\n", label);
+		return;
+	}
+	char* ra = use_value(a, "$t8");
+	if (is_const(b) && const_value[b] == 0) {
+		emit("\t%s %s, %s\n", is_le ? "blez" : "bltz", ra, label);
+		return;
+	}
+	// a < c、a <= c（a < c + 1）は即値で比較する
+	if (is_const(b) && fits_simm16((long long)const_value[b] + is_le)) {
+		emit("\tslti $v1, %s, %d\n", ra, const_value[b] + is_le);
+		emit("\tbnez $v1, %s\n", label);
+		return;
+	}
+	char* rb = use_value(b, "$t9");
+	if (is_le) {
+		// a <= b は !(b < a)
+		emit("\tslt $v1, %s, %s\n", rb, ra);
+		emit("\tbeqz $v1, %s\n", label);
+	} else {
+		emit("\tslt $v1, %s, %s\n", ra, rb);
+		emit("\tbnez $v1, %s\n", label);
+	}
+}
+
+// a cmp b が成り立たなければlabelへ分岐する
+static void gen_branch_false(IrOp cmp, int a, int b, char* label) {
+	switch (cmp) {
+	case IR_EQ:
+		gen_branch(IR_NE, a, b, label);
+		return;
+	case IR_NE:
+		gen_branch(IR_EQ, a, b, label);
+		return;
+	case IR_LT:
+		gen_branch(IR_LE, b, a, label);  // !(a < b) は b <= a
+		return;
+	default:
+		gen_branch(IR_LT, b, a, label);  // !(a <= b) は b < a
+		return;
+	}
+}
+
+// a cmp b の真偽を0か0以外で表すレジスタを返す。*nonzero_if_trueには成り立つときに0以外になるかを入れる
+// 割り当てたレジスタをそのまま使うとき以外は$v1に求める
+static char* gen_select_cond(IrOp cmp, int a, int b, bool* nonzero_if_true) {
+	if (cmp == IR_EQ || cmp == IR_NE) {
+		*nonzero_if_true = cmp == IR_NE;
+		if (is_const(a) && !is_const(b)) {
+			int t = a;
+			a = b;
+			b = t;
+		}
+		char* ra = use_value(a, "$t8");
+		if (is_const(b) && const_value[b] == 0) {
+			if (fn->regs[a] >= 0) {
+				return ra;
+			}
+			emit("\tmove $v1, %s\n", ra);
+		} else if (is_const(b) && const_value[b] > 0 && const_value[b] <= 0xffff) {
+			emit("\txori $v1, %s, %d\n", ra, const_value[b]);
+		} else {
+			emit("\txor $v1, %s, %s\n", ra, use_value(b, "$t9"));
+		}
+		return "$v1";
+	}
+	bool is_le = cmp == IR_LE;
+	// c < b は !(b < c + 1)、c <= b は !(b < c)
+	if (is_const(a) && !is_const(b) && fits_simm16((long long)const_value[a] + !is_le)) {
+		emit("\tslti $v1, %s, %d\n", use_value(b, "$t9"), const_value[a] + !is_le);
+		*nonzero_if_true = false;
+		return "$v1";
+	}
+	char* ra = use_value(a, "$t8");
+	*nonzero_if_true = true;
+	// a < c、a <= c（a < c + 1）は即値で比較する
+	if (is_const(b) && fits_simm16((long long)const_value[b] + is_le)) {
+		emit("\tslti $v1, %s, %d\n", ra, const_value[b] + is_le);
+		return "$v1";
+	}
+	char* rb = use_value(b, "$t9");
+	if (is_le) {
+		// a <= b は !(b < a)
+		emit("\tslt $v1, %s, %s\n", rb, ra);
+		*nonzero_if_true = false;
+	} else {
+		emit("\tslt $v1, %s, %s\n", ra, rb);
+	}
+	return "$v1";
+}
+
+// dst = a cmp b ? args[0] : args[1] を分岐せずにmovn/movzで求める
+static void gen_select(IrInst* inst) {
+	bool nonzero_if_true;
+	char* rc = gen_select_cond(inst->cmp, inst->a, inst->b, &nonzero_if_true);
+	char* rd = def_reg(inst->dst);
+	char* rt = use_value(inst->args[0], "$t8");
+	char* re = use_value(inst->args[1], "$t9");
+	if (strcmp(rc, rd) == 0) {
+		emit("\tmove $v1, %s\n", rc);
+		rc = "$v1";
+	}
+	if (strcmp(rd, rt) == 0) {
+		// 条件が成り立たないときだけ書き換える
+		emit("\t%s %s, %s, %s\n", nonzero_if_true ? "movz" : "movn", rd, re, rc);
+	} else {
+		if (strcmp(rd, re) != 0) {
+			emit("\tmove %s, %s\n", rd, re);
+		}
+		emit("\t%s %s, %s, %s\n", nonzero_if_true ? "movn" : "movz", rd, rt, rc);
+	}
+	finish_def(inst->dst, rd);
+}
+
+static void block_label(char* buf, BasicBlock* bb) {
+	sprintf(buf, ".L_bb_%d", bb->label);
+}
+
+// フレームを解放して$raを呼び出し元の値に戻す
+// 後に続く基本ブロックのためにsp_offsetは元に戻す
+static void gen_release_frame(void) {
+	int saved_sp_offset = sp_offset;
+	char mem[64];
+	for (int r = 0; r < NUM_ALLOC_REGS - FIRST_SAVED_REG; r++) {
+		if (fn->save_slots[r]) {
+			frame_operand(mem, fn->save_slots[r]);
+			emit("\tlw %s, %s\n", alloc_regs[FIRST_SAVED_REG + r], mem);
+		}
+	}
+	if (!is_leaf) {
+		frame_operand(mem, ARG_SAVE_OFFSET);
+		emit("\tlw $ra, %s\n", mem);
+	}
+	if (current_frame_size + sp_offset) {
+		emit("\taddiu $sp, $sp, %d\n", current_frame_size + sp_offset);
+	}
+	sp_offset = saved_sp_offset;
+}
+
+// 関数を呼び出す前に引数を$a0-$a3に置く
+static void gen_call_args(IrInst* inst) {
+	for (int i = 0; i < inst->num_args; i++) {
+		load_value(arg_regs[i], inst->args[i]);
+	}
+}
+
+static void gen_inst(IrInst* inst, BasicBlock* next) {
+	char buf[64];
+	BasicBlock* bb = inst->block;
+	switch (inst->op) {
+	case IR_CONST:
+		return;
+	case IR_PARAM:
+		store_value(inst->dst, arg_regs[inst->imm]);
+		return;
+	case IR_COPY:
+		if (fn->regs[inst->dst] >= 0) {
+			load_value(def_reg(inst->dst), inst->a);
+		} else if (fn->regs[inst->dst] == REG_SPILLED) {
+			char* r = use_value(inst->a, "$t8");
+			finish_def(inst->dst, r);
+		}
+		return;
+	case IR_ADD:
+	case IR_SUB:
+	case IR_MUL:
+	case IR_DIV:
+	case IR_MOD:
+	case IR_EQ:
+	case IR_NE:
+	case IR_LT:
+	case IR_LE:
+		gen_binary(inst);
+		return;
+	case IR_SELECT:
+		gen_select(inst);
+		return;
+	case IR_ADDR: {
+		char* rd = def_reg(inst->dst);
+		if (inst->mem.kind == MEM_FRAME) {
+			gen_frame_addr(rd, inst->mem.offset);
+		} else if (inst->mem.offset) {
+			emit("\tla %s, %s+%d\n", rd, inst->mem.name, inst->mem.offset);
+		} else {
+			emit("\tla %s, %s\n", rd, inst->mem.name);
+		}
+		finish_def(inst->dst, rd);
+		return;
+	}
+	case IR_LOAD: {
+		char* rd = def_reg(inst->dst);
+		mem_operand(buf, &inst->mem, "$t9");
+		emit("\tlw %s, %s\n", rd, buf);
+		finish_def(inst->dst, rd);
+		return;
+	}
+	case IR_STORE: {
+		char* rs = use_value(inst->a, "$t8");
+		mem_operand(buf, &inst->mem, "$t9");
+		emit("\tsw %s, %s\n", rs, buf);
+		return;
+	}
+	case IR_CALL:
+		gen_call_args(inst);
+		emit("\tjal %s\n", inst->name);
+		emit("\tnop\n");
+		store_value(inst->dst, "$v0");
+		return;
+	case IR_STACK:
+		gen(inst->node);
+		if (fn->regs[inst->dst] == REG_NONE) {
+			emit("\taddiu $sp, $sp, 4\n");
+			return;
+		}
+		emit("\tlw %s, 0($sp)\n", def_reg(inst->dst));
+		emit("\taddiu $sp, $sp, 4\n");
+		finish_def(inst->dst, def_reg(inst->dst));
+		return;
+	case IR_JUMP:
+		if (bb->succs[0] != next) {
+			block_label(buf, bb->succs[0]);
+			emit("\tj %s\n", buf);
+		}
+		return;
+	case IR_BRANCH:
+		if (bb->succs[0] == next) {
+			block_label(buf, bb->succs[1]);
+			gen_branch_false(inst->cmp, inst->a, inst->b, buf);
+		} else {
+			block_label(buf, bb->succs[0]);
+			gen_branch(inst->cmp, inst->a, inst->b, buf);
+			if (bb->succs[1] != next) {
+				block_label(buf, bb->succs[1]);
+				emit("\tj %s\n", buf);
+			}
+		}
+		return;
+	case IR_SWITCH: {
+		load_value("$v0", inst->a);
+		char** labels = calloc(inst->num_cases + 1, sizeof(char*));
+		for (int i = 0; i < inst->num_cases; i++) {
+			labels[i] = calloc(64, sizeof(char));
+			block_label(labels[i], bb->succs[i + 1]);
+		}
+		block_label(buf, bb->succs[0]);
+		gen_switch_dispatch(inst->cases, labels, inst->num_cases, buf);
+		for (int i = 0; i < inst->num_cases; i++) {
+			free(labels[i]);
+		}
+		free(labels);
+		return;
+	}
+	case IR_RET:
+		load_value("$v0", inst->a);
+		gen_release_frame();
+		emit("\tjr $ra\n");
+		emit("\tnop\n");
+		return;
+	case IR_TAIL_CALL:
+		gen_call_args(inst);
+		gen_release_frame();
+		emit("\tj %s\n", inst->name);
+		emit("\tnop\n");
+		return;
+	case IR_PHI:
+		error("phi remains in IR");
+	}
+}
+
+// フレーム上でoffsetの変数全体を使う
+static void cover_frame(int* lowest, int offset) {
+	LVar* var = frame_var_at(offset);
+	if (var) {
+		offset = var->offset;
+	}
+	if (offset < *lowest) {
+		*lowest = offset;
+	}
+}
+
+static bool cover_lvar(Node* node, void* data) {
+	if (node->kind == ND_LVAR) {
+		cover_frame(data, node->offset);
+	}
+	return false;
+}
+
+// 読み書きの残った変数と退避領域のうち最も低いオフセット
+// SSA形式の値にした変数には領域を取らない
+static int lowest_frame_offset(IrFunc* f) {
+	int lowest = ARG_SAVE_OFFSET;
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			if ((inst->op == IR_ADDR || inst->op == IR_LOAD || inst->op == IR_STORE) &&
+			    inst->mem.kind == MEM_FRAME) {
+				cover_frame(&lowest, inst->mem.offset);
+			} else if (inst->op == IR_STACK) {
+				tree_any(inst->node, cover_lvar, &lowest);
+			}
+		}
+	}
+	for (int v = 0; v < f->num_values; v++) {
+		if (f->regs[v] == REG_SPILLED) {
+			cover_frame(&lowest, f->spill_slots[v]);
+		}
+	}
+	for (int r = 0; r < NUM_ALLOC_REGS - FIRST_SAVED_REG; r++) {
+		if (f->save_slots[r]) {
+			cover_frame(&lowest, f->save_slots[r]);
+		}
+	}
+	return lowest;
+}
+
+// 割り当て済みの中間表現から関数を出力する
+void gen_func_ir(IrFunc* f) {
+	fn = f;
+	LVar* saved_locals = gen_func_label(f->node);
+	locals = f->func->locals;
+
+	const_value = calloc(f->num_values, sizeof(int));
+	is_leaf = true;
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		bb->label = label_count++;
+		for (IrInst* inst = bb->first; inst; inst = inst->next) {
+			if (inst->op == IR_CONST) {
+				const_value[inst->dst] = inst->imm;
+			} else if (inst->op == IR_CALL || inst->op == IR_STACK) {
+				is_leaf = false;
+			}
+		}
+	}
+
+	// フレームは読み書きの残った変数・一時値の領域と$ra（関数呼び出しがある場合）
+	int size = ARG_SAVE_OFFSET - lowest_frame_offset(f);
+	int ra_size = is_leaf ? 0 : 4;
+	size = (size + ra_size + 7) / 8 * 8;
+	current_frame_size = size;
+	frame_uses_fp = false;
+	frame_top = size - ARG_SAVE_OFFSET - ra_size;
+	if (size) {
+		emit("\taddiu $sp, $sp, -%d\n", size);
+	}
+	sp_offset = 0;
+	char mem[64];
+	if (!is_leaf) {
+		frame_operand(mem, ARG_SAVE_OFFSET);
+		emit("\tsw $ra, %s\n", mem);
+	}
+	for (int r = 0; r < NUM_ALLOC_REGS - FIRST_SAVED_REG; r++) {
+		if (f->save_slots[r]) {
+			frame_operand(mem, f->save_slots[r]);
+			emit("\tsw %s, %s\n", alloc_regs[FIRST_SAVED_REG + r], mem);
+		}
+	}
+
+	// 直前の基本ブロックから流れ込むだけの基本ブロックにはラベルを付けない
+	// （switchの分岐先はジャンプテーブルから参照するので常に付ける）
+	bool* targeted = calloc(f->num_blocks, sizeof(bool));
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		bool is_switch = bb->last && bb->last->op == IR_SWITCH;
+		for (int s = 0; s < bb->num_succs; s++) {
+			if (is_switch || i + 1 >= f->num_blocks || bb->succs[s] != f->blocks[i + 1]) {
+				targeted[bb->succs[s]->rpo] = true;
+			}
+		}
+	}
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		BasicBlock* next = i + 1 < f->num_blocks ? f->blocks[i + 1] : NULL;
+		if (targeted[i]) {
+			emit(".L_bb_%d:\n", bb->label);
+		}
+		for (IrInst* inst = bb->first; inst; inst = inst->next) {
+			gen_inst(inst, next);
+		}
+	}
+
+	free(targeted);
+	free(const_value);
+	locals = saved_locals;
+}
@@ -0,0 +1,1369 @@
+#include "mipsc.h"
+
+// =============================================================================
+// レジスタ割り当てモードのコード生成（-O1以上）
+// =============================================================================
+//
+// 式の一時値を深さごとに$t0-$t9へ割り当てる（レジスタスタック方式）。
+// 深さがレジスタ数を超えた場合のみ、同じレジスタを使っていた最も古い値を
+// メモリのスタックへ退避し、その値が再び必要になった時点で復元する。
+// そのため演算対象となる上位の値は常にレジスタ上にある。
+
+#define NUM_TEMP_REGS 10
+
+static char* temp_regs[NUM_TEMP_REGS] = {
+	"$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$t8", "$t9",
+};
+
+static int reg_depth; // 使用中の一時値の数
+
+// 生成中のインライン展開（return文は結果を置いて展開の末尾へ分岐する）
+typedef struct InlineContext InlineContext;
+struct InlineContext {
+	int result;          // 結果を置く一時値の深さ
+	int end_label;       // 展開の末尾のラベル番号
+	InlineContext* next; // 外側の展開
+};
+
+static InlineContext* inline_context;
+
+static Node* current_func; // 生成中の関数定義
+static bool frame_address_taken; // 生成中の関数がローカル変数のアドレスを取る（末尾呼び出しにしない）
+
+static void gen_stmt(Node* node);
+static int gen_expr(Node* node);
+static void gen_epilogue(void);
+static void gen_release_frame(void);
+static void gen_cond(Node* node, bool jump_if, char* label);
+
+// 深さdの一時値が割り当てられたレジスタ名
+static char* reg(int d) {
+	return temp_regs[d % NUM_TEMP_REGS];
+}
+
+// 一時値を1つ確保する。レジスタが足りなければ古い値を退避する
+static int push_reg(void) {
+	int d = reg_depth++;
+	if (d >= NUM_TEMP_REGS) {
+		emit("\taddiu $sp, $sp, -4\n");
+		emit("\tsw %s, 0($sp)\n", reg(d));
+	}
+	return d;
+}
+
+// 最上位の一時値を解放する。退避していた値があれば復元する
+static void pop_reg(void) {
+	int d = --reg_depth;
+	if (d >= NUM_TEMP_REGS) {
+		emit("\tlw %s, 0($sp)\n", reg(d));
+		emit("\taddiu $sp, $sp, 4\n");
+	}
+}
+
+// 最上位の一時値を解放し、その値で条件分岐する
+static void pop_and_branch(char* op, char* label) {
+	int d = reg_depth - 1;
+	char* r = reg(d);
+	if (d >= NUM_TEMP_REGS) {
+		// 解放時にレジスタが復元されるため、条件値を$v1に逃がしておく
+		emit("\tmove $v1, %s\n", r);
+		r = "$v1";
+	}
+	pop_reg();
+	emit("\t%s %s, %s\n", op, r, label);
+}
+
+// 関数呼び出しの前後で生存している一時値をスタックに保存する
+static int save_live_regs(void) {
+	int lo = reg_depth > NUM_TEMP_REGS ? reg_depth - NUM_TEMP_REGS : 0;
+	int n = reg_depth - lo;
+	if (n == 0) {
+		return 0;
+	}
+	emit("\taddiu $sp, $sp, -%d\n", n * 4);
+	for (int i = 0; i < n; i++) {
+		emit("\tsw %s, %d($sp)\n", reg(lo + i), i * 4);
+	}
+	return n;
+}
+
+static void restore_live_regs(int n) {
+	if (n == 0) {
+		return;
+	}
+	int lo = reg_depth - n;
+	for (int i = 0; i < n; i++) {
+		emit("\tlw %s, %d($sp)\n", reg(lo + i), i * 4);
+	}
+	emit("\taddiu $sp, $sp, %d\n", n * 4);
+}
+
+// -----------------------------------------------------------------------------
+// 変数の置き場所
+// -----------------------------------------------------------------------------
+//
+// ローカル変数は通常$s8からのオフセットで参照する。フレームポインタを使わない
+// 関数では$spからの位置に読み替え、途中で$spを下げた分（sp_offset）を補正する。
+// 引数をレジスタに置いたままにする関数では、その変数への読み書きはmoveになる。
+
+#define MAX_REG_VARS 4
+
+// レジスタに割り当てた変数
+typedef struct {
+	int offset; // 変数のオフセット
+	char* reg;  // 割り当てたレジスタ
+} RegVar;
+
+static RegVar reg_vars[MAX_REG_VARS];
+static int num_reg_vars;
+
+static bool frame_saves_ra; // $s8を使わない関数で$raをフレームに退避したか
+
+// 左辺値の置き場所
+typedef struct {
+	char* reg;        // レジスタに割り当てた変数ならそのレジスタ
+	bool on_frame;    // スタックフレーム上の変数か
+	int offset;       // on_frameなら$s8相当の位置からのオフセット
+	char operand[64]; // それ以外のメモリオペランド（"off($reg)"またはラベル）
+} Loc;
+
+// オフセットの変数を割り当てたレジスタ（メモリ上ならNULL）
+static char* var_reg(int offset) {
+	for (int i = 0; i < num_reg_vars; i++) {
+		if (reg_vars[i].offset == offset) {
+			return reg_vars[i].reg;
+		}
+	}
+	return NULL;
+}
+
+static void emit_load(char* rd, Loc* loc) {
+	if (loc->reg) {
+		emit("\tmove %s, %s\n", rd, loc->reg);
+		return;
+	}
+	char mem[64];
+	if (loc->on_frame) {
+		frame_operand(mem, loc->offset);
+	} else {
+		strcpy(mem, loc->operand);
+	}
+	emit("\tlw %s, %s\n", rd, mem);
+}
+
+static void emit_store(char* rs, Loc* loc) {
+	if (loc->reg) {
+		emit("\tmove %s, %s\n", loc->reg, rs);
+		return;
+	}
+	char mem[64];
+	if (loc->on_frame) {
+		frame_operand(mem, loc->offset);
+	} else {
+		strcpy(mem, loc->operand);
+	}
+	emit("\tsw %s, %s\n", rs, mem);
+}
+
+// 左辺値の置き場所をlocに求める
+// アドレス計算のために一時値を確保した場合はその数（0か1）を返す
+static int gen_loc(Node* node, Loc* loc, int offset) {
+	loc->reg = NULL;
+	loc->on_frame = false;
+	switch (node->kind) {
+	case ND_LVAR:
+		loc->reg = offset ? NULL : var_reg(node->offset);
+		loc->on_frame = true;
+		loc->offset = node->offset + offset;
+		return 0;
+	case ND_GVAR:
+		if (offset) {
+			sprintf(loc->operand, "%s+%d", node->name, offset);
+		} else {
+			sprintf(loc->operand, "%s", node->name);
+		}
+		return 0;
+	case ND_DEREF: {
+		// *ptr の左辺値は ptr の値（アドレス）
+		int d = gen_expr(node->lhs);
+		sprintf(loc->operand, "%d(%s)", offset, reg(d));
+		return 1;
+	}
+	case ND_MEMBER: {
+		// メンバオフセットはアドレッシングモードの即値に畳み込む
+		Member* member = lookup_member(node);
+		return gen_loc(node->lhs, loc, offset + member->offset);
+	}
+	default:
+		error("not left value");
+	}
+	return 0;
+}
+
+// 左辺値のアドレスを一時値として求める
+static int gen_addr(Node* node) {
+	switch (node->kind) {
+	case ND_LVAR: {
+		int d = push_reg();
+		gen_frame_addr(reg(d), node->offset);
+		return d;
+	}
+	case ND_GVAR: {
+		int d = push_reg();
+		emit("\tla %s, %s\n", reg(d), node->name);
+		return d;
+	}
+	case ND_DEREF:
+		return gen_expr(node->lhs);
+	case ND_MEMBER: {
+		int d = gen_addr(node->lhs);
+		Member* member = lookup_member(node);
+		if (member->offset) {
+			emit("\taddiu %s, %s, %d\n", reg(d), reg(d), member->offset);
+		}
+		return d;
+	}
+	default:
+		error("not left value");
+	}
+	return 0;
+}
+
+// アドレス用の一時値を使っていた場合、その位置に結果を移して解放する
+static void drop_addr(int addr_regs, int result) {
+	if (addr_regs) {
+		emit("\tmove %s, %s\n", reg(result - 1), reg(result));
+		pop_reg();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// 定数との乗除算の命令選択
+// -----------------------------------------------------------------------------
+//
+// mul/divはHI/LOを使う多サイクル命令なので、定数が相手の場合はシフトと加減算、
+// または逆数の乗算（上位32ビットだけを使う）に置き換える。作業用に$v1を使う。
+
+// 2のべき乗ならその指数、そうでなければ-1
+static int exact_log2(unsigned v) {
+	if (v == 0 || (v & (v - 1)))
+		return -1;
+	int n = 0;
+	while (v > 1) {
+		v >>= 1;
+		n++;
+	}
+	return n;
+}
+
+// rd = rs * c（c >= 0）をシフトと加減算で計算できれば出力する
+static bool gen_mul_shift(char* rd, char* rs, unsigned c) {
+	if (c == 0) {
+		emit("\tli %s, 0\n", rd);
+		return true;
+	}
+	int k = exact_log2(c);
+	if (k >= 0) {
+		if (k == 0) {
+			emit("\tmove %s, %s\n", rd, rs);
+		} else {
+			emit("\tsll %s, %s, %d\n", rd, rs, k);
+		}
+		return true;
+	}
+	// 2^a + 2^b（a > b）
+	int b = exact_log2(c & -c);
+	int a = exact_log2(c - (c & -c));
+	if (a >= 0) {
+		emit("\tsll $v1, %s, %d\n", rs, a);
+		if (b == 0) {
+			emit("\taddu %s, %s, $v1\n", rd, rs);
+		} else {
+			emit("\tsll %s, %s, %d\n", rd, rs, b);
+			emit("\taddu %s, %s, $v1\n", rd, rd);
+		}
+		return true;
+	}
+	// 2^a - 2^b（a > b）
+	a = exact_log2(c + (c & -c));
+	if (a >= 0 && a < 32) {
+		emit("\tsll $v1, %s, %d\n", rs, a);
+		if (b == 0) {
+			emit("\tsubu %s, $v1, %s\n", rd, rs);
+		} else {
+			emit("\tsll %s, %s, %d\n", rd, rs, b);
+			emit("\tsubu %s, $v1, %s\n", rd, rd);
+		}
+		return true;
+	}
+	return false;
+}
+
+// rd = rs * c
+void gen_mul_const(char* rd, char* rs, int c) {
+	if (c != INT_MIN && gen_mul_shift(rd, rs, c < 0 ? -c : c)) {
+		if (c < 0) {
+			emit("\tsubu %s, $zero, %s\n", rd, rd);
+		}
+		return;
+	}
+	emit("\tli $v1, %d\n", c);
+	emit("\tmul %s, %s, $v1\n", rd, rs);
+}
+
+// 符号付き除算を乗算に置き換えるための魔法数（Hacker's Delight 10-1）
+// x / d = (上位32ビット(x * multiplier) [+ x]) >> shift + (x < 0)
+static void signed_magic(int d, int* multiplier, int* shift) {
+	const unsigned two31 = 0x80000000u;
+	unsigned ad = d;
+	unsigned anc = two31 - 1 - two31 % ad;
+	int p = 31;
+	unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+	unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+	unsigned delta;
+	do {
+		p++;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			q1++;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= ad) {
+			q2++;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+	*multiplier = (int)(q2 + 1);
+	*shift = p - 32;
+}
+
+// rq = rx / c（c >= 2）。rxは変更しない
+void gen_div_positive(char* rq, char* rx, int c) {
+	int k = exact_log2(c);
+	if (k > 0) {
+		// 負の数は0方向へ丸めるため 2^k - 1 を足してからシフトする
+		if (k == 1) {
+			emit("\tsrl $v1, %s, 31\n", rx);
+		} else {
+			emit("\tsra $v1, %s, 31\n", rx);
+			emit("\tsrl $v1, $v1, %d\n", 32 - k);
+		}
+		emit("\taddu $v1, %s, $v1\n", rx);
+		emit("\tsra %s, $v1, %d\n", rq, k);
+		return;
+	}
+
+	int m, sh;
+	signed_magic(c, &m, &sh);
+	emit("\tli $v1, %d\n", m);
+	emit("\tmult %s, $v1\n", rx);
+	emit("\tmfhi $v1\n");
+	if (m < 0) {
+		emit("\taddu $v1, $v1, %s\n", rx);
+	}
+	if (sh > 0) {
+		emit("\tsra $v1, $v1, %d\n", sh);
+	}
+	// 商が負なら1を足して0方向へ丸める
+	emit("\tsrl %s, $v1, 31\n", rq);
+	emit("\taddu %s, %s, $v1\n", rq, rq);
+}
+
+// 深さdの値を定数cで割った商（is_modなら余り）に置き換える。できなければfalse
+static bool gen_div_const(int d, int c, bool is_mod) {
+	if (c == 0 || c == INT_MIN)
+		return false;
+	char* rd = reg(d);
+	int ac = c < 0 ? -c : c;
+
+	if (ac == 1) {
+		if (is_mod) {
+			emit("\tli %s, 0\n", rd);
+		} else if (c < 0) {
+			emit("\tsubu %s, $zero, %s\n", rd, rd);
+		}
+		return true;
+	}
+
+	if (!is_mod) {
+		gen_div_positive(rd, rd, ac);
+		if (c < 0) {
+			emit("\tsubu %s, $zero, %s\n", rd, rd);
+		}
+		return true;
+	}
+
+	// 余り: x - (x / |c|) * |c|（符号は被除数に従う）
+	int q = push_reg();
+	gen_div_positive(reg(q), rd, ac);
+	gen_mul_const(reg(q), reg(q), ac);
+	emit("\tsubu %s, %s, %s\n", rd, rd, reg(q));
+	pop_reg();
+	return true;
+}
+
+// 深さdの値と定数の二項演算。即値や命令選択で済めばtrue
+static bool gen_binary_const(Node* node, int d, int c) {
+	char* rd = reg(d);
+	switch (node->kind) {
+	case ND_ADD: {
+		Type* ty = get_type(node->lhs);
+		if (ty->ty == TY_PTR || ty->ty == TY_ARRAY) {
+			long long scaled = (long long)c * size_of(ty->ptr_to);
+			if (scaled < INT_MIN || scaled > INT_MAX)
+				return false;
+			c = (int)scaled;
+		}
+		if (c < -32768 || c > 32767)
+			return false;
+		if (c != 0) {
+			emit("\taddiu %s, %s, %d\n", rd, rd, c);
+		}
+		return true;
+	}
+	case ND_MUL:
+		gen_mul_const(rd, rd, c);
+		return true;
+	case ND_DIV:
+		return gen_div_const(d, c, false);
+	case ND_MOD:
+		return gen_div_const(d, c, true);
+	default:
+		return false;
+	}
+}
+
+// ポインタ演算のために深さdの添字を要素サイズ倍する
+static void gen_scale_index(int d, Type* ptr_type) {
+	int elem_size = size_of(ptr_type->ptr_to);
+	if (elem_size > 1) {
+		gen_mul_const(reg(d), reg(d), elem_size);
+	}
+}
+
+// 複合代入（+=, -=, *=, /=）
+static int gen_compound_assign_reg(Node* node) {
+	Loc loc;
+	int n = gen_loc(node->lhs, &loc, 0);
+	int d = push_reg();
+	emit_load(reg(d), &loc);  // 現在の値
+
+	// 定数の右辺は即値・シフトで計算する
+	Node* rhs = node->rhs;
+	if (rhs->kind == ND_NUM) {
+		bool done = false;
+		switch (node->kind) {
+		case ND_ADD_ASSIGN:
+		case ND_SUB_ASSIGN: {
+			int c = node->kind == ND_ADD_ASSIGN ? rhs->val : -rhs->val;
+			if (rhs->val != INT_MIN && c >= -32768 && c <= 32767) {
+				emit("\taddiu %s, %s, %d\n", reg(d), reg(d), c);
+				done = true;
+			}
+			break;
+		}
+		case ND_MUL_ASSIGN:
+			gen_mul_const(reg(d), reg(d), rhs->val);
+			done = true;
+			break;
+		default:
+			done = gen_div_const(d, rhs->val, false);
+			break;
+		}
+		if (done) {
+			emit_store(reg(d), &loc);
+			drop_addr(n, d);
+			return reg_depth - 1;
+		}
+	}
+
+	int r = gen_expr(node->rhs);
+	switch (node->kind) {
+	case ND_ADD_ASSIGN:
+		emit("\taddu %s, %s, %s\n", reg(d), reg(d), reg(r));
+		break;
+	case ND_SUB_ASSIGN:
+		emit("\tsubu %s, %s, %s\n", reg(d), reg(d), reg(r));
+		break;
+	case ND_MUL_ASSIGN:
+		emit("\tmul %s, %s, %s\n", reg(d), reg(d), reg(r));
+		break;
+	default:
+		emit("\tdiv $zero, %s, %s\n", reg(d), reg(r));
+		emit("\tmflo %s\n", reg(d));
+		break;
+	}
+	pop_reg();
+	emit_store(reg(d), &loc);
+	drop_addr(n, d);
+	return reg_depth - 1;
+}
+
+// インクリメント/デクリメント（値を使わない場合は前置と同じ処理）
+static int gen_inc_dec_reg(Node* node, int delta, bool is_prefix) {
+	Loc loc;
+	int n = gen_loc(node->lhs, &loc, 0);
+	int d = push_reg();
+	emit_load(reg(d), &loc);
+	if (is_prefix) {
+		emit("\taddiu %s, %s, %d\n", reg(d), reg(d), delta);
+		emit_store(reg(d), &loc);
+	} else {
+		emit("\taddiu $v1, %s, %d\n", reg(d), delta);
+		emit_store("$v1", &loc);
+	}
+	drop_addr(n, d);
+	return reg_depth - 1;
+}
+
+// 通常の関数呼び出し
+static int gen_call_reg(Node* node) {
+	// 引数を正しい順序で評価して一時値に積む
+	int argc = node->argc < 4 ? node->argc : 4;
+	for (int i = 0; i < argc; i++) {
+		gen_expr(node->args[i]);
+	}
+	// 最後の引数から順に引数レジスタへ移す（解放のたびに退避値が戻る）
+	for (int i = argc - 1; i >= 0; i--) {
+		emit("\tmove $a%d, %s\n", i, reg(reg_depth - 1));
+		pop_reg();
+	}
+
+	int saved = save_live_regs();
+	emit("\tjal %s\n", node->name);
+	emit("\tnop\n");
+	restore_live_regs(saved);
+
+	int d = push_reg();
+	emit("\tmove %s, $v0\n", reg(d));
+	return d;
+}
+
+// return文の値が末尾呼び出しとして生成できる呼び出しか
+// printfはスタックマシンで生成し、5つ以上の引数はスタック渡しになるため対象外
+// ローカル変数のアドレスを取る関数は、呼び出し先がそのフレームを指しうるので対象外
+static bool is_tail_call(Node* node) {
+	if (!node || node->kind != ND_CALL || strcmp(node->name, "printf") == 0 || node->argc > 4 ||
+	    frame_address_taken) {
+		return false;
+	}
+	// 自分自身の呼び出しは引数の領域を書き換えるため、引数の数が一致する必要がある
+	return strcmp(node->name, current_func->name) != 0 || node->argc == current_func->argc;
+}
+
+// 末尾呼び出し。自分自身の呼び出しは引数を書き換えて関数の先頭へ戻るループにし、
+// それ以外はフレームを解放してから呼び出し先へジャンプする（$raは呼び出し元のまま）
+static void gen_tail_call(Node* node) {
+	for (int i = 0; i < node->argc; i++) {
+		gen_expr(node->args[i]);
+	}
+	if (strcmp(node->name, current_func->name) == 0) {
+		// すべての引数を評価してから書き換える（新しい引数が古い引数を読むことがある）
+		for (int i = node->argc - 1; i >= 0; i--) {
+			Loc loc = {NULL, true, ARG_SAVE_OFFSET - (i + 1) * ARG_SIZE};
+			loc.reg = var_reg(loc.offset);
+			emit_store(reg(reg_depth - 1), &loc);
+			pop_reg();
+		}
+		emit("\tj .L_tail_%s\n", node->name);
+		return;
+	}
+	for (int i = node->argc - 1; i >= 0; i--) {
+		emit("\tmove $a%d, %s\n", i, reg(reg_depth - 1));
+		pop_reg();
+	}
+	int saved_sp_offset = sp_offset;  // return文の後に続くコードのために戻す
+	gen_release_frame();
+	emit("\tj %s\n", node->name);
+	emit("\tnop\n");
+	sp_offset = saved_sp_offset;
+}
+
+// 組み込み関数とprintfは従来のスタックマシンの展開を使う
+static int gen_stack_fallback(Node* node) {
+	int saved = save_live_regs();
+	gen(node);
+	emit("\tlw $v0, 0($sp)\n");
+	emit("\taddiu $sp, $sp, 4\n");
+	restore_live_regs(saved);
+
+	int d = push_reg();
+	emit("\tmove %s, $v0\n", reg(d));
+	return d;
+}
+
+// インライン展開した関数本体を生成し、戻り値を保持する一時値の深さを返す
+static int gen_inline(Node* node) {
+	int d = push_reg();
+	InlineContext context = {d, label_count++, inline_context};
+	inline_context = &context;
+
+	bool has_return = false;
+	for (int i = 0; node->body[i]; i++) {
+		gen_stmt(node->body[i]);
+		if (node->body[i]->kind == ND_RETURN) {
+			has_return = true;
+			break;
+		}
+	}
+	if (!has_return) {
+		emit("\tli %s, 0\n", reg(d));
+	}
+	emit(".L_inline_end_%d:\n", context.end_label);
+
+	inline_context = context.next;
+	return d;
+}
+
+// 条件式の真偽を0か0以外の一時値に求め、成り立つときに0以外になればtrueを返す
+// ==と!=は排他的論理和だけで済ませ、0と比べる命令を省く
+static bool gen_select_cond(Node* node) {
+	if (node->kind == ND_NOT) {
+		return !gen_select_cond(node->lhs);
+	}
+	if (node->kind != ND_EQ && node->kind != ND_NE) {
+		gen_expr(node);
+		return true;
+	}
+	int d = gen_expr(node->lhs);
+	Node* rhs = node->rhs;
+	if (rhs->kind == ND_NUM && rhs->val >= 0 && rhs->val <= 0xffff) {
+		if (rhs->val != 0) {
+			emit("\txori %s, %s, %d\n", reg(d), reg(d), rhs->val);
+		}
+	} else {
+		int r = gen_expr(rhs);
+		emit("\txor %s, %s, %s\n", reg(d), reg(d), reg(r));
+		pop_reg();
+	}
+	return node->kind == ND_NE;
+}
+
+// 両側とも軽い三項演算子は分岐せず、両方の値を求めてからmovn/movzで選ぶ
+static int gen_select(Node* node) {
+	if (has_side_effects(node->cond)) {
+		// 条件を先に評価し、選んだ値を条件の一時値の位置へ移す
+		int c = reg_depth;
+		bool nonzero_if_true = gen_select_cond(node->cond);
+		int t = gen_expr(node->then);
+		int e = gen_expr(node->els);
+		emit("\t%s %s, %s, %s\n", nonzero_if_true ? "movz" : "movn", reg(t), reg(e), reg(c));
+		pop_reg();
+		emit("\tmove %s, %s\n", reg(c), reg(t));
+		pop_reg();
+		return c;
+	}
+	int t = gen_expr(node->then);
+	int e = gen_expr(node->els);
+	bool nonzero_if_true = gen_select_cond(node->cond);
+	emit("\t%s %s, %s, %s\n", nonzero_if_true ? "movz" : "movn", reg(t), reg(e), reg(reg_depth - 1));
+	pop_reg();
+	pop_reg();
+	return t;
+}
+
+// 同じレジスタ変数へ代入するだけのif文を分岐せずに生成する。生成したらtrue
+// elseがなければ代入する値を求め、条件が成り立つときだけmovn/movzで変数へ移す
+static bool gen_select_assign(Node* node) {
+	Node* assign = select_assign(node);
+	char* var = assign ? var_reg(assign->lhs->offset) : NULL;
+	if (!var) {
+		return false;
+	}
+	if (node->els) {
+		gen_expr(assign);
+		pop_reg();
+		return true;
+	}
+	Node* select = assign->rhs;
+	bool nonzero_if_true;
+	int c, t;
+	if (has_side_effects(select->cond)) {
+		c = reg_depth;
+		nonzero_if_true = gen_select_cond(select->cond);
+		t = gen_expr(select->then);
+	} else {
+		t = gen_expr(select->then);
+		c = reg_depth;
+		nonzero_if_true = gen_select_cond(select->cond);
+	}
+	emit("\t%s %s, %s, %s\n", nonzero_if_true ? "movn" : "movz", var, reg(t), reg(c));
+	pop_reg();
+	pop_reg();
+	return true;
+}
+
+// 式を評価し、結果を保持する一時値の深さを返す
+static int gen_expr(Node* node) {
+	switch (node->kind) {
+	case ND_NUM: {
+		int d = push_reg();
+		emit("\tli %s, %d\n", reg(d), node->val);
+		return d;
+	}
+	case ND_STR: {
+		int d = push_reg();
+		emit("\tla %s, .L_str_%d\n", reg(d), add_string_literal(node));
+		return d;
+	}
+	case ND_LVAR:
+	case ND_GVAR: {
+		if (is_array_var(node)) {
+			// 配列はアドレス（配列→ポインタ変換）
+			return gen_addr(node);
+		}
+		Loc loc;
+		gen_loc(node, &loc, 0);
+		int d = push_reg();
+		emit_load(reg(d), &loc);
+		return d;
+	}
+	case ND_DEREF:
+	case ND_MEMBER: {
+		Loc loc;
+		int n = gen_loc(node, &loc, 0);
+		if (n) {
+			// アドレスを保持していたレジスタに値を読み込む
+			emit_load(reg(reg_depth - 1), &loc);
+			return reg_depth - 1;
+		}
+		int d = push_reg();
+		emit_load(reg(d), &loc);
+		return d;
+	}
+	case ND_ADDR:
+		return gen_addr(node->lhs);
+	case ND_ASSIGN: {
+		Loc loc;
+		int n = gen_loc(node->lhs, &loc, 0);
+		int d = gen_expr(node->rhs);
+		emit_store(reg(d), &loc);
+		drop_addr(n, d);
+		return reg_depth - 1;
+	}
+	case ND_ADD_ASSIGN:
+	case ND_SUB_ASSIGN:
+	case ND_MUL_ASSIGN:
+	case ND_DIV_ASSIGN:
+		return gen_compound_assign_reg(node);
+	case ND_PRE_INC:
+		return gen_inc_dec_reg(node, 1, true);
+	case ND_POST_INC:
+		return gen_inc_dec_reg(node, 1, false);
+	case ND_PRE_DEC:
+		return gen_inc_dec_reg(node, -1, true);
+	case ND_POST_DEC:
+		return gen_inc_dec_reg(node, -1, false);
+	case ND_CALL:
+		if (strcmp(node->name, "printf") == 0) {
+			return gen_stack_fallback(node);
+		}
+		return gen_call_reg(node);
+	case ND_BUILTIN_CALL:
+		return gen_stack_fallback(node);
+	case ND_INLINE:
+		return gen_inline(node);
+	case ND_NOT: {
+		// 値が0なら1、それ以外なら0（符号なしで1未満かどうか）
+		int d = gen_expr(node->lhs);
+		emit("\tsltiu %s, %s, 1\n", reg(d), reg(d));
+		return d;
+	}
+	case ND_TERNARY: {
+		if (if_conversion && is_speculatable(node->then) && is_speculatable(node->els)) {
+			return gen_select(node);
+		}
+		int label = label_count++;
+		char else_label[32];
+		sprintf(else_label, ".Lelse%d", label);
+		gen_cond(node->cond, false, else_label);
+		int depth = reg_depth;
+		int saved_sp_offset = sp_offset;
+		int d = gen_expr(node->then);
+		emit("\tj .Lend%d\n", label);
+		emit(".Lelse%d:\n", label);
+		// else側は条件分岐直後の状態から評価する
+		reg_depth = depth;
+		sp_offset = saved_sp_offset;
+		gen_expr(node->els);
+		emit(".Lend%d:\n", label);
+		return d;
+	}
+	case ND_AND: {
+		// 左辺が偽ならその値（0）がそのまま結果になる
+		int label = label_count++;
+		int d = gen_expr(node->lhs);
+		emit("\tbeqz %s, .Lend%d\n", reg(d), label);
+		int r = gen_expr(node->rhs);
+		emit("\tsltu %s, $zero, %s\n", reg(d), reg(r));
+		pop_reg();
+		emit(".Lend%d:\n", label);
+		return d;
+	}
+	case ND_OR: {
+		int label = label_count++;
+		int d = gen_expr(node->lhs);
+		emit("\tsltu %s, $zero, %s\n", reg(d), reg(d));
+		emit("\tbnez %s, .Lend%d\n", reg(d), label);
+		int r = gen_expr(node->rhs);
+		emit("\tsltu %s, $zero, %s\n", reg(d), reg(r));
+		pop_reg();
+		emit(".Lend%d:\n", label);
+		return d;
+	}
+	default:
+		break;
+	}
+
+	// 二項演算子の処理
+	int d = gen_expr(node->lhs);
+	if (node->rhs->kind == ND_NUM && gen_binary_const(node, d, node->rhs->val)) {
+		return d;
+	}
+	int r = gen_expr(node->rhs);
+	char* rd = reg(d);
+	char* rr = reg(r);
+
+	switch (node->kind) {
+	case ND_ADD: {
+		// ポインタ演算のチェック
+		Type* left_type = get_type(node->lhs);
+		Type* right_type = get_type(node->rhs);
+
+		if (left_type->ty == TY_PTR || left_type->ty == TY_ARRAY) {
+			// 左がポインタ/配列: ptr + int => ptr + (int * sizeof(pointee))
+			gen_scale_index(r, left_type);
+		} else if (right_type->ty == TY_PTR || right_type->ty == TY_ARRAY) {
+			// 右がポインタ/配列: int + ptr => (int * sizeof(pointee)) + ptr
+			gen_scale_index(d, right_type);
+		}
+		emit("\taddu %s, %s, %s\n", rd, rd, rr);
+		break;
+	}
+	case ND_SUB:
+		emit("\tsubu %s, %s, %s\n", rd, rd, rr);
+		break;
+	case ND_MUL:
+		emit("\tmul %s, %s, %s\n", rd, rd, rr);
+		break;
+	case ND_DIV:
+		emit("\tdiv $zero, %s, %s\n", rd, rr);
+		emit("\tmflo %s\n", rd);
+		break;
+	case ND_MOD:
+		emit("\tdiv $zero, %s, %s\n", rd, rr);
+		emit("\tmfhi %s\n", rd);
+		break;
+	case ND_EQ:
+		emit("\tseq %s, %s, %s\n", rd, rd, rr);
+		break;
+	case ND_NE:
+		emit("\tsne %s, %s, %s\n", rd, rd, rr);
+		break;
+	case ND_LT:
+		emit("\tslt %s, %s, %s\n", rd, rd, rr);
+		break;
+	case ND_LE:
+		emit("\tsle %s, %s, %s\n", rd, rd, rr);
+		break;
+	default:
+		error("unsupported expression");
+	}
+	pop_reg();
+	return d;
+}
+
+// -----------------------------------------------------------------------------
+// 条件分岐の生成
+// -----------------------------------------------------------------------------
+//
+// if/while/for/三項演算子の条件は0/1の値を作らずに比較結果で直接分岐する。
+// &&/||/!は分岐先を入れ替えながら再帰的に処理する。
+
+// 16ビット符号付き即値に収まるか
+static bool is_simm16(long long val) {
+	return val >= -32768 && val <= 32767;
+}
+
+// 比較演算で分岐する。比較が成り立つときに分岐するならon_trueがtrue
+static void gen_compare_branch(Node* node, bool on_true, char* label) {
+	Node* lhs = node->lhs;
+	Node* rhs = node->rhs;
+
+	if (node->kind == ND_EQ || node->kind == ND_NE) {
+		bool branch_if_equal = (node->kind == ND_EQ) == on_true;
+		int d = gen_expr(lhs);
+		if (rhs->kind == ND_NUM && rhs->val == 0) {
+			pop_and_branch(branch_if_equal ? "beqz" : "bnez", label);
+			return;
+		}
+		int r = gen_expr(rhs);
+		if (r >= NUM_TEMP_REGS) {
+			// 退避中の値があると2つのレジスタを同時に比較できない
+			emit("\txor %s, %s, %s\n", reg(d), reg(d), reg(r));
+			pop_reg();
+			pop_and_branch(branch_if_equal ? "beqz" : "bnez", label);
+			return;
+		}
+		emit("\t%s %s, %s, %s\n", branch_if_equal ? "beq" : "bne", reg(d), reg(r), label);
+		pop_reg();
+		pop_reg();
+		return;
+	}
+
+	bool is_le = node->kind == ND_LE;
+
+	// 0との比較は専用の分岐命令を使う
+	if (lhs->kind == ND_NUM && lhs->val == 0) {
+		gen_expr(rhs);
+		// 0 < b は b > 0、0 <= b は b >= 0
+		if (is_le) {
+			pop_and_branch(on_true ? "bgez" : "bltz", label);
+		} else {
+			pop_and_branch(on_true ? "bgtz" : "blez", label);
+		}
+		return;
+	}
+	int d = gen_expr(lhs);
+	if (rhs->kind == ND_NUM && rhs->val == 0) {
+		if (is_le) {
+			pop_and_branch(on_true ? "blez" : "bgtz", label);
+		} else {
+			pop_and_branch(on_true ? "bltz" : "bgez", label);
+		}
+		return;
+	}
+
+	// a < c、a <= c（a < c + 1）は即値で比較する
+	if (rhs->kind == ND_NUM && is_simm16((long long)rhs->val + is_le)) {
+		emit("\tslti %s, %s, %d\n", reg(d), reg(d), rhs->val + is_le);
+		pop_and_branch(on_true ? "bnez" : "beqz", label);
+		return;
+	}
+
+	int r = gen_expr(rhs);
+	if (is_le) {
+		// a <= b は !(b < a)
+		emit("\tslt %s, %s, %s\n", reg(d), reg(r), reg(d));
+		on_true = !on_true;
+	} else {
+		emit("\tslt %s, %s, %s\n", reg(d), reg(d), reg(r));
+	}
+	pop_reg();
+	pop_and_branch(on_true ? "bnez" : "beqz", label);
+}
+
+// 条件式nodeの真偽がjump_ifと一致したらlabelへ分岐し、そうでなければ次へ進む
+static void gen_cond(Node* node, bool jump_if, char* label) {
+	switch (node->kind) {
+	case ND_NUM:
+		if ((node->val != 0) == jump_if) {
+			emit("\tj %s\n", label);
+		}
+		return;
+	case ND_NOT:
+		gen_cond(node->lhs, !jump_if, label);
+		return;
+	case ND_AND:
+	case ND_OR: {
+		// 左辺がこの値なら右辺を評価せずに結果が決まる（&&なら偽、||なら真）
+		bool decisive = node->kind == ND_OR;
+		if (jump_if == decisive) {
+			gen_cond(node->lhs, jump_if, label);
+			gen_cond(node->rhs, jump_if, label);
+		} else {
+			char skip[32];
+			sprintf(skip, ".L_cond_%d", label_count++);
+			gen_cond(node->lhs, decisive, skip);
+			gen_cond(node->rhs, jump_if, label);
+			emit("%s:\n", skip);
+		}
+		return;
+	}
+	case ND_EQ:
+	case ND_NE:
+	case ND_LT:
+	case ND_LE:
+		gen_compare_branch(node, jump_if, label);
+		return;
+	default:
+		gen_expr(node);
+		pop_and_branch(jump_if ? "bnez" : "beqz", label);
+		return;
+	}
+}
+
+// 値を使わない式文を評価する
+static void gen_expr_stmt(Node* node) {
+	// 後置インクリメント/デクリメントは前置と同じ処理で済む
+	if (node->kind == ND_POST_INC) {
+		gen_inc_dec_reg(node, 1, true);
+	} else if (node->kind == ND_POST_DEC) {
+		gen_inc_dec_reg(node, -1, true);
+	} else {
+		gen_expr(node);
+	}
+	pop_reg();
+}
+
+static bool count_node(Node* node, void* data) {
+	(*(int*)data)++;
+	return false;
+}
+
+// while/forを末尾で条件を判定する形で生成する
+//
+// 	（初期化式）
+// 	条件が偽なら .Lbreak へ        … 最初の1回だけ
+// .L_begin:
+// 	本体
+// .Lcontinue:
+// 	（更新式）
+// 	条件が真なら .L_begin へ
+// .Lbreak:
+//
+// 反復ごとの分岐は条件分岐1つになる。条件の式が大きい場合は複製せず、
+// 最初に末尾の判定へ分岐する。
+static void gen_loop(Node* node) {
+	int seq = label_count++;
+	int continue_label = node->kind == ND_FOR ? label_count++ : seq;
+	push_loop_labels(seq, continue_label);
+	if (node->init) {
+		gen_expr_stmt(node->init);
+	}
+	char begin[32];
+	char end[32];
+	sprintf(begin, ".L_begin_%d", seq);
+	sprintf(end, ".Lbreak%d", seq);
+	// 条件が常に真の場合は簡約でNULLになる
+	int cond_size = 0;
+	tree_any(node->cond, count_node, &cond_size);
+	bool guard = cond_size <= ROTATE_MAX_COND_SIZE;
+	if (node->cond) {
+		if (guard) {
+			gen_cond(node->cond, false, end);
+		} else {
+			emit("\tj .L_test_%d\n", seq);
+		}
+	}
+	emit("%s:\n", begin);
+	gen_stmt(node->then);
+	emit(".Lcontinue%d:\n", continue_label);
+	if (node->inc) {
+		gen_stmt(node->inc);
+	}
+	if (node->cond) {
+		if (!guard) {
+			emit(".L_test_%d:\n", seq);
+		}
+		gen_cond(node->cond, true, begin);
+	} else {
+		emit("\tj %s\n", begin);
+	}
+	emit("%s:\n", end);
+	pop_loop_labels();
+}
+
+static void gen_stmt(Node* node) {
+	switch (node->kind) {
+	case ND_BLOCK:
+		for (int i = 0; node->body[i]; i++) {
+			gen_stmt(node->body[i]);
+		}
+		return;
+	case ND_IF: {
+		if (if_conversion && gen_select_assign(node)) {
+			return;
+		}
+		int seq = label_count++;
+		char label[32];
+		if (node->els) {
+			sprintf(label, ".L_else_%d", seq);
+			gen_cond(node->cond, false, label);
+			gen_stmt(node->then);
+			emit("\tj .L_end_%d\n", seq);
+			emit(".L_else_%d:\n", seq);
+			gen_stmt(node->els);
+			emit(".L_end_%d:\n", seq);
+		} else {
+			sprintf(label, ".L_end_%d", seq);
+			gen_cond(node->cond, false, label);
+			gen_stmt(node->then);
+			emit(".L_end_%d:\n", seq);
+		}
+		return;
+	}
+	case ND_WHILE:
+	case ND_FOR:
+		gen_loop(node);
+		return;
+	case ND_SWITCH: {
+		int seq = label_count++;
+		int d = gen_expr(node->cond);
+		emit("\tmove $v0, %s\n", reg(d));
+		pop_reg();
+		// breakはswitch文の後ろへ、continueは外側のループへ
+		push_loop_labels(seq, loop_stack ? loop_stack->continue_label : -1);
+		gen_switch_branch(node, seq);
+		gen_stmt(node->then);
+		emit(".Lbreak%d:\n", seq);
+		pop_loop_labels();
+		return;
+	}
+	case ND_CASE:
+	case ND_DEFAULT:
+		emit(".L_case_%d:\n", node->case_label);
+		gen_stmt(node->then);
+		return;
+	case ND_RETURN:
+		if (inline_context) {
+			// インライン展開中は結果を置いて展開の末尾へ
+			char* result = reg(inline_context->result);
+			if (node->lhs) {
+				int d = gen_expr(node->lhs);
+				emit("\tmove %s, %s\n", result, reg(d));
+				pop_reg();
+			} else {
+				emit("\tli %s, 0\n", result);
+			}
+			emit("\tj .L_inline_end_%d\n", inline_context->end_label);
+			return;
+		}
+		if (is_tail_call(node->lhs)) {
+			gen_tail_call(node->lhs);
+			return;
+		}
+		if (node->lhs) {
+			int d = gen_expr(node->lhs);
+			emit("\tmove $v0, %s\n", reg(d));
+			pop_reg();
+		} else {
+			emit("\tli $v0, 0\n");
+		}
+		gen_epilogue();
+		return;
+	case ND_BREAK:
+		if (!loop_stack) {
+			error("break statement not within a loop");
+		}
+		emit("\tj .Lbreak%d\n", loop_stack->break_label);
+		return;
+	case ND_CONTINUE:
+		if (!loop_stack || loop_stack->continue_label < 0) {
+			error("continue statement not within a loop");
+		}
+		emit("\tj .Lcontinue%d\n", loop_stack->continue_label);
+		return;
+	default:
+		gen_expr_stmt(node);
+		return;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// 関数のフレーム
+// -----------------------------------------------------------------------------
+//
+// 関数呼び出しを含まない関数（葉関数）は$raを退避せず、$s8も使わない。
+// アドレスを取られない引数は$a0-$a3に置いたままにし、スタックフレームは
+// メモリに置く変数がある場合だけ確保する。
+// -fomit-frame-pointerではそれ以外の関数も$s8を使わず、$raだけを退避する。
+
+static char* arg_regs[] = {"$a0", "$a1", "$a2", "$a3"};
+
+// オフセットが*dataの変数のアドレスを取る式か
+static bool takes_address(Node* node, void* data) {
+	if (node->kind != ND_ADDR) {
+		return false;
+	}
+	Node* var = node->lhs;
+	while (var->kind == ND_MEMBER) {
+		var = var->lhs;
+	}
+	return var->kind == ND_LVAR && var->offset == *(int*)data;
+}
+
+// 関数本体のどこかにpredを満たすノードがあるか
+static bool body_any(Node* func, bool (*pred)(Node* node, void* data), void* data) {
+	for (int i = 0; func->body[i]; i++) {
+		if (tree_any(func->body[i], pred, data)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// オフセットの変数の型
+static Type* var_type(int offset) {
+	for (LVar* var = locals; var; var = var->next) {
+		if (var->offset == offset) {
+			return var->type;
+		}
+	}
+	return NULL;
+}
+
+// $s8を使わない関数のプロローグ
+// 葉関数は$raも退避せず、アドレスを取られないスカラーの引数をレジスタに置いたままにする
+static LVar* gen_sp_prologue(Node* node, bool is_leaf) {
+	LVar* saved_locals = gen_func_label(node);
+
+	num_reg_vars = 0;
+	for (int i = 0; is_leaf && i < node->argc && i < 4; i++) {
+		int offset = ARG_SAVE_OFFSET - (i + 1) * ARG_SIZE;
+		Type* ty = var_type(offset);
+		if (ty && (is_integer(ty) || ty->ty == TY_PTR) && !body_any(node, takes_address, &offset)) {
+			reg_vars[num_reg_vars].offset = offset;
+			reg_vars[num_reg_vars].reg = arg_regs[i];
+			num_reg_vars++;
+		}
+	}
+
+	// メモリに置く変数の分だけフレームを確保する
+	// $raは$s8に相当する位置の8バイト下（変数領域の直上）に退避する
+	int size = 0;
+	for (LVar* var = locals; var; var = var->next) {
+		if (!var_reg(var->offset) && ARG_SAVE_OFFSET - var->offset > size) {
+			size = ARG_SAVE_OFFSET - var->offset;
+		}
+	}
+	int ra_size = is_leaf ? 0 : 4;
+	size = (size + ra_size + 7) / 8 * 8;
+	current_frame_size = size;
+	frame_saves_ra = !is_leaf;
+	frame_uses_fp = false;
+	frame_top = size - ARG_SAVE_OFFSET - ra_size;
+
+	if (size) {
+		emit("\taddiu $sp, $sp, -%d\n", size);
+	}
+	sp_offset = 0;
+	char mem[64];
+	if (frame_saves_ra) {
+		frame_operand(mem, ARG_SAVE_OFFSET);
+		emit("\tsw $ra, %s\n", mem);
+	}
+	for (int i = 0; i < node->argc && i < 4; i++) {
+		int offset = ARG_SAVE_OFFSET - (i + 1) * ARG_SIZE;
+		if (!var_reg(offset)) {
+			frame_operand(mem, offset);
+			emit("\tsw %s, %s\n", arg_regs[i], mem);
+		}
+	}
+	return saved_locals;
+}
+
+// フレームを解放し、$raと$s8を呼び出し元の値に戻す
+static void gen_release_frame(void) {
+	if (frame_uses_fp) {
+		emit("\tlw $ra, 4($s8)\n");
+		emit("\tlw $s8, 0($s8)\n");
+		emit("\taddiu $sp, $sp, %d\n", current_frame_size);
+		return;
+	}
+	if (frame_saves_ra) {
+		char mem[64];
+		frame_operand(mem, ARG_SAVE_OFFSET);
+		emit("\tlw $ra, %s\n", mem);
+	}
+	if (current_frame_size + sp_offset) {
+		emit("\taddiu $sp, $sp, %d\n", current_frame_size + sp_offset);
+	}
+}
+
+// エピローグ（戻り値は$v0に設定済み）
+static void gen_epilogue(void) {
+	int saved_sp_offset = sp_offset;  // return文の後に続くコードのために戻す
+	gen_release_frame();
+	emit("\tjr $ra\n");
+	emit("\tnop\n");
+	sp_offset = saved_sp_offset;
+}
+
+static bool count_call(Node* node, void* data) {
+	if (is_call_node(node, NULL)) {
+		(*(int*)data)++;
+	}
+	return false;
+}
+
+// 文の中の末尾呼び出しの数（インライン展開した本体のreturn文は式の中なので数えない）
+static int count_tail_calls(Node* node) {
+	if (!node) {
+		return 0;
+	}
+	switch (node->kind) {
+	case ND_BLOCK: {
+		int n = 0;
+		for (int i = 0; node->body[i]; i++) {
+			n += count_tail_calls(node->body[i]);
+		}
+		return n;
+	}
+	case ND_IF:
+		return count_tail_calls(node->then) + count_tail_calls(node->els);
+	case ND_WHILE:
+	case ND_FOR:
+	case ND_SWITCH:
+	case ND_CASE:
+	case ND_DEFAULT:
+		return count_tail_calls(node->then);
+	case ND_RETURN:
+		return is_tail_call(node->lhs);
+	default:
+		return 0;
+	}
+}
+
+// 関数定義をレジスタ割り当てモードで出力する
+void gen_func_reg(Node* node) {
+	current_func = node;
+	LVar* outer_locals = locals;
+	Function* func = lookup_function(node->name);
+	if (func) {
+		locals = func->locals;
+	}
+	frame_address_taken = body_any(node, takes_local_address, NULL);
+	locals = outer_locals;
+
+	// 末尾呼び出ししかない関数はjalを実行せず$raが保たれるので、葉関数として扱える
+	int calls = 0;
+	int tail_calls = 0;
+	for (int i = 0; node->body[i]; i++) {
+		tree_any(node->body[i], count_call, &calls);
+		tail_calls += count_tail_calls(node->body[i]);
+	}
+	bool is_leaf = calls == tail_calls;
+
+	LVar* saved_locals;
+	if (is_leaf || omit_frame_pointer) {
+		saved_locals = gen_sp_prologue(node, is_leaf);
+	} else {
+		saved_locals = gen_func_prologue(node);
+		num_reg_vars = 0;
+	}
+	reg_depth = 0;
+	emit(".L_tail_%s:\n", node->name);
+
+	bool has_return = false;
+	for (int i = 0; node->body[i]; i++) {
+		gen_stmt(node->body[i]);
+		if (node->body[i]->kind == ND_RETURN) {
+			has_return = true;
+			break;
+		}
+	}
+
+	// デフォルトの戻り値とエピローグ
+	if (!has_return) {
+		emit(".L_func_end_%s:\n", node->name);
+		emit("\tli $v0, 0\n");
+		gen_epilogue();
+	}
+
+	locals = saved_locals;
+}
@@ -0,0 +1,83 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 到達しない関数とグローバル変数の削除（-O1以上）
+// =============================================================================
+//
+// mainから関数呼び出しをたどり、到達する関数だけをコード生成の対象に残す。
+// グローバル変数は到達する関数から参照されるものだけ領域を確保する。
+// 文字列リテラルはコード生成の時点で登録されるので、削除した関数の中の文字列は出力されない。
+// インライン展開の後に行うので、すべての呼び出しが展開された関数も削除される。
+
+static void mark_function(Function* f);
+
+static GVar* lookup_global(char* name) {
+	for (GVar* var = globals; var; var = var->next) {
+		if (strcmp(var->name, name) == 0) {
+			return var;
+		}
+	}
+	return NULL;
+}
+
+static bool mark_node(Node* node, void* data) {
+	if (node->kind == ND_CALL) {
+		// 定義のない関数（printfなど）はたどらない
+		Function* f = lookup_function(node->name);
+		if (f) {
+			mark_function(f);
+		}
+	} else if (node->kind == ND_GVAR) {
+		GVar* var = lookup_global(node->name);
+		if (var) {
+			var->used = true;
+		}
+	}
+	return false;
+}
+
+static void mark_function(Function* f) {
+	if (f->used) {
+		return;
+	}
+	f->used = true;
+	tree_any(f->node, mark_node, NULL);
+}
+
+void remove_dead_code(void) {
+	Function* main_func = lookup_function("main");
+	if (!main_func) {
+		return;
+	}
+	mark_function(main_func);
+
+	// 出力するノードの列から到達しない関数を除く
+	int n = 0;
+	for (int i = 0; code[i]; i++) {
+		Function* f = code[i]->kind == ND_FUNC ? lookup_function(code[i]->name) : NULL;
+		if (!f || f->used) {
+			code[n++] = code[i];
+		}
+	}
+	code[n] = NULL;
+
+	// 関数の一覧から除く（上の判定が一覧を引くので後で行う）
+	Function** link = &functions;
+	while (*link) {
+		if ((*link)->used) {
+			link = &(*link)->next;
+		} else {
+			*link = (*link)->next;
+		}
+	}
+
+	// 参照されないグローバル変数を除く
+	GVar** var_link = &globals;
+	while (*var_link) {
+		if ((*var_link)->used) {
+			var_link = &(*var_link)->next;
+		} else {
+			*var_link = (*var_link)->next;
+		}
+	}
+}
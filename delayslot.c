@@ -0,0 +1,178 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 遅延スロットの充填（-O1以上）
+// =============================================================================
+//
+// 関数全体を .set noreorder で囲み、分岐命令の直後の遅延スロットを自分で埋める。
+// 分岐より前にある独立した命令を遅延スロットへ移し、見つからなければnopを置く。
+
+#define MAX_LOOKBACK 4 // 遅延スロットへ移す命令を探す範囲
+
+// 命令idxの直後に出力される行の位置（なければ-1）
+static int next_line(int idx) {
+	for (int i = idx + 1; i < inst_count; i++)
+		if (!insts[i].deleted)
+			return i;
+	return -1;
+}
+
+// 即値が符号付き16ビットに収まるか
+static bool fits_simm16(char* imm) {
+	char* end;
+	long val = strtol(imm, &end, 0);
+	return *end == '\0' && val >= -32768 && val <= 32767;
+}
+
+// 即値が符号なし16ビットに収まるか
+static bool fits_uimm16(char* imm) {
+	char* end;
+	long val = strtol(imm, &end, 0);
+	return *end == '\0' && val >= 0 && val <= 65535;
+}
+
+// "off(reg)" 形式のメモリオペランドか（ラベル参照はマクロ展開される）
+static bool is_base_offset(char* operand) {
+	char* paren = strchr(operand, '(');
+	if (!paren)
+		return false;
+	if (paren == operand)
+		return true;
+	char off[INST_OPERAND_LEN];
+	memcpy(off, operand, paren - operand);
+	off[paren - operand] = '\0';
+	return fits_simm16(off);
+}
+
+static bool is_memory_op(Inst* inst) {
+	static char* ops[] = {"lw", "lb", "lbu", "lh", "lhu", "sw", "sb", "sh", NULL};
+	for (int i = 0; ops[i]; i++)
+		if (inst_is(inst, ops[i]))
+			return true;
+	return false;
+}
+
+// 1命令の機械語になる命令か（遅延スロットにマクロは置けない）
+static bool is_single_inst(Inst* inst) {
+	static char* reg_ops[] = {
+		"move", "addu", "subu", "and", "or", "xor", "nor", "not", "negu",
+		"slt", "sltu", "sllv", "srlv", "srav", "mul", "movn", "movz", "mflo", "mfhi", NULL,
+	};
+	for (int i = 0; reg_ops[i]; i++)
+		if (inst_is(inst, reg_ops[i]))
+			return true;
+
+	if (is_memory_op(inst))
+		return is_base_offset(inst->operands[1]);
+	if (inst_is(inst, "addiu") || inst_is(inst, "slti") || inst_is(inst, "sltiu"))
+		return fits_simm16(inst->operands[2]);
+	if (inst_is(inst, "andi") || inst_is(inst, "ori") || inst_is(inst, "xori"))
+		return fits_uimm16(inst->operands[2]);
+	if (inst_is(inst, "sll") || inst_is(inst, "srl") || inst_is(inst, "sra"))
+		return true;
+	if (inst_is(inst, "li"))
+		return fits_simm16(inst->operands[1]) || fits_uimm16(inst->operands[1]);
+	if (inst_is(inst, "lui"))
+		return true;
+	return false;
+}
+
+// 命令pが書き込むレジスタ（なければNULL）
+static char* dest_of(Inst* p) {
+	return inst_defines_first(p) ? p->operands[0] : NULL;
+}
+
+// 命令pを命令iより後ろへ移しても結果が変わらないか
+static bool can_swap(Inst* p, Inst* i) {
+	char* pd = dest_of(p);
+	char* id = dest_of(i);
+	if (pd && (inst_reads(i, pd) || inst_writes(i, pd)))
+		return false;
+	if (id && inst_reads_operand(p, id))
+		return false;
+	// HI/LOの読み書きの順序
+	if ((inst_is(p, "mflo") || inst_is(p, "mfhi")) &&
+	    (inst_is(i, "mult") || inst_is(i, "multu") || inst_is(i, "div") || inst_is(i, "divu")))
+		return false;
+	// メモリアクセス同士は（読み込み同士を除き）追い越さない
+	if (is_memory_op(p) && is_memory_op(i) && (p->op[0] == 's' || i->op[0] == 's'))
+		return false;
+	return true;
+}
+
+// 命令pを分岐bの遅延スロットに置けるか
+static bool fits_delay_slot(Inst* p, Inst* b) {
+	// jalは遅延スロットの実行前に$raを書き換える。引数レジスタは呼び出し先で読まれる
+	if (inst_is(b, "jal")) {
+		for (int i = 0; i < p->num_operands; i++)
+			if (operand_mentions(p->operands[i], "$ra"))
+				return false;
+		return true;
+	}
+	char* pd = dest_of(p);
+	return !pd || !inst_reads(b, pd);
+}
+
+// 分岐bの前から遅延スロットへ移せる命令を探す（見つからなければ-1）
+static int find_slot_candidate(int b) {
+	int i = b;
+	for (int n = 0; n < MAX_LOOKBACK; n++) {
+		// 直前の命令（ラベルやディレクティブがあればそこで打ち切る）
+		int p = i - 1;
+		while (p >= 0 && insts[p].deleted)
+			p--;
+		if (p < 0 || insts[p].kind != INST_OP)
+			return -1;
+
+		Inst* cand = &insts[p];
+		if (inst_is_branch(cand) || !inst_is_known(cand) || inst_is(cand, "syscall"))
+			return -1;
+
+		// 別の分岐の遅延スロットに入っている命令は動かせない
+		int prev = p - 1;
+		while (prev >= 0 && (insts[prev].deleted || insts[prev].kind == INST_OTHER))
+			prev--;
+		bool in_slot = prev >= 0 && insts[prev].kind == INST_OP && inst_is_branch(&insts[prev]);
+
+		if (!in_slot && is_single_inst(cand) && fits_delay_slot(cand, &insts[b])) {
+			bool ok = true;
+			for (int k = p + 1; k < b && ok; k++)
+				if (!insts[k].deleted && insts[k].kind == INST_OP)
+					ok = can_swap(cand, &insts[k]);
+			if (ok)
+				return p;
+		}
+		if (in_slot)
+			return -1;
+		i = p;
+	}
+	return -1;
+}
+
+void fill_delay_slots(void) {
+	// すべての分岐の直後に遅延スロット用のnopを置く
+	for (int i = 0; i < inst_count; i++) {
+		if (insts[i].deleted || !inst_is_branch(&insts[i]))
+			continue;
+		int next = next_line(i);
+		if (next < 0 || !inst_is(&insts[next], "nop"))
+			insert_inst(i + 1, "\tnop");
+	}
+
+	// 分岐より前の命令でnopを置き換える
+	for (int i = 0; i < inst_count; i++) {
+		if (insts[i].deleted || !inst_is_branch(&insts[i]))
+			continue;
+		int p = find_slot_candidate(i);
+		if (p < 0)
+			continue;
+		Inst* slot = &insts[next_line(i)];
+		free(slot->text);
+		*slot = insts[p];
+		insts[p].text = NULL;
+		insts[p].deleted = true;
+	}
+
+	insert_inst(0, "\t.set noreorder");
+	insert_inst(inst_count, "\t.set reorder");
+}
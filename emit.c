@@ -0,0 +1,275 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 命令バッファ
+// =============================================================================
+//
+// コード生成は標準出力へ直接書かずにemit()で命令列をメモリ上に溜める。
+// 関数1つ分の生成が終わったらflush_insts()で最適化パスを通してから出力する。
+
+Inst* insts; // 命令列
+int inst_count; // 命令数
+static int inst_capacity;
+
+// プロローグ後に$spを下げたバイト数。addiu $sp, $sp, Nを出力するたびに更新し、
+// フレーム上の変数を$sp基準で参照するときの補正に使う
+int sp_offset;
+
+static char line_buf[1024]; // 改行が来るまでの出力途中の行
+static int line_len;
+
+// 文字列を複製する
+static char* copy_text(char* text) {
+	char* buf = calloc(strlen(text) + 1, sizeof(char));
+	strcpy(buf, text);
+	return buf;
+}
+
+// オペランド文字列の前後の空白を取り除いてコピーする
+static void copy_operand(char* dst, char* begin, char* end) {
+	while (begin < end && isspace(*begin))
+		begin++;
+	while (end > begin && isspace(end[-1]))
+		end--;
+	int len = end - begin;
+	if (len >= INST_OPERAND_LEN)
+		error("operand too long: %.*s", len, begin);
+	memcpy(dst, begin, len);
+	dst[len] = '\0';
+}
+
+// 1行を解析してニーモニックとオペランドに分ける
+static void parse_inst(Inst* inst, char* line) {
+	char* p = line;
+	while (isspace(*p))
+		p++;
+
+	inst->kind = INST_OTHER;
+	inst->op[0] = '\0';
+	inst->num_operands = 0;
+
+	// 空行、コメント、ディレクティブ
+	if (*p == '\0' || *p == '#' || *p == '.' && p[strlen(p) - 1] != ':')
+		return;
+
+	// ラベル
+	if (p[strlen(p) - 1] == ':' && !strchr(p, ' ')) {
+		inst->kind = INST_LABEL;
+		copy_operand(inst->operands[0], p, p + strlen(p) - 1);
+		inst->num_operands = 1;
+		return;
+	}
+
+	inst->kind = INST_OP;
+	char* q = p;
+	while (*q && !isspace(*q))
+		q++;
+	if (q - p >= (int)sizeof(inst->op))
+		error("unknown instruction: %s", p);
+	memcpy(inst->op, p, q - p);
+	inst->op[q - p] = '\0';
+
+	while (isspace(*q))
+		q++;
+	while (*q && inst->num_operands < INST_MAX_OPERANDS) {
+		char* comma = strchr(q, ',');
+		char* end = comma ? comma : q + strlen(q);
+		copy_operand(inst->operands[inst->num_operands++], q, end);
+		q = comma ? comma + 1 : end;
+	}
+}
+
+// 命令列の位置idxに1行を挿入する（挿入より後ろの要素へのポインタは無効になる）
+void insert_inst(int idx, char* line) {
+	if (inst_count == inst_capacity) {
+		inst_capacity = inst_capacity ? inst_capacity * 2 : 256;
+		insts = realloc(insts, sizeof(Inst) * inst_capacity);
+	}
+	memmove(&insts[idx + 1], &insts[idx], sizeof(Inst) * (inst_count - idx));
+	inst_count++;
+
+	Inst* inst = &insts[idx];
+	inst->text = copy_text(line);
+	inst->deleted = false;
+	parse_inst(inst, line);
+}
+
+// printfと同じ書式で命令を出力する（改行までを1命令として扱う）
+void emit(char* fmt, ...) {
+	char buf[1024];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	for (char* p = buf; *p; p++) {
+		if (*p == '\n') {
+			line_buf[line_len] = '\0';
+			insert_inst(inst_count, line_buf);
+			line_len = 0;
+			Inst* inst = &insts[inst_count - 1];
+			if (inst_is(inst, "addiu") && strcmp(inst->operands[0], "$sp") == 0 &&
+			    strcmp(inst->operands[1], "$sp") == 0)
+				sp_offset -= atoi(inst->operands[2]);
+			continue;
+		}
+		if (line_len == sizeof(line_buf) - 1)
+			error("assembly line too long");
+		line_buf[line_len++] = *p;
+	}
+}
+
+// 命令を書き換える（オペランドはNULLで打ち切り）
+// 引数が書き換え対象の命令自身のオペランドを指していても良いように先に複製する
+void set_inst(Inst* inst, char* op, char* a, char* b, char* c) {
+	char* operands[INST_MAX_OPERANDS] = {a, b, c};
+	char copy[INST_MAX_OPERANDS][INST_OPERAND_LEN];
+	char new_op[sizeof(inst->op)];
+	int n = 0;
+
+	strcpy(new_op, op);
+	while (n < INST_MAX_OPERANDS && operands[n]) {
+		strcpy(copy[n], operands[n]);
+		n++;
+	}
+
+	char buf[256];
+	int len = snprintf(buf, sizeof(buf), "\t%s", new_op);
+	strcpy(inst->op, new_op);
+	inst->num_operands = n;
+	for (int i = 0; i < n; i++) {
+		strcpy(inst->operands[i], copy[i]);
+		len += snprintf(buf + len, sizeof(buf) - len, "%s%s", i ? ", " : " ", copy[i]);
+	}
+	free(inst->text);
+	inst->text = copy_text(buf);
+	inst->kind = INST_OP;
+}
+
+// オペランドを書き換えた命令のテキストを作り直す
+void update_inst(Inst* inst) {
+	char* operands[INST_MAX_OPERANDS] = {NULL, NULL, NULL};
+	for (int i = 0; i < inst->num_operands; i++)
+		operands[i] = inst->operands[i];
+	set_inst(inst, inst->op, operands[0], operands[1], operands[2]);
+}
+
+// -----------------------------------------------------------------------------
+// 命令の解析（最適化パスで共通に使う）
+// -----------------------------------------------------------------------------
+
+// 値を書き込む先が第1オペランドである命令
+static char* def_ops[] = {
+	"li", "la", "lui", "lw", "lb", "lbu", "lh", "lhu", "move",
+	"addu", "addiu", "add", "addi", "subu", "sub", "mul", "negu", "neg",
+	"and", "andi", "or", "ori", "xor", "xori", "nor", "not",
+	"slt", "slti", "sltu", "sltiu", "seq", "sne", "sle", "sge", "sgt",
+	"sll", "srl", "sra", "sllv", "srlv", "srav", "mflo", "mfhi",
+	"movn", "movz", NULL,
+};
+
+// 値を書き込まない命令（分岐・ストアなど）
+static char* use_ops[] = {
+	"sw", "sb", "sh", "mult", "multu", "div", "divu",
+	"beq", "bne", "beqz", "bnez", "bltz", "blez", "bgtz", "bgez",
+	"blt", "ble", "bgt", "bge", "j", "jr", "jal", "syscall", "nop", NULL,
+};
+
+// 制御を移す命令
+static char* branch_ops[] = {
+	"beq", "bne", "beqz", "bnez", "bltz", "blez", "bgtz", "bgez",
+	"blt", "ble", "bgt", "bge", "j", "jr", "jal", NULL,
+};
+
+static bool in_list(char* op, char** list) {
+	for (int i = 0; list[i]; i++)
+		if (strcmp(op, list[i]) == 0)
+			return true;
+	return false;
+}
+
+bool inst_is(Inst* inst, char* op) {
+	return inst->kind == INST_OP && strcmp(inst->op, op) == 0;
+}
+
+// 第1オペランドに結果を書く命令か
+// divは第1オペランドが$zeroの形だけが実際の命令でHI/LOにしか書かない。それ以外の3オペランド形は
+// 結果を書く擬似命令（2オペランド形もmfloで第1オペランドを書き換えるマクロになるので生成しない）
+bool inst_defines_first(Inst* inst) {
+	if (in_list(inst->op, def_ops))
+		return true;
+	return (inst_is(inst, "div") || inst_is(inst, "divu")) && inst->num_operands == 3 &&
+	       strcmp(inst->operands[0], "$zero") != 0;
+}
+
+// 命令の意味が分かっているか（分からない命令は最適化の壁として扱う）
+bool inst_is_known(Inst* inst) {
+	return inst->kind == INST_OP && (in_list(inst->op, def_ops) || in_list(inst->op, use_ops));
+}
+
+bool inst_is_branch(Inst* inst) {
+	return inst->kind == INST_OP && in_list(inst->op, branch_ops);
+}
+
+// オペランドがレジスタregを参照しているか（"reg" または "off(reg)"）
+bool operand_mentions(char* operand, char* reg) {
+	if (strcmp(operand, reg) == 0)
+		return true;
+	char* paren = strchr(operand, '(');
+	if (!paren)
+		return false;
+	int len = strlen(reg);
+	return strncmp(paren + 1, reg, len) == 0 && paren[len + 1] == ')';
+}
+
+// 明示的なオペランドでregを読むか
+bool inst_reads_operand(Inst* inst, char* reg) {
+	int first = inst_defines_first(inst) ? 1 : 0;
+	// movn/movzは条件が偽のとき書き込み先の値が残る
+	if (inst_is(inst, "movn") || inst_is(inst, "movz"))
+		first = 0;
+	for (int i = first; i < inst->num_operands; i++)
+		if (operand_mentions(inst->operands[i], reg))
+			return true;
+	// 書き込み先がメモリオペランドのベースレジスタであることはない
+	return false;
+}
+
+bool is_arg_reg(char* reg) {
+	return strncmp(reg, "$a", 2) == 0;
+}
+
+bool is_temp_reg(char* reg) {
+	return strncmp(reg, "$t", 2) == 0 || strcmp(reg, "$v1") == 0 || strcmp(reg, "$at") == 0;
+}
+
+// regを（暗黙のものも含めて）読むか
+bool inst_reads(Inst* inst, char* reg) {
+	if (inst_is(inst, "syscall"))
+		return strcmp(reg, "$v0") == 0 || is_arg_reg(reg);
+	if (inst_is(inst, "jal"))
+		return is_arg_reg(reg);
+	return inst_reads_operand(inst, reg);
+}
+
+// regに値を書き込むか
+bool inst_writes(Inst* inst, char* reg) {
+	if (inst_is(inst, "syscall"))
+		return strcmp(reg, "$v0") == 0 || strcmp(reg, "$a3") == 0;
+	if (inst_is(inst, "jal"))
+		return is_temp_reg(reg) || is_arg_reg(reg) || strcmp(reg, "$v0") == 0 || strcmp(reg, "$ra") == 0;
+	return inst_defines_first(inst) && strcmp(inst->operands[0], reg) == 0;
+}
+
+// 溜めた命令列を標準出力に書き出す（最適化はパスマネージャが先に行う）
+void flush_insts(void) {
+	if (line_len > 0)
+		emit("\n");
+
+	for (int i = 0; i < inst_count; i++) {
+		if (!insts[i].deleted)
+			printf("%s\n", insts[i].text);
+		free(insts[i].text);
+	}
+	inst_count = 0;
+}
@@ -0,0 +1,674 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 値番号付け（-O2）
+// =============================================================================
+//
+// 支配木をたどりながら、同じ演算・同じオペランドの命令を先に計算した値で置き換える
+// （支配する基本ブロックで計算した値だけを使う）。定数の演算はここで畳み込む。
+// メモリの読み込みは、先行ブロックが1つだけの基本ブロックの並び（拡張基本ブロック）の中で
+// 同じ場所の読み込み・書き込みの値を使い回す。間の書き込みと関数呼び出しが
+// その場所を書き換えうるかは、アドレスの指すオブジェクトで判断する。
+//   - アドレスが命令の外へ出ていかない（escapeしない）ローカル変数は、
+//     その変数への書き込みでしか変わらない
+//   - グローバル変数とescapeしたローカル変数は、どこを指すか分からないポインタ経由の
+//     書き込みと関数呼び出しでも変わりうる
+
+#define OBJ_UNSET -2  // まだ求めていない（φ関数の引数）
+#define OBJ_ANY -1    // どのオブジェクトを指すか分からない（ポインタでない値も含む）
+
+// 読み書きされるメモリのまとまり（ローカル変数1つかグローバル変数1つ）
+typedef struct {
+	MemKind kind;
+	LVar* var;     // MEM_FRAME（変数に含まれない領域ならNULL）
+	char* name;    // MEM_GLOBAL
+	bool escaped;  // どこを指すか分からないポインタと関数呼び出しから触られうる
+} MemObject;
+
+static MemObject* objects;
+static int num_objects;
+static int* object_of;     // 値がアドレスなら指すオブジェクト
+static int* offset_of;     // そのオブジェクトの先頭からのバイト数
+static bool* offset_known;
+
+// 支配木の上で使える式
+typedef struct {
+	IrOp op;
+	int a, b, imm;
+	MemRef mem;  // IR_ADDR
+	int value;
+} Expr;
+
+static Expr* exprs;
+static int num_exprs;
+static int cap_exprs;
+
+// 拡張基本ブロックの中で起きたメモリの読み書き
+typedef enum {
+	EV_LOAD,    // memの値はvalue
+	EV_STORE,   // memにvalueを書いた（重なりうる場所の値は分からなくなる）
+	EV_CALL,    // 関数呼び出し（escapeしたオブジェクトの値は分からなくなる）
+} MemEventKind;
+
+typedef struct {
+	MemEventKind kind;
+	MemRef mem;
+	int value;
+} MemEvent;
+
+static MemEvent* events;
+static int num_events;
+static int cap_events;
+static int first_event;  // 現在の基本ブロックから見える最初の記録
+
+static int* alias;        // 取り除いた命令の値の置き換え先
+static bool* is_const;
+static int* const_value;
+static BasicBlock*** children;
+static int* num_children;
+
+static int resolve(int v) {
+	while (alias[v] != v) {
+		v = alias[v];
+	}
+	return v;
+}
+
+// -----------------------------------------------------------------------------
+// アドレスの指すオブジェクト
+// -----------------------------------------------------------------------------
+
+static int find_object(MemKind kind, LVar* var, char* name) {
+	for (int i = 0; i < num_objects; i++) {
+		MemObject* obj = &objects[i];
+		if (obj->kind == kind && obj->var == var && (kind != MEM_GLOBAL || strcmp(obj->name, name) == 0)) {
+			return i;
+		}
+	}
+	objects = realloc(objects, sizeof(MemObject) * (num_objects + 1));
+	objects[num_objects] = (MemObject){kind, var, name, kind == MEM_GLOBAL || !var};
+	return num_objects++;
+}
+
+// memの指すオブジェクトと、分かればその先頭からのバイト数
+static int mem_object(MemRef* mem, int* offset, bool* known) {
+	switch (mem->kind) {
+	case MEM_FRAME: {
+		LVar* var = frame_var_at(mem->offset);
+		*offset = var ? mem->offset - var->offset : mem->offset;
+		*known = true;
+		return find_object(MEM_FRAME, var, NULL);
+	}
+	case MEM_GLOBAL:
+		*offset = mem->offset;
+		*known = true;
+		return find_object(MEM_GLOBAL, NULL, mem->name);
+	case MEM_POINTER:
+		*offset = offset_of[mem->base] + mem->offset;
+		*known = offset_known[mem->base];
+		return object_of[mem->base];
+	}
+	return OBJ_ANY;
+}
+
+static void set_object(int v, int obj, int offset, bool known, bool* changed) {
+	if (object_of[v] != obj || offset_of[v] != offset || offset_known[v] != known) {
+		object_of[v] = obj;
+		offset_of[v] = offset;
+		offset_known[v] = known;
+		*changed = true;
+	}
+}
+
+// アドレス + 整数 の結果
+static void add_offset(IrInst* inst, int ptr, int other, int sign, bool* changed) {
+	bool known = offset_known[ptr] && is_const[other];
+	int offset = known ? offset_of[ptr] + sign * const_value[other] : 0;
+	set_object(inst->dst, object_of[ptr], offset, known, changed);
+}
+
+static void propagate_object(IrInst* inst, bool* changed) {
+	int offset;
+	bool known;
+	switch (inst->op) {
+	case IR_ADDR: {
+		int obj = mem_object(&inst->mem, &offset, &known);
+		set_object(inst->dst, obj, offset, known, changed);
+		return;
+	}
+	case IR_COPY:
+		set_object(inst->dst, object_of[inst->a], offset_of[inst->a], offset_known[inst->a], changed);
+		return;
+	case IR_ADD:
+		if (object_of[inst->a] >= 0 && object_of[inst->b] < 0) {
+			add_offset(inst, inst->a, inst->b, 1, changed);
+			return;
+		}
+		if (object_of[inst->b] >= 0 && object_of[inst->a] < 0) {
+			add_offset(inst, inst->b, inst->a, 1, changed);
+			return;
+		}
+		break;
+	case IR_SUB:
+		if (object_of[inst->a] >= 0 && object_of[inst->b] < 0) {
+			add_offset(inst, inst->a, inst->b, -1, changed);
+			return;
+		}
+		break;
+	case IR_PHI: {
+		int obj = OBJ_UNSET;
+		offset = 0;
+		known = true;
+		for (int i = 0; i < inst->num_args; i++) {
+			int arg = inst->args[i];
+			if (object_of[arg] == OBJ_UNSET) {
+				continue;
+			}
+			if (obj == OBJ_UNSET) {
+				obj = object_of[arg];
+				offset = offset_of[arg];
+			} else if (obj != object_of[arg]) {
+				obj = OBJ_ANY;
+			}
+			if (!offset_known[arg] || offset_of[arg] != offset) {
+				known = false;
+			}
+		}
+		set_object(inst->dst, obj, obj >= 0 && known ? offset : 0, obj >= 0 && known, changed);
+		return;
+	}
+	default:
+		break;
+	}
+	if (inst->dst >= 0) {
+		set_object(inst->dst, OBJ_ANY, 0, false, changed);
+	}
+}
+
+static bool escape_lvar(Node* node, void* data) {
+	if (node->kind == ND_LVAR) {
+		int obj = find_object(MEM_FRAME, frame_var_at(node->offset), NULL);
+		objects[obj].escaped = true;
+	}
+	return false;
+}
+
+// アドレスが読み書きの場所と比較以外に使われたオブジェクトをescapeしたとする
+static void find_escapes(IrFunc* f) {
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			if (inst->op == IR_STACK) {
+				// スタックマシンの展開はフレーム上の変数を直接読み書きする
+				tree_any(inst->node, escape_lvar, NULL);
+				continue;
+			}
+			if (inst->op == IR_EQ || inst->op == IR_NE || inst->op == IR_LT || inst->op == IR_LE ||
+			    inst->op == IR_BRANCH || inst->op == IR_SWITCH) {
+				continue;
+			}
+			bool derives = inst->op == IR_ADD || inst->op == IR_SUB || inst->op == IR_COPY || inst->op == IR_PHI;
+			int* ops[3 + inst->num_args];
+			int num_ops = inst_operands(inst, ops);
+			for (int j = 0; j < num_ops; j++) {
+				int v = *ops[j];
+				if (object_of[v] < 0 || ops[j] == &inst->mem.base) {
+					continue;
+				}
+				if (derives && object_of[inst->dst] == object_of[v]) {
+					continue;
+				}
+				objects[object_of[v]].escaped = true;
+			}
+		}
+	}
+}
+
+static void analyze_objects(IrFunc* f) {
+	num_objects = 0;
+	objects = NULL;
+	object_of = malloc(sizeof(int) * f->num_values);
+	offset_of = calloc(f->num_values, sizeof(int));
+	offset_known = calloc(f->num_values, sizeof(bool));
+	for (int v = 0; v < f->num_values; v++) {
+		object_of[v] = OBJ_UNSET;
+	}
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 0; i < f->num_blocks; i++) {
+			for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+				propagate_object(inst, &changed);
+			}
+		}
+	}
+	find_escapes(f);
+}
+
+// 2つのメモリが重なりうるか
+static bool may_alias(MemRef* x, MemRef* y) {
+	int ox, oy;
+	bool kx, ky;
+	int a = mem_object(x, &ox, &kx);
+	int b = mem_object(y, &oy, &ky);
+	if (a < 0 || b < 0) {
+		return (a < 0 || objects[a].escaped) && (b < 0 || objects[b].escaped);
+	}
+	if (a != b) {
+		return false;
+	}
+	return !kx || !ky || (ox < oy + ARG_SIZE && oy < ox + ARG_SIZE);
+}
+
+// 関数呼び出しがmemを書き換えうるか
+static bool clobbered_by_call(MemRef* mem) {
+	int offset;
+	bool known;
+	int obj = mem_object(mem, &offset, &known);
+	return obj < 0 || objects[obj].escaped;
+}
+
+static bool same_mem(MemRef* x, MemRef* y) {
+	if (x->kind != y->kind || x->offset != y->offset) {
+		return false;
+	}
+	switch (x->kind) {
+	case MEM_GLOBAL:
+		return strcmp(x->name, y->name) == 0;
+	case MEM_POINTER:
+		return x->base == y->base;
+	default:
+		return true;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// 値番号付け
+// -----------------------------------------------------------------------------
+
+static void push_event(MemEventKind kind, MemRef mem, int value) {
+	if (num_events == cap_events) {
+		cap_events = cap_events ? cap_events * 2 : 64;
+		events = realloc(events, sizeof(MemEvent) * cap_events);
+	}
+	events[num_events++] = (MemEvent){kind, mem, value};
+}
+
+// 現在の位置でのmemの値（分からなければ-1）
+static int memory_value(MemRef* mem) {
+	for (int i = num_events - 1; i >= first_event; i--) {
+		MemEvent* ev = &events[i];
+		if (ev->kind == EV_CALL) {
+			if (clobbered_by_call(mem)) {
+				return -1;
+			}
+			continue;
+		}
+		if (same_mem(&ev->mem, mem)) {
+			return ev->value;
+		}
+		if (ev->kind == EV_STORE && may_alias(&ev->mem, mem)) {
+			return -1;
+		}
+	}
+	return -1;
+}
+
+static bool same_expr(Expr* e, IrInst* inst) {
+	if (e->op != inst->op || e->a != inst->a || e->b != inst->b) {
+		return false;
+	}
+	if (inst->op == IR_CONST) {
+		return e->imm == inst->imm;
+	}
+	if (inst->op == IR_ADDR) {
+		return same_mem(&e->mem, &inst->mem);
+	}
+	return true;
+}
+
+static int find_expr(IrInst* inst) {
+	for (int i = num_exprs - 1; i >= 0; i--) {
+		if (same_expr(&exprs[i], inst)) {
+			return exprs[i].value;
+		}
+	}
+	return -1;
+}
+
+static void push_expr(IrInst* inst) {
+	if (num_exprs == cap_exprs) {
+		cap_exprs = cap_exprs ? cap_exprs * 2 : 64;
+		exprs = realloc(exprs, sizeof(Expr) * cap_exprs);
+	}
+	exprs[num_exprs++] = (Expr){inst->op, inst->a, inst->b, inst->imm, inst->mem, inst->dst};
+}
+
+// 定数同士の演算を計算する（できなければfalse）
+static bool fold(IrOp op, int x, int y, int* result) {
+	switch (op) {
+	case IR_ADD:
+		*result = (int)((unsigned)x + (unsigned)y);
+		return true;
+	case IR_SUB:
+		*result = (int)((unsigned)x - (unsigned)y);
+		return true;
+	case IR_MUL:
+		*result = (int)((unsigned)x * (unsigned)y);
+		return true;
+	case IR_DIV:
+	case IR_MOD:
+		if (y == 0 || (x == INT_MIN && y == -1)) {
+			return false;
+		}
+		*result = op == IR_DIV ? x / y : x % y;
+		return true;
+	case IR_EQ:
+		*result = x == y;
+		return true;
+	case IR_NE:
+		*result = x != y;
+		return true;
+	case IR_LT:
+		*result = x < y;
+		return true;
+	case IR_LE:
+		*result = x <= y;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void make_const(IrInst* inst, int val) {
+	inst->op = IR_CONST;
+	inst->imm = val;
+	inst->a = inst->b = -1;
+	is_const[inst->dst] = true;
+	const_value[inst->dst] = val;
+}
+
+static bool has_const(int v, int val) {
+	return is_const[v] && const_value[v] == val;
+}
+
+// 定数の畳み込みと恒等式。命令が値1つに置き換わるならその値を返す
+static int simplify_inst(IrInst* inst) {
+	int a = inst->a;
+	int b = inst->b;
+	int val;
+	if (is_const[a] && is_const[b] && fold(inst->op, const_value[a], const_value[b], &val)) {
+		make_const(inst, val);
+		return -1;
+	}
+	switch (inst->op) {
+	case IR_ADD:
+		if (has_const(b, 0)) {
+			return a;
+		}
+		if (has_const(a, 0)) {
+			return b;
+		}
+		break;
+	case IR_SUB:
+		if (has_const(b, 0)) {
+			return a;
+		}
+		if (a == b) {
+			make_const(inst, 0);
+		}
+		break;
+	case IR_MUL:
+		if (has_const(b, 1)) {
+			return a;
+		}
+		if (has_const(a, 1)) {
+			return b;
+		}
+		if (has_const(a, 0) || has_const(b, 0)) {
+			make_const(inst, 0);
+		}
+		break;
+	case IR_DIV:
+		if (has_const(b, 1)) {
+			return a;
+		}
+		break;
+	case IR_MOD:
+		if (has_const(b, 1) || has_const(b, -1)) {
+			make_const(inst, 0);
+		}
+		break;
+	case IR_EQ:
+	case IR_LE:
+		if (a == b) {
+			make_const(inst, 1);
+		}
+		break;
+	case IR_NE:
+	case IR_LT:
+		if (a == b) {
+			make_const(inst, 0);
+		}
+		break;
+	default:
+		break;
+	}
+	// 可換な演算はオペランドの順をそろえて同じ式として見つける
+	if ((inst->op == IR_ADD || inst->op == IR_MUL || inst->op == IR_EQ || inst->op == IR_NE) && a > b) {
+		inst->a = b;
+		inst->b = a;
+	}
+	return -1;
+}
+
+static void replace(IrInst* inst, int v) {
+	alias[inst->dst] = v;
+	remove_inst(inst);
+}
+
+static void number_block(BasicBlock* bb) {
+	int saved_exprs = num_exprs;
+	int saved_events = num_events;
+	int saved_first = first_event;
+	// 合流点では先行ブロックごとにメモリの値が違いうる
+	if (bb->num_preds != 1) {
+		first_event = num_events;
+	}
+
+	IrInst* next;
+	for (IrInst* inst = bb->first; inst; inst = next) {
+		next = inst->next;
+		if (inst->op == IR_PHI) {
+			continue;
+		}
+		int* ops[3 + inst->num_args];
+		int num_ops = inst_operands(inst, ops);
+		for (int j = 0; j < num_ops; j++) {
+			*ops[j] = resolve(*ops[j]);
+		}
+
+		switch (inst->op) {
+		case IR_COPY:
+			replace(inst, inst->a);
+			break;
+		case IR_ADD:
+		case IR_SUB:
+		case IR_MUL:
+		case IR_DIV:
+		case IR_MOD:
+		case IR_EQ:
+		case IR_NE:
+		case IR_LT:
+		case IR_LE: {
+			int v = simplify_inst(inst);
+			if (v >= 0) {
+				replace(inst, v);
+				break;
+			}
+		}
+			// fallthrough
+		case IR_CONST:
+		case IR_ADDR: {
+			if (inst->op == IR_CONST) {
+				is_const[inst->dst] = true;
+				const_value[inst->dst] = inst->imm;
+			}
+			int v = find_expr(inst);
+			if (v >= 0) {
+				replace(inst, v);
+			} else {
+				push_expr(inst);
+			}
+			break;
+		}
+		case IR_LOAD: {
+			int v = memory_value(&inst->mem);
+			if (v >= 0) {
+				replace(inst, v);
+			} else {
+				push_event(EV_LOAD, inst->mem, inst->dst);
+			}
+			break;
+		}
+		case IR_STORE:
+			// 同じ値が入っている場所への書き込みは不要
+			if (memory_value(&inst->mem) == inst->a) {
+				remove_inst(inst);
+			} else {
+				push_event(EV_STORE, inst->mem, inst->a);
+			}
+			break;
+		case IR_CALL:
+		case IR_STACK:
+			push_event(EV_CALL, inst->mem, -1);
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (int i = 0; i < num_children[bb->rpo]; i++) {
+		number_block(children[bb->rpo][i]);
+	}
+	num_exprs = saved_exprs;
+	num_events = saved_events;
+	first_event = saved_first;
+}
+
+// 値が定数になったswitchを、一致するcase（なければdefault）への無条件の分岐にする
+// switchの後続はすべて異なる基本ブロック
+static void fold_switch(BasicBlock* bb) {
+	IrInst* sw = bb->last;
+	int taken = 0;
+	for (int i = 0; i < sw->num_cases; i++) {
+		if (sw->cases[i] == const_value[sw->a]) {
+			taken = i + 1;
+		}
+	}
+	BasicBlock* target = bb->succs[taken];
+	for (int s = 0; s < bb->num_succs; s++) {
+		if (s != taken) {
+			remove_pred(bb->succs[s], bb);
+		}
+	}
+	remove_inst(sw);
+	append_inst(bb, new_inst(IR_JUMP));
+	bb->succs[0] = target;
+	bb->num_succs = 1;
+}
+
+// 条件が定数になった分岐を無条件の分岐にする
+static void fold_branches(IrFunc* f) {
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		IrInst* br = bb->last;
+		int taken;
+		if (br->op == IR_SWITCH && is_const[br->a]) {
+			fold_switch(bb);
+			continue;
+		}
+		if (br->op != IR_BRANCH) {
+			continue;
+		}
+		if (is_const[br->a] && is_const[br->b]) {
+			fold(br->cmp, const_value[br->a], const_value[br->b], &taken);
+		} else if (br->a == br->b) {
+			taken = br->cmp == IR_EQ || br->cmp == IR_LE;
+		} else {
+			continue;
+		}
+		BasicBlock* target = bb->succs[taken ? 0 : 1];
+		BasicBlock* other = bb->succs[taken ? 1 : 0];
+		remove_inst(br);
+		append_inst(bb, new_inst(IR_JUMP));
+		bb->succs[0] = target;
+		bb->num_succs = 1;
+		if (other != target) {
+			remove_pred(other, bb);
+		}
+	}
+}
+
+// 同じ値を求める命令と、同じ場所を読み直す命令を取り除く
+void number_values(IrFunc* f) {
+	compute_cfg(f);
+	compute_dominators(f);
+	locals = f->func->locals;
+
+	int n = f->num_values;
+	alias = malloc(sizeof(int) * n);
+	is_const = calloc(n, sizeof(bool));
+	const_value = calloc(n, sizeof(int));
+	for (int v = 0; v < n; v++) {
+		alias[v] = v;
+	}
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			if (inst->op == IR_CONST) {
+				is_const[inst->dst] = true;
+				const_value[inst->dst] = inst->imm;
+			}
+		}
+	}
+	analyze_objects(f);
+
+	children = calloc(f->num_blocks, sizeof(BasicBlock**));
+	num_children = calloc(f->num_blocks, sizeof(int));
+	for (int i = 1; i < f->num_blocks; i++) {
+		int p = f->blocks[i]->idom->rpo;
+		children[p] = realloc(children[p], sizeof(BasicBlock*) * (num_children[p] + 1));
+		children[p][num_children[p]++] = f->blocks[i];
+	}
+	num_exprs = num_events = first_event = 0;
+	number_block(f->entry);
+
+	// φ関数の引数は支配木で後から訪れる基本ブロックの値でありうる
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			int* ops[3 + inst->num_args];
+			int num_ops = inst_operands(inst, ops);
+			for (int j = 0; j < num_ops; j++) {
+				*ops[j] = resolve(*ops[j]);
+			}
+		}
+	}
+	for (int i = 0; i < f->num_blocks; i++) {
+		free(children[i]);
+	}
+	free(children);
+	free(num_children);
+	free(exprs);
+	free(events);
+	free(objects);
+	free(object_of);
+	free(offset_of);
+	free(offset_known);
+	free(alias);
+	fold_branches(f);
+	compute_cfg(f);
+	free(is_const);
+	free(const_value);
+	exprs = NULL;
+	events = NULL;
+	cap_exprs = cap_events = 0;
+}
@@ -0,0 +1,168 @@
+#include "mipsc.h"
+
+// =============================================================================
+// if変換（-O2）
+// =============================================================================
+//
+// 条件分岐の先が少数の副作用のない命令だけを実行して合流する形（菱形・三角形）を探し、
+// その命令を分岐の前へ移して合流点のφ関数を条件付きの選択（IR_SELECT）に置き換える。
+// 選択はmovn/movzで出力するので、最小値・最大値・範囲への丸めのように
+// 値によって向きが変わる分岐がなくなる。変換した合流点は分岐元の基本ブロックにつなげ、
+// 外側の分岐も続けて変換できるようにする。
+
+#define MAX_SPECULATED 3  // 分岐の片側から前へ移す命令の数（定数を除く）
+#define MAX_SELECTS 2     // 1つの合流点で選択にするφ関数の数
+
+int if_conversion = -1;  // -f[no-]if-conversion（未指定なら-1）
+
+// 条件に関係なく実行してよい命令か（メモリはフレームとグローバル変数を読むだけ）
+static bool can_speculate(IrInst* inst) {
+	switch (inst->op) {
+	case IR_CONST:
+	case IR_COPY:
+	case IR_ADD:
+	case IR_SUB:
+	case IR_MUL:
+	case IR_EQ:
+	case IR_NE:
+	case IR_LT:
+	case IR_LE:
+	case IR_ADDR:
+	case IR_SELECT:
+		return true;
+	case IR_LOAD:
+		return inst->mem.kind != MEM_POINTER;
+	default:
+		return false;
+	}
+}
+
+// headの分岐先bbが、headからだけ入って軽い命令を実行しjoinへ抜ける基本ブロックか
+static bool is_arm(BasicBlock* bb, BasicBlock* head, BasicBlock* join) {
+	if (bb == head || bb == join || bb->num_preds != 1 || bb->preds[0] != head ||
+	    bb->num_succs != 1 || bb->succs[0] != join || bb->last->op != IR_JUMP) {
+		return false;
+	}
+	int count = 0;
+	for (IrInst* inst = bb->first; inst != bb->last; inst = inst->next) {
+		if (!can_speculate(inst)) {
+			return false;
+		}
+		if (inst->op != IR_CONST) {
+			count++;
+		}
+	}
+	return count <= MAX_SPECULATED;
+}
+
+// bbの終端以外の命令をposの前へ移す
+static void hoist_arm(BasicBlock* bb, IrInst* pos) {
+	while (bb->first != bb->last) {
+		IrInst* inst = bb->first;
+		remove_inst(inst);
+		insert_inst_before(pos, inst);
+	}
+}
+
+// 先行ブロックがheadだけになったjoinをheadの後ろにつなげる
+static void merge_block(BasicBlock* head, BasicBlock* join) {
+	remove_inst(head->last);
+	while (join->first) {
+		IrInst* inst = join->first;
+		remove_inst(inst);
+		append_inst(head, inst);
+	}
+	head->succs = join->succs;
+	head->num_succs = join->num_succs;
+	for (int i = 0; i < head->num_succs; i++) {
+		BasicBlock* succ = head->succs[i];
+		for (int j = 0; j < succ->num_preds; j++) {
+			if (succ->preds[j] == join) {
+				succ->preds[j] = head;
+			}
+		}
+	}
+	join->succs = NULL;
+	join->num_succs = 0;
+	join->num_preds = 0;
+}
+
+// headの分岐を選択に置き換えられれば置き換える
+static bool convert_branch(IrFunc* f, BasicBlock* head) {
+	IrInst* br = head->last;
+	if (br->op != IR_BRANCH || head->succs[0] == head->succs[1]) {
+		return false;
+	}
+	// 条件が成り立つとき・成り立たないときに合流点へ入ってくる基本ブロック
+	BasicBlock* then = head->succs[0];
+	BasicBlock* els = head->succs[1];
+	BasicBlock* join;
+	if (then->num_succs == 1 && is_arm(then, head, then->succs[0]) &&
+	    is_arm(els, head, then->succs[0])) {
+		join = then->succs[0];
+	} else if (is_arm(then, head, els)) {
+		join = els;
+		els = head;
+	} else if (is_arm(els, head, then)) {
+		join = then;
+		then = head;
+	} else {
+		return false;
+	}
+	if (join == head || join == f->entry || join->num_preds != 2) {
+		return false;
+	}
+	int num_phis = 0;
+	for (IrInst* inst = join->first; inst && inst->op == IR_PHI; inst = inst->next) {
+		num_phis++;
+	}
+	if (num_phis > MAX_SELECTS) {
+		return false;
+	}
+
+	int then_index = pred_index(join, then);
+	int els_index = pred_index(join, els);
+	if (then != head) {
+		hoist_arm(then, br);
+	}
+	if (els != head) {
+		hoist_arm(els, br);
+	}
+	while (join->first->op == IR_PHI) {
+		IrInst* phi = join->first;
+		IrInst* select = new_inst(IR_SELECT);
+		select->dst = phi->dst;
+		select->a = br->a;
+		select->b = br->b;
+		select->cmp = br->cmp;
+		select->args = malloc(sizeof(int) * 2);
+		select->args[0] = phi->args[then_index];
+		select->args[1] = phi->args[els_index];
+		select->num_args = 2;
+		remove_inst(phi);
+		insert_inst_before(br, select);
+	}
+	remove_inst(br);
+	append_inst(head, new_inst(IR_JUMP));
+	head->succs[0] = join;
+	head->num_succs = 1;
+	join->preds[0] = head;
+	join->num_preds = 1;
+	merge_block(head, join);
+	return true;
+}
+
+// 逆後順に分岐を調べ、変換できなくなるまで繰り返す（内側の分岐から外側へ広がる）
+void convert_ifs(IrFunc* f) {
+	compute_cfg(f);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 0; i < f->num_blocks; i++) {
+			if (f->blocks[i]->num_succs == 2 && convert_branch(f, f->blocks[i])) {
+				changed = true;
+			}
+		}
+		compute_cfg(f);
+	}
+}
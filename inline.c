@@ -0,0 +1,314 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 関数のインライン展開（-O1以上）
+// =============================================================================
+//
+// 小さい関数と呼び出し元が1箇所だけの関数について、ND_CALLを関数本体の複製
+// （ND_INLINE）に置き換える。引数とローカル変数は呼び出し元のフレームに新しい
+// 領域を割り当てて付け替え、引数の値は本体の先頭で代入する。
+// 本体中のreturnはコード生成で展開の末尾への分岐になる。
+// 再帰（相互再帰を含む）する関数は展開しない。
+
+#define INLINE_SMALL_SIZE 40  // 常に展開する関数本体の大きさ（ノード数）
+#define INLINE_ONCE_SIZE 400  // 呼び出し元が1箇所なら展開する大きさ
+
+// 関数ごとの解析結果
+typedef struct {
+	Function* func;
+	int size;        // 本体のノード数
+	int call_sites;  // プログラム全体での呼び出し箇所の数
+	bool recursive;  // 自分自身へ戻る呼び出し経路がある
+	int state;       // 0: 未処理, 1: 展開中, 2: 展開済み
+} InlineInfo;
+
+static InlineInfo* infos;
+static int num_infos;
+
+// 変数オフセットの付け替え表
+typedef struct {
+	int from;
+	int to;
+} OffsetMap;
+
+static InlineInfo* lookup_info(char* name) {
+	for (int i = 0; i < num_infos; i++) {
+		if (strcmp(infos[i].func->name, name) == 0) {
+			return &infos[i];
+		}
+	}
+	return NULL;
+}
+
+static bool is_printf_call(Node* node) {
+	return node->kind == ND_CALL && strcmp(node->name, "printf") == 0;
+}
+
+static bool count_node(Node* node, void* data) {
+	(*(int*)data)++;
+	return false;
+}
+
+static int tree_size(Node* func) {
+	int size = 0;
+	for (int i = 0; func->body[i]; i++) {
+		tree_any(func->body[i], count_node, &size);
+	}
+	return size;
+}
+
+static bool count_call(Node* node, void* data) {
+	if (node->kind == ND_CALL) {
+		InlineInfo* info = lookup_info(node->name);
+		if (info) {
+			info->call_sites++;
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// 再帰の検出
+// -----------------------------------------------------------------------------
+
+// 関数fromがtargetを（直接または間接に）呼ぶか。visitedで同じ関数を二度調べない
+typedef struct {
+	char* target;
+	bool* visited;
+} ReachQuery;
+
+static bool calls_target(Node* node, void* data);
+
+static bool reaches(Function* from, ReachQuery* query) {
+	InlineInfo* info = lookup_info(from->name);
+	int idx = info - infos;
+	if (query->visited[idx]) {
+		return false;
+	}
+	query->visited[idx] = true;
+	for (int i = 0; from->node->body[i]; i++) {
+		if (tree_any(from->node->body[i], calls_target, query)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool calls_target(Node* node, void* data) {
+	ReachQuery* query = data;
+	if (node->kind != ND_CALL) {
+		return false;
+	}
+	if (strcmp(node->name, query->target) == 0) {
+		return true;
+	}
+	InlineInfo* callee = lookup_info(node->name);
+	return callee && reaches(callee->func, query);
+}
+
+static bool is_recursive(Function* func) {
+	ReachQuery query = {func->name, calloc(num_infos, sizeof(bool))};
+	bool result = reaches(func, &query);
+	free(query.visited);
+	return result;
+}
+
+// -----------------------------------------------------------------------------
+// 本体の複製
+// -----------------------------------------------------------------------------
+
+static Node* copy_tree(Node* node, OffsetMap* map, int map_size);
+
+static Node** copy_list(Node** list, OffsetMap* map, int map_size) {
+	if (!list) {
+		return NULL;
+	}
+	int n = 0;
+	while (list[n]) {
+		n++;
+	}
+	Node** copy = calloc(n + 1, sizeof(Node*));
+	for (int i = 0; i < n; i++) {
+		copy[i] = copy_tree(list[i], map, map_size);
+	}
+	return copy;
+}
+
+static Node* copy_tree(Node* node, OffsetMap* map, int map_size) {
+	if (!node) {
+		return NULL;
+	}
+	Node* copy = calloc(1, sizeof(Node));
+	*copy = *node;
+	if (node->kind == ND_LVAR) {
+		for (int i = 0; i < map_size; i++) {
+			if (map[i].from == node->offset) {
+				copy->offset = map[i].to;
+			}
+		}
+	}
+	copy->lhs = copy_tree(node->lhs, map, map_size);
+	copy->rhs = copy_tree(node->rhs, map, map_size);
+	copy->cond = copy_tree(node->cond, map, map_size);
+	copy->then = copy_tree(node->then, map, map_size);
+	copy->els = copy_tree(node->els, map, map_size);
+	copy->init = copy_tree(node->init, map, map_size);
+	copy->inc = copy_tree(node->inc, map, map_size);
+	copy->body = copy_list(node->body, map, map_size);
+	copy->args = copy_list(node->args, map, map_size);
+	return copy;
+}
+
+// 部分木を複製する
+Node* copy_expr(Node* node) {
+	return copy_tree(node, NULL, 0);
+}
+
+// 呼び出し元のフレームに変数の領域を追加し、そのオフセットを返す
+int add_frame_var(Function* caller, LVar* var) {
+	int min_offset = ARG_SAVE_OFFSET;
+	for (LVar* v = caller->locals; v; v = v->next) {
+		if (v->offset < min_offset) {
+			min_offset = v->offset;
+		}
+	}
+	int size = size_of(var->type);
+	if (size < MIN_ALIGNMENT) {
+		size = MIN_ALIGNMENT;
+	}
+	LVar* copy = calloc(1, sizeof(LVar));
+	*copy = *var;
+	copy->offset = min_offset - size;
+	copy->next = caller->locals;
+	caller->locals = copy;
+	return copy->offset;
+}
+
+// 呼び出しcallを関数calleeの本体の複製に置き換えたノードを作る
+static Node* expand_call(Function* caller, Function* callee, Node* call) {
+	int map_size = 0;
+	for (LVar* var = callee->locals; var; var = var->next) {
+		map_size++;
+	}
+	OffsetMap* map = calloc(map_size, sizeof(OffsetMap));
+	int n = 0;
+	for (LVar* var = callee->locals; var; var = var->next) {
+		map[n].from = var->offset;
+		map[n].to = add_frame_var(caller, var);
+		n++;
+	}
+
+	// 引数の代入 + 本体
+	Node** callee_body = callee->node->body;
+	int body_len = 0;
+	while (callee_body[body_len]) {
+		body_len++;
+	}
+	Node** body = calloc(call->argc + body_len + 1, sizeof(Node*));
+	for (int i = 0; i < call->argc; i++) {
+		Node* param = calloc(1, sizeof(Node));
+		param->kind = ND_LVAR;
+		param->offset = ARG_SAVE_OFFSET - (i + 1) * ARG_SIZE;
+		body[i] = new_node(ND_ASSIGN, copy_tree(param, map, map_size), call->args[i]);
+	}
+	for (int i = 0; i < body_len; i++) {
+		body[call->argc + i] = copy_tree(callee_body[i], map, map_size);
+	}
+	free(map);
+
+	Node* node = new_node(ND_INLINE, NULL, NULL);
+	node->name = callee->name;
+	node->body = body;
+	return node;
+}
+
+// -----------------------------------------------------------------------------
+// 展開
+// -----------------------------------------------------------------------------
+
+static void inline_into(InlineInfo* info);
+
+// 呼び出しを展開するか（呼び出し先の展開は済ませておく）
+static bool should_inline(Node* call) {
+	InlineInfo* callee = lookup_info(call->name);
+	if (!callee || callee->recursive || strcmp(call->name, "main") == 0) {
+		return false;
+	}
+	// 4つを超える引数はレジスタで渡せないため元から扱えない
+	if (call->argc != callee->func->node->argc || call->argc > 4) {
+		return false;
+	}
+	inline_into(callee);
+	if (callee->size <= INLINE_SMALL_SIZE) {
+		return true;
+	}
+	return callee->call_sites == 1 && callee->size <= INLINE_ONCE_SIZE;
+}
+
+// 部分木の中の呼び出しを展開する
+// printfと組み込み関数の引数はスタックマシンで生成されるため対象にしない
+static Node* inline_tree(Function* caller, Node* node) {
+	if (!node) {
+		return NULL;
+	}
+	if (node->kind == ND_BUILTIN_CALL || is_printf_call(node)) {
+		return node;
+	}
+	node->lhs = inline_tree(caller, node->lhs);
+	node->rhs = inline_tree(caller, node->rhs);
+	node->cond = inline_tree(caller, node->cond);
+	node->then = inline_tree(caller, node->then);
+	node->els = inline_tree(caller, node->els);
+	node->init = inline_tree(caller, node->init);
+	node->inc = inline_tree(caller, node->inc);
+	for (int i = 0; node->body && node->body[i]; i++) {
+		node->body[i] = inline_tree(caller, node->body[i]);
+	}
+	for (int i = 0; node->args && node->args[i]; i++) {
+		node->args[i] = inline_tree(caller, node->args[i]);
+	}
+	if (node->kind == ND_CALL && should_inline(node)) {
+		return expand_call(caller, lookup_info(node->name)->func, node);
+	}
+	return node;
+}
+
+static void inline_into(InlineInfo* info) {
+	if (info->state != 0) {
+		return;
+	}
+	info->state = 1;
+	Node* func = info->func->node;
+	for (int i = 0; func->body[i]; i++) {
+		func->body[i] = inline_tree(info->func, func->body[i]);
+	}
+	info->size = tree_size(func);
+	info->state = 2;
+}
+
+void inline_functions(void) {
+	num_infos = 0;
+	for (Function* f = functions; f; f = f->next) {
+		num_infos++;
+	}
+	infos = calloc(num_infos, sizeof(InlineInfo));
+	int n = 0;
+	for (Function* f = functions; f; f = f->next) {
+		infos[n].func = f;
+		infos[n].size = tree_size(f->node);
+		n++;
+	}
+	for (int i = 0; i < num_infos; i++) {
+		Node* func = infos[i].func->node;
+		for (int j = 0; func->body[j]; j++) {
+			tree_any(func->body[j], count_call, NULL);
+		}
+	}
+	for (int i = 0; i < num_infos; i++) {
+		infos[i].recursive = is_recursive(infos[i].func);
+	}
+	for (int i = 0; i < num_infos; i++) {
+		inline_into(&infos[i]);
+	}
+	free(infos);
+}
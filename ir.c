@@ -0,0 +1,436 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 中間表現（-O2）
+// =============================================================================
+//
+// 構文木を関数ごとに3番地コードへ変換し（ir_lower.c）、基本ブロックの
+// 制御フローグラフの上で最適化してから（ssa.c、gvn.c）、レジスタを割り当てて
+// アセンブリを出力する（codegen_ir.c）。
+// ここでは命令と基本ブロックの操作、制御フローグラフと支配木の計算、
+// デバッグ用の出力をまとめる。
+
+IrFunc* new_ir_func(Node* node) {
+	IrFunc* f = calloc(1, sizeof(IrFunc));
+	f->node = node;
+	f->func = lookup_function(node->name);
+	return f;
+}
+
+BasicBlock* new_basic_block(IrFunc* f) {
+	if (f->num_blocks == f->cap_blocks) {
+		f->cap_blocks = f->cap_blocks ? f->cap_blocks * 2 : 16;
+		f->blocks = realloc(f->blocks, sizeof(BasicBlock*) * f->cap_blocks);
+	}
+	BasicBlock* bb = calloc(1, sizeof(BasicBlock));
+	bb->id = f->num_blocks;
+	bb->rpo = -1;
+	f->blocks[f->num_blocks++] = bb;
+	return bb;
+}
+
+int new_value(IrFunc* f) {
+	return f->num_values++;
+}
+
+IrInst* new_inst(IrOp op) {
+	IrInst* inst = calloc(1, sizeof(IrInst));
+	inst->op = op;
+	inst->dst = -1;
+	inst->a = -1;
+	inst->b = -1;
+	return inst;
+}
+
+void append_inst(BasicBlock* bb, IrInst* inst) {
+	inst->block = bb;
+	inst->prev = bb->last;
+	inst->next = NULL;
+	if (bb->last) {
+		bb->last->next = inst;
+	} else {
+		bb->first = inst;
+	}
+	bb->last = inst;
+}
+
+void insert_inst_before(IrInst* pos, IrInst* inst) {
+	BasicBlock* bb = pos->block;
+	inst->block = bb;
+	inst->prev = pos->prev;
+	inst->next = pos;
+	if (pos->prev) {
+		pos->prev->next = inst;
+	} else {
+		bb->first = inst;
+	}
+	pos->prev = inst;
+}
+
+void remove_inst(IrInst* inst) {
+	BasicBlock* bb = inst->block;
+	if (inst->prev) {
+		inst->prev->next = inst->next;
+	} else {
+		bb->first = inst->next;
+	}
+	if (inst->next) {
+		inst->next->prev = inst->prev;
+	} else {
+		bb->last = inst->prev;
+	}
+	inst->prev = inst->next = NULL;
+}
+
+bool is_terminator(IrOp op) {
+	return op == IR_JUMP || op == IR_BRANCH || op == IR_SWITCH || op == IR_RET || op == IR_TAIL_CALL;
+}
+
+// 結果を使わなくても削除できない命令か
+bool inst_has_side_effect(IrInst* inst) {
+	return inst->op == IR_STORE || inst->op == IR_CALL || inst->op == IR_STACK ||
+	       is_terminator(inst->op);
+}
+
+// 命令が読む値を指す場所をopsに並べ、その数を返す
+// opsには3 + num_args個の領域が必要
+int inst_operands(IrInst* inst, int** ops) {
+	int n = 0;
+	if (inst->a >= 0) {
+		ops[n++] = &inst->a;
+	}
+	if (inst->b >= 0) {
+		ops[n++] = &inst->b;
+	}
+	if ((inst->op == IR_ADDR || inst->op == IR_LOAD || inst->op == IR_STORE) &&
+	    inst->mem.kind == MEM_POINTER) {
+		ops[n++] = &inst->mem.base;
+	}
+	for (int i = 0; i < inst->num_args; i++) {
+		if (inst->args[i] >= 0) {
+			ops[n++] = &inst->args[i];
+		}
+	}
+	return n;
+}
+
+// フレーム上のoffsetを含むローカル変数（現在のlocalsから探す）
+LVar* frame_var_at(int offset) {
+	for (LVar* var = locals; var; var = var->next) {
+		int size = size_of(var->type) < MIN_ALIGNMENT ? MIN_ALIGNMENT : size_of(var->type);
+		if (offset >= var->offset && offset < var->offset + size) {
+			return var;
+		}
+	}
+	return NULL;
+}
+
+void add_succ(BasicBlock* bb, BasicBlock* succ) {
+	bb->succs = realloc(bb->succs, sizeof(BasicBlock*) * (bb->num_succs + 1));
+	bb->succs[bb->num_succs++] = succ;
+}
+
+void add_pred(BasicBlock* bb, BasicBlock* pred) {
+	bb->preds = realloc(bb->preds, sizeof(BasicBlock*) * (bb->num_preds + 1));
+	bb->preds[bb->num_preds++] = pred;
+}
+
+int pred_index(BasicBlock* bb, BasicBlock* pred) {
+	for (int i = 0; i < bb->num_preds; i++) {
+		if (bb->preds[i] == pred) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// 先行ブロックpredからの辺を取り除く（φ関数の対応する引数も消す）
+void remove_pred(BasicBlock* bb, BasicBlock* pred) {
+	int j = pred_index(bb, pred);
+	for (int i = j + 1; i < bb->num_preds; i++) {
+		bb->preds[i - 1] = bb->preds[i];
+	}
+	for (IrInst* inst = bb->first; inst && inst->op == IR_PHI; inst = inst->next) {
+		for (int i = j + 1; i < inst->num_args; i++) {
+			inst->args[i - 1] = inst->args[i];
+		}
+		inst->num_args--;
+	}
+	bb->num_preds--;
+}
+
+// -----------------------------------------------------------------------------
+// 制御フローグラフ
+// -----------------------------------------------------------------------------
+
+static void visit_postorder(BasicBlock* bb, BasicBlock** order, int* n) {
+	bb->rpo = 0;  // 訪問済み
+	for (int i = bb->num_succs - 1; i >= 0; i--) {
+		if (bb->succs[i]->rpo < 0) {
+			visit_postorder(bb->succs[i], order, n);
+		}
+	}
+	order[(*n)++] = bb;
+}
+
+// 到達しない基本ブロックを取り除き、blocksを逆後順に並べ替える
+// 先行ブロックの並びはφ関数の引数と対応するので、残ったものの順序は変えない
+void compute_cfg(IrFunc* f) {
+	for (int i = 0; i < f->num_blocks; i++) {
+		f->blocks[i]->rpo = -1;
+	}
+	BasicBlock** order = calloc(f->num_blocks, sizeof(BasicBlock*));
+	int n = 0;
+	visit_postorder(f->entry, order, &n);
+
+	for (int i = 0; i < n; i++) {
+		BasicBlock* bb = order[n - 1 - i];
+		f->blocks[i] = bb;
+		bb->rpo = i;
+	}
+	f->num_blocks = n;
+	free(order);
+
+	for (int i = 0; i < n; i++) {
+		BasicBlock* bb = f->blocks[i];
+		int k = 0;
+		for (int j = 0; j < bb->num_preds; j++) {
+			if (bb->preds[j]->rpo < 0) {
+				continue;
+			}
+			for (IrInst* inst = bb->first; inst && inst->op == IR_PHI; inst = inst->next) {
+				inst->args[k] = inst->args[j];
+			}
+			bb->preds[k++] = bb->preds[j];
+		}
+		bb->num_preds = k;
+		for (IrInst* inst = bb->first; inst && inst->op == IR_PHI; inst = inst->next) {
+			inst->num_args = k;
+		}
+	}
+}
+
+// 逆後順の番号で2つの支配木の経路が出会う基本ブロック
+static BasicBlock* intersect(BasicBlock* a, BasicBlock* b) {
+	while (a != b) {
+		while (a->rpo > b->rpo) {
+			a = a->idom;
+		}
+		while (b->rpo > a->rpo) {
+			b = b->idom;
+		}
+	}
+	return a;
+}
+
+// 各基本ブロックを直接支配する基本ブロックを求める（Cooper, Harvey, Kennedy）
+// compute_cfgの後に呼ぶ
+void compute_dominators(IrFunc* f) {
+	for (int i = 0; i < f->num_blocks; i++) {
+		f->blocks[i]->idom = NULL;
+	}
+	f->entry->idom = f->entry;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 1; i < f->num_blocks; i++) {
+			BasicBlock* bb = f->blocks[i];
+			BasicBlock* idom = NULL;
+			for (int j = 0; j < bb->num_preds; j++) {
+				BasicBlock* pred = bb->preds[j];
+				if (!pred->idom) {
+					continue;
+				}
+				idom = idom ? intersect(pred, idom) : pred;
+			}
+			if (bb->idom != idom) {
+				bb->idom = idom;
+				changed = true;
+			}
+		}
+	}
+	f->entry->idom = NULL;
+}
+
+// -----------------------------------------------------------------------------
+// 生存解析
+// -----------------------------------------------------------------------------
+//
+// 値の集合はビット列で表す。φ関数の引数は対応する先行ブロックの出口で使われるものとし、
+// φ関数の結果は基本ブロックの入口で定義されるものとする。
+
+unsigned* new_value_set(IrFunc* f) {
+	return calloc((f->num_values + 31) / 32, sizeof(unsigned));
+}
+
+bool set_has(unsigned* set, int v) {
+	return (set[v / 32] >> (v % 32)) & 1;
+}
+
+void set_add(unsigned* set, int v) {
+	set[v / 32] |= 1u << (v % 32);
+}
+
+// 各基本ブロックの入口と出口で生きている値を求める（compute_cfgの後に呼ぶ）
+void compute_liveness(IrFunc* f) {
+	int n = f->num_blocks;
+	int words = (f->num_values + 31) / 32;
+	unsigned** uses = calloc(n, sizeof(unsigned*));   // 定義より前に読む値
+	unsigned** defs = calloc(n, sizeof(unsigned*));
+	f->live_in = calloc(n, sizeof(unsigned*));
+	f->live_out = calloc(n, sizeof(unsigned*));
+
+	for (int i = 0; i < n; i++) {
+		uses[i] = new_value_set(f);
+		defs[i] = new_value_set(f);
+		f->live_in[i] = new_value_set(f);
+		f->live_out[i] = new_value_set(f);
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			if (inst->op != IR_PHI) {
+				int* ops[3 + inst->num_args];
+				int num_ops = inst_operands(inst, ops);
+				for (int j = 0; j < num_ops; j++) {
+					if (!set_has(defs[i], *ops[j])) {
+						set_add(uses[i], *ops[j]);
+					}
+				}
+			}
+			if (inst->dst >= 0) {
+				set_add(defs[i], inst->dst);
+			}
+		}
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = n - 1; i >= 0; i--) {
+			BasicBlock* bb = f->blocks[i];
+			unsigned* out = f->live_out[i];
+			for (int s = 0; s < bb->num_succs; s++) {
+				BasicBlock* succ = bb->succs[s];
+				unsigned* in = f->live_in[succ->rpo];
+				for (int w = 0; w < words; w++) {
+					out[w] |= in[w];
+				}
+				int j = pred_index(succ, bb);
+				for (IrInst* inst = succ->first; inst && inst->op == IR_PHI; inst = inst->next) {
+					if (inst->args[j] >= 0) {
+						set_add(out, inst->args[j]);
+					}
+				}
+			}
+			unsigned* in = f->live_in[i];
+			for (int w = 0; w < words; w++) {
+				unsigned v = uses[i][w] | (out[w] & ~defs[i][w]);
+				if (v != in[w]) {
+					in[w] = v;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		free(uses[i]);
+		free(defs[i]);
+	}
+	free(uses);
+	free(defs);
+}
+
+// -----------------------------------------------------------------------------
+// デバッグ用の出力（-fdump-ir）
+// -----------------------------------------------------------------------------
+
+static char* op_names[] = {
+	"const", "param", "copy", "add", "sub", "mul", "div", "mod",
+	"eq", "ne", "lt", "le", "addr", "load", "store", "call", "stack",
+	"phi", "select", "jump", "branch", "switch", "ret", "tailcall",
+};
+
+static void dump_mem(MemRef* mem, FILE* out) {
+	switch (mem->kind) {
+	case MEM_FRAME:
+		fprintf(out, "[frame%+d]", mem->offset);
+		break;
+	case MEM_GLOBAL:
+		fprintf(out, "[%s%+d]", mem->name, mem->offset);
+		break;
+	case MEM_POINTER:
+		fprintf(out, "[v%d%+d]", mem->base, mem->offset);
+		break;
+	}
+}
+
+void dump_ir(IrFunc* f, FILE* out) {
+	fprintf(out, "function %s\n", f->node->name);
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		fprintf(out, "bb%d:", bb->id);
+		if (bb->num_preds) {
+			fprintf(out, "  ; preds");
+			for (int j = 0; j < bb->num_preds; j++) {
+				fprintf(out, " bb%d", bb->preds[j]->id);
+			}
+		}
+		fprintf(out, "\n");
+		for (IrInst* inst = bb->first; inst; inst = inst->next) {
+			fprintf(out, "\t");
+			if (inst->dst >= 0) {
+				fprintf(out, "v%d = ", inst->dst);
+			}
+			fprintf(out, "%s", op_names[inst->op]);
+			switch (inst->op) {
+			case IR_CONST:
+			case IR_PARAM:
+				fprintf(out, " %d", inst->imm);
+				break;
+			case IR_ADDR:
+			case IR_LOAD:
+				fprintf(out, " ");
+				dump_mem(&inst->mem, out);
+				break;
+			case IR_STORE:
+				fprintf(out, " ");
+				dump_mem(&inst->mem, out);
+				fprintf(out, ", v%d", inst->a);
+				break;
+			case IR_CALL:
+			case IR_TAIL_CALL:
+				fprintf(out, " %s", inst->name);
+				break;
+			case IR_BRANCH:
+			case IR_SELECT:
+				fprintf(out, " %s", op_names[inst->cmp]);
+				break;
+			case IR_SWITCH:
+				for (int j = 0; j < inst->num_cases; j++) {
+					fprintf(out, "%s%d", j ? ", " : " [", inst->cases[j]);
+				}
+				fprintf(out, "%s", inst->num_cases ? "]" : "");
+				break;
+			default:
+				break;
+			}
+			if (inst->op != IR_STORE) {
+				if (inst->a >= 0) {
+					fprintf(out, " v%d", inst->a);
+				}
+				if (inst->b >= 0) {
+					fprintf(out, ", v%d", inst->b);
+				}
+			}
+			for (int j = 0; j < inst->num_args; j++) {
+				fprintf(out, "%sv%d", j || inst->a >= 0 ? ", " : " ", inst->args[j]);
+				if (inst->op == IR_PHI) {
+					fprintf(out, "(bb%d)", bb->preds[j]->id);
+				}
+			}
+			for (int j = 0; j < bb->num_succs && inst == bb->last; j++) {
+				fprintf(out, "%sbb%d", j ? ", " : " -> ", bb->succs[j]->id);
+			}
+			fprintf(out, "\n");
+		}
+	}
+}
@@ -0,0 +1,683 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 構文木から中間表現への変換（-O2）
+// =============================================================================
+//
+// 式の評価順序とポインタ演算の扱いはレジスタ割り当てモード（codegen_reg.c）に合わせる。
+// ローカル変数はすべてフレーム上のメモリとして読み書きし、レジスタに置けるものは
+// SSA形式への変換（ssa.c）で値に置き換える。三項演算子・&&・||・インライン展開の
+// 結果も一時変数を経由させ、合流点のφ関数にする。
+// printfと組み込み関数はスタックマシンの展開を使うので、先に評価してよい引数を
+// 一時変数に置き、その変数を読む式に差し替えた構文木をIR_STACKに持たせる。
+
+// break/continueの分岐先
+typedef struct LowerLoop LowerLoop;
+struct LowerLoop {
+	BasicBlock* brk;
+	BasicBlock* cont;  // ループの外のswitch文ではNULL
+	LowerLoop* next;
+};
+
+// switch文のcase/defaultラベルの基本ブロック（case_labelの番号で引く）
+typedef struct LowerSwitch LowerSwitch;
+struct LowerSwitch {
+	BasicBlock** blocks;
+	LowerSwitch* next;
+};
+
+// インライン展開の中のreturn文の行き先
+typedef struct LowerInline LowerInline;
+struct LowerInline {
+	int result;        // 結果を置く一時変数のオフセット
+	BasicBlock* end;   // 展開の末尾
+	LowerInline* next;
+};
+
+static IrFunc* fn;              // 変換中の関数
+static BasicBlock* cur;         // 命令を追加している基本ブロック
+static BasicBlock* body_start;  // 関数本体の先頭（自己末尾呼び出しの分岐先）
+static bool frame_address_taken; // ローカル変数のアドレスを取る（末尾呼び出しにしない）
+static LowerLoop* loops;
+static LowerInline* inlines;
+static LowerSwitch* switches;
+
+static int lower_expr(Node* node);
+static void lower_stmt(Node* node);
+static void lower_cond(Node* node, BasicBlock* then, BasicBlock* els);
+
+static IrInst* add_inst(IrInst* inst) {
+	append_inst(cur, inst);
+	return inst;
+}
+
+// 値を定義する命令を追加し、その値を返す
+static int add_value(IrInst* inst) {
+	inst->dst = new_value(fn);
+	add_inst(inst);
+	return inst->dst;
+}
+
+static int lower_const(int val) {
+	IrInst* inst = new_inst(IR_CONST);
+	inst->imm = val;
+	return add_value(inst);
+}
+
+static int lower_binary(IrOp op, int a, int b) {
+	IrInst* inst = new_inst(op);
+	inst->a = a;
+	inst->b = b;
+	return add_value(inst);
+}
+
+static int lower_load(MemRef mem) {
+	IrInst* inst = new_inst(IR_LOAD);
+	inst->mem = mem;
+	return add_value(inst);
+}
+
+static void lower_store(MemRef mem, int v) {
+	IrInst* inst = new_inst(IR_STORE);
+	inst->mem = mem;
+	inst->a = v;
+	add_inst(inst);
+}
+
+static MemRef frame_mem(int offset) {
+	MemRef mem = {MEM_FRAME, offset, NULL, -1};
+	return mem;
+}
+
+// -----------------------------------------------------------------------------
+// 基本ブロックの区切り
+// -----------------------------------------------------------------------------
+//
+// 分岐やreturnの後ろの文は新しい基本ブロックに置く。到達しなければ
+// compute_cfgで取り除かれる。
+
+static bool reachable(BasicBlock* bb) {
+	return bb == fn->entry || bb->num_preds > 0;
+}
+
+static void set_succ(BasicBlock* target) {
+	add_succ(cur, target);
+	add_pred(target, cur);
+}
+
+static void jump_to(BasicBlock* target) {
+	add_inst(new_inst(IR_JUMP));
+	set_succ(target);
+	cur = new_basic_block(fn);
+}
+
+// a cmp b なら then、そうでなければ els へ分岐する
+static void branch_to(IrOp cmp, int a, int b, BasicBlock* then, BasicBlock* els) {
+	if (then == els) {
+		jump_to(then);
+		return;
+	}
+	IrInst* inst = new_inst(IR_BRANCH);
+	inst->cmp = cmp;
+	inst->a = a;
+	inst->b = b;
+	add_inst(inst);
+	set_succ(then);
+	set_succ(els);
+	cur = new_basic_block(fn);
+}
+
+// 基本ブロックを終える命令（return・末尾呼び出し）
+static void terminate(IrInst* inst) {
+	add_inst(inst);
+	cur = new_basic_block(fn);
+}
+
+// bbから命令の追加を続ける。直前の基本ブロックが終わっていなければbbへ進ませる
+static void start_block(BasicBlock* bb) {
+	if (reachable(cur) || cur->first) {
+		jump_to(bb);
+	}
+	cur = bb;
+}
+
+// フレームに一時変数を追加し、そのオフセットを返す
+static int new_temp(void) {
+	LVar var = {NULL, "", 0, 0, new_type(TY_INT)};
+	int offset = add_frame_var(fn->func, &var);
+	locals = fn->func->locals;
+	return offset;
+}
+
+// -----------------------------------------------------------------------------
+// 式
+// -----------------------------------------------------------------------------
+
+// 左辺値のメモリ（gen_locと同じくメンバのオフセットは即値に畳み込む）
+static MemRef lower_mem(Node* node, int offset) {
+	MemRef mem = {MEM_FRAME, offset, NULL, -1};
+	switch (node->kind) {
+	case ND_LVAR:
+		mem.offset += node->offset;
+		return mem;
+	case ND_GVAR:
+		mem.kind = MEM_GLOBAL;
+		mem.name = node->name;
+		return mem;
+	case ND_DEREF:
+		mem.kind = MEM_POINTER;
+		mem.base = lower_expr(node->lhs);
+		return mem;
+	case ND_MEMBER:
+		return lower_mem(node->lhs, offset + lookup_member(node)->offset);
+	default:
+		error("not left value");
+	}
+	return mem;
+}
+
+static int lower_addr(Node* node) {
+	switch (node->kind) {
+	case ND_LVAR:
+	case ND_GVAR: {
+		IrInst* inst = new_inst(IR_ADDR);
+		inst->mem = lower_mem(node, 0);
+		return add_value(inst);
+	}
+	case ND_DEREF:
+		return lower_expr(node->lhs);
+	case ND_MEMBER: {
+		int v = lower_addr(node->lhs);
+		Member* member = lookup_member(node);
+		if (member->offset) {
+			v = lower_binary(IR_ADD, v, lower_const(member->offset));
+		}
+		return v;
+	}
+	default:
+		error("not left value");
+	}
+	return -1;
+}
+
+// ポインタ演算のために添字を要素サイズ倍する
+static int scale_index(int v, Type* ptr_type) {
+	int elem_size = size_of(ptr_type->ptr_to);
+	if (elem_size > 1) {
+		v = lower_binary(IR_MUL, v, lower_const(elem_size));
+	}
+	return v;
+}
+
+static int lower_compound_assign(Node* node) {
+	MemRef mem = lower_mem(node->lhs, 0);
+	int v = lower_load(mem);
+	int r = lower_expr(node->rhs);
+	IrOp op = node->kind == ND_ADD_ASSIGN ? IR_ADD :
+	          node->kind == ND_SUB_ASSIGN ? IR_SUB :
+	          node->kind == ND_MUL_ASSIGN ? IR_MUL : IR_DIV;
+	v = lower_binary(op, v, r);
+	lower_store(mem, v);
+	return v;
+}
+
+static int lower_inc_dec(Node* node, int delta, bool is_prefix) {
+	MemRef mem = lower_mem(node->lhs, 0);
+	int old = lower_load(mem);
+	int v = lower_binary(IR_ADD, old, lower_const(delta));
+	lower_store(mem, v);
+	return is_prefix ? v : old;
+}
+
+static int lower_call(Node* node) {
+	IrInst* inst = new_inst(IR_CALL);
+	inst->name = node->name;
+	inst->num_args = node->argc < 4 ? node->argc : 4;
+	inst->args = calloc(inst->num_args, sizeof(int));
+	for (int i = 0; i < inst->num_args; i++) {
+		inst->args[i] = lower_expr(node->args[i]);
+	}
+	return add_value(inst);
+}
+
+// printfと組み込み関数
+// printfの2番目以降の引数は書式の%dに出会った時点で評価されるので、
+// 副作用のあるものだけはその場で評価されるよう構文木のまま残す
+static int lower_stack(Node* node) {
+	Node* copy = calloc(1, sizeof(Node));
+	*copy = *node;
+	copy->args = calloc(node->argc + 1, sizeof(Node*));
+	for (int i = 0; i < node->argc; i++) {
+		Node* arg = node->args[i];
+		bool eager = node->kind == ND_BUILTIN_CALL || i == 0 || !has_side_effects(arg);
+		if (arg->kind == ND_NUM || arg->kind == ND_STR || !eager) {
+			copy->args[i] = arg;
+			continue;
+		}
+		int v = lower_expr(arg);
+		Node* var = new_node(ND_LVAR, NULL, NULL);
+		var->offset = new_temp();
+		lower_store(frame_mem(var->offset), v);
+		copy->args[i] = var;
+	}
+	IrInst* inst = new_inst(IR_STACK);
+	inst->node = copy;
+	return add_value(inst);
+}
+
+// インライン展開した関数本体。return文は結果を一時変数に置いて末尾へ分岐する
+static int lower_inline(Node* node) {
+	LowerInline context = {new_temp(), new_basic_block(fn), inlines};
+	inlines = &context;
+
+	bool has_return = false;
+	for (int i = 0; node->body[i]; i++) {
+		lower_stmt(node->body[i]);
+		if (node->body[i]->kind == ND_RETURN) {
+			has_return = true;
+			break;
+		}
+	}
+	if (!has_return) {
+		lower_store(frame_mem(context.result), lower_const(0));
+	}
+	start_block(context.end);
+
+	inlines = context.next;
+	return lower_load(frame_mem(context.result));
+}
+
+// 条件式の値（0か1）を一時変数に求める（三項演算子・&&・||）
+static int lower_cond_value(Node* node) {
+	int result = new_temp();
+	BasicBlock* then = new_basic_block(fn);
+	BasicBlock* els = new_basic_block(fn);
+	BasicBlock* join = new_basic_block(fn);
+	Node* rhs = node->rhs;  // &&/||で結果を決める右辺
+
+	switch (node->kind) {
+	case ND_TERNARY:
+		lower_cond(node->cond, then, els);
+		cur = then;
+		lower_store(frame_mem(result), lower_expr(node->then));
+		jump_to(join);
+		cur = els;
+		lower_store(frame_mem(result), lower_expr(node->els));
+		break;
+	case ND_AND:
+		// 左辺が偽なら0、真なら右辺の真偽
+		lower_cond(node->lhs, then, els);
+		cur = els;
+		lower_store(frame_mem(result), lower_const(0));
+		jump_to(join);
+		cur = then;
+		lower_store(frame_mem(result), lower_binary(IR_NE, lower_expr(rhs), lower_const(0)));
+		break;
+	default:
+		// 左辺が真なら1、偽なら右辺の真偽
+		lower_cond(node->lhs, then, els);
+		cur = then;
+		lower_store(frame_mem(result), lower_const(1));
+		jump_to(join);
+		cur = els;
+		lower_store(frame_mem(result), lower_binary(IR_NE, lower_expr(rhs), lower_const(0)));
+		break;
+	}
+	start_block(join);
+	return lower_load(frame_mem(result));
+}
+
+static IrOp binary_op(NodeKind kind) {
+	switch (kind) {
+	case ND_ADD: return IR_ADD;
+	case ND_SUB: return IR_SUB;
+	case ND_MUL: return IR_MUL;
+	case ND_DIV: return IR_DIV;
+	case ND_MOD: return IR_MOD;
+	case ND_EQ: return IR_EQ;
+	case ND_NE: return IR_NE;
+	case ND_LT: return IR_LT;
+	case ND_LE: return IR_LE;
+	default:
+		error("unsupported expression");
+	}
+	return IR_ADD;
+}
+
+// 式を変換し、その値を返す
+static int lower_expr(Node* node) {
+	switch (node->kind) {
+	case ND_NUM:
+		return lower_const(node->val);
+	case ND_STR: {
+		IrInst* inst = new_inst(IR_ADDR);
+		inst->mem.kind = MEM_GLOBAL;
+		inst->mem.name = calloc(1, 32);
+		sprintf(inst->mem.name, ".L_str_%d", add_string_literal(node));
+		return add_value(inst);
+	}
+	case ND_LVAR:
+	case ND_GVAR:
+		if (is_array_var(node)) {
+			// 配列はアドレス（配列→ポインタ変換）
+			return lower_addr(node);
+		}
+		return lower_load(lower_mem(node, 0));
+	case ND_DEREF:
+	case ND_MEMBER:
+		return lower_load(lower_mem(node, 0));
+	case ND_ADDR:
+		return lower_addr(node->lhs);
+	case ND_ASSIGN: {
+		MemRef mem = lower_mem(node->lhs, 0);
+		int v = lower_expr(node->rhs);
+		lower_store(mem, v);
+		return v;
+	}
+	case ND_ADD_ASSIGN:
+	case ND_SUB_ASSIGN:
+	case ND_MUL_ASSIGN:
+	case ND_DIV_ASSIGN:
+		return lower_compound_assign(node);
+	case ND_PRE_INC:
+		return lower_inc_dec(node, 1, true);
+	case ND_POST_INC:
+		return lower_inc_dec(node, 1, false);
+	case ND_PRE_DEC:
+		return lower_inc_dec(node, -1, true);
+	case ND_POST_DEC:
+		return lower_inc_dec(node, -1, false);
+	case ND_CALL:
+		if (strcmp(node->name, "printf") == 0) {
+			return lower_stack(node);
+		}
+		return lower_call(node);
+	case ND_BUILTIN_CALL:
+		return lower_stack(node);
+	case ND_INLINE:
+		return lower_inline(node);
+	case ND_NOT:
+		return lower_binary(IR_EQ, lower_expr(node->lhs), lower_const(0));
+	case ND_TERNARY:
+	case ND_AND:
+	case ND_OR:
+		return lower_cond_value(node);
+	default:
+		break;
+	}
+
+	IrOp op = binary_op(node->kind);
+	int a = lower_expr(node->lhs);
+	int b = lower_expr(node->rhs);
+	if (node->kind == ND_ADD) {
+		Type* left_type = get_type(node->lhs);
+		Type* right_type = get_type(node->rhs);
+		if (left_type->ty == TY_PTR || left_type->ty == TY_ARRAY) {
+			b = scale_index(b, left_type);
+		} else if (right_type->ty == TY_PTR || right_type->ty == TY_ARRAY) {
+			a = scale_index(a, right_type);
+		}
+	}
+	return lower_binary(op, a, b);
+}
+
+// 条件式nodeが真ならthen、偽ならelsへ分岐する
+static void lower_cond(Node* node, BasicBlock* then, BasicBlock* els) {
+	switch (node->kind) {
+	case ND_NUM:
+		jump_to(node->val ? then : els);
+		return;
+	case ND_NOT:
+		lower_cond(node->lhs, els, then);
+		return;
+	case ND_AND:
+	case ND_OR: {
+		BasicBlock* rhs = new_basic_block(fn);
+		if (node->kind == ND_AND) {
+			lower_cond(node->lhs, rhs, els);
+		} else {
+			lower_cond(node->lhs, then, rhs);
+		}
+		cur = rhs;
+		lower_cond(node->rhs, then, els);
+		return;
+	}
+	case ND_EQ:
+	case ND_NE:
+	case ND_LT:
+	case ND_LE: {
+		int a = lower_expr(node->lhs);
+		int b = lower_expr(node->rhs);
+		branch_to(binary_op(node->kind), a, b, then, els);
+		return;
+	}
+	default:
+		branch_to(IR_NE, lower_expr(node), lower_const(0), then, els);
+		return;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// 文
+// -----------------------------------------------------------------------------
+
+static bool count_node(Node* node, void* data) {
+	(*(int*)data)++;
+	return false;
+}
+
+// while/forは末尾で条件を判定する形にする（gen_loopと同じ）
+static void lower_loop(Node* node) {
+	if (node->init) {
+		lower_expr(node->init);
+	}
+	BasicBlock* body = new_basic_block(fn);
+	BasicBlock* cont = new_basic_block(fn);
+	BasicBlock* test = new_basic_block(fn);
+	BasicBlock* exit = new_basic_block(fn);
+
+	// 小さい条件は入口に複製し、大きい条件は最初に末尾の判定へ進む
+	int cond_size = 0;
+	tree_any(node->cond, count_node, &cond_size);
+	bool guard = node->cond && cond_size <= ROTATE_MAX_COND_SIZE;
+	if (guard) {
+		lower_cond(node->cond, body, exit);
+	} else if (node->cond) {
+		jump_to(test);
+	} else {
+		jump_to(body);
+	}
+
+	LowerLoop loop = {exit, cont, loops};
+	loops = &loop;
+	cur = body;
+	lower_stmt(node->then);
+	start_block(cont);
+	if (node->inc) {
+		lower_stmt(node->inc);
+	}
+	start_block(test);
+	if (node->cond) {
+		lower_cond(node->cond, body, exit);
+	} else {
+		jump_to(body);
+	}
+	loops = loop.next;
+	cur = exit;
+}
+
+// switch文はcaseごとに別の基本ブロックへ分岐するIR_SWITCHにする
+// defaultがなければswitch文の後ろへ進む基本ブロックを挟み、後続が重ならないようにする
+static void lower_switch(Node* node) {
+	SwitchCases sc = {0};
+	collect_switch_cases(node->then, &sc);
+	IrInst* inst = new_inst(IR_SWITCH);
+	inst->a = lower_expr(node->cond);
+	inst->num_cases = sc.num_cases;
+	inst->cases = calloc(sc.num_cases + 1, sizeof(int));
+	add_inst(inst);
+
+	BasicBlock* exit = new_basic_block(fn);
+	BasicBlock** blocks = calloc(sc.num_cases + 1, sizeof(BasicBlock*));
+	BasicBlock* dflt = new_basic_block(fn);
+	set_succ(dflt);
+	for (int i = 0; i < sc.num_cases; i++) {
+		blocks[i] = new_basic_block(fn);
+		sc.cases[i]->case_label = i;
+		inst->cases[i] = sc.cases[i]->val;
+		set_succ(blocks[i]);
+	}
+	if (sc.default_case) {
+		sc.default_case->case_label = sc.num_cases;
+		blocks[sc.num_cases] = dflt;
+		cur = new_basic_block(fn);
+	} else {
+		cur = dflt;
+		jump_to(exit);
+	}
+
+	LowerSwitch sw = {blocks, switches};
+	LowerLoop loop = {exit, loops ? loops->cont : NULL, loops};
+	switches = &sw;
+	loops = &loop;
+	lower_stmt(node->then);
+	loops = loop.next;
+	switches = sw.next;
+	start_block(exit);
+	free(blocks);
+	free(sc.cases);
+}
+
+// return文の値が末尾呼び出しとして生成できる呼び出しか（is_tail_callと同じ条件）
+static bool is_tail_call(Node* node) {
+	if (!node || node->kind != ND_CALL || strcmp(node->name, "printf") == 0 || node->argc > 4 ||
+	    frame_address_taken) {
+		return false;
+	}
+	return strcmp(node->name, fn->node->name) != 0 || node->argc == fn->node->argc;
+}
+
+static void lower_tail_call(Node* node) {
+	int args[4];
+	for (int i = 0; i < node->argc; i++) {
+		args[i] = lower_expr(node->args[i]);
+	}
+	if (strcmp(node->name, fn->node->name) == 0) {
+		// 引数を書き換えて関数本体の先頭へ戻る
+		for (int i = 0; i < node->argc; i++) {
+			lower_store(frame_mem(ARG_SAVE_OFFSET - (i + 1) * ARG_SIZE), args[i]);
+		}
+		jump_to(body_start);
+		return;
+	}
+	IrInst* inst = new_inst(IR_TAIL_CALL);
+	inst->name = node->name;
+	inst->num_args = node->argc;
+	inst->args = calloc(node->argc, sizeof(int));
+	memcpy(inst->args, args, sizeof(int) * node->argc);
+	terminate(inst);
+}
+
+static void lower_stmt(Node* node) {
+	switch (node->kind) {
+	case ND_BLOCK:
+		for (int i = 0; node->body[i]; i++) {
+			lower_stmt(node->body[i]);
+		}
+		return;
+	case ND_IF: {
+		BasicBlock* then = new_basic_block(fn);
+		BasicBlock* join = new_basic_block(fn);
+		BasicBlock* els = node->els ? new_basic_block(fn) : join;
+		lower_cond(node->cond, then, els);
+		cur = then;
+		lower_stmt(node->then);
+		if (node->els) {
+			jump_to(join);
+			cur = els;
+			lower_stmt(node->els);
+		}
+		start_block(join);
+		return;
+	}
+	case ND_WHILE:
+	case ND_FOR:
+		lower_loop(node);
+		return;
+	case ND_SWITCH:
+		lower_switch(node);
+		return;
+	case ND_CASE:
+	case ND_DEFAULT:
+		start_block(switches->blocks[node->case_label]);
+		lower_stmt(node->then);
+		return;
+	case ND_RETURN: {
+		if (inlines) {
+			int v = node->lhs ? lower_expr(node->lhs) : lower_const(0);
+			lower_store(frame_mem(inlines->result), v);
+			jump_to(inlines->end);
+			return;
+		}
+		if (is_tail_call(node->lhs)) {
+			lower_tail_call(node->lhs);
+			return;
+		}
+		IrInst* inst = new_inst(IR_RET);
+		inst->a = node->lhs ? lower_expr(node->lhs) : lower_const(0);
+		terminate(inst);
+		return;
+	}
+	case ND_BREAK:
+		if (!loops) {
+			error("break statement not within a loop");
+		}
+		jump_to(loops->brk);
+		return;
+	case ND_CONTINUE:
+		if (!loops || !loops->cont) {
+			error("continue statement not within a loop");
+		}
+		jump_to(loops->cont);
+		return;
+	default:
+		lower_expr(node);
+		return;
+	}
+}
+
+// 関数定義を中間表現に変換する
+IrFunc* lower_function(Node* node) {
+	fn = new_ir_func(node);
+	locals = fn->func->locals;
+	loops = NULL;
+	inlines = NULL;
+	switches = NULL;
+	frame_address_taken = false;
+	for (int i = 0; node->body[i]; i++) {
+		frame_address_taken = frame_address_taken || tree_any(node->body[i], takes_local_address, NULL);
+	}
+
+	// 引数はフレーム上の変数に置く
+	fn->entry = cur = new_basic_block(fn);
+	for (int i = 0; i < node->argc && i < 4; i++) {
+		IrInst* param = new_inst(IR_PARAM);
+		param->imm = i;
+		lower_store(frame_mem(ARG_SAVE_OFFSET - (i + 1) * ARG_SIZE), add_value(param));
+	}
+	body_start = new_basic_block(fn);
+	start_block(body_start);
+
+	for (int i = 0; node->body[i]; i++) {
+		lower_stmt(node->body[i]);
+		if (node->body[i]->kind == ND_RETURN) {
+			break;
+		}
+	}
+	// 最後の文がreturn文なら、ここは到達しない基本ブロックになる
+	IrInst* ret = new_inst(IR_RET);
+	ret->a = lower_const(0);
+	terminate(ret);
+	compute_cfg(fn);
+	return fn;
+}
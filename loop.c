@@ -0,0 +1,1202 @@
+#include "mipsc.h"
+
+// =============================================================================
+// ループ最適化（-O1以上）
+// =============================================================================
+//
+// ループ不変式の移動: while/forの条件・本体・更新式の中で値が変わらない式を
+// ループの直前（プリヘッダ）で一度だけ計算して新しいローカル変数に置き、
+// ループ内ではその変数を読む。
+// ループ内の代入と書き込みを書き込み先のオブジェクト（変数・配列）ごとに集め、
+// 式の読み込みがそれと重なりうるかで不変かどうかを判断する。
+// 誘導変数の強さの削減: for文の添字による配列参照を、反復ごとに進めるポインタにする。
+// ループの展開（-funroll-loops）: 回数の分かるfor文の本体を複数並べ、分岐の回数を減らす。
+
+#define MAX_LOOP_STORES 64 // ループ内で区別して覚える書き込み先の数
+#define MAX_ESCAPED 64     // アドレスが外に出るローカル変数の数
+#define MAX_HOISTED 32     // 1つのループから移動する式の数
+#define HOIST_MIN_COST 3   // 移動する式の最小の評価コスト（命令数の目安）
+
+// 読み書きするメモリのオブジェクト
+typedef enum {
+	OBJ_UNKNOWN, // ポインタの指す先（どこか分からない）
+	OBJ_LOCAL,   // ローカル変数
+	OBJ_GLOBAL,  // グローバル変数
+	OBJ_STRING,  // 文字列リテラル（書き込まれない）
+} ObjectKind;
+
+typedef struct {
+	ObjectKind kind;
+	int offset; // OBJ_LOCALのオフセット
+	char* name; // OBJ_GLOBALの名前
+} Object;
+
+// ループ内の書き込み
+typedef struct {
+	Object stores[MAX_LOOP_STORES];
+	int num_stores;
+	bool unknown_store;   // 書き込み先の分からない書き込み（関数呼び出しを含む）
+	bool too_many_stores; // 覚えきれない場合はすべてが書き換えられうるとみなす
+} LoopEffects;
+
+// ループの直前に移動した式
+typedef struct {
+	Node* expr[MAX_HOISTED];
+	int offset[MAX_HOISTED]; // 値を置いたローカル変数
+	int num;
+} Hoisted;
+
+static Function* current; // 処理中の関数
+
+// アドレスを取られる（ポインタから指されうる）ローカル変数
+static int escaped[MAX_ESCAPED];
+static int num_escaped;
+static bool all_escaped; // 覚えきれない場合はすべて指されうるとみなす
+
+static bool is_array_type(Type* ty) {
+	return ty->ty == TY_ARRAY;
+}
+
+static bool is_pointer_like(Node* node) {
+	Type* ty = get_type(node);
+	return ty->ty == TY_PTR || ty->ty == TY_ARRAY;
+}
+
+static bool is_printf(Node* node) {
+	return node->kind == ND_CALL && strcmp(node->name, "printf") == 0;
+}
+
+// -----------------------------------------------------------------------------
+// オブジェクトとエイリアス
+// -----------------------------------------------------------------------------
+
+static Object unknown_object(void) {
+	Object obj = {OBJ_UNKNOWN, 0, NULL};
+	return obj;
+}
+
+static Object var_object(Node* var) {
+	Object obj = unknown_object();
+	if (var->kind == ND_LVAR) {
+		obj.kind = OBJ_LOCAL;
+		obj.offset = var->offset;
+	} else if (var->kind == ND_GVAR) {
+		obj.kind = OBJ_GLOBAL;
+		obj.name = var->name;
+	}
+	return obj;
+}
+
+static Object address_object(Node* addr);
+
+// 左辺値が属するオブジェクト
+static Object lvalue_object(Node* lvalue) {
+	while (lvalue->kind == ND_MEMBER) {
+		lvalue = lvalue->lhs;
+	}
+	if (lvalue->kind == ND_DEREF) {
+		return address_object(lvalue->lhs);
+	}
+	return var_object(lvalue);
+}
+
+// アドレスを表す式がどのオブジェクトの中を指すか
+static Object address_object(Node* addr) {
+	switch (addr->kind) {
+	case ND_LVAR:
+	case ND_GVAR:
+		// 配列は先頭アドレスになる。ポインタ変数の値はどこを指すか分からない
+		return is_array_type(get_type(addr)) ? var_object(addr) : unknown_object();
+	case ND_STR: {
+		Object obj = {OBJ_STRING, 0, NULL};
+		return obj;
+	}
+	case ND_ADDR:
+		return lvalue_object(addr->lhs);
+	case ND_ADD:
+	case ND_SUB:
+		// ポインタ±整数は元のポインタと同じオブジェクトの中を指す
+		if (is_pointer_like(addr->lhs)) {
+			return address_object(addr->lhs);
+		}
+		if (addr->kind == ND_ADD && is_pointer_like(addr->rhs)) {
+			return address_object(addr->rhs);
+		}
+		return unknown_object();
+	default:
+		return unknown_object();
+	}
+}
+
+static bool same_object(Object a, Object b) {
+	if (a.kind != b.kind) {
+		return false;
+	}
+	if (a.kind == OBJ_LOCAL) {
+		return a.offset == b.offset;
+	}
+	if (a.kind == OBJ_GLOBAL) {
+		return strcmp(a.name, b.name) == 0;
+	}
+	return a.kind == OBJ_STRING;
+}
+
+// ポインタ経由で読み書きされうるオブジェクトか
+static bool may_be_pointed(Object obj) {
+	if (obj.kind == OBJ_GLOBAL) {
+		return true;
+	}
+	if (obj.kind != OBJ_LOCAL) {
+		return false;
+	}
+	if (all_escaped) {
+		return true;
+	}
+	for (int i = 0; i < num_escaped; i++) {
+		if (escaped[i] == obj.offset) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void add_escaped(Object obj) {
+	if (obj.kind != OBJ_LOCAL || may_be_pointed(obj)) {
+		return;
+	}
+	if (num_escaped == MAX_ESCAPED) {
+		all_escaped = true;
+		return;
+	}
+	escaped[num_escaped++] = obj.offset;
+}
+
+// 配列名が添字・間接参照・組み込み関数の引数以外で使われたり、&で
+// アドレスを取られたりしたローカル変数を集める
+static void find_escapes(Node* node, Node* parent, Node* grandparent) {
+	if (!node) {
+		return;
+	}
+	if (node->kind == ND_ADDR) {
+		add_escaped(lvalue_object(node->lhs));
+	}
+	bool is_array = (node->kind == ND_LVAR && is_array_type(get_type(node))) ||
+	                (node->kind == ND_MEMBER && is_array_type(lookup_member(node)->type));
+	if (is_array) {
+		bool direct = parent && (parent->kind == ND_DEREF || parent->kind == ND_BUILTIN_CALL ||
+		                         is_printf(parent));
+		if (parent && (parent->kind == ND_ADD || parent->kind == ND_SUB) && grandparent &&
+		    grandparent->kind == ND_DEREF) {
+			direct = true;
+		}
+		if (!direct) {
+			add_escaped(lvalue_object(node));
+		}
+	}
+	find_escapes(node->lhs, node, parent);
+	find_escapes(node->rhs, node, parent);
+	find_escapes(node->cond, node, parent);
+	find_escapes(node->then, node, parent);
+	find_escapes(node->els, node, parent);
+	find_escapes(node->init, node, parent);
+	find_escapes(node->inc, node, parent);
+	for (int i = 0; node->body && node->body[i]; i++) {
+		find_escapes(node->body[i], node, parent);
+	}
+	for (int i = 0; node->args && node->args[i]; i++) {
+		find_escapes(node->args[i], node, parent);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// ループ内の書き込み
+// -----------------------------------------------------------------------------
+
+static void add_store(LoopEffects* effects, Object obj) {
+	if (obj.kind == OBJ_UNKNOWN) {
+		effects->unknown_store = true;
+		return;
+	}
+	for (int i = 0; i < effects->num_stores; i++) {
+		if (same_object(effects->stores[i], obj)) {
+			return;
+		}
+	}
+	if (effects->num_stores == MAX_LOOP_STORES) {
+		effects->too_many_stores = true;
+		return;
+	}
+	effects->stores[effects->num_stores++] = obj;
+}
+
+static bool collect_store(Node* node, void* data) {
+	LoopEffects* effects = data;
+	switch (node->kind) {
+	case ND_ASSIGN:
+	case ND_ADD_ASSIGN:
+	case ND_SUB_ASSIGN:
+	case ND_MUL_ASSIGN:
+	case ND_DIV_ASSIGN:
+	case ND_PRE_INC:
+	case ND_POST_INC:
+	case ND_PRE_DEC:
+	case ND_POST_DEC:
+		add_store(effects, lvalue_object(node->lhs));
+		break;
+	case ND_CALL:
+		// 呼び出し先はグローバル変数とアドレスを渡された変数に書き込みうる
+		if (!is_printf(node)) {
+			effects->unknown_store = true;
+		}
+		break;
+	case ND_BUILTIN_CALL:
+		if (node->builtin_kind == BUILTIN_STRCPY) {
+			add_store(effects, address_object(node->args[0]));
+		}
+		break;
+	default:
+		break;
+	}
+	return false;
+}
+
+static void collect_effects(Node* loop, LoopEffects* effects) {
+	effects->num_stores = 0;
+	effects->unknown_store = false;
+	effects->too_many_stores = false;
+	tree_any(loop->cond, collect_store, effects);
+	tree_any(loop->then, collect_store, effects);
+	tree_any(loop->inc, collect_store, effects);
+}
+
+// オブジェクトがループ内で書き換えられうるか
+static bool is_modified(Object obj, LoopEffects* effects) {
+	if (obj.kind == OBJ_STRING) {
+		return false;
+	}
+	if (effects->too_many_stores) {
+		return true;
+	}
+	if (obj.kind == OBJ_UNKNOWN) {
+		// どこを指すか分からない読み込みは、指されうるものへの書き込みすべてと重なる
+		if (effects->unknown_store) {
+			return true;
+		}
+		for (int i = 0; i < effects->num_stores; i++) {
+			if (may_be_pointed(effects->stores[i])) {
+				return true;
+			}
+		}
+		return false;
+	}
+	if (effects->unknown_store && may_be_pointed(obj)) {
+		return true;
+	}
+	for (int i = 0; i < effects->num_stores; i++) {
+		if (same_object(effects->stores[i], obj)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// 不変式の判定
+// -----------------------------------------------------------------------------
+
+static bool is_invariant(Node* node, LoopEffects* effects);
+
+// 左辺値のアドレスがループ内で変わらないか
+static bool is_invariant_address(Node* lvalue, LoopEffects* effects) {
+	switch (lvalue->kind) {
+	case ND_LVAR:
+	case ND_GVAR:
+		return true;
+	case ND_MEMBER:
+		return is_invariant_address(lvalue->lhs, effects);
+	case ND_DEREF:
+		return is_invariant(lvalue->lhs, effects);
+	default:
+		return false;
+	}
+}
+
+// 左辺値の読み込みがループ内で変わらないか
+static bool is_invariant_load(Node* lvalue, LoopEffects* effects) {
+	return is_invariant_address(lvalue, effects) && !is_modified(lvalue_object(lvalue), effects);
+}
+
+// ループ内で値が変わらず、副作用もない式か
+static bool is_invariant(Node* node, LoopEffects* effects) {
+	switch (node->kind) {
+	case ND_NUM:
+	case ND_STR:
+		return true;
+	case ND_LVAR:
+	case ND_GVAR:
+		// 配列は先頭アドレスなので変わらない
+		return is_array_type(get_type(node)) || is_invariant_load(node, effects);
+	case ND_DEREF:
+	case ND_MEMBER:
+		return is_invariant_load(node, effects);
+	case ND_ADDR:
+		return is_invariant_address(node->lhs, effects);
+	case ND_NOT:
+		return is_invariant(node->lhs, effects);
+	case ND_ADD:
+	case ND_SUB:
+	case ND_MUL:
+	case ND_DIV:
+	case ND_MOD:
+	case ND_EQ:
+	case ND_NE:
+	case ND_LT:
+	case ND_LE:
+		return is_invariant(node->lhs, effects) && is_invariant(node->rhs, effects);
+	case ND_BUILTIN_CALL:
+		// 文字列を読むだけの組み込み関数
+		if (node->builtin_kind != BUILTIN_STRLEN && node->builtin_kind != BUILTIN_STRCMP) {
+			return false;
+		}
+		for (int i = 0; node->args[i]; i++) {
+			if (!is_invariant(node->args[i], effects) ||
+			    is_modified(address_object(node->args[i]), effects)) {
+				return false;
+			}
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+// 評価すると実行時エラーになりうる式を含むか（メモリの読み込みと変数による除算）
+static bool may_trap(Node* node, void* data) {
+	switch (node->kind) {
+	case ND_DEREF:
+	case ND_BUILTIN_CALL:
+		return true;
+	case ND_DIV:
+	case ND_MOD:
+		return node->rhs->kind != ND_NUM || node->rhs->val == 0;
+	default:
+		return false;
+	}
+}
+
+// 式の評価にかかる命令数の目安
+static int expr_cost(Node* node) {
+	if (!node) {
+		return 0;
+	}
+	switch (node->kind) {
+	case ND_NUM:
+	case ND_STR:
+		return 1;
+	case ND_LVAR:
+		return 1;
+	case ND_GVAR:
+		return 2; // la/lwはlui + 1命令になる
+	case ND_ADDR:
+	case ND_MEMBER: {
+		// 変数のメンバやアドレスは$sp/$s8やラベルからの即値で求まる
+		Node* base = node->lhs;
+		while (base->kind == ND_MEMBER) {
+			base = base->lhs;
+		}
+		if (base->kind == ND_LVAR) {
+			return 1;
+		}
+		if (base->kind == ND_GVAR) {
+			return 2;
+		}
+		return expr_cost(base->lhs) + 1;
+	}
+	case ND_DEREF:
+	case ND_NOT:
+		return expr_cost(node->lhs) + 1;
+	case ND_BUILTIN_CALL:
+		return 20; // 文字列全体を走査する
+	case ND_MUL:
+		return expr_cost(node->lhs) + expr_cost(node->rhs) + 2;
+	case ND_DIV:
+	case ND_MOD:
+		return expr_cost(node->lhs) + expr_cost(node->rhs) + 4;
+	default:
+		return expr_cost(node->lhs) + expr_cost(node->rhs) + 1;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// 式の移動
+// -----------------------------------------------------------------------------
+
+// 2つの式が同じ計算か
+static bool same_expr(Node* a, Node* b) {
+	if (!a || !b) {
+		return a == b;
+	}
+	if (a->kind != b->kind || a->val != b->val || a->offset != b->offset) {
+		return false;
+	}
+	if ((a->name || b->name) && (!a->name || !b->name || strcmp(a->name, b->name) != 0)) {
+		return false;
+	}
+	if (a->kind == ND_STR) {
+		return a == b;
+	}
+	if (a->kind == ND_BUILTIN_CALL) {
+		if (a->builtin_kind != b->builtin_kind) {
+			return false;
+		}
+		for (int i = 0; a->args[i] || b->args[i]; i++) {
+			if (!same_expr(a->args[i], b->args[i])) {
+				return false;
+			}
+		}
+	}
+	return same_expr(a->lhs, b->lhs) && same_expr(a->rhs, b->rhs);
+}
+
+// 式の値を置くローカル変数（同じ式を移動済みならそれを使う）
+static Node* hoisted_var(Node* expr, Hoisted* hoisted) {
+	int i = 0;
+	while (i < hoisted->num && !same_expr(hoisted->expr[i], expr)) {
+		i++;
+	}
+	if (i == hoisted->num) {
+		LVar var = {NULL, "", 0, 0, get_type(expr)};
+		hoisted->expr[i] = expr;
+		hoisted->offset[i] = add_frame_var(current, &var);
+		hoisted->num++;
+		locals = current->locals;
+	}
+	Node* node = new_node(ND_LVAR, NULL, NULL);
+	node->offset = hoisted->offset[i];
+	return node;
+}
+
+static Node* hoist_expr(Node* node, LoopEffects* effects, Hoisted* hoisted, bool may_run_first);
+static Node* hoist_stmt(Node* node, LoopEffects* effects, Hoisted* hoisted);
+
+// 左辺値の中のアドレス計算だけを対象にする
+static void hoist_lvalue(Node* node, LoopEffects* effects, Hoisted* hoisted) {
+	if (node->kind == ND_MEMBER) {
+		hoist_lvalue(node->lhs, effects, hoisted);
+	} else if (node->kind == ND_DEREF) {
+		node->lhs = hoist_expr(node->lhs, effects, hoisted, false);
+	}
+}
+
+// 不変式を変数の読み込みに置き換える
+// may_run_firstは、ループに入ると必ず最初に評価される位置か（実行時エラーになりうる式も移動できる）
+static Node* hoist_expr(Node* node, LoopEffects* effects, Hoisted* hoisted, bool may_run_first) {
+	if (!node) {
+		return NULL;
+	}
+	Type* ty = get_type(node);
+	if (hoisted->num < MAX_HOISTED && ty->ty != TY_ARRAY && ty->ty != TY_STRUCT &&
+	    is_invariant(node, effects) && expr_cost(node) >= HOIST_MIN_COST &&
+	    (may_run_first || !tree_any(node, may_trap, NULL))) {
+		return hoisted_var(node, hoisted);
+	}
+
+	switch (node->kind) {
+	case ND_ASSIGN:
+	case ND_ADD_ASSIGN:
+	case ND_SUB_ASSIGN:
+	case ND_MUL_ASSIGN:
+	case ND_DIV_ASSIGN:
+		hoist_lvalue(node->lhs, effects, hoisted);
+		node->rhs = hoist_expr(node->rhs, effects, hoisted, may_run_first);
+		return node;
+	case ND_PRE_INC:
+	case ND_POST_INC:
+	case ND_PRE_DEC:
+	case ND_POST_DEC:
+		hoist_lvalue(node->lhs, effects, hoisted);
+		return node;
+	case ND_ADDR:
+	case ND_MEMBER:
+		hoist_lvalue(node->kind == ND_ADDR ? node->lhs : node, effects, hoisted);
+		return node;
+	case ND_AND:
+	case ND_OR:
+		// 右辺は評価されないことがある
+		node->lhs = hoist_expr(node->lhs, effects, hoisted, may_run_first);
+		node->rhs = hoist_expr(node->rhs, effects, hoisted, false);
+		return node;
+	case ND_TERNARY:
+		node->cond = hoist_expr(node->cond, effects, hoisted, may_run_first);
+		node->then = hoist_expr(node->then, effects, hoisted, false);
+		node->els = hoist_expr(node->els, effects, hoisted, false);
+		return node;
+	case ND_INLINE:
+		for (int i = 0; node->body[i]; i++) {
+			node->body[i] = hoist_stmt(node->body[i], effects, hoisted);
+		}
+		return node;
+	case ND_CALL:
+	case ND_BUILTIN_CALL:
+		for (int i = 0; node->args[i]; i++) {
+			node->args[i] = hoist_expr(node->args[i], effects, hoisted, may_run_first);
+		}
+		return node;
+	default:
+		node->lhs = hoist_expr(node->lhs, effects, hoisted, may_run_first);
+		node->rhs = hoist_expr(node->rhs, effects, hoisted, may_run_first);
+		return node;
+	}
+}
+
+// ループ本体の文の中の不変式を置き換える（内側のループは処理済み）
+static Node* hoist_stmt(Node* node, LoopEffects* effects, Hoisted* hoisted) {
+	switch (node->kind) {
+	case ND_BLOCK:
+		for (int i = 0; node->body[i]; i++) {
+			node->body[i] = hoist_stmt(node->body[i], effects, hoisted);
+		}
+		return node;
+	case ND_IF:
+		node->cond = hoist_expr(node->cond, effects, hoisted, false);
+		node->then = hoist_stmt(node->then, effects, hoisted);
+		if (node->els) {
+			node->els = hoist_stmt(node->els, effects, hoisted);
+		}
+		return node;
+	case ND_WHILE:
+	case ND_FOR:
+		if (node->init) {
+			node->init = hoist_stmt(node->init, effects, hoisted);
+		}
+		node->cond = hoist_expr(node->cond, effects, hoisted, false);
+		node->then = hoist_stmt(node->then, effects, hoisted);
+		if (node->inc) {
+			node->inc = hoist_stmt(node->inc, effects, hoisted);
+		}
+		return node;
+	case ND_SWITCH:
+		node->cond = hoist_expr(node->cond, effects, hoisted, false);
+		node->then = hoist_stmt(node->then, effects, hoisted);
+		return node;
+	case ND_CASE:
+	case ND_DEFAULT:
+		node->then = hoist_stmt(node->then, effects, hoisted);
+		return node;
+	case ND_RETURN:
+		node->lhs = hoist_expr(node->lhs, effects, hoisted, false);
+		return node;
+	case ND_BREAK:
+	case ND_CONTINUE:
+		return node;
+	default:
+		return hoist_expr(node, effects, hoisted, false);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// 誘導変数の強さの削減
+// -----------------------------------------------------------------------------
+//
+// for (i = ...; ...; i += c) の中の配列参照 base[i]（= *(base + i)）について、
+// base + i を保持する変数pをループの直前で求め、更新式でpを要素サイズ×cずつ進める。
+// 添字の乗算（シフト）と加算が、pの読み込み1回になる。
+// iが条件の i < n とアドレス計算にしか使われず、ループの後でも読まれなければ、
+// 条件をpと終端アドレス base + n の比較に書き換え、iの更新をやめる。
+// pはintとして扱い、base + iの計算（要素サイズ倍）は元の式と同じ規則で行う。
+
+#define MAX_IV_BASES 8 // 1つのループで強さの削減をする配列の数
+
+// 同じ配列（アドレスの基になる式）への参照
+typedef struct {
+	Node* base;
+	int elem_size; // base + 1 で進むバイト数
+	int count;     // ループ内の参照の数
+	int offset;    // base + i を置く変数
+} IvBase;
+
+typedef struct {
+	int iv;        // 誘導変数のオフセット
+	int step;      // 1回の反復で増える値
+	LoopEffects* effects;
+	IvBase bases[MAX_IV_BASES];
+	int num_bases;
+	int matched_reads; // 配列参照の中での誘導変数の読み込みの数
+} IvInfo;
+
+static Node* new_lvar(int offset) {
+	Node* node = new_node(ND_LVAR, NULL, NULL);
+	node->offset = offset;
+	return node;
+}
+
+static bool is_var(Node* node, int offset) {
+	return node && node->kind == ND_LVAR && node->offset == offset;
+}
+
+// for文の更新式が i++, i += c, i = i + c の形なら、iのオフセットとcを求める
+static bool induction_step(Node* inc, int* offset, int* step) {
+	if (!inc || inc->lhs == NULL || inc->lhs->kind != ND_LVAR) {
+		return false;
+	}
+	*offset = inc->lhs->offset;
+	switch (inc->kind) {
+	case ND_PRE_INC:
+	case ND_POST_INC:
+		*step = 1;
+		return true;
+	case ND_PRE_DEC:
+	case ND_POST_DEC:
+		*step = -1;
+		return true;
+	case ND_ADD_ASSIGN:
+	case ND_SUB_ASSIGN:
+		if (inc->rhs->kind != ND_NUM) {
+			return false;
+		}
+		*step = inc->kind == ND_ADD_ASSIGN ? inc->rhs->val : -inc->rhs->val;
+		return true;
+	case ND_ASSIGN:
+		if (inc->rhs->kind != ND_ADD || !is_var(inc->rhs->lhs, *offset) || inc->rhs->rhs->kind != ND_NUM) {
+			return false;
+		}
+		*step = inc->rhs->rhs->val;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool reads_var(Node* node, void* data) {
+	return is_var(node, *(int*)data);
+}
+
+static bool writes_var(Node* node, void* data) {
+	switch (node->kind) {
+	case ND_ASSIGN:
+	case ND_ADD_ASSIGN:
+	case ND_SUB_ASSIGN:
+	case ND_MUL_ASSIGN:
+	case ND_DIV_ASSIGN:
+	case ND_PRE_INC:
+	case ND_POST_INC:
+	case ND_PRE_DEC:
+	case ND_POST_DEC:
+		return is_var(node->lhs, *(int*)data);
+	default:
+		return false;
+	}
+}
+
+static bool is_node(Node* node, void* data) {
+	return node == data;
+}
+
+static int count_reads(Node* node, int offset) {
+	if (!node) {
+		return 0;
+	}
+	int n = is_var(node, offset);
+	n += count_reads(node->lhs, offset) + count_reads(node->rhs, offset);
+	n += count_reads(node->cond, offset) + count_reads(node->then, offset);
+	n += count_reads(node->els, offset) + count_reads(node->init, offset);
+	n += count_reads(node->inc, offset);
+	for (int i = 0; node->body && node->body[i]; i++) {
+		n += count_reads(node->body[i], offset);
+	}
+	for (int i = 0; node->args && node->args[i]; i++) {
+		n += count_reads(node->args[i], offset);
+	}
+	return n;
+}
+
+// ループの外で変数の値が読まれうるか
+// 初期化式でその変数に代入する別のfor文の中の読み込みは、代入後の値を読むので除く
+static bool read_outside(Node* node, Node* loop, int offset) {
+	if (!node || node == loop) {
+		return false;
+	}
+	if (node->kind == ND_FOR && node->init && node->init->kind == ND_ASSIGN &&
+	    is_var(node->init->lhs, offset) && !tree_any(node->init->rhs, reads_var, &offset) &&
+	    !tree_any(node, is_node, loop)) {
+		return false;
+	}
+	if (node->kind == ND_ASSIGN && is_var(node->lhs, offset)) {
+		return read_outside(node->rhs, loop, offset);
+	}
+	if (is_var(node, offset)) {
+		return true;
+	}
+	if (read_outside(node->lhs, loop, offset) || read_outside(node->rhs, loop, offset) ||
+	    read_outside(node->cond, loop, offset) || read_outside(node->then, loop, offset) ||
+	    read_outside(node->els, loop, offset) || read_outside(node->init, loop, offset) ||
+	    read_outside(node->inc, loop, offset)) {
+		return true;
+	}
+	for (int i = 0; node->body && node->body[i]; i++) {
+		if (read_outside(node->body[i], loop, offset)) {
+			return true;
+		}
+	}
+	for (int i = 0; node->args && node->args[i]; i++) {
+		if (read_outside(node->args[i], loop, offset)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// base + i または base + (i + k) の形のアドレスなら、baseとkを求める
+static bool match_access(Node* node, IvInfo* iv, Node** base, int* k) {
+	if (node->kind != ND_ADD || !is_pointer_like(node->lhs)) {
+		return false;
+	}
+	Node* index = node->rhs;
+	*k = 0;
+	if (index->kind == ND_ADD && index->rhs->kind == ND_NUM) {
+		*k = index->rhs->val;
+		index = index->lhs;
+	}
+	if (!is_var(index, iv->iv)) {
+		return false;
+	}
+	*base = node->lhs;
+	return !tree_any(*base, reads_var, &iv->iv) && is_invariant(*base, iv->effects);
+}
+
+static IvBase* find_base(IvInfo* iv, Node* base) {
+	for (int i = 0; i < iv->num_bases; i++) {
+		if (same_expr(iv->bases[i].base, base)) {
+			return &iv->bases[i];
+		}
+	}
+	return NULL;
+}
+
+static bool collect_access(Node* node, void* data) {
+	IvInfo* iv = data;
+	Node* base;
+	int k;
+	if (!match_access(node, iv, &base, &k)) {
+		return false;
+	}
+	IvBase* group = find_base(iv, base);
+	if (!group) {
+		if (iv->num_bases == MAX_IV_BASES) {
+			return false;
+		}
+		group = &iv->bases[iv->num_bases++];
+		group->base = base;
+		Type* ty = get_type(base);
+		group->elem_size = size_of(ty->ptr_to);
+		group->count = 0;
+		group->offset = 0;
+	}
+	group->count++;
+	iv->matched_reads++;
+	return false;
+}
+
+// 配列参照を base + i を置いた変数の読み込みに置き換える
+static Node* replace_access(Node* node, IvInfo* iv) {
+	if (!node) {
+		return NULL;
+	}
+	Node* base;
+	int k;
+	if (match_access(node, iv, &base, &k)) {
+		IvBase* group = find_base(iv, base);
+		if (group && group->offset) {
+			Node* ptr = new_lvar(group->offset);
+			return k ? new_node(ND_ADD, ptr, new_node_num(k * group->elem_size)) : ptr;
+		}
+	}
+	node->lhs = replace_access(node->lhs, iv);
+	node->rhs = replace_access(node->rhs, iv);
+	node->cond = replace_access(node->cond, iv);
+	node->then = replace_access(node->then, iv);
+	node->els = replace_access(node->els, iv);
+	node->init = replace_access(node->init, iv);
+	node->inc = replace_access(node->inc, iv);
+	for (int i = 0; node->body && node->body[i]; i++) {
+		node->body[i] = replace_access(node->body[i], iv);
+	}
+	for (int i = 0; node->args && node->args[i]; i++) {
+		node->args[i] = replace_access(node->args[i], iv);
+	}
+	return node;
+}
+
+static Node* new_block(Node** stmts, int n) {
+	Node* block = new_node(ND_BLOCK, NULL, NULL);
+	block->body = calloc(n + 1, sizeof(Node*));
+	for (int i = 0; i < n; i++) {
+		block->body[i] = stmts[i];
+	}
+	return block;
+}
+
+// 誘導変数による配列参照の強さを削減し、プリヘッダに置く文をpreに追加する
+static void reduce_induction(Node* loop, LoopEffects* effects, Node** pre, int* num_pre) {
+	IvInfo iv = {0};
+	iv.effects = effects;
+	if (loop->kind != ND_FOR || !induction_step(loop->inc, &iv.iv, &iv.step)) {
+		return;
+	}
+	Type* ty = get_type(loop->inc->lhs);
+	Object obj = {OBJ_LOCAL, iv.iv, NULL};
+	if (ty->ty != TY_INT || may_be_pointed(obj) || tree_any(loop->cond, writes_var, &iv.iv) ||
+	    tree_any(loop->then, writes_var, &iv.iv)) {
+		return;
+	}
+	tree_any(loop->cond, collect_access, &iv);
+	tree_any(loop->then, collect_access, &iv);
+	if (iv.num_bases == 0) {
+		return;
+	}
+
+	// 条件が i < n / i <= n（nは不変）なら終端アドレスとの比較にできる
+	Node* cond = loop->cond;
+	bool cond_rewritable = cond && (cond->kind == ND_LT || cond->kind == ND_LE) && iv.step > 0 &&
+	                       is_var(cond->lhs, iv.iv) && !tree_any(cond->rhs, reads_var, &iv.iv) &&
+	                       is_invariant(cond->rhs, effects);
+	int reads = count_reads(loop->cond, iv.iv) + count_reads(loop->then, iv.iv);
+	bool drop_iv = cond_rewritable && reads == iv.matched_reads + 1 &&
+	               !read_outside(current->node, loop, iv.iv);
+
+	// iを残す場合は、同じ配列を2回以上参照するときだけ得になる
+	int n = 0;
+	for (int i = 0; i < iv.num_bases; i++) {
+		if (drop_iv || iv.bases[i].count >= 2) {
+			iv.bases[n++] = iv.bases[i];
+		}
+	}
+	iv.num_bases = n;
+	if (n == 0) {
+		return;
+	}
+
+	Node* bumps[MAX_IV_BASES + 1];
+	int num_bumps = 0;
+	if (!drop_iv) {
+		bumps[num_bumps++] = loop->inc;
+	}
+	for (int i = 0; i < iv.num_bases; i++) {
+		IvBase* group = &iv.bases[i];
+		LVar var = {NULL, "", 0, 0, new_type(TY_INT)};
+		group->offset = add_frame_var(current, &var);
+		locals = current->locals;
+		// p = base + i（要素サイズ倍は元の式と同じ）
+		Node* start = new_node(ND_ADD, copy_expr(group->base), new_lvar(iv.iv));
+		pre[(*num_pre)++] = new_node(ND_ASSIGN, new_lvar(group->offset), start);
+		// p = p + c * 要素サイズ
+		Node* next = new_node(ND_ADD, new_lvar(group->offset), new_node_num(iv.step * group->elem_size));
+		bumps[num_bumps++] = new_node(ND_ASSIGN, new_lvar(group->offset), next);
+	}
+
+	if (drop_iv) {
+		// 終端 = base + n と比較する
+		IvBase* group = &iv.bases[0];
+		LVar var = {NULL, "", 0, 0, new_type(TY_INT)};
+		int end = add_frame_var(current, &var);
+		locals = current->locals;
+		Node* limit = new_node(ND_ADD, copy_expr(group->base), cond->rhs);
+		pre[(*num_pre)++] = new_node(ND_ASSIGN, new_lvar(end), limit);
+		loop->cond = new_node(cond->kind, new_lvar(group->offset), new_lvar(end));
+	} else {
+		loop->cond = replace_access(loop->cond, &iv);
+	}
+	loop->then = replace_access(loop->then, &iv);
+	loop->inc = num_bumps == 1 ? bumps[0] : new_block(bumps, num_bumps);
+}
+
+// -----------------------------------------------------------------------------
+// ループの展開
+// -----------------------------------------------------------------------------
+//
+// for (i = a; i < n; i += c) 本体 を、本体をunroll_factor個（U個）並べたループにする。
+//   nが定数のとき（回数T）: T / U 回のループ + 残りの T % U 個の本体を直線で並べる
+//   nが不変のとき: for (; i < n - (U-1)*c; i += U*c) {...} の後に元のループを残りの処理として置く
+// 並べたk番目の本体ではiを i + k*c に置き換えるので、iの更新は反復ごとに1回になる。
+
+#define UNROLL_MAX_SIZE 40 // 展開する本体の大きさ（ノード数）の上限
+
+static bool count_node(Node* node, void* data) {
+	(*(int*)data)++;
+	return false;
+}
+
+// 文がループの外へ抜ける（またはループの次の反復へ進む）可能性があるか
+static bool has_jump(Node* node, bool in_loop) {
+	if (!node) {
+		return false;
+	}
+	switch (node->kind) {
+	case ND_RETURN:
+		return true;
+	case ND_BREAK:
+	case ND_CONTINUE:
+		return !in_loop;
+	case ND_INLINE:
+		// 展開された関数のreturnは展開の末尾へ進むだけ
+		return false;
+	case ND_WHILE:
+	case ND_FOR:
+		in_loop = true;
+		break;
+	default:
+		break;
+	}
+	if (has_jump(node->lhs, in_loop) || has_jump(node->rhs, in_loop) || has_jump(node->cond, in_loop) ||
+	    has_jump(node->then, in_loop) || has_jump(node->els, in_loop) || has_jump(node->init, in_loop) ||
+	    has_jump(node->inc, in_loop)) {
+		return true;
+	}
+	for (int i = 0; node->body && node->body[i]; i++) {
+		if (has_jump(node->body[i], in_loop)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// 複製した本体の中の変数の読み込みを var + k に置き換える
+static Node* shift_var(Node* node, int offset, int k) {
+	if (!node) {
+		return NULL;
+	}
+	if (is_var(node, offset)) {
+		return new_node(ND_ADD, node, new_node_num(k));
+	}
+	if (node->kind == ND_ADD && is_var(node->lhs, offset) && node->rhs->kind == ND_NUM) {
+		node->rhs = new_node_num(node->rhs->val + k);
+		return node;
+	}
+	node->lhs = shift_var(node->lhs, offset, k);
+	node->rhs = shift_var(node->rhs, offset, k);
+	node->cond = shift_var(node->cond, offset, k);
+	node->then = shift_var(node->then, offset, k);
+	node->els = shift_var(node->els, offset, k);
+	node->init = shift_var(node->init, offset, k);
+	node->inc = shift_var(node->inc, offset, k);
+	for (int i = 0; node->body && node->body[i]; i++) {
+		node->body[i] = shift_var(node->body[i], offset, k);
+	}
+	for (int i = 0; node->args && node->args[i]; i++) {
+		node->args[i] = shift_var(node->args[i], offset, k);
+	}
+	return node;
+}
+
+// 本体をn個並べ、最後に i += n*c とする文を stmts に追加する
+static void add_copies(Node** stmts, int* num, Node* body, int iv, int step, int n) {
+	for (int k = 0; k < n; k++) {
+		Node* copy = copy_expr(body);
+		stmts[(*num)++] = k ? shift_var(copy, iv, k * step) : copy;
+	}
+	stmts[(*num)++] = new_node(ND_ADD_ASSIGN, new_lvar(iv), new_node_num(n * step));
+}
+
+// 本体をU個並べ、iを U*c ずつ進めるループを作る
+static Node* unrolled_loop(Node* body, int iv, int step, int factor, Node* cond) {
+	Node* block = new_node(ND_BLOCK, NULL, NULL);
+	block->body = calloc(factor + 2, sizeof(Node*));
+	int n = 0;
+	add_copies(block->body, &n, body, iv, step, factor);
+	Node* loop = new_node(ND_FOR, NULL, NULL);
+	loop->cond = cond;
+	loop->inc = block->body[--n]; // i += U*c は更新式にする
+	block->body[n] = NULL;
+	loop->then = block;
+	return loop;
+}
+
+// 初期値a・終端n・増分cが定数のときの反復回数
+// （iを減らすループの i > n / i >= n は、構文木では n < i / n <= i になっている）
+static long long trip_count(bool inclusive, long long a, long long n, long long c) {
+	if (c > 0) {
+		return a < n || (inclusive && a == n) ? (n - a + (inclusive ? c : c - 1)) / c : 0;
+	}
+	return a > n || (inclusive && a == n) ? (a - n + (inclusive ? -c : -c - 1)) / -c : 0;
+}
+
+// 増分cの向きにiがlimitを越えていないかの条件
+static Node* new_iv_cond(bool inclusive, int iv, int step, Node* limit) {
+	NodeKind kind = inclusive ? ND_LE : ND_LT;
+	return step > 0 ? new_node(kind, new_lvar(iv), limit) : new_node(kind, limit, new_lvar(iv));
+}
+
+// 展開できるループなら展開した文を返す（できなければloopをそのまま返す）
+static Node* unroll_loop(Node* loop) {
+	int factor = unroll_factor;
+	int iv;
+	int step;
+	if (factor < 2 || loop->kind != ND_FOR || !loop->cond || !induction_step(loop->inc, &iv, &step) || step == 0) {
+		return loop;
+	}
+	// 条件は i < n / i <= n（増やす場合）か n < i / n <= i（減らす場合）
+	Node* cond = loop->cond;
+	if (cond->kind != ND_LT && cond->kind != ND_LE) {
+		return loop;
+	}
+	bool inclusive = cond->kind == ND_LE;
+	Node* var = step > 0 ? cond->lhs : cond->rhs;
+	Node* bound = step > 0 ? cond->rhs : cond->lhs;
+	Object obj = {OBJ_LOCAL, iv, NULL};
+	if (!is_var(var, iv) || get_type(var)->ty != TY_INT || may_be_pointed(obj) ||
+	    tree_any(loop->then, writes_var, &iv)) {
+		return loop;
+	}
+	int size = 0;
+	tree_any(loop->then, count_node, &size);
+	if (size > UNROLL_MAX_SIZE || has_jump(loop->then, false)) {
+		return loop;
+	}
+	LoopEffects effects;
+	collect_effects(loop, &effects);
+	if ((bound->kind != ND_NUM && bound->kind != ND_LVAR) || is_var(bound, iv) || !is_invariant(bound, &effects)) {
+		return loop;
+	}
+
+	Node* body = loop->then;
+	Node* init = loop->init;
+	Node** stmts = calloc(2 * factor + 4, sizeof(Node*)); // 直線で並べる本体は2U-1個まで
+	int num = 0;
+	if (init) {
+		stmts[num++] = init;
+		loop->init = NULL;
+	}
+	if (bound->kind == ND_NUM && init && init->kind == ND_ASSIGN && is_var(init->lhs, iv) &&
+	    init->rhs->kind == ND_NUM) {
+		// 回数が決まっている: 残りは直線で並べる
+		long long a = init->rhs->val;
+		long long trips = trip_count(inclusive, a, bound->val, step);
+		long long iterations = trips / factor;
+		int rest = trips % factor;
+		if (iterations >= 2) {
+			Node* end = new_node_num(a + iterations * factor * step);
+			stmts[num++] = unrolled_loop(body, iv, step, factor, new_iv_cond(false, iv, step, end));
+		} else {
+			rest = trips;
+		}
+		if (rest > 0) {
+			add_copies(stmts, &num, body, iv, step, rest);
+		}
+		return new_block(stmts, num);
+	}
+
+	// 回数が実行時に決まる: U個まとめて実行できる間は展開したループ、残りは元のループ
+	Node* limit;
+	if (bound->kind == ND_NUM) {
+		limit = new_node_num(bound->val - (factor - 1) * step);
+	} else {
+		LVar var = {NULL, "", 0, 0, new_type(TY_INT)};
+		int offset = add_frame_var(current, &var);
+		locals = current->locals;
+		Node* value = new_node(ND_ADD, copy_expr(bound), new_node_num(-(factor - 1) * step));
+		stmts[num++] = new_node(ND_ASSIGN, new_lvar(offset), value);
+		limit = new_lvar(offset);
+	}
+	stmts[num++] = unrolled_loop(body, iv, step, factor, new_iv_cond(inclusive, iv, step, limit));
+	stmts[num++] = loop;
+	return new_block(stmts, num);
+}
+
+// -----------------------------------------------------------------------------
+// ループ単位の処理
+// -----------------------------------------------------------------------------
+
+#define MAX_PREHEADER (MAX_HOISTED + 2 * MAX_IV_BASES) // プリヘッダに置く文の数
+
+// ループを最適化し、置き換える文を返す
+static Node* optimize_loop(Node* loop) {
+	LoopEffects effects;
+	collect_effects(loop, &effects);
+	Hoisted hoisted = {{NULL}, {0}, 0};
+
+	// 条件は最初の反復の前に必ず評価される（forは初期化式の後）
+	loop->cond = hoist_expr(loop->cond, &effects, &hoisted, true);
+	loop->then = hoist_stmt(loop->then, &effects, &hoisted);
+	if (loop->inc) {
+		loop->inc = hoist_stmt(loop->inc, &effects, &hoisted);
+	}
+	Node* pre[MAX_PREHEADER];
+	int num_pre = 0;
+	for (int i = 0; i < hoisted.num; i++) {
+		pre[num_pre++] = new_node(ND_ASSIGN, new_lvar(hoisted.offset[i]), hoisted.expr[i]);
+	}
+	reduce_induction(loop, &effects, pre, &num_pre);
+	if (num_pre == 0) {
+		return loop;
+	}
+
+	// { 初期化式; プリヘッダ; ループ }
+	Node* block = new_node(ND_BLOCK, NULL, NULL);
+	block->body = calloc(num_pre + 3, sizeof(Node*));
+	int n = 0;
+	if (loop->init) {
+		block->body[n++] = loop->init;
+		loop->init = NULL;
+	}
+	for (int i = 0; i < num_pre; i++) {
+		block->body[n++] = pre[i];
+	}
+	block->body[n] = loop;
+	return block;
+}
+
+// 文の中のループを内側から順に処理する
+static Node* optimize_stmt(Node* node) {
+	switch (node->kind) {
+	case ND_BLOCK:
+		for (int i = 0; node->body[i]; i++) {
+			node->body[i] = optimize_stmt(node->body[i]);
+		}
+		return node;
+	case ND_IF:
+		node->then = optimize_stmt(node->then);
+		if (node->els) {
+			node->els = optimize_stmt(node->els);
+		}
+		return node;
+	case ND_SWITCH:
+	case ND_CASE:
+	case ND_DEFAULT:
+		node->then = optimize_stmt(node->then);
+		return node;
+	case ND_WHILE:
+	case ND_FOR:
+		node->then = optimize_stmt(node->then);
+		node = unroll_loop(node);
+		if (node->kind == ND_BLOCK) {
+			for (int i = 0; node->body[i]; i++) {
+				if (node->body[i]->kind == ND_FOR) {
+					node->body[i] = optimize_loop(node->body[i]);
+				}
+			}
+			return node;
+		}
+		return optimize_loop(node);
+	default:
+		return node;
+	}
+}
+
+void optimize_loops(void) {
+	LVar* saved_locals = locals;
+	for (Function* f = functions; f; f = f->next) {
+		current = f;
+		// 型の判定に関数のローカル変数を使う
+		locals = f->locals;
+		num_escaped = 0;
+		all_escaped = false;
+		Node* func = f->node;
+		for (int i = 0; func->body[i]; i++) {
+			find_escapes(func->body[i], NULL, NULL);
+		}
+		for (int i = 0; func->body[i]; i++) {
+			func->body[i] = optimize_stmt(func->body[i]);
+		}
+	}
+	locals = saved_locals;
+}
@@ -1,5 +1,7 @@
 #include "mipsc.h"
 
+#define DEFAULT_UNROLL_FACTOR 4 // -funroll-loops（-O2）の展開数
+
 char* user_input; // 入力文字列
 Token* token; // 現在読んでいるtoken
 LVar* locals; // ローカル変数のリスト
@@ -12,6 +14,11 @@ int label_count = 0; // ラベル生成用のカウンタ
 int string_count = 0; // 文字列ラベル生成用のカウンタ
 StringLiteral* string_literals = NULL; // 文字列リテラルのリスト
 LoopLabel* loop_stack = NULL; // ループラベルスタック
+int opt_level = 1; // 最適化レベル
+int omit_frame_pointer = -1; // -f[no-]omit-frame-pointer（未指定なら-1）
+int unroll_factor = -1; // -funroll-loops[=N] の展開数（未指定なら-1）
+bool frame_uses_fp = true; // 現在の関数がローカル変数を$s8基準で参照するか
+int frame_top; // $s8に相当する位置の、プロローグ直後の$spからのオフセット
 
 void error(char* fmt, ...) {
 	va_list ap;
@@ -60,18 +67,91 @@ char* read_file(char* path) {
 }
 
 int main(int argc, char** argv) {
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s <input.c or \"source code\">\n", argv[0]);
+	// オプションと入力を解析
+	char* input = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "-O", 2) == 0 && !strchr(argv[i], ' ')) {
+			// -O0: スタックマシン, -O1以上: レジスタ割り当て
+			opt_level = argv[i][2] ? atoi(argv[i] + 2) : 1;
+		} else if (strcmp(argv[i], "-fomit-frame-pointer") == 0) {
+			omit_frame_pointer = 1;
+		} else if (strcmp(argv[i], "-fno-omit-frame-pointer") == 0) {
+			omit_frame_pointer = 0;
+		} else if (strcmp(argv[i], "-funroll-loops") == 0) {
+			unroll_factor = DEFAULT_UNROLL_FACTOR;
+		} else if (strncmp(argv[i], "-funroll-loops=", 15) == 0) {
+			unroll_factor = atoi(argv[i] + 15);
+		} else if (strcmp(argv[i], "-fno-unroll-loops") == 0) {
+			unroll_factor = 0;
+		} else if (strcmp(argv[i], "-fir") == 0) {
+			use_ir = 1;
+		} else if (strcmp(argv[i], "-fno-ir") == 0) {
+			use_ir = 0;
+		} else if (strcmp(argv[i], "-ftime-passes") == 0) {
+			time_passes = true;
+		} else if (strcmp(argv[i], "-fdump-ir") == 0) {
+			dump_ir_passes = true;
+		} else if (strcmp(argv[i], "-fschedule-insns") == 0) {
+			schedule_insns = 1;
+		} else if (strcmp(argv[i], "-fno-schedule-insns") == 0) {
+			schedule_insns = 0;
+		} else if (strcmp(argv[i], "-fif-conversion") == 0) {
+			if_conversion = 1;
+		} else if (strcmp(argv[i], "-fno-if-conversion") == 0) {
+			if_conversion = 0;
+		} else if (strcmp(argv[i], "-fsched-verbose") == 0) {
+			sched_verbose = true;
+		} else if (strncmp(argv[i], "-mtune=", 7) == 0) {
+			if (!set_tune(argv[i] + 7)) {
+				error("unknown CPU: %s", argv[i] + 7);
+			}
+		} else if (strncmp(argv[i], "-fdisable-pass=", 15) == 0) {
+			if (!disable_pass(argv[i] + 15)) {
+				error("cannot disable pass: %s", argv[i] + 15);
+			}
+		} else if (!input) {
+			input = argv[i];
+		} else {
+			input = NULL;
+			break;
+		}
+	}
+	if (!input) {
+		fprintf(stderr, "Usage: %s [-O0|-O1|-O2] [-f[no-]omit-frame-pointer] [-funroll-loops[=N]|-fno-unroll-loops] [-f[no-]ir] [-f[no-]schedule-insns] [-fsched-verbose] [-f[no-]if-conversion] [-mtune=24k|4kc|r3000] [-ftime-passes] [-fdump-ir] [-fdisable-pass=NAME] <input.c or \"source code\">\n", argv[0]);
 		return 1;
 	}
+	// フレームポインタの省略は-O2以上で標準にする（スタックマシン方式では使えない）
+	if (omit_frame_pointer < 0) {
+		omit_frame_pointer = opt_level >= 2;
+	}
+	// ループの展開も-O2以上で標準にする
+	if (unroll_factor < 0) {
+		unroll_factor = opt_level >= 2 ? DEFAULT_UNROLL_FACTOR : 0;
+	}
+	// 中間表現を経由するコード生成も-O2以上で標準にする
+	if (use_ir < 0) {
+		use_ir = opt_level >= 2;
+	}
+	// 命令スケジューリングも-O2以上で標準にする
+	if (schedule_insns < 0) {
+		schedule_insns = opt_level >= 2;
+	}
+	// 分岐しない選択（movn/movz）への変換は-O1以上で標準にする
+	if (if_conversion < 0) {
+		if_conversion = opt_level >= 1;
+	}
+	if (opt_level == 0) {
+		omit_frame_pointer = 0;
+		use_ir = 0;
+	}
 	
 	// ファイルパスかソースコード文字列かを判定
-	if (strchr(argv[1], ' ') || strchr(argv[1], '{') || strchr(argv[1], ';')) {
+	if (strchr(input, ' ') || strchr(input, '{') || strchr(input, ';')) {
 		// 空白や特定の文字が含まれていれば直接のソースコード
-		user_input = argv[1];
+		user_input = input;
 	} else {
 		// そうでなければファイルパスとして扱う
-		user_input = read_file(argv[1]);
+		user_input = read_file(input);
 	}
 	token = tokenize(user_input);
 	locals = NULL;
@@ -83,12 +163,23 @@ int main(int argc, char** argv) {
 	loop_stack = NULL;
 	program();
 
+	// 構文木の簡約、関数のインライン展開、ループ最適化と到達しない関数の削除
+	run_program_passes();
+
 	// アセンブリの前半部を出力
 	printf(".data\n");
 	printf("stack: .space 4096\n");
 	
-	// printf用バッファ
-	printf(".L_char_buffer: .space 4\n");
+	// 標準入力のバッファ（読み込んだバイト数と、次に返す位置）
+	printf(".L_in_buffer: .space %d\n", IN_BUFFER_SIZE);
+	printf(".L_in_len: .word 0\n");
+	printf(".L_in_pos: .word 0\n");
+	// 標準出力のバッファ（溜まった文字数と、書き出しのきっかけにする文字）
+	printf(".L_out_buffer: .space %d\n", OUT_BUFFER_SIZE);
+	printf(".L_out_len: .word 0\n");
+	printf(".L_out_flush_char: .word 256\n");
+	// printfで整数を文字列にする作業領域
+	printf(".L_itoa_buffer: .space %d\n", ITOA_BUFFER_SIZE);
 	
 	// グローバル変数を出力
 	for (GVar* var = globals; var; var = var->next) {
@@ -101,21 +192,41 @@ int main(int argc, char** argv) {
 	// スタックポインタの初期化
 	printf("	addi $s8, $sp, 0\n");
 	printf("	addi $sp, $sp, -4096\n");
+	// 標準出力が端末（ioctl TCGETSが成功する）なら改行ごとに書き出す
+	printf("	li $a0, 1\n");
+	printf("	li $a1, 0x540d\n");
+	printf("	la $a2, .L_out_buffer\n");
+	printf("	li $v0, 4054\n");
+	printf("	syscall\n");
+	printf("	bnez $a3, .L_start_notty\n");
+	printf("	li $t0, 10\n");
+	printf("	sw $t0, .L_out_flush_char\n");
+	printf(".L_start_notty:\n");
 	printf("	jal main\n");
 	printf("	nop\n");
-	printf("	move $a0, $v0\n");
+	// 終了する前に出力バッファに残った文字を書き出す
+	printf("	move $s0, $v0\n");
+	printf("	lw $a2, .L_out_len\n");
+	printf("	beqz $a2, .L_start_exit\n");
+	printf("	li $a0, 1\n");
+	printf("	la $a1, .L_out_buffer\n");
+	printf("	li $v0, 4004\n");
+	printf("	syscall\n");
+	printf(".L_start_exit:\n");
+	printf("	move $a0, $s0\n");
 	printf("	li $v0, 4001\n");
 	printf("	syscall\n");
 	
-	// すべての関数を出力
+	// すべての関数を出力（関数ごとに命令バッファを最適化して書き出す）
 	for (int i = 0; code[i]; i++) {
-		gen(code[i]);
+		gen_function(code[i]);
 	}
 	
 	// 文字列リテラルを出力（後から追加）
 	if (string_literals) {
 		printf("\n# String literals\n");
 		for (StringLiteral* str = string_literals; str; str = str->next) {
+			printf("	.align 2\n");  // 文字列関数が先頭から1語ずつ読めるように
 			printf(".L_str_%d:\n", str->id);
 			printf("	.asciiz \"");
 			for (int i = 0; i < str->len; i++) {
@@ -133,6 +244,14 @@ int main(int argc, char** argv) {
 			printf("\"\n");
 		}
 	}
-	
+	print_printf_runtime();
+	print_jump_tables();
+
+	if (time_passes) {
+		print_pass_times();
+	}
+	if (sched_verbose && schedule_insns) {
+		print_sched_stats();
+	}
 	return 0;
 }
\ No newline at end of file
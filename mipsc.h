@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <string.h>
+#include <limits.h>
 
 // 定数定義
 // 配列とバッファサイズの制限
@@ -23,6 +24,15 @@
 #define ARG_SAVE_OFFSET -8
 #define ARG_SIZE 4
 
+// 標準入力・標準出力のバッファの大きさ（バイト）
+#define IN_BUFFER_SIZE 4096
+#define OUT_BUFFER_SIZE 4096
+// printfで整数を文字列にする作業領域の大きさ（符号と10桁）
+#define ITOA_BUFFER_SIZE 12
+
+// ループの条件を入口の判定に複製する式の大きさ（ノード数）の上限
+#define ROTATE_MAX_COND_SIZE 24
+
 // キーワード長
 #define LEN_RETURN 6
 #define LEN_IF 2
@@ -36,6 +46,9 @@
 #define LEN_STRUCT 6
 #define LEN_BREAK 5
 #define LEN_CONTINUE 8
+#define LEN_SWITCH 6
+#define LEN_CASE 4
+#define LEN_DEFAULT 7
 
 // コメント関連
 #define COMMENT_LINE_START "//"
@@ -77,6 +90,9 @@ typedef enum {
 	TK_COLON, // :
 	TK_BREAK, // break
 	TK_CONTINUE, // continue
+	TK_SWITCH, // switch
+	TK_CASE, // case
+	TK_DEFAULT, // default
 	TK_EOF, // 入力の終わり
 } TokenKind;
 
@@ -133,9 +149,13 @@ typedef enum {
 	ND_TERNARY, // 三項演算子 ? :
 	ND_BREAK, // break文
 	ND_CONTINUE, // continue文
+	ND_SWITCH, // switch文
+	ND_CASE, // caseラベル
+	ND_DEFAULT, // defaultラベル
 	ND_MEMBER, // メンバアクセス (.)
 	ND_STRUCT_DEF, // 構造体定義
 	ND_BUILTIN_CALL, // 組み込み関数呼び出し
+	ND_INLINE, // インライン展開した関数本体（-O1以上）
 } NodeKind;
 
 // 型の種類を表すenum
@@ -197,21 +217,22 @@ struct Node {
 	NodeKind kind; // ノードの種類
 	Node* lhs; // 左辺
 	Node* rhs; // 右辺
-	Node* cond; // if文/while文/for文の条件
-	Node* then; // if文/while文/for文のthen/body節
+	Node* cond; // if文/while文/for文の条件、switch文の式
+	Node* then; // if文/while文/for文/switch文のthen/body節、case/defaultラベルの後の文
 	Node* els; // if文のelse節
 	Node* init; // for文の初期化
 	Node* inc; // for文のインクリメント
 	Node** body; // ブロック文の本体（文のリスト）
 	Node** args; // 関数呼び出しの引数リスト
 	char* name; // 関数名
-	int val; // kindがND_NUMのときの数値
+	int val; // kindがND_NUM/ND_CASEのときの数値
 	int offset; // kindがND_LVARのときのオフセット
 	int argc; // 引数の数
 	Type* type; // ノードの型情報
 	char* str; // kindがND_STRのときの文字列データ
 	int str_len; // kindがND_STRのときの文字列の長さ
 	BuiltinKind builtin_kind; // kindがND_BUILTIN_CALLのときの組み込み関数の種類
+	int case_label; // kindがND_CASE/ND_DEFAULTのときの分岐先の番号（コード生成で割り当てる）
 };
 
 // 文字列リテラルを管理する構造体
@@ -240,6 +261,7 @@ struct GVar {
 	char* name; // 変数の名前
 	int len;    // 名前の長さ
 	Type* type; // 変数の型情報
+	bool used;  // mainから到達する関数で参照されるか（-O1以上）
 };
 
 // 関数を管理する構造体
@@ -250,16 +272,148 @@ struct Function {
 	int len; // 名前の長さ
 	Node* node; // 関数定義のノード
 	LVar* locals; // その関数のローカル変数
+	bool used; // mainから到達するか（-O1以上）
+};
+
+// 命令バッファの要素の種類
+typedef enum {
+	INST_OP,    // 命令
+	INST_LABEL, // ラベル
+	INST_OTHER, // ディレクティブ・コメント・空行
+} InstKind;
+
+#define INST_MAX_OPERANDS 3
+#define INST_OPERAND_LEN 64
+
+// 出力前の1行分の命令
+typedef struct Inst Inst;
+struct Inst {
+	InstKind kind;
+	char* text;     // 出力する行
+	char op[16];    // ニーモニック
+	char operands[INST_MAX_OPERANDS][INST_OPERAND_LEN]; // ラベルの場合は[0]がラベル名
+	int num_operands;
+	bool deleted;   // 最適化で削除された
 };
 
 // ループラベル管理構造
 typedef struct LoopLabel LoopLabel;
 struct LoopLabel {
 	int break_label;    // breakのジャンプ先ラベル
-	int continue_label; // continueのジャンプ先ラベル
+	int continue_label; // continueのジャンプ先ラベル（ループの外のswitch文では-1）
 	LoopLabel* next;    // ネストしたループ用のスタック
 };
 
+// switch文の本体から集めたラベル
+typedef struct {
+	Node** cases;       // caseラベル（出現順）
+	int num_cases;
+	Node* default_case; // defaultラベル（なければNULL）
+} SwitchCases;
+
+// -----------------------------------------------------------------------------
+// 中間表現（IR）
+// -----------------------------------------------------------------------------
+//
+// 関数ごとに構文木を3番地コードの命令列へ変換し、基本ブロックの制御フローグラフにする。
+// 値は番号（仮想レジスタ）で表し、SSA形式では各値を定義する命令が1つだけになる。
+
+// IR命令の種類
+typedef enum {
+	IR_CONST,     // dst = imm
+	IR_PARAM,     // dst = imm番目の引数レジスタ（入口の基本ブロックだけで使う）
+	IR_COPY,      // dst = a
+	IR_ADD,       // dst = a + b
+	IR_SUB,       // dst = a - b
+	IR_MUL,       // dst = a * b
+	IR_DIV,       // dst = a / b
+	IR_MOD,       // dst = a % b
+	IR_EQ,        // dst = a == b（0か1）
+	IR_NE,        // dst = a != b
+	IR_LT,        // dst = a < b
+	IR_LE,        // dst = a <= b
+	IR_ADDR,      // dst = memのアドレス
+	IR_LOAD,      // dst = mem
+	IR_STORE,     // mem = a
+	IR_CALL,      // dst = name(args)
+	IR_STACK,     // dst = スタックマシンで生成する式node（printf・組み込み関数）
+	IR_PHI,       // dst = 前の基本ブロックpreds[i]から来たときargs[i]
+	IR_SELECT,    // dst = a cmp b なら args[0]、そうでなければ args[1]
+	IR_JUMP,      // succs[0]へ分岐する（ここから下は基本ブロックの終端）
+	IR_BRANCH,    // a cmp b なら succs[0]、そうでなければ succs[1] へ分岐する
+	IR_SWITCH,    // a == cases[i] なら succs[i + 1]、どれでもなければ succs[0] へ分岐する
+	IR_RET,       // aを返す
+	IR_TAIL_CALL, // フレームを解放して name(args) へ分岐する
+} IrOp;
+
+// IR命令が読み書きするメモリ
+typedef enum {
+	MEM_FRAME,   // スタックフレーム上の offset（$s8相当の位置から）
+	MEM_GLOBAL,  // ラベル name から offset バイト
+	MEM_POINTER, // 値 base から offset バイト
+} MemKind;
+
+typedef struct {
+	MemKind kind;
+	int offset;
+	char* name;
+	int base;
+} MemRef;
+
+typedef struct BasicBlock BasicBlock;
+
+typedef struct IrInst IrInst;
+struct IrInst {
+	IrOp op;
+	int dst;         // 定義する値（なければ-1）
+	int a, b;        // オペランドの値（なければ-1）
+	int imm;         // IR_CONSTの値、IR_PARAMの番号、IR_PHIの変数番号
+	IrOp cmp;        // IR_BRANCH/IR_SELECTの比較（IR_EQ/IR_NE/IR_LT/IR_LE）
+	MemRef mem;      // IR_ADDR/IR_LOAD/IR_STOREのメモリ
+	char* name;      // IR_CALL/IR_TAIL_CALLの関数名
+	int* args;       // IR_CALL/IR_TAIL_CALL/IR_PHI/IR_SELECTのオペランド
+	int num_args;
+	int* cases;      // IR_SWITCHのcaseの値
+	int num_cases;
+	Node* node;      // IR_STACKの式
+	BasicBlock* block;
+	IrInst* prev;
+	IrInst* next;
+};
+
+struct BasicBlock {
+	int id;
+	IrInst* first;
+	IrInst* last;        // 終端命令（IR_JUMP/IR_BRANCH/IR_SWITCH/IR_RET/IR_TAIL_CALL）
+	BasicBlock** succs;  // 後続（IR_SWITCHでは3つ以上になりうる）
+	int num_succs;
+	BasicBlock** preds;
+	int num_preds;
+	BasicBlock* idom;    // 直接支配する基本ブロック（入口はNULL）
+	int rpo;             // 逆後順での番号（到達しなければ-1）
+	int label;           // 出力するラベルの番号
+};
+
+typedef struct {
+	Node* node;           // 関数定義
+	Function* func;
+	BasicBlock** blocks;  // 逆後順（compute_cfgの後）
+	int num_blocks;
+	int cap_blocks;
+	BasicBlock* entry;
+	int num_values;
+	unsigned** live_in;   // 基本ブロックの入口で生きている値の集合（compute_livenessの後）
+	unsigned** live_out;  // 基本ブロックの出口で生きている値の集合
+	int* regs;            // 値を割り当てたレジスタの番号（regallocの後）
+	int* spill_slots;     // レジスタに載らない値のフレーム上のオフセット
+	int save_slots[8];    // $s0-$s7を退避するフレーム上のオフセット（使わなければ0）
+} IrFunc;
+
+// 割り当て結果（IrFunc.regs）
+#define REG_SPILLED -1 // spill_slotsに置く
+#define REG_CONST -2   // 定数なので使う場所で即値にする
+#define REG_NONE -3    // 使われない
+
 extern char* user_input; // 入力文字列
 extern Token* token; // 現在読んでいるtoken
 extern LVar* locals; // ローカル変数のリスト
@@ -272,6 +426,14 @@ extern int label_count; // ラベル生成用のカウンタ
 extern int string_count; // 文字列ラベル生成用のカウンタ
 extern StringLiteral* string_literals; // 文字列リテラルのリスト
 extern LoopLabel* loop_stack; // ループラベルスタック
+extern int opt_level; // 最適化レベル（-O0: スタックマシン, -O1: レジスタ割り当て）
+extern int omit_frame_pointer; // フレームポインタ（$s8）を使わずに$sp基準で変数を参照する
+extern int unroll_factor; // ループを展開するときに並べる本体の数（2未満なら展開しない）
+extern bool frame_uses_fp; // 現在の関数がローカル変数を$s8基準で参照するか
+extern int frame_top; // $s8に相当する位置の、プロローグ直後の$spからのオフセット
+extern Inst* insts; // 出力待ちの命令列
+extern int inst_count; // 出力待ちの命令数
+extern int sp_offset; // プロローグ後に$spを下げたバイト数
 
 // パーサ関連の関数
 Token* tokenize(char* p);
@@ -283,6 +445,9 @@ bool consume_continue();
 bool consume_if();
 bool consume_while();
 bool consume_for();
+bool consume_switch();
+bool consume_case();
+bool consume_default();
 bool consume_void();
 bool consume_int();
 bool consume_char();
@@ -331,12 +496,120 @@ void gen_lval(Node* node);
 void gen_compound_assign(Node* node, const char* operation, bool is_div);
 void gen_inc_dec(Node* node, int delta, bool is_prefix);
 void gen_variable_access(Node* node, bool is_local);
+bool is_array_var(Node* node);
+Member* lookup_member(Node* node);
+int add_string_literal(Node* node);
+Function* lookup_function(char* name);
+void frame_operand(char* buf, int offset);
+void gen_frame_addr(char* rd, int offset);
+LVar* gen_func_label(Node* node);
+LVar* gen_func_prologue(Node* node);
+void gen_func_epilogue(void);
+void collect_switch_cases(Node* node, SwitchCases* sc);
+void gen_switch_dispatch(int* vals, char** labels, int n, char* default_label);
+void gen_switch_branch(Node* node, int break_label);
+bool jump_table_refers(char* label);
+void print_jump_tables(void);
+
+// レジスタ割り当てモードのコード生成（-O1以上）
+void gen_func_reg(Node* node);
+
+// 構文木の簡約（-O1以上）
+void simplify_program(void);
+void inline_functions(void);
+int add_frame_var(Function* caller, LVar* var);
+Node* copy_expr(Node* node);
+void optimize_loops(void);
+void remove_dead_code(void);
+bool has_side_effects(Node* node);
+bool is_speculatable(Node* node);
+Node* select_assign(Node* node);
+bool tree_any(Node* node, bool (*pred)(Node* node, void* data), void* data);
+bool is_call_node(Node* node, void* data);
+bool takes_local_address(Node* node, void* data);
+
+// 中間表現（-O2）
+IrFunc* new_ir_func(Node* node);
+BasicBlock* new_basic_block(IrFunc* f);
+int new_value(IrFunc* f);
+IrInst* new_inst(IrOp op);
+void append_inst(BasicBlock* bb, IrInst* inst);
+void insert_inst_before(IrInst* pos, IrInst* inst);
+void remove_inst(IrInst* inst);
+bool is_terminator(IrOp op);
+bool inst_has_side_effect(IrInst* inst);
+int inst_operands(IrInst* inst, int** ops);
+LVar* frame_var_at(int offset);
+void add_succ(BasicBlock* bb, BasicBlock* succ);
+void add_pred(BasicBlock* bb, BasicBlock* pred);
+int pred_index(BasicBlock* bb, BasicBlock* pred);
+void remove_pred(BasicBlock* bb, BasicBlock* pred);
+void compute_cfg(IrFunc* f);
+void compute_dominators(IrFunc* f);
+unsigned* new_value_set(IrFunc* f);
+bool set_has(unsigned* set, int v);
+void set_add(unsigned* set, int v);
+void compute_liveness(IrFunc* f);
+void dump_ir(IrFunc* f, FILE* out);
+IrFunc* lower_function(Node* node);
+void build_ssa(IrFunc* f);
+void number_values(IrFunc* f);
+void eliminate_dead_code(IrFunc* f);
+extern int if_conversion;
+void convert_ifs(IrFunc* f);
+void destruct_ssa(IrFunc* f);
+void allocate_registers(IrFunc* f);
+void gen_func_ir(IrFunc* f);
+void gen_mul_const(char* rd, char* rs, int c);
+void gen_div_positive(char* rq, char* rx, int c);
+
+// パスマネージャ
+extern int use_ir;
+void run_program_passes(void);
+void gen_function(Node* node);
+bool disable_pass(char* name);
+void print_pass_times(void);
+extern bool time_passes;
+extern bool dump_ir_passes;
+
+// 命令バッファ
+void emit(char* fmt, ...);
+void insert_inst(int idx, char* line);
+void set_inst(Inst* inst, char* op, char* a, char* b, char* c);
+void update_inst(Inst* inst);
+void flush_insts(void);
+
+// 命令の解析
+bool inst_is(Inst* inst, char* op);
+bool inst_defines_first(Inst* inst);
+bool inst_is_known(Inst* inst);
+bool inst_is_branch(Inst* inst);
+bool operand_mentions(char* operand, char* reg);
+bool inst_reads_operand(Inst* inst, char* reg);
+bool inst_reads(Inst* inst, char* reg);
+bool inst_writes(Inst* inst, char* reg);
+bool is_arg_reg(char* reg);
+bool is_temp_reg(char* reg);
+
+// のぞき穴最適化
+void peephole(void);
+
+// 命令スケジューリング
+extern int schedule_insns;
+extern bool sched_verbose;
+bool set_tune(char* name);
+void schedule_insts(void);
+void print_sched_stats(void);
+
+// 遅延スロットの充填
+void fill_delay_slots(void);
 
 // printf実装の補助関数
 void gen_printf_call(Node* node);
 void gen_printf_char(int printf_id);
-void gen_printf_integer(int printf_id, int arg_index);
-void gen_write_syscall(void);
+void print_printf_runtime(void);
+void gen_write_char(char* reg);
+void gen_flush_output(void);
 
 // 組み込み関数サポート
 BuiltinKind get_builtin_kind(Token* tok);
@@ -353,6 +353,12 @@ Token* tokenize(char* p) {
 				cur = new_token(TK_BREAK, cur, start, len);
 			} else if (len == LEN_CONTINUE && !memcmp(start, "continue", LEN_CONTINUE)) {
 				cur = new_token(TK_CONTINUE, cur, start, len);
+			} else if (len == LEN_SWITCH && !memcmp(start, "switch", LEN_SWITCH)) {
+				cur = new_token(TK_SWITCH, cur, start, len);
+			} else if (len == LEN_CASE && !memcmp(start, "case", LEN_CASE)) {
+				cur = new_token(TK_CASE, cur, start, len);
+			} else if (len == LEN_DEFAULT && !memcmp(start, "default", LEN_DEFAULT)) {
+				cur = new_token(TK_DEFAULT, cur, start, len);
 			} else {
 				cur = new_token(TK_IDENT, cur, start, len);
 			}
@@ -475,6 +481,27 @@ bool consume_for() {
 	return true;
 }
 
+bool consume_switch() {
+	if (token->kind != TK_SWITCH)
+		return false;
+	token = token->next;
+	return true;
+}
+
+bool consume_case() {
+	if (token->kind != TK_CASE)
+		return false;
+	token = token->next;
+	return true;
+}
+
+bool consume_default() {
+	if (token->kind != TK_DEFAULT)
+		return false;
+	token = token->next;
+	return true;
+}
+
 bool consume_void() {
 	if (token->kind != TK_VOID)
 		return false;
@@ -619,7 +646,7 @@ Node* new_node_num(int val) {
 // ノードのパーサ
 /*
 program    = stmt*
-stmt       = declaration | "return" expr ";" | "if" "(" expr ")" stmt | "while" "(" expr ")" stmt | "for" "(" expr? ";" expr? ";" expr? ")" stmt | "{" stmt* "}" | expr ";"
+stmt       = declaration | "return" expr ";" | "if" "(" expr ")" stmt | "while" "(" expr ")" stmt | "for" "(" expr? ";" expr? ";" expr? ")" stmt | "switch" "(" expr ")" stmt | "case" expr ":" stmt | "default" ":" stmt | "{" stmt* "}" | expr ";"
 declaration = type_spec declarator ("," declarator)* ";"
 declarator = ident ("[" num "]")? ("=" expr)?
 type_spec  = "int" | "char" | type_spec "*"
@@ -685,6 +712,64 @@ Node* ternary() {
 Node* expr() {
 	return ternary();
 }
+// 解析中のswitch文
+typedef struct {
+	int* vals;        // これまでに出てきたcaseの値
+	int num_vals;
+	bool has_default;
+	int loop_depth;   // 本体の中で解析中のループの深さ
+} SwitchScope;
+
+static SwitchScope* current_switch;
+
+Node* stmt();
+
+// ループの本体。switch文の中のループにはcase/defaultラベルを置けない
+static Node* loop_body() {
+	if (current_switch)
+		current_switch->loop_depth++;
+	Node* node = stmt();
+	if (current_switch)
+		current_switch->loop_depth--;
+	return node;
+}
+
+// caseラベルの整数定数式を計算する
+static int eval_const(Node* node) {
+	switch (node->kind) {
+	case ND_NUM:
+		return node->val;
+	case ND_ADD:
+		return eval_const(node->lhs) + eval_const(node->rhs);
+	case ND_SUB:
+		return eval_const(node->lhs) - eval_const(node->rhs);
+	case ND_MUL:
+		return eval_const(node->lhs) * eval_const(node->rhs);
+	case ND_DIV:
+	case ND_MOD: {
+		int rhs = eval_const(node->rhs);
+		if (rhs == 0)
+			error("division by zero in case label");
+		return node->kind == ND_DIV ? eval_const(node->lhs) / rhs : eval_const(node->lhs) % rhs;
+	}
+	default:
+		error("case label is not an integer constant");
+		return 0;
+	}
+}
+
+// case/defaultラベルの ":" と、その後の文（ブロックの末尾なら空文）
+static Node* label_stmt() {
+	if (token->kind != TK_COLON)
+		error("expected ':' after case label");
+	token = token->next;
+	if (current_switch->loop_depth)
+		error("case label inside a loop within a switch statement is not supported");
+	if (token->kind == TK_RESERVED && token->len == 1 && *token->str == '}')
+		return new_node_num(0);
+	return stmt();
+}
+
 Node* stmt() {
 	Node* node;
 	if (token->kind == TK_VOID || token->kind == TK_INT || token->kind == TK_CHAR || token->kind == TK_STRUCT) {
@@ -811,7 +896,7 @@ Node* stmt() {
 		expect("(");
 		node->cond = expr();
 		expect(")");
-		node->then = stmt();
+		node->then = loop_body();
 		return node;
 	}
 	if (consume_for()) {
@@ -833,7 +918,47 @@ Node* stmt() {
 			node->inc = expr();
 			expect(")");
 		}
+		node->then = loop_body();
+		return node;
+	}
+	if (consume_switch()) {
+		node = calloc(1, sizeof(Node));
+		node->kind = ND_SWITCH;
+		expect("(");
+		node->cond = expr();
+		expect(")");
+		SwitchScope scope = {0};
+		SwitchScope* outer = current_switch;
+		current_switch = &scope;
 		node->then = stmt();
+		current_switch = outer;
+		free(scope.vals);
+		return node;
+	}
+	if (consume_case()) {
+		if (!current_switch)
+			error("case label not within a switch statement");
+		node = calloc(1, sizeof(Node));
+		node->kind = ND_CASE;
+		node->val = eval_const(expr());
+		for (int i = 0; i < current_switch->num_vals; i++) {
+			if (current_switch->vals[i] == node->val)
+				error("duplicate case value %d", node->val);
+		}
+		current_switch->vals = realloc(current_switch->vals, sizeof(int) * (current_switch->num_vals + 1));
+		current_switch->vals[current_switch->num_vals++] = node->val;
+		node->then = label_stmt();
+		return node;
+	}
+	if (consume_default()) {
+		if (!current_switch)
+			error("default label not within a switch statement");
+		if (current_switch->has_default)
+			error("multiple default labels in one switch");
+		current_switch->has_default = true;
+		node = calloc(1, sizeof(Node));
+		node->kind = ND_DEFAULT;
+		node->then = label_stmt();
 		return node;
 	}
 	if (consume("{")) {
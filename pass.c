@@ -0,0 +1,168 @@
+#include "mipsc.h"
+#include <time.h>
+
+// =============================================================================
+// パスマネージャ
+// =============================================================================
+//
+// 最適化とコード生成の各段階をpasses[]に登録し、有効なものを順に実行する。
+// 構文木全体に対するパスを先にすべて行い、その後は関数ごとに
+// （中間表現のパス →）コード生成 → 命令バッファのパス の順に処理する。
+// -ftime-passesで各パスの所要時間を、-fdump-irで中間表現のパスの結果を
+// 標準エラー出力に出す。-fdisable-pass=名前 で省略できるパスを止められる。
+
+int use_ir = -1;             // -f[no-]ir（未指定なら-1）
+bool time_passes;            // -ftime-passes
+bool dump_ir_passes;         // -fdump-ir
+
+typedef enum {
+	PASS_PROGRAM, // 構文木全体（-O1以上）
+	PASS_IR,      // 関数の中間表現（-fir）
+	PASS_CODEGEN, // 関数のコード生成
+	PASS_ASM,     // 関数の命令バッファ（-O1以上）
+} PassKind;
+
+typedef struct {
+	char* name;
+	char* desc;
+	PassKind kind;
+	bool optional;              // -fdisable-passで止められる
+	void (*run)(void);          // PASS_PROGRAM/PASS_ASM
+	void (*run_ir)(IrFunc* f);  // PASS_IR（loweringはNULL）
+	int* flag;                  // 0なら実行しない（NULLなら最適化レベルだけで決める）
+	bool disabled;
+	double seconds;             // 累計の所要時間
+} Pass;
+
+static Pass passes[] = {
+	{"simplify", "simplify expressions", PASS_PROGRAM, true, simplify_program},
+	{"inline", "inline small functions", PASS_PROGRAM, true, inline_functions},
+	{"loop", "loop optimizations", PASS_PROGRAM, true, optimize_loops},
+	{"deadcode", "remove unreachable functions", PASS_PROGRAM, true, remove_dead_code},
+	{"lower", "lower AST to IR", PASS_IR, false, NULL, NULL},
+	{"ssa", "promote locals to SSA values", PASS_IR, true, NULL, build_ssa},
+	{"gvn", "global value numbering", PASS_IR, true, NULL, number_values},
+	{"ifcvt", "if-conversion to selects", PASS_IR, true, NULL, convert_ifs, &if_conversion},
+	{"dce", "dead code elimination", PASS_IR, true, NULL, eliminate_dead_code},
+	{"out-of-ssa", "replace phis with copies", PASS_IR, false, NULL, destruct_ssa},
+	{"regalloc", "linear scan register allocation", PASS_IR, false, NULL, allocate_registers},
+	{"codegen", "instruction selection", PASS_CODEGEN, false},
+	{"peephole", "peephole optimization", PASS_ASM, true, peephole},
+	{"schedule", "list instruction scheduling", PASS_ASM, true, schedule_insts, NULL, &schedule_insns},
+	{"delayslot", "fill branch delay slots", PASS_ASM, false, fill_delay_slots},
+};
+
+#define NUM_PASSES (int)(sizeof(passes) / sizeof(passes[0]))
+
+static Pass* find_pass(char* name) {
+	for (int i = 0; i < NUM_PASSES; i++) {
+		if (strcmp(passes[i].name, name) == 0) {
+			return &passes[i];
+		}
+	}
+	return NULL;
+}
+
+// 名前のパスを止める。止められないパスならfalse
+bool disable_pass(char* name) {
+	Pass* pass = find_pass(name);
+	if (!pass || !pass->optional) {
+		return false;
+	}
+	pass->disabled = true;
+	return true;
+}
+
+static double now(void) {
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static bool pass_enabled(Pass* pass) {
+	if (pass->disabled || (pass->flag && !*pass->flag)) {
+		return false;
+	}
+	switch (pass->kind) {
+	case PASS_PROGRAM:
+	case PASS_ASM:
+		return opt_level >= 1;
+	case PASS_IR:
+		return use_ir;
+	default:
+		return true;
+	}
+}
+
+// 構文木全体に対するパスを順に実行する
+void run_program_passes(void) {
+	for (int i = 0; i < NUM_PASSES; i++) {
+		Pass* pass = &passes[i];
+		if (pass->kind != PASS_PROGRAM || !pass_enabled(pass)) {
+			continue;
+		}
+		double start = now();
+		pass->run();
+		pass->seconds += now() - start;
+	}
+}
+
+static void dump_after(Pass* pass, IrFunc* f) {
+	if (dump_ir_passes) {
+		fprintf(stderr, "; after %s\n", pass->name);
+		dump_ir(f, stderr);
+	}
+}
+
+// 関数定義を1つ出力する
+void gen_function(Node* node) {
+	LVar* saved_locals = locals;
+	IrFunc* f = NULL;
+	for (int i = 0; i < NUM_PASSES; i++) {
+		Pass* pass = &passes[i];
+		if (pass->kind == PASS_PROGRAM || !pass_enabled(pass)) {
+			continue;
+		}
+		double start = now();
+		switch (pass->kind) {
+		case PASS_IR:
+			if (pass->run_ir) {
+				pass->run_ir(f);
+			} else {
+				f = lower_function(node);
+			}
+			break;
+		case PASS_CODEGEN:
+			if (f) {
+				gen_func_ir(f);
+			} else if (opt_level == 0) {
+				gen(node);
+			} else {
+				gen_func_reg(node);
+			}
+			locals = saved_locals;
+			break;
+		default:
+			pass->run();
+			break;
+		}
+		pass->seconds += now() - start;
+		if (pass->kind == PASS_IR) {
+			dump_after(pass, f);
+		}
+	}
+	flush_insts();
+}
+
+// -ftime-passes の集計
+void print_pass_times(void) {
+	double total = 0;
+	fprintf(stderr, "%-12s %10s  %s\n", "pass", "seconds", "description");
+	for (int i = 0; i < NUM_PASSES; i++) {
+		Pass* pass = &passes[i];
+		if (!pass_enabled(pass)) {
+			continue;
+		}
+		fprintf(stderr, "%-12s %10.6f  %s\n", pass->name, pass->seconds, pass->desc);
+		total += pass->seconds;
+	}
+	fprintf(stderr, "%-12s %10.6f\n", "total", total);
+}
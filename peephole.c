@@ -0,0 +1,279 @@
+#include "mipsc.h"
+
+// =============================================================================
+// のぞき穴最適化（-O1以上）
+// =============================================================================
+//
+// 命令バッファ上の連続した命令を小さな窓で見て、冗長な並びを書き換える。
+// 規則はpeephole_rules[]に登録し、どの規則も適用できなくなるまで繰り返す。
+// ラベルやディレクティブをまたぐ並びは対象にしない（参照されないラベルは先に取り除く）。
+
+// 命令idxより後でregの値が使われないことが確実か
+static bool reg_dead_after(int idx, char* reg) {
+	if (!is_temp_reg(reg) && strcmp(reg, "$v0") != 0 && !is_arg_reg(reg))
+		return false;
+
+	for (int i = idx + 1; i < inst_count; i++) {
+		Inst* inst = &insts[i];
+		if (inst->deleted || inst->kind == INST_OTHER)
+			continue;
+		if (inst->kind == INST_LABEL || !inst_is_known(inst))
+			return false;
+		if (inst_reads(inst, reg))
+			return false;
+		if (inst_writes(inst, reg))
+			return true;
+		// 関数から戻るときは戻り値以外は不要
+		if (inst_is(inst, "jr") && strcmp(inst->operands[0], "$ra") == 0)
+			return strcmp(reg, "$v0") != 0;
+		if (inst_is_branch(inst))
+			return false;
+	}
+	return false;
+}
+
+// idx以降の削除されていない命令をn個集める（ラベルなどで途切れたら失敗）
+static bool window(int idx, Inst** w, int n) {
+	int count = 0;
+	for (int i = idx; i < inst_count && count < n; i++) {
+		Inst* inst = &insts[i];
+		if (inst->deleted)
+			continue;
+		if (inst->kind != INST_OP)
+			return false;
+		w[count++] = inst;
+	}
+	return count == n;
+}
+
+// 窓の最後の命令の位置
+static int index_of(Inst* inst) {
+	return inst - insts;
+}
+
+static bool is_sp_adjust(Inst* inst, int* amount) {
+	if (!inst_is(inst, "addiu") || strcmp(inst->operands[0], "$sp") != 0 ||
+	    strcmp(inst->operands[1], "$sp") != 0)
+		return false;
+	*amount = atoi(inst->operands[2]);
+	return true;
+}
+
+// movで置き換える（同じレジスタ同士なら削除する）
+static void replace_with_move(Inst* inst, char* dst, char* src) {
+	if (strcmp(dst, src) == 0) {
+		inst->deleted = true;
+		return;
+	}
+	set_inst(inst, "move", dst, src, NULL);
+}
+
+// -----------------------------------------------------------------------------
+// 規則
+// -----------------------------------------------------------------------------
+
+// move $tX, $tX を削除する
+static bool rule_self_move(int idx) {
+	Inst* w[1];
+	if (!window(idx, w, 1) || !inst_is(w[0], "move"))
+		return false;
+	if (strcmp(w[0]->operands[0], w[0]->operands[1]) != 0)
+		return false;
+	w[0]->deleted = true;
+	return true;
+}
+
+// プッシュ直後のポップをレジスタ間の転送にする
+//   addiu $sp, $sp, -4 / sw A, 0($sp) / lw B, 0($sp) / addiu $sp, $sp, 4
+static bool rule_push_pop(int idx) {
+	Inst* w[4];
+	int down, up;
+	if (!window(idx, w, 4) || !is_sp_adjust(w[0], &down) || down != -4 ||
+	    !inst_is(w[1], "sw") || strcmp(w[1]->operands[1], "0($sp)") != 0 ||
+	    !inst_is(w[2], "lw") || strcmp(w[2]->operands[1], "0($sp)") != 0 ||
+	    !is_sp_adjust(w[3], &up) || up != 4)
+		return false;
+	w[0]->deleted = true;
+	w[1]->deleted = true;
+	w[3]->deleted = true;
+	replace_with_move(w[2], w[2]->operands[0], w[1]->operands[0]);
+	return true;
+}
+
+// 隣り合う$spの調整をまとめる
+static bool rule_merge_sp(int idx) {
+	Inst* w[2];
+	int a, b;
+	if (!window(idx, w, 2) || !is_sp_adjust(w[0], &a) || !is_sp_adjust(w[1], &b))
+		return false;
+	w[1]->deleted = true;
+	if (a + b == 0) {
+		w[0]->deleted = true;
+		return true;
+	}
+	char imm[16];
+	sprintf(imm, "%d", a + b);
+	set_inst(w[0], "addiu", "$sp", "$sp", imm);
+	return true;
+}
+
+// 格納した直後に同じ場所から読み直さない
+//   sw A, X / lw B, X  →  sw A, X / move B, A
+static bool rule_store_load(int idx) {
+	Inst* w[2];
+	if (!window(idx, w, 2) || !inst_is(w[0], "sw") || !inst_is(w[1], "lw") ||
+	    strcmp(w[0]->operands[1], w[1]->operands[1]) != 0)
+		return false;
+	replace_with_move(w[1], w[1]->operands[0], w[0]->operands[0]);
+	return true;
+}
+
+// 読み込んだ値をそのまま同じ場所へ書き戻さない
+//   lw A, X / sw A, X  →  lw A, X
+static bool rule_load_store(int idx) {
+	Inst* w[2];
+	if (!window(idx, w, 2) || !inst_is(w[0], "lw") || !inst_is(w[1], "sw") ||
+	    strcmp(w[0]->operands[0], w[1]->operands[0]) != 0 ||
+	    strcmp(w[0]->operands[1], w[1]->operands[1]) != 0 ||
+	    operand_mentions(w[0]->operands[1], w[0]->operands[0]))
+		return false;
+	w[1]->deleted = true;
+	return true;
+}
+
+// 往復する転送の2つ目を削除する
+//   move A, B / move B, A  →  move A, B
+static bool rule_move_back(int idx) {
+	Inst* w[2];
+	if (!window(idx, w, 2) || !inst_is(w[0], "move") || !inst_is(w[1], "move") ||
+	    strcmp(w[0]->operands[0], w[1]->operands[1]) != 0 ||
+	    strcmp(w[0]->operands[1], w[1]->operands[0]) != 0)
+		return false;
+	w[1]->deleted = true;
+	return true;
+}
+
+// 計算結果を転送するだけなら転送先に直接書く
+//   addu $t0, $t1, $t2 / move $v0, $t0  →  addu $v0, $t1, $t2（$t0が以後不要な場合）
+static bool rule_forward_def(int idx) {
+	Inst* w[2];
+	if (!window(idx, w, 2) || !inst_defines_first(w[0]) || !inst_is(w[1], "move") ||
+	    inst_is(w[0], "movn") || inst_is(w[0], "movz"))
+		return false;
+	char* tmp = w[0]->operands[0];
+	if (strcmp(w[1]->operands[1], tmp) != 0 || strcmp(w[1]->operands[0], tmp) == 0 ||
+	    !reg_dead_after(index_of(w[1]), tmp))
+		return false;
+	strcpy(w[0]->operands[0], w[1]->operands[0]);
+	update_inst(w[0]);
+	w[1]->deleted = true;
+	return true;
+}
+
+// 転送したレジスタを1回使うだけなら転送元を直接使う
+//   move $t0, $v0 / sw $t0, -12($s8)  →  sw $v0, -12($s8)（$t0が以後不要な場合）
+static bool rule_forward_use(int idx) {
+	Inst* w[2];
+	if (!window(idx, w, 2) || !inst_is(w[0], "move") || !inst_is_known(w[1]) || inst_is_branch(w[1]) ||
+	    inst_is(w[1], "syscall"))
+		return false;
+	char* dst = w[0]->operands[0];
+	char* src = w[0]->operands[1];
+	if (!inst_reads_operand(w[1], dst))
+		return false;
+	if (!inst_writes(w[1], dst) && !reg_dead_after(index_of(w[1]), dst))
+		return false;
+	// movn/movzの書き込み先は置き換えられない
+	if ((inst_is(w[1], "movn") || inst_is(w[1], "movz")) && strcmp(w[1]->operands[0], dst) == 0)
+		return false;
+
+	int first = inst_defines_first(w[1]) ? 1 : 0;
+	for (int i = first; i < w[1]->num_operands; i++) {
+		char* operand = w[1]->operands[i];
+		if (strcmp(operand, dst) == 0) {
+			strcpy(operand, src);
+		} else if (operand_mentions(operand, dst)) {
+			char buf[INST_OPERAND_LEN];
+			*strchr(operand, '(') = '\0';
+			snprintf(buf, sizeof(buf), "%s(%s)", operand, src);
+			strcpy(operand, buf);
+		}
+	}
+	update_inst(w[1]);
+	w[0]->deleted = true;
+	return true;
+}
+
+// 直後のラベルへのジャンプを削除する
+static bool rule_jump_to_next(int idx) {
+	Inst* inst = &insts[idx];
+	if (inst->deleted || !inst_is(inst, "j"))
+		return false;
+	for (int i = idx + 1; i < inst_count; i++) {
+		if (insts[i].deleted || insts[i].kind == INST_OTHER)
+			continue;
+		if (insts[i].kind != INST_LABEL)
+			return false;
+		if (strcmp(insts[i].operands[0], inst->operands[0]) == 0) {
+			inst->deleted = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+// どこからも参照されないローカルラベルを削除する（前後の命令を同じ窓で扱えるようにする）
+static bool rule_unused_label(int idx) {
+	Inst* label = &insts[idx];
+	if (label->kind != INST_LABEL || strncmp(label->operands[0], ".L", 2) != 0)
+		return false;
+	if (jump_table_refers(label->operands[0]))
+		return false;
+	for (int i = 0; i < inst_count; i++) {
+		Inst* inst = &insts[i];
+		if (inst->deleted || inst->kind != INST_OP)
+			continue;
+		for (int j = 0; j < inst->num_operands; j++)
+			if (strcmp(inst->operands[j], label->operands[0]) == 0)
+				return false;
+	}
+	label->deleted = true;
+	return true;
+}
+
+typedef struct {
+	char* name;
+	bool (*apply)(int idx); // 位置idxから始まる並びを書き換えたらtrue
+} PeepholeRule;
+
+static PeepholeRule peephole_rules[] = {
+	{"self-move", rule_self_move},
+	{"push-pop", rule_push_pop},
+	{"merge-sp", rule_merge_sp},
+	{"store-load", rule_store_load},
+	{"load-store", rule_load_store},
+	{"move-back", rule_move_back},
+	{"forward-def", rule_forward_def},
+	{"forward-use", rule_forward_use},
+	{"jump-to-next", rule_jump_to_next},
+	{"unused-label", rule_unused_label},
+	{NULL, NULL},
+};
+
+void peephole(void) {
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 0; i < inst_count; i++) {
+			if (insts[i].deleted || insts[i].kind == INST_OTHER)
+				continue;
+			for (PeepholeRule* rule = peephole_rules; rule->name; rule++) {
+				if (rule->apply(i)) {
+					changed = true;
+					if (insts[i].deleted)
+						break;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,282 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 命令スケジューリング（-O2）
+// =============================================================================
+//
+// レジスタ割り当てとのぞき穴最適化の後の命令列を、ラベル・分岐・システムコールで
+// 区切った範囲ごとに並べ替える（リストスケジューリング）。
+// 読み込みや乗除算の結果を使う命令を結果が出るまで後ろへずらし、間に独立した命令を置く。
+// 結果が使えるまでのサイクル数は-mtuneで選んだCPUの表から引き、1命令ずつ順に発行する
+// パイプラインで待つサイクル（ストール）が減る場合だけ並べ替えを採用する。
+
+#define MAX_REGION 128 // 一度に並べ替える命令数
+
+// 結果が使えるようになるまでのサイクル数（ALU命令は1）
+typedef struct {
+	char* name;
+	int load;  // lw/lbなど
+	int mul;   // 3オペランドのmul
+	int mult;  // mult/multuからmflo/mfhiまで
+	int div;   // div/divuからmflo/mfhiまで
+} CpuModel;
+
+static CpuModel cpu_models[] = {
+	{"24k", 2, 5, 5, 35},
+	{"4kc", 2, 3, 3, 35},
+	{"r3000", 2, 12, 12, 35},
+};
+
+#define NUM_CPU_MODELS (int)(sizeof(cpu_models) / sizeof(cpu_models[0]))
+
+int schedule_insns = -1;  // -f[no-]schedule-insns（未指定なら-1）
+bool sched_verbose;       // -fsched-verbose
+static CpuModel* cpu = &cpu_models[0];
+static int stalls_before; // 並べ替える前と後のストールの合計
+static int stalls_after;
+
+// -mtune=名前 でCPUを選ぶ。知らない名前ならfalse
+bool set_tune(char* name) {
+	for (int i = 0; i < NUM_CPU_MODELS; i++) {
+		if (strcmp(cpu_models[i].name, name) == 0) {
+			cpu = &cpu_models[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// 命令間の依存
+// -----------------------------------------------------------------------------
+
+static bool is_load(Inst* inst) {
+	return inst_is(inst, "lw") || inst_is(inst, "lb") || inst_is(inst, "lbu") ||
+	       inst_is(inst, "lh") || inst_is(inst, "lhu");
+}
+
+static bool is_store(Inst* inst) {
+	return inst_is(inst, "sw") || inst_is(inst, "sb") || inst_is(inst, "sh");
+}
+
+static int access_size(Inst* inst) {
+	if (inst->op[1] == 'b')
+		return 1;
+	if (inst->op[1] == 'h')
+		return 2;
+	return 4;
+}
+
+// HI/LOに書く命令（mulはHI/LOを壊す）
+static bool writes_hilo(Inst* inst) {
+	return inst_is(inst, "mult") || inst_is(inst, "multu") || inst_is(inst, "div") || inst_is(inst, "divu") ||
+	       inst_is(inst, "mul");
+}
+
+static bool reads_hilo(Inst* inst) {
+	return inst_is(inst, "mflo") || inst_is(inst, "mfhi");
+}
+
+static bool is_div(Inst* inst) {
+	return inst_is(inst, "div") || inst_is(inst, "divu");
+}
+
+// 命令の結果（第1オペランド）が使えるまでのサイクル数
+static int result_latency(Inst* inst) {
+	if (is_load(inst))
+		return cpu->load;
+	if (inst_is(inst, "mul"))
+		return cpu->mul;
+	if (is_div(inst))
+		return cpu->div;
+	return 1;
+}
+
+// 2つのメモリオペランドが同じベースレジスタからの重ならない範囲か
+static bool disjoint_access(Inst* p, Inst* q) {
+	char* pp = strchr(p->operands[1], '(');
+	char* qp = strchr(q->operands[1], '(');
+	if (!pp || !qp || strcmp(pp, qp) != 0)
+		return false;
+	char* end;
+	long po = pp == p->operands[1] ? 0 : strtol(p->operands[1], &end, 0);
+	if (pp != p->operands[1] && end != pp)
+		return false;
+	long qo = qp == q->operands[1] ? 0 : strtol(q->operands[1], &end, 0);
+	if (qp != q->operands[1] && end != qp)
+		return false;
+	return po + access_size(p) <= qo || qo + access_size(q) <= po;
+}
+
+// 命令qを命令pより後ろに置かなければならないとき、pの発行からqの発行までに
+// 空けるサイクル数（依存がなければ-1）
+static int dependence(Inst* p, Inst* q) {
+	int latency = -1;
+	char* pd = inst_defines_first(p) ? p->operands[0] : NULL;
+	char* qd = inst_defines_first(q) ? q->operands[0] : NULL;
+	if (pd && inst_reads(q, pd))
+		latency = result_latency(p);
+	if (writes_hilo(p) && reads_hilo(q)) {
+		int hilo = is_div(p) ? cpu->div : cpu->mult;
+		if (hilo > latency)
+			latency = hilo;
+	}
+	if (latency >= 0)
+		return latency;
+
+	if (qd && (inst_reads(p, qd) || (pd && strcmp(pd, qd) == 0)))
+		return 0;
+	if ((writes_hilo(p) || reads_hilo(p)) && writes_hilo(q))
+		return 0;
+	if (reads_hilo(q) && writes_hilo(p))
+		return 0;
+	if ((is_store(p) && (is_load(q) || is_store(q))) || (is_load(p) && is_store(q)))
+		return disjoint_access(p, q) ? -1 : 0;
+	return -1;
+}
+
+// -----------------------------------------------------------------------------
+// リストスケジューリング
+// -----------------------------------------------------------------------------
+
+static int lat[MAX_REGION][MAX_REGION];  // lat[i][j]: 命令iから命令jへの依存
+
+// order順に1命令ずつ発行したときのストールのサイクル数
+static int count_stalls(int* order, int n) {
+	int issue[MAX_REGION];
+	int pos[MAX_REGION];
+	for (int k = 0; k < n; k++)
+		pos[order[k]] = k;
+	int cycle = 0;
+	int stalls = 0;
+	for (int k = 0; k < n; k++) {
+		int j = order[k];
+		int ready = cycle;
+		for (int i = 0; i < n; i++)
+			if (lat[i][j] > 0 && pos[i] < k && issue[i] + lat[i][j] > ready)
+				ready = issue[i] + lat[i][j];
+		stalls += ready - cycle;
+		issue[j] = ready;
+		cycle = ready + 1;
+	}
+	return stalls;
+}
+
+// region[0..n)の位置にある命令を並べ替える。最後の命令が分岐なら動かさない
+static void schedule_region(int* region, int n) {
+	if (n == 0)
+		return;
+	Inst* list[MAX_REGION];
+	for (int i = 0; i < n; i++)
+		list[i] = &insts[region[i]];
+	bool has_terminator = inst_is_branch(list[n - 1]) || inst_is(list[n - 1], "syscall");
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) {
+			lat[i][j] = -1;
+			if (i < j)
+				lat[i][j] = dependence(list[i], list[j]);
+		}
+		if (has_terminator && i < n - 1 && lat[i][n - 1] < 0)
+			lat[i][n - 1] = 0;
+	}
+
+	// 優先度は命令の後に続く依存の連鎖の長さ
+	int priority[MAX_REGION];
+	for (int i = n - 1; i >= 0; i--) {
+		priority[i] = 0;
+		for (int j = i + 1; j < n; j++)
+			if (lat[i][j] >= 0 && lat[i][j] + priority[j] > priority[i])
+				priority[i] = lat[i][j] + priority[j];
+	}
+
+	int num_preds[MAX_REGION];
+	int ready_at[MAX_REGION];
+	for (int j = 0; j < n; j++) {
+		num_preds[j] = 0;
+		ready_at[j] = 0;
+		for (int i = 0; i < j; i++)
+			if (lat[i][j] >= 0)
+				num_preds[j]++;
+	}
+	int order[MAX_REGION];
+	bool done[MAX_REGION] = {false};
+	int cycle = 0;
+	for (int k = 0; k < n; k++) {
+		// 今のサイクルで発行できる中で優先度の高い命令、なければ最も早く発行できる命令
+		int best = -1;
+		for (int j = 0; j < n; j++) {
+			if (done[j] || num_preds[j])
+				continue;
+			if (best < 0) {
+				best = j;
+				continue;
+			}
+			int start_j = ready_at[j] > cycle ? ready_at[j] : cycle;
+			int start_best = ready_at[best] > cycle ? ready_at[best] : cycle;
+			if (start_j < start_best || (start_j == start_best && priority[j] > priority[best]))
+				best = j;
+		}
+		int issue = ready_at[best] > cycle ? ready_at[best] : cycle;
+		order[k] = best;
+		done[best] = true;
+		cycle = issue + 1;
+		for (int j = 0; j < n; j++) {
+			if (lat[best][j] < 0)
+				continue;
+			num_preds[j]--;
+			if (issue + lat[best][j] > ready_at[j])
+				ready_at[j] = issue + lat[best][j];
+		}
+	}
+
+	int original[MAX_REGION];
+	for (int i = 0; i < n; i++)
+		original[i] = i;
+	int before = count_stalls(original, n);
+	int after = count_stalls(order, n);
+	stalls_before += before;
+	if (after >= before) {
+		stalls_after += before;
+		return;
+	}
+	stalls_after += after;
+
+	Inst copy[MAX_REGION];
+	for (int i = 0; i < n; i++)
+		copy[i] = *list[i];
+	for (int k = 0; k < n; k++)
+		insts[region[k]] = copy[order[k]];
+}
+
+// 並べ替えの範囲に入れられる命令か（ラベル・ディレクティブ・意味の分からない命令は壁）
+// nopは分岐の遅延スロットの場所取りなので動かさない
+static bool schedulable(Inst* inst) {
+	return inst->kind == INST_OP && inst_is_known(inst) && !inst_is(inst, "nop");
+}
+
+void schedule_insts(void) {
+	int region[MAX_REGION];
+	int n = 0;
+	for (int i = 0; i < inst_count; i++) {
+		Inst* inst = &insts[i];
+		if (inst->deleted)
+			continue;
+		if (!schedulable(inst)) {
+			schedule_region(region, n);
+			n = 0;
+			continue;
+		}
+		region[n++] = i;
+		if (inst_is_branch(inst) || inst_is(inst, "syscall") || n == MAX_REGION) {
+			schedule_region(region, n);
+			n = 0;
+		}
+	}
+	schedule_region(region, n);
+}
+
+// -fsched-verbose の集計
+void print_sched_stats(void) {
+	fprintf(stderr, "schedule (%s): %d stall cycles before, %d after (%d hidden)\n",
+	        cpu->name, stalls_before, stalls_after, stalls_before - stalls_after);
+}
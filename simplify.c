@@ -0,0 +1,429 @@
+#include "mipsc.h"
+
+// =============================================================================
+// 構文木の定数畳み込みと簡約（-O1以上）
+// =============================================================================
+//
+// program()が作った構文木をコード生成の前に書き換える。
+// 定数だけの部分木を計算済みの値に置き換え、x+0 や x*1 などの恒等式を簡約し、
+// 条件が定数のif/while/for/三項演算子から実行されない側を取り除く。
+
+#define MAX_SPECULATION_COST 3 // 分岐せずに評価する式の演算の数
+
+static Node* simplify_expr(Node* node);
+static Node* simplify_stmt(Node* node);
+
+static bool is_const(Node* node) {
+	return node && node->kind == ND_NUM;
+}
+
+static bool is_num(Node* node, int val) {
+	return is_const(node) && node->val == val;
+}
+
+// 整数型の式か（ポインタの加減算は要素サイズ倍されるため簡約しない）
+static bool is_int_expr(Node* node) {
+	Type* ty = get_type(node);
+	return ty->ty == TY_INT || ty->ty == TY_CHAR;
+}
+
+// 評価すると代入・関数呼び出しなどの副作用が起こる式か
+bool has_side_effects(Node* node) {
+	if (!node)
+		return false;
+	switch (node->kind) {
+	case ND_ASSIGN:
+	case ND_ADD_ASSIGN:
+	case ND_SUB_ASSIGN:
+	case ND_MUL_ASSIGN:
+	case ND_DIV_ASSIGN:
+	case ND_PRE_INC:
+	case ND_POST_INC:
+	case ND_PRE_DEC:
+	case ND_POST_DEC:
+	case ND_CALL:
+	case ND_BUILTIN_CALL:
+	case ND_INLINE:
+		return true;
+	default:
+		return has_side_effects(node->lhs) || has_side_effects(node->rhs) ||
+		       has_side_effects(node->cond) || has_side_effects(node->then) ||
+		       has_side_effects(node->els);
+	}
+}
+
+// 条件に関係なく評価してよい式の演算の数（ポインタの参照・除算・呼び出しなどを含めば-1）
+static int speculation_cost(Node* node) {
+	switch (node->kind) {
+	case ND_NUM:
+		return 0;
+	case ND_LVAR:
+	case ND_GVAR:
+		return 1;
+	case ND_NOT:
+		return speculation_cost(node->lhs) < 0 ? -1 : speculation_cost(node->lhs) + 1;
+	case ND_ADD:
+	case ND_SUB:
+	case ND_MUL:
+	case ND_EQ:
+	case ND_NE:
+	case ND_LT:
+	case ND_LE: {
+		int l = speculation_cost(node->lhs);
+		int r = speculation_cost(node->rhs);
+		return l < 0 || r < 0 ? -1 : l + r + 1;
+	}
+	case ND_TERNARY: {
+		int c = speculation_cost(node->cond);
+		int t = speculation_cost(node->then);
+		int e = speculation_cost(node->els);
+		return c < 0 || t < 0 || e < 0 ? -1 : c + t + e + 2;
+	}
+	default:
+		return -1;
+	}
+}
+
+// 分岐せずに両方の値を求めてもよい軽い式か（三項演算子をmovn/movzにする条件）
+bool is_speculatable(Node* node) {
+	int cost = speculation_cost(node);
+	return cost >= 0 && cost <= MAX_SPECULATION_COST;
+}
+
+// 部分木のどこかにpredを満たすノードがあるか
+bool tree_any(Node* node, bool (*pred)(Node* node, void* data), void* data) {
+	if (!node)
+		return false;
+	if (pred(node, data))
+		return true;
+	if (tree_any(node->lhs, pred, data) || tree_any(node->rhs, pred, data) ||
+	    tree_any(node->cond, pred, data) || tree_any(node->then, pred, data) ||
+	    tree_any(node->els, pred, data) || tree_any(node->init, pred, data) ||
+	    tree_any(node->inc, pred, data))
+		return true;
+	for (int i = 0; node->body && node->body[i]; i++)
+		if (tree_any(node->body[i], pred, data))
+			return true;
+	for (int i = 0; node->args && node->args[i]; i++)
+		if (tree_any(node->args[i], pred, data))
+			return true;
+	return false;
+}
+
+// 関数呼び出しか（組み込み関数の展開も$a0-$a2や$t8/$t9を使うので含める）
+bool is_call_node(Node* node, void* data) {
+	return node->kind == ND_CALL || node->kind == ND_BUILTIN_CALL;
+}
+
+// ローカル変数のアドレスが値になりうるか（&で取るか、配列の名前を使う）
+// そうした関数は末尾呼び出しでフレームを手放したり書き換えたりできない
+bool takes_local_address(Node* node, void* data) {
+	bool is_array = (node->kind == ND_LVAR && get_type(node)->ty == TY_ARRAY) ||
+	                (node->kind == ND_MEMBER && lookup_member(node)->type->ty == TY_ARRAY);
+	if (node->kind != ND_ADDR && !is_array)
+		return false;
+	Node* var = node->kind == ND_ADDR ? node->lhs : node;
+	while (var->kind == ND_MEMBER)
+		var = var->lhs;
+	return var->kind == ND_LVAR;
+}
+
+static bool is_case_label(Node* node, void* data) {
+	return node->kind == ND_CASE || node->kind == ND_DEFAULT;
+}
+
+// 何もしない文（空のブロック）
+static Node* new_empty_stmt(void) {
+	Node* node = new_node(ND_BLOCK, NULL, NULL);
+	node->body = calloc(1, sizeof(Node*));
+	return node;
+}
+
+static bool is_empty_stmt(Node* node) {
+	return node->kind == ND_BLOCK && !node->body[0];
+}
+
+// 定数同士の二項演算を計算する（MIPSと同じく32ビットで桁あふれさせる）
+static bool fold_binary(NodeKind kind, int a, int b, int* result) {
+	unsigned ua = a, ub = b;
+	switch (kind) {
+	case ND_ADD: *result = (int)(ua + ub); return true;
+	case ND_SUB: *result = (int)(ua - ub); return true;
+	case ND_MUL: *result = (int)(ua * ub); return true;
+	case ND_DIV:
+	case ND_MOD:
+		// ゼロ除算とオーバーフローする除算は実行時に任せる
+		if (b == 0 || (a == INT_MIN && b == -1))
+			return false;
+		*result = kind == ND_DIV ? a / b : a % b;
+		return true;
+	case ND_EQ: *result = a == b; return true;
+	case ND_NE: *result = a != b; return true;
+	case ND_LT: *result = a < b; return true;
+	case ND_LE: *result = a <= b; return true;
+	default:
+		return false;
+	}
+}
+
+// 0/1に正規化した真偽値 (x != 0)
+static Node* new_bool(Node* node) {
+	return new_node(ND_NE, node, new_node_num(0));
+}
+
+// 加算・乗算の定数を右辺に寄せ、定数同士をまとめる
+//   c + x → x + c,  (x + c1) + c2 → x + (c1 + c2)
+static Node* simplify_assoc(Node* node) {
+	if (is_const(node->lhs) && !is_const(node->rhs)) {
+		Node* tmp = node->lhs;
+		node->lhs = node->rhs;
+		node->rhs = tmp;
+	}
+	Node* inner = node->lhs;
+	if (is_const(node->rhs) && inner->kind == node->kind && is_const(inner->rhs) &&
+	    is_int_expr(inner->lhs)) {
+		int val;
+		fold_binary(node->kind, inner->rhs->val, node->rhs->val, &val);
+		node->lhs = inner->lhs;
+		node->rhs = new_node_num(val);
+	}
+	return node;
+}
+
+// 二項演算の簡約（子は簡約済み）
+static Node* simplify_binary(Node* node) {
+	Node* lhs = node->lhs;
+	Node* rhs = node->rhs;
+	int val;
+
+	if (is_const(lhs) && is_const(rhs) && fold_binary(node->kind, lhs->val, rhs->val, &val))
+		return new_node_num(val);
+	if (!is_int_expr(lhs) || !is_int_expr(rhs))
+		return node;
+
+	switch (node->kind) {
+	case ND_SUB:
+		// x - c → x + (-c)
+		if (is_const(rhs) && rhs->val != INT_MIN) {
+			node->kind = ND_ADD;
+			node->rhs = new_node_num(-rhs->val);
+			return simplify_binary(node);
+		}
+		return node;
+	case ND_ADD:
+		node = simplify_assoc(node);
+		if (is_num(node->rhs, 0))
+			return node->lhs;
+		return node;
+	case ND_MUL:
+		node = simplify_assoc(node);
+		if (is_num(node->rhs, 1))
+			return node->lhs;
+		if (is_num(node->rhs, 0) && !has_side_effects(node->lhs))
+			return node->rhs;
+		return node;
+	case ND_DIV:
+		if (is_num(rhs, 1))
+			return lhs;
+		return node;
+	case ND_MOD:
+		if ((is_num(rhs, 1) || is_num(rhs, -1)) && !has_side_effects(lhs))
+			return new_node_num(0);
+		return node;
+	default:
+		return node;
+	}
+}
+
+static Node* simplify_expr(Node* node) {
+	if (!node)
+		return NULL;
+
+	switch (node->kind) {
+	case ND_NUM:
+	case ND_STR:
+	case ND_LVAR:
+	case ND_GVAR:
+		return node;
+	case ND_CALL:
+	case ND_BUILTIN_CALL:
+		for (int i = 0; node->args && node->args[i]; i++)
+			node->args[i] = simplify_expr(node->args[i]);
+		return node;
+	case ND_TERNARY:
+		node->cond = simplify_expr(node->cond);
+		node->then = simplify_expr(node->then);
+		node->els = simplify_expr(node->els);
+		if (is_const(node->cond))
+			return node->cond->val ? node->then : node->els;
+		return node;
+	case ND_NOT:
+		node->lhs = simplify_expr(node->lhs);
+		if (is_const(node->lhs))
+			return new_node_num(!node->lhs->val);
+		return node;
+	case ND_AND:
+	case ND_OR: {
+		node->lhs = simplify_expr(node->lhs);
+		node->rhs = simplify_expr(node->rhs);
+		// 短絡評価で結果が決まる値（&&なら0、||なら1）
+		int decisive = node->kind == ND_OR;
+		if (is_const(node->lhs)) {
+			if ((node->lhs->val != 0) == decisive)
+				return new_node_num(decisive);
+			return is_const(node->rhs) ? new_node_num(node->rhs->val != 0) : new_bool(node->rhs);
+		}
+		if (is_const(node->rhs)) {
+			if ((node->rhs->val != 0) != decisive)
+				return new_bool(node->lhs);
+			if (!has_side_effects(node->lhs))
+				return new_node_num(decisive);
+		}
+		return node;
+	}
+	default:
+		node->lhs = simplify_expr(node->lhs);
+		node->rhs = simplify_expr(node->rhs);
+		switch (node->kind) {
+		case ND_ADD:
+		case ND_SUB:
+		case ND_MUL:
+		case ND_DIV:
+		case ND_MOD:
+		case ND_EQ:
+		case ND_NE:
+		case ND_LT:
+		case ND_LE:
+			return simplify_binary(node);
+		default:
+			return node;
+		}
+	}
+}
+
+// 文が1つだけのブロックを外した文
+static Node* single_stmt(Node* node) {
+	while (node->kind == ND_BLOCK && node->body[0] && !node->body[1])
+		node = node->body[0];
+	return node;
+}
+
+// スカラーのローカル変数への代入 x = 式 か
+static bool is_var_assign(Node* node) {
+	if (node->kind != ND_ASSIGN || node->lhs->kind != ND_LVAR)
+		return false;
+	TypeKind ty = get_type(node->lhs)->ty;
+	return ty == TY_INT || ty == TY_CHAR || ty == TY_PTR;
+}
+
+// 同じ変数へ代入するだけのif文と同じ意味の、三項演算子の代入を作る（if文は書き換えない）
+//   if (c) x = a; else x = b;  →  x = c ? a : b;
+//   if (c) x = a;              →  x = c ? a : x;
+// 形が合わないか、分岐せずに評価できない節があればNULL
+Node* select_assign(Node* node) {
+	Node* then = single_stmt(node->then);
+	if (!is_var_assign(then) || !is_speculatable(then->rhs))
+		return NULL;
+	Node* other = then->lhs;
+	if (node->els) {
+		Node* els = single_stmt(node->els);
+		if (!is_var_assign(els) || els->lhs->offset != then->lhs->offset || !is_speculatable(els->rhs))
+			return NULL;
+		other = els->rhs;
+	}
+	Node* select = new_node(ND_TERNARY, NULL, NULL);
+	select->cond = node->cond;
+	select->then = then->rhs;
+	select->els = other;
+	return new_node(ND_ASSIGN, then->lhs, select);
+}
+
+static Node* simplify_stmt(Node* node) {
+	switch (node->kind) {
+	case ND_BLOCK: {
+		int n = 0;
+		for (int i = 0; node->body[i]; i++) {
+			Node* stmt = simplify_stmt(node->body[i]);
+			if (!is_empty_stmt(stmt))
+				node->body[n++] = stmt;
+		}
+		node->body[n] = NULL;
+		return node;
+	}
+	case ND_IF:
+		node->cond = simplify_expr(node->cond);
+		node->then = simplify_stmt(node->then);
+		if (node->els)
+			node->els = simplify_stmt(node->els);
+		// switch文のcaseラベルを含む節は外から分岐して入りうるので残す
+		if (is_const(node->cond) && !tree_any(node, is_case_label, NULL)) {
+			if (node->cond->val)
+				return node->then;
+			return node->els ? node->els : new_empty_stmt();
+		}
+		return node;
+	case ND_WHILE:
+		node->cond = simplify_expr(node->cond);
+		node->then = simplify_stmt(node->then);
+		if (is_num(node->cond, 0))
+			return new_empty_stmt();
+		// 常に真の条件は判定しない
+		if (is_const(node->cond))
+			node->cond = NULL;
+		return node;
+	case ND_FOR:
+		node->init = node->init ? simplify_stmt(node->init) : NULL;
+		node->cond = simplify_expr(node->cond);
+		node->inc = node->inc ? simplify_stmt(node->inc) : NULL;
+		node->then = simplify_stmt(node->then);
+		if (node->init && is_empty_stmt(node->init))
+			node->init = NULL;
+		if (node->inc && is_empty_stmt(node->inc))
+			node->inc = NULL;
+		if (is_num(node->cond, 0))
+			return node->init ? node->init : new_empty_stmt();
+		if (is_const(node->cond))
+			node->cond = NULL;
+		return node;
+	case ND_SWITCH:
+		node->cond = simplify_expr(node->cond);
+		node->then = simplify_stmt(node->then);
+		return node;
+	case ND_CASE:
+	case ND_DEFAULT:
+		node->then = simplify_stmt(node->then);
+		return node;
+	case ND_RETURN:
+		node->lhs = simplify_expr(node->lhs);
+		return node;
+	case ND_BREAK:
+	case ND_CONTINUE:
+		return node;
+	default:
+		// 式文: 副作用がなければ評価しない
+		node = simplify_expr(node);
+		if (!has_side_effects(node))
+			return new_empty_stmt();
+		return node;
+	}
+}
+
+void simplify_program(void) {
+	LVar* saved_locals = locals;
+	for (int i = 0; code[i]; i++) {
+		Node* func = code[i];
+		if (func->kind != ND_FUNC)
+			continue;
+		// 型の判定に関数のローカル変数を使う
+		Function* f = lookup_function(func->name);
+		locals = f ? f->locals : NULL;
+		int n = 0;
+		for (int j = 0; func->body[j]; j++) {
+			Node* stmt = simplify_stmt(func->body[j]);
+			if (!is_empty_stmt(stmt))
+				func->body[n++] = stmt;
+		}
+		func->body[n] = NULL;
+	}
+	locals = saved_locals;
+}
@@ -0,0 +1,722 @@
+#include "mipsc.h"
+
+// =============================================================================
+// SSA形式（-O2）
+// =============================================================================
+//
+// アドレスを取られないスカラーのローカル変数への読み書きを値に置き換え、
+// 支配辺境にφ関数を置く（Cytron et al.）。変数の値は支配木をたどりながら
+// 変数ごとのスタックで管理する。アドレスを取られても読み書きにしか使われない変数は、
+// ポインタ経由の読み書きを変数への読み書きに直してから、もう一度変換する。
+// 出力の前には、互いに干渉しない値を同じ値にまとめてから（Budimlić et al.）、
+// 残ったφ関数を先行ブロックの末尾のコピーに戻す。
+
+// SSA形式に変換するローカル変数
+typedef struct {
+	int offset;
+	int* stack;       // 現在の値（支配木の経路上の定義）
+	int depth;
+	int cap;
+} SsaVar;
+
+static SsaVar* vars;
+static int num_vars;
+static int* alias;          // LOADを取り除いた値の置き換え先
+static BasicBlock*** children;  // 支配木の子
+static int* num_children;
+
+static int find_var(int offset) {
+	for (int i = 0; i < num_vars; i++) {
+		if (vars[i].offset == offset) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// offsetを含む変数をSSA形式の対象から外す
+static void exclude_var(int offset) {
+	LVar* var = frame_var_at(offset);
+	int i = var ? find_var(var->offset) : -1;
+	if (i >= 0) {
+		vars[i] = vars[--num_vars];
+	}
+}
+
+static bool exclude_lvar(Node* node, void* data) {
+	if (node->kind == ND_LVAR) {
+		exclude_var(node->offset);
+	}
+	return false;
+}
+
+// アドレスを取られず、先頭のオフセットでだけ読み書きするスカラーの変数を集める
+static void collect_vars(IrFunc* f) {
+	num_vars = 0;
+	for (LVar* var = locals; var; var = var->next) {
+		num_vars++;
+	}
+	vars = calloc(num_vars, sizeof(SsaVar));
+	num_vars = 0;
+	for (LVar* var = locals; var; var = var->next) {
+		if (is_integer(var->type) || var->type->ty == TY_PTR) {
+			vars[num_vars++].offset = var->offset;
+		}
+	}
+
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			switch (inst->op) {
+			case IR_ADDR:
+				if (inst->mem.kind == MEM_FRAME) {
+					exclude_var(inst->mem.offset);
+				}
+				break;
+			case IR_LOAD:
+			case IR_STORE:
+				if (inst->mem.kind == MEM_FRAME && find_var(inst->mem.offset) < 0) {
+					exclude_var(inst->mem.offset);
+				}
+				break;
+			case IR_STACK:
+				// スタックマシンの展開はフレーム上の変数を直接読む
+				tree_any(inst->node, exclude_lvar, NULL);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+static int promoted_var(IrInst* inst) {
+	if ((inst->op != IR_LOAD && inst->op != IR_STORE) || inst->mem.kind != MEM_FRAME) {
+		return -1;
+	}
+	return find_var(inst->mem.offset);
+}
+
+// -----------------------------------------------------------------------------
+// φ関数の配置
+// -----------------------------------------------------------------------------
+
+// 各基本ブロックの支配辺境（逆後順の番号で引く）
+static BasicBlock*** frontier;
+static int* num_frontier;
+
+static void add_frontier(BasicBlock* bb, BasicBlock* df) {
+	int i = bb->rpo;
+	for (int j = 0; j < num_frontier[i]; j++) {
+		if (frontier[i][j] == df) {
+			return;
+		}
+	}
+	frontier[i] = realloc(frontier[i], sizeof(BasicBlock*) * (num_frontier[i] + 1));
+	frontier[i][num_frontier[i]++] = df;
+}
+
+static void compute_frontiers(IrFunc* f) {
+	frontier = calloc(f->num_blocks, sizeof(BasicBlock**));
+	num_frontier = calloc(f->num_blocks, sizeof(int));
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		if (bb->num_preds < 2) {
+			continue;
+		}
+		for (int j = 0; j < bb->num_preds; j++) {
+			for (BasicBlock* runner = bb->preds[j]; runner != bb->idom; runner = runner->idom) {
+				add_frontier(runner, bb);
+			}
+		}
+	}
+}
+
+static void insert_phi(IrFunc* f, BasicBlock* bb, int var) {
+	IrInst* phi = new_inst(IR_PHI);
+	phi->dst = new_value(f);
+	phi->imm = var;
+	phi->num_args = bb->num_preds;
+	phi->args = malloc(sizeof(int) * bb->num_preds);
+	for (int i = 0; i < bb->num_preds; i++) {
+		phi->args[i] = -1;
+	}
+	if (bb->first) {
+		insert_inst_before(bb->first, phi);
+	} else {
+		append_inst(bb, phi);
+	}
+}
+
+static void place_phis(IrFunc* f) {
+	int n = f->num_blocks;
+	int* has_phi = malloc(sizeof(int) * n);
+	int* queued = malloc(sizeof(int) * n);
+	BasicBlock** work = malloc(sizeof(BasicBlock*) * n);
+	for (int i = 0; i < n; i++) {
+		has_phi[i] = queued[i] = -1;
+	}
+
+	for (int v = 0; v < num_vars; v++) {
+		int num_work = 0;
+		for (int i = 0; i < n; i++) {
+			for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+				if (inst->op == IR_STORE && promoted_var(inst) == v) {
+					work[num_work++] = f->blocks[i];
+					queued[i] = v;
+					break;
+				}
+			}
+		}
+		while (num_work) {
+			BasicBlock* bb = work[--num_work];
+			for (int j = 0; j < num_frontier[bb->rpo]; j++) {
+				BasicBlock* df = frontier[bb->rpo][j];
+				if (has_phi[df->rpo] == v) {
+					continue;
+				}
+				insert_phi(f, df, v);
+				has_phi[df->rpo] = v;
+				if (queued[df->rpo] != v) {
+					queued[df->rpo] = v;
+					work[num_work++] = df;
+				}
+			}
+		}
+	}
+	free(has_phi);
+	free(queued);
+	free(work);
+}
+
+// -----------------------------------------------------------------------------
+// 名前の付け替え
+// -----------------------------------------------------------------------------
+
+static int undef_value;  // 代入前に読まれた変数の値（0とする）
+
+static int resolve(int v) {
+	while (alias[v] != v) {
+		v = alias[v];
+	}
+	return v;
+}
+
+static void push_value(int var, int v) {
+	SsaVar* sv = &vars[var];
+	if (sv->depth == sv->cap) {
+		sv->cap = sv->cap ? sv->cap * 2 : 8;
+		sv->stack = realloc(sv->stack, sizeof(int) * sv->cap);
+	}
+	sv->stack[sv->depth++] = v;
+}
+
+static int current_value(int var) {
+	SsaVar* sv = &vars[var];
+	return sv->depth ? sv->stack[sv->depth - 1] : undef_value;
+}
+
+static void rename_block(BasicBlock* bb) {
+	int* saved = malloc(sizeof(int) * (num_vars + 1));
+	for (int v = 0; v < num_vars; v++) {
+		saved[v] = vars[v].depth;
+	}
+
+	IrInst* next;
+	for (IrInst* inst = bb->first; inst; inst = next) {
+		next = inst->next;
+		if (inst->op == IR_PHI) {
+			if (inst->imm >= 0) {
+				push_value(inst->imm, inst->dst);
+			}
+			continue;
+		}
+		int* ops[3 + inst->num_args];
+		int num_ops = inst_operands(inst, ops);
+		for (int j = 0; j < num_ops; j++) {
+			*ops[j] = resolve(*ops[j]);
+		}
+		int var = promoted_var(inst);
+		if (var < 0) {
+			continue;
+		}
+		if (inst->op == IR_LOAD) {
+			alias[inst->dst] = current_value(var);
+		} else {
+			push_value(var, inst->a);
+		}
+		remove_inst(inst);
+	}
+
+	for (int i = 0; i < bb->num_succs; i++) {
+		BasicBlock* succ = bb->succs[i];
+		int j = pred_index(succ, bb);
+		for (IrInst* inst = succ->first; inst && inst->op == IR_PHI; inst = inst->next) {
+			if (inst->imm >= 0) {
+				inst->args[j] = current_value(inst->imm);
+			}
+		}
+	}
+	for (int i = 0; i < num_children[bb->rpo]; i++) {
+		rename_block(children[bb->rpo][i]);
+	}
+
+	for (int v = 0; v < num_vars; v++) {
+		vars[v].depth = saved[v];
+	}
+	free(saved);
+}
+
+// 集めた変数の読み書きを値に置き換える
+static void promote_vars(IrFunc* f) {
+	compute_frontiers(f);
+	place_phis(f);
+
+	children = calloc(f->num_blocks, sizeof(BasicBlock**));
+	num_children = calloc(f->num_blocks, sizeof(int));
+	for (int i = 1; i < f->num_blocks; i++) {
+		int p = f->blocks[i]->idom->rpo;
+		children[p] = realloc(children[p], sizeof(BasicBlock*) * (num_children[p] + 1));
+		children[p][num_children[p]++] = f->blocks[i];
+	}
+	alias = malloc(sizeof(int) * f->num_values);
+	for (int v = 0; v < f->num_values; v++) {
+		alias[v] = v;
+	}
+	rename_block(f->entry);
+
+	// 次に変換するときに、このφ関数を変数の定義として扱わない
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst && inst->op == IR_PHI; inst = inst->next) {
+			inst->imm = -1;
+		}
+		free(frontier[i]);
+		free(children[i]);
+	}
+	for (int v = 0; v < num_vars; v++) {
+		free(vars[v].stack);
+	}
+	free(frontier);
+	free(num_frontier);
+	free(children);
+	free(num_children);
+	free(vars);
+	free(alias);
+}
+
+// 読み書きの場所としてしか使われないローカル変数のアドレスを、変数への直接の読み書きにする
+// （アドレスがescapeしない変数）。変数を指すポインタ変数をSSA形式にした後なら、
+// *p の読み書きも変数そのものの読み書きになり、次の変換で値にできる
+static bool forward_addresses(IrFunc* f) {
+	bool* escapes = calloc(f->num_values, sizeof(bool));
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			int* ops[3 + inst->num_args];
+			int num_ops = inst_operands(inst, ops);
+			for (int j = 0; j < num_ops; j++) {
+				if (ops[j] != &inst->mem.base || inst->op == IR_ADDR) {
+					escapes[*ops[j]] = true;
+				}
+			}
+		}
+	}
+
+	IrInst** addr = calloc(f->num_values, sizeof(IrInst*));
+	bool changed = false;
+	for (int i = 0; i < f->num_blocks; i++) {
+		IrInst* next;
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = next) {
+			next = inst->next;
+			if (inst->op == IR_ADDR && inst->mem.kind == MEM_FRAME && !escapes[inst->dst]) {
+				addr[inst->dst] = inst;
+				remove_inst(inst);
+				changed = true;
+			}
+		}
+	}
+	for (int i = 0; changed && i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			if ((inst->op == IR_LOAD || inst->op == IR_STORE) && inst->mem.kind == MEM_POINTER &&
+			    addr[inst->mem.base]) {
+				inst->mem.offset += addr[inst->mem.base]->mem.offset;
+				inst->mem.kind = MEM_FRAME;
+				inst->mem.base = -1;
+			}
+		}
+	}
+	free(escapes);
+	free(addr);
+	return changed;
+}
+
+// 変数の読み書きを値に置き換えてSSA形式にする
+void build_ssa(IrFunc* f) {
+	compute_dominators(f);
+	IrInst* undef = new_inst(IR_CONST);
+	undef->dst = undef_value = new_value(f);
+	insert_inst_before(f->entry->first, undef);
+
+	do {
+		collect_vars(f);
+		promote_vars(f);
+	} while (forward_addresses(f));
+}
+
+// -----------------------------------------------------------------------------
+// 不要な命令の削除
+// -----------------------------------------------------------------------------
+
+// すべての引数が同じ値（か自分自身）のφ関数をその値に置き換える
+static bool remove_trivial_phis(IrFunc* f) {
+	bool changed = false;
+	for (int i = 0; i < f->num_blocks; i++) {
+		IrInst* next;
+		for (IrInst* inst = f->blocks[i]->first; inst && inst->op == IR_PHI; inst = next) {
+			next = inst->next;
+			int same = -1;
+			bool trivial = true;
+			for (int j = 0; j < inst->num_args; j++) {
+				int arg = resolve(inst->args[j]);
+				if (arg == inst->dst || arg == same) {
+					continue;
+				}
+				if (same >= 0) {
+					trivial = false;
+					break;
+				}
+				same = arg;
+			}
+			if (trivial && same >= 0) {
+				alias[inst->dst] = same;
+				remove_inst(inst);
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+// 結果が使われず副作用もない命令を取り除く
+void eliminate_dead_code(IrFunc* f) {
+	alias = malloc(sizeof(int) * f->num_values);
+	for (int v = 0; v < f->num_values; v++) {
+		alias[v] = v;
+	}
+	while (remove_trivial_phis(f)) {
+	}
+
+	IrInst** def = calloc(f->num_values, sizeof(IrInst*));
+	bool* live = calloc(f->num_values, sizeof(bool));
+	int* work = malloc(sizeof(int) * f->num_values);
+	int num_work = 0;
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			int* ops[3 + inst->num_args];
+			int num_ops = inst_operands(inst, ops);
+			for (int j = 0; j < num_ops; j++) {
+				*ops[j] = resolve(*ops[j]);
+			}
+			if (inst->dst >= 0) {
+				def[inst->dst] = inst;
+			}
+		}
+	}
+	// 副作用のある命令が読む値から、定義する命令をたどる
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			if (!inst_has_side_effect(inst)) {
+				continue;
+			}
+			if (inst->dst >= 0 && !live[inst->dst]) {
+				live[inst->dst] = true;
+				work[num_work++] = inst->dst;
+			}
+			int* ops[3 + inst->num_args];
+			int num_ops = inst_operands(inst, ops);
+			for (int j = 0; j < num_ops; j++) {
+				if (!live[*ops[j]]) {
+					live[*ops[j]] = true;
+					work[num_work++] = *ops[j];
+				}
+			}
+		}
+	}
+	while (num_work) {
+		IrInst* inst = def[work[--num_work]];
+		if (!inst) {
+			continue;
+		}
+		int* ops[3 + inst->num_args];
+		int num_ops = inst_operands(inst, ops);
+		for (int j = 0; j < num_ops; j++) {
+			if (!live[*ops[j]]) {
+				live[*ops[j]] = true;
+				work[num_work++] = *ops[j];
+			}
+		}
+	}
+	for (int i = 0; i < f->num_blocks; i++) {
+		IrInst* next;
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = next) {
+			next = inst->next;
+			if (!inst_has_side_effect(inst) && !live[inst->dst]) {
+				remove_inst(inst);
+			}
+		}
+	}
+	free(def);
+	free(live);
+	free(work);
+	free(alias);
+}
+
+// -----------------------------------------------------------------------------
+// SSA形式からの変換
+// -----------------------------------------------------------------------------
+
+static int* parent;       // 同じ値にまとめた集合（union-find）
+static int* next_member;  // 集合の要素のリスト
+static int* def_index;    // 値を定義する命令の基本ブロック内の位置（φ関数は-1）
+static BasicBlock** def_block;
+
+static int find(int v) {
+	while (parent[v] != v) {
+		parent[v] = parent[parent[v]];
+		v = parent[v];
+	}
+	return v;
+}
+
+// 値aが基本ブロックbbの位置indexの命令の直後で生きているか
+static bool live_after(IrFunc* f, int a, BasicBlock* bb, int index) {
+	if (!set_has(f->live_in[bb->rpo], a) && (def_block[a] != bb || def_index[a] > index)) {
+		return false;
+	}
+	if (set_has(f->live_out[bb->rpo], a)) {
+		return true;
+	}
+	int i = 0;
+	for (IrInst* inst = bb->first; inst; inst = inst->next, i++) {
+		if (i <= index || inst->op == IR_PHI) {
+			continue;
+		}
+		int* ops[3 + inst->num_args];
+		int num_ops = inst_operands(inst, ops);
+		for (int j = 0; j < num_ops; j++) {
+			if (*ops[j] == a) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// 2つの値の生存範囲が重なるか（SSA形式では一方の定義の位置で他方が生きているか）
+static bool interfere(IrFunc* f, int a, int b) {
+	return live_after(f, a, def_block[b], def_index[b]) ||
+	       live_after(f, b, def_block[a], def_index[a]);
+}
+
+// 2つの集合の要素が互いに干渉しなければ1つにまとめる
+static void try_coalesce(IrFunc* f, int a, int b) {
+	a = find(a);
+	b = find(b);
+	if (a == b) {
+		return;
+	}
+	for (int x = a; x >= 0; x = next_member[x]) {
+		for (int y = b; y >= 0; y = next_member[y]) {
+			if (interfere(f, x, y)) {
+				return;
+			}
+		}
+	}
+	parent[b] = a;
+	int last = a;
+	while (next_member[last] >= 0) {
+		last = next_member[last];
+	}
+	next_member[last] = b;
+}
+
+// φ関数の結果と引数で、生存範囲が重ならないものを同じ値にまとめる
+// 定数は使う場所で即値にするのでまとめない
+static void coalesce_phis(IrFunc* f) {
+	parent = malloc(sizeof(int) * f->num_values);
+	next_member = malloc(sizeof(int) * f->num_values);
+	def_index = malloc(sizeof(int) * f->num_values);
+	def_block = calloc(f->num_values, sizeof(BasicBlock*));
+	bool* is_const = calloc(f->num_values, sizeof(bool));
+	for (int v = 0; v < f->num_values; v++) {
+		parent[v] = v;
+		next_member[v] = -1;
+	}
+	for (int i = 0; i < f->num_blocks; i++) {
+		int index = 0;
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next, index++) {
+			if (inst->dst >= 0) {
+				def_block[inst->dst] = f->blocks[i];
+				def_index[inst->dst] = inst->op == IR_PHI ? -1 : index;
+				is_const[inst->dst] = inst->op == IR_CONST;
+			}
+		}
+	}
+	compute_liveness(f);
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst && inst->op == IR_PHI; inst = inst->next) {
+			for (int j = 0; j < inst->num_args; j++) {
+				if (!is_const[inst->args[j]]) {
+					try_coalesce(f, inst->dst, inst->args[j]);
+				}
+			}
+		}
+	}
+	free(is_const);
+	free(next_member);
+	free(def_index);
+	free(def_block);
+}
+
+// 先行ブロックの末尾に、φ関数の結果への同時のコピーを順に並べて置く
+// 他のコピーがまだ読む値は書き換えないよう順序を決め、循環していれば一時値を使う
+static void insert_copies(IrFunc* f, BasicBlock* pred, int* dsts, int* srcs, int n) {
+	IrInst* pos = pred->last;
+	while (n > 0) {
+		int k = -1;
+		for (int i = 0; i < n && k < 0; i++) {
+			k = i;
+			for (int j = 0; j < n; j++) {
+				if (j != i && srcs[j] == dsts[i]) {
+					k = -1;
+					break;
+				}
+			}
+		}
+		IrInst* copy = new_inst(IR_COPY);
+		if (k < 0) {
+			// 循環を断つ: 最初のコピーの読む値を一時値に逃がす
+			int tmp = new_value(f);
+			copy->dst = tmp;
+			copy->a = srcs[0];
+			insert_inst_before(pos, copy);
+			srcs[0] = tmp;
+			continue;
+		}
+		copy->dst = dsts[k];
+		copy->a = srcs[k];
+		insert_inst_before(pos, copy);
+		dsts[k] = dsts[n - 1];
+		srcs[k] = srcs[n - 1];
+		n--;
+	}
+}
+
+// 後続が複数ある基本ブロックからφ関数を持つ基本ブロックへの辺に、コピーを置く基本ブロックを挟む
+static void split_critical_edges(IrFunc* f) {
+	int n = f->num_blocks;
+	for (int i = 0; i < n; i++) {
+		BasicBlock* bb = f->blocks[i];
+		if (!bb->first || bb->first->op != IR_PHI) {
+			continue;
+		}
+		for (int j = 0; j < bb->num_preds; j++) {
+			BasicBlock* pred = bb->preds[j];
+			if (pred->num_succs < 2) {
+				continue;
+			}
+			BasicBlock* mid = new_basic_block(f);
+			append_inst(mid, new_inst(IR_JUMP));
+			add_succ(mid, bb);
+			add_pred(mid, pred);
+			for (int s = 0; s < pred->num_succs; s++) {
+				if (pred->succs[s] == bb) {
+					pred->succs[s] = mid;
+				}
+			}
+			bb->preds[j] = mid;
+		}
+	}
+	compute_cfg(f);
+}
+
+// ジャンプだけの基本ブロックを辿った先（空の無限ループで止まらないよう回数を限る）
+static BasicBlock* jump_target(BasicBlock* bb) {
+	for (int n = 0; n < 8 && bb->first && bb->first->op == IR_JUMP; n++) {
+		bb = bb->succs[0];
+	}
+	return bb;
+}
+
+// 分岐先がジャンプだけの基本ブロックなら、その行き先へ直接分岐させる
+// φ関数を消した後に行うので、先行ブロックの一覧は後続から作り直すだけでよい
+static void thread_jumps(IrFunc* f) {
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		for (int s = 0; s < bb->num_succs; s++) {
+			bb->succs[s] = jump_target(bb->succs[s]);
+		}
+		if (bb->num_succs == 2 && bb->succs[0] == bb->succs[1]) {
+			IrInst* jump = new_inst(IR_JUMP);
+			remove_inst(bb->last);
+			append_inst(bb, jump);
+			bb->num_succs = 1;
+		}
+	}
+	compute_cfg(f);
+	for (int i = 0; i < f->num_blocks; i++) {
+		f->blocks[i]->num_preds = 0;
+	}
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		for (int s = 0; s < bb->num_succs; s++) {
+			add_pred(bb->succs[s], bb);
+		}
+	}
+}
+
+// φ関数をコピーに戻す
+void destruct_ssa(IrFunc* f) {
+	split_critical_edges(f);
+	coalesce_phis(f);
+
+	for (int i = 0; i < f->num_blocks; i++) {
+		for (IrInst* inst = f->blocks[i]->first; inst; inst = inst->next) {
+			int* ops[3 + inst->num_args];
+			int num_ops = inst_operands(inst, ops);
+			for (int j = 0; j < num_ops; j++) {
+				*ops[j] = find(*ops[j]);
+			}
+			if (inst->dst >= 0) {
+				inst->dst = find(inst->dst);
+			}
+		}
+	}
+
+	for (int i = 0; i < f->num_blocks; i++) {
+		BasicBlock* bb = f->blocks[i];
+		int num_phis = 0;
+		for (IrInst* inst = bb->first; inst && inst->op == IR_PHI; inst = inst->next) {
+			num_phis++;
+		}
+		if (!num_phis) {
+			continue;
+		}
+		for (int j = 0; j < bb->num_preds; j++) {
+			int dsts[num_phis];
+			int srcs[num_phis];
+			int n = 0;
+			for (IrInst* inst = bb->first; inst && inst->op == IR_PHI; inst = inst->next) {
+				if (inst->dst != inst->args[j]) {
+					dsts[n] = inst->dst;
+					srcs[n] = inst->args[j];
+					n++;
+				}
+			}
+			insert_copies(f, bb->preds[j], dsts, srcs, n);
+		}
+		while (bb->first->op == IR_PHI) {
+			remove_inst(bb->first);
+		}
+	}
+	free(parent);
+	thread_jumps(f);
+}
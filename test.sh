@@ -2,12 +2,19 @@
 
 # GCCとの比較テスト関数（簡潔版）
 test_gcc(){
-    program="$1"
+    test_gcc_with "" "$1"
+}
+
+# コンパイラのオプションを指定したGCCとの比較テスト関数（オプションが空ならtest_gccと同じ）
+test_gcc_with(){
+    option="$1"
+    program="$2"
+    label="${option:+($option) }"
     
     # 作ったコンパイラでテスト
-    ./mipsc "$program" > tmp_our.s 2>/dev/null
+    ./mipsc $option "$program" > tmp_our.s 2>/dev/null
     if ! mips-linux-gnu-gcc -mno-abicalls -fno-pic tmp_our.s -o tmp_our -nostdlib -static 2>/dev/null; then
-        echo "❌ COMPILE FAILED: $program"
+        echo "❌ COMPILE FAILED${option:+ ($option)}: $program"
         return 1
     fi
     qemu-mips tmp_our 2>/dev/null
@@ -24,9 +31,9 @@ test_gcc(){
     
     # 比較
     if [ "$our_exit" = "$gcc_exit" ]; then
-        echo "✅ $program => $our_exit"
+        echo "✅ $label$program => $our_exit"
     else
-        echo "❌ $program => Our: $our_exit, GCC: $gcc_exit"
+        echo "❌ $label$program => Our: $our_exit, GCC: $gcc_exit"
         return 1
     fi
     
@@ -577,6 +584,491 @@ test_gcc 'int main() { return 15 / 3 % 2; }'
 test_gcc 'int main() { int x = 23; int y = 4; return (x + y) % (y - 1); }'
 test_gcc 'int main() { return 1 + 2 * 3 % 4 + 5; }'
 
+echo ""
+echo "=== PART 19: レジスタ割り当てテスト ==="
+echo ""
+
+# 一時レジスタが足りなくなる深い式（スタックへの退避）
+test_gcc 'int main() { return 1+(2+(3+(4+(5+(6+(7+(8+(9+(10+(11+(12+13))))))))))); }'
+test_gcc 'int f(int x) { return x + 1; } int main() { int a = 3; return a * 10 + f(a) * f(a + 1); }'
+test_gcc 'int f(int x, int y) { return x - y; } int main() { int a[3]; a[0] = 7; a[1] = 2; a[2] = a[0] + f(a[0], a[1]); return a[2]; }'
+# printfの引数の中で呼ぶ関数が$t8/$t9を使っても書式の読み取りが壊れないこと
+test_gcc 'int f(int a) { return a + (a + (a + (a + (a + (a + (a + (a + (a + a)))))))); } int main() { printf("%d %d\n", f(1), f(2)); return f(3); }'
+
+# -O0（スタックマシン方式）でも同じ結果になること
+./mipsc -O0 "int f(int x) { return x * 2; } int main() { int a = 5; return f(a) + a; }" > tmp.s
+mips-linux-gnu-gcc -mno-abicalls -fno-pic tmp.s -o tmp -nostdlib -static
+result=$(qemu-mips tmp; echo $?)
+if [ "$result" = "15" ]; then
+    echo "✅ -O0: $result"
+else
+    echo "❌ -O0: expected 15, got $result"
+fi
+rm -f tmp.s tmp 2>/dev/null
+
+echo ""
+echo "=== PART 20: 定数畳み込みテスト ==="
+echo ""
+
+test_gcc 'int main() { int x = 3; return 2 * 3 + x * 1 - (4 + 0); }'
+test_gcc 'int main() { int x = 5; return -x + 10 / 3 + 10 % 3; }'
+test_gcc 'int g; int f() { g = g + 1; return 2; } int main() { int x; x = f() * 0; x = f() || 1; return g * 10 + x; }'
+test_gcc 'int main() { int x = 0; if (0) x = 1; else x = 2; while (0) x = 3; return x + (1 ? 4 : 5); }'
+test_gcc 'int main() { int i = 0; while (1) { i++; if (i == 7) break; } return i; }'
+
+echo ""
+echo "=== PART 21: 定数乗除算テスト ==="
+echo ""
+
+test_gcc 'int main() { int x = -47; return x / 4 + x / 7 + x % 8 + x % -5 + 100; }'
+test_gcc 'int main() { int x = 12345; return (x / 10) % 100 + x / 641 + x % 3; }'
+test_gcc 'int main() { int x = 13; return x * 10 - x * 7 + x * -3 + x * 16; }'
+test_gcc 'int main() { int x = 100; x /= 3; x *= 6; return x; }'
+test_gcc 'int main() { int a[5]; int i; for (i = 0; i < 5; i++) a[i] = i * 3; return a[4] + *(a + 2); }'
+
+echo ""
+echo "=== PART 22: 条件分岐テスト ==="
+echo ""
+
+test_gcc 'int main() { int x = -3; int n = 0; if (x < 0) n = n + 1; if (0 < x) n = n + 2; if (x <= -3) n = n + 4; if (x >= 0) n = n + 8; return n; }'
+test_gcc 'int main() { int x = 40000; int n = 0; if (x > 32767) n = n + 1; if (x <= 40000) n = n + 2; if (x != 40000) n = n + 4; return n; }'
+test_gcc 'int g; int f(int v) { g = g * 10 + 1; return v; } int main() { if (f(0) && f(1)) g = g + 100; if (f(1) || f(1)) g = g + 200; return g; }'
+test_gcc 'int main() { int i = 0; int n = 0; while (i < 10 && !(i == 6)) { i++; n = n + (i > 3 ? 2 : 1); } return n; }'
+test_gcc 'int main() { int x = 0; int y = 7; return !x + !y * 2 + (!(x || y) ? 10 : 20); }'
+
+echo ""
+echo "=== PART 23: 葉関数テスト ==="
+echo ""
+
+test_gcc 'int max(int a, int b) { if (a < b) return b; return a; } int main() { return max(3, 9) * 10 + max(9, 3); }'
+test_gcc 'int inc(int n) { n++; n += 3; return n--; } int main() { return inc(4); }'
+test_gcc 'int f(int a) { int* p = &a; *p = *p + 1; return a; } int main() { return f(41); }'
+test_gcc 'int f(int k) { int a[4]; int s; a[0] = k; a[1] = k * 2; s = a[0] + a[1]; return s; } int main() { return f(5); }'
+test_gcc 'int f(int a, int b, int c) { return a + (b + (c + (a + (b + (c + (a + (b + (c + (a + (b + c)))))))))); } int main() { return f(1, 2, 3); }'
+# 除算の後も被除数の引数レジスタを使う
+test_gcc_with -fdisable-pass=inline 'int f(int a, int b) { return a / b + a % b + a; } int main() { return f(17, 5); }'
+test_gcc_with -fdisable-pass=inline 'int f(int a, int b) { int q = a % b; return q * 10 + a / b + a; } int main() { return f(23, 7); }'
+
+echo ""
+echo "=== PART 24: フレームポインタ省略テスト ==="
+echo ""
+
+test_gcc_with -O2 'int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); } int main() { return fib(10); }'
+test_gcc_with -O2 'int g(int* p) { return *p + 1; } int f(int a) { int x = a * 2; int y = g(&x); return x + y + a; } int main() { return f(5); }'
+test_gcc_with -O2 'int f(int x) { return x + 1; } int main() { int a[3]; a[0] = 1; a[1] = f(a[0]); a[2] = f(a[1]) + f(a[0] ? 2 : 3) * (1+(2+(3+(4+(5+(6+(7+(8+(9+(10+f(a[1]))))))))))); return a[2]; }'
+test_gcc_with -O2 'int f(int c) { return c; } int main() { int n = 0; int i; for (i = 0; i < 5; i++) n = n + (i < 3 ? f(i) : f(10)); printf("%d\n", n); return n; }'
+test_gcc_with "-O1 -fomit-frame-pointer" 'int f(int a, int b) { return a - b; } int main() { int x = 9; return f(x, 4) * f(x, 3); }'
+
+echo ""
+echo "=== PART 25: インライン展開テスト ==="
+echo ""
+
+test_gcc 'int sq(int x) { return x * x; } int main() { int a = 3; return sq(a) + sq(a + 1); }'
+test_gcc 'int max(int a, int b) { if (a < b) return b; return a; } int clamp(int v, int lo, int hi) { return max(lo, v < hi ? v : hi); } int main() { return clamp(15, 0, 10) + clamp(-3, 0, 10) * 2 + clamp(5, 0, 10) * 3; }'
+test_gcc 'int bump(int* p) { *p = *p + 1; return *p; } int main() { int k = 0; int r = bump(&k) + bump(&k) * 10; return r + k; }'
+test_gcc 'int g; int add(int x) { g = g + x; } int main() { add(5); add(7); return g; }'
+test_gcc 'int f(int n) { int a[3]; int i; int s = 0; for (i = 0; i < 3; i++) { a[i] = i * n; if (a[i] > 5) return s; s += a[i]; } return s; } int main() { return f(2) * 10 + f(4); }'
+test_gcc 'int fact(int n) { if (n <= 1) return 1; return n * fact(n - 1); } int main() { return fact(5); }'
+test_gcc 'int odd(int n) { if (n == 0) return 0; return even(n - 1); } int even(int n) { if (n == 0) return 1; return odd(n - 1); } int main() { return odd(7) + even(7) * 10; }'
+
+echo ""
+echo "=== PART 26: 末尾呼び出しテスト ==="
+echo ""
+
+# 4096バイトのスタックでは末尾呼び出しをループにしないと溢れる深さ
+test_gcc 'int sum(int n, int acc) { if (n == 0) return acc; return sum(n - 1, acc + n); } int main() { return sum(3000, 0) % 256; }'
+test_gcc 'int gcd(int a, int b) { if (b == 0) return a; return gcd(b, a % b); } int main() { return gcd(1071, 462); }'
+test_gcc 'int f(int a, int b) { int x[2]; x[0] = a; x[1] = b; if (a > 1000) return (a + b) % 256; return f(x[1] + 1, x[0] * 2 + 1); } int main() { return f(1, 2); }'
+test_gcc 'int is_odd(int n) { if (n == 0) return 0; return is_even(n - 1); } int is_even(int n) { if (n == 0) return 1; return is_odd(n - 1); } int main() { return is_even(3001) * 10 + is_odd(2001); }'
+test_gcc 'int big(int a, int b, int c) { int s = 0; int i; for (i = 0; i < a; i++) { if (i % 3 == 0) s += b; else if (i % 3 == 1) s -= c; else s = s * 2 + i; } return s + a * b - c; } int f(int n) { int t = n * 3; return big(t, n, t - n); } int k(int n) { return big(n, n + 1, n + 2); } int main() { return f(2) + k(3); }'
+test_gcc_with -fno-omit-frame-pointer 'int count(int* p, int n) { if (*p == 0) return n; return count(p + 1, n + (*p == 7)); } int main() { int a[5]; a[0] = 7; a[1] = 3; a[2] = 7; a[3] = 7; a[4] = 0; return count(a, 0); }'
+test_gcc_with -fno-omit-frame-pointer 'int gcd(int a, int b) { if (b == 0) return a; return gcd(b, a % b); } int f(int a, int b, int c) { int t = gcd(a, b); return gcd(t, c); } int main() { return f(84, 126, 35) + f(48, 180, 20) * 10; }'
+# ローカル変数のアドレスを渡す関数は末尾呼び出しにしない
+test_gcc_with '-O1 -fdisable-pass=inline' 'int sum(int* p, int n) { int b[8]; int i; int s = 0; for (i = 0; i < 8; i++) b[i] = i; for (i = 0; i < n; i++) s = s + p[i] * 3 + b[i]; return s; } int f(int k) { if (k > 1000) return f(k - 1); int a[4]; a[0] = k; a[1] = k * 2; a[2] = 5; a[3] = 1; return sum(a, 4); } int main() { return f(1003); }'
+test_gcc_with '-O2 -fdisable-pass=inline' 'int sum(int* p, int n) { int b[8]; int i; int s = 0; for (i = 0; i < 8; i++) b[i] = i; for (i = 0; i < n; i++) s = s + p[i] * 3 + b[i]; return s; } int f(int k) { if (k > 1000) return f(k - 1); int a[4]; a[0] = k; a[1] = k * 2; a[2] = 5; a[3] = 1; return sum(a, 4); } int main() { return f(1003); }'
+test_gcc_with -O1 'int f(int* p, int n) { int x; x = n * 10; if (n == 0) return *p; return f(&x, n - 1); } int main() { int y = 7; return f(&y, 3); }'
+test_gcc_with -O2 'int f(int* p, int n) { int x; x = n * 10; if (n == 0) return *p; return f(&x, n - 1); } int main() { int y = 7; return f(&y, 3); }'
+
+echo ""
+echo "=== PART 27: ループ不変式の移動テスト ==="
+echo ""
+
+test_gcc 'int main() { char* s = "hello world"; int i; int n = 0; for (i = 0; i < strlen(s); i++) n += 2; return n; }'
+test_gcc 'int data[16]; int main() { int k = 3; int m = 5; int i; int acc = 0; for (i = 0; i < 16; i++) { data[i] = k * m + i; acc += data[i] * (k + m); } return acc % 256; }'
+test_gcc 'int main() { int a[4]; int i; int n = 4; int t = 0; a[0] = 1; a[1] = 2; a[2] = 3; a[3] = 4; for (i = 0; i < n * 2; i++) { t += a[i % n] * n; if (i == 3) n = 2; } return t; }'
+test_gcc 'int main() { int a[4]; int* p = a; int i = 0; a[0] = 1; a[1] = 2; a[2] = 30; a[3] = 4; while (i < a[2] - 20) { *p = *p - 1; if (i == 2) p = a + 2; i++; } return a[0] * 10 + a[2]; }'
+test_gcc 'int g; void bump() { g = g + 1; } int main() { int i; int s = 0; g = 1; for (i = 0; i < 5; i++) { s += g * 3 + 1; bump(); } return s; }'
+test_gcc 'int main() { int x = 0; int* p = &x; int i; int s = 0; for (i = 0; i < 4; i++) { s += x * 7 + 1; *p = *p + i; } return s; }'
+test_gcc 'int main() { int* p = 0; int i; int n = 0; int s = 0; for (i = 0; i < n && *p > 0; i++) s += *p; return s + 7; }'
+test_gcc 'int main() { int d = 0; int i; int s = 0; for (i = 0; i < 3; i++) { if (d != 0) s += 100 / d; else s += 1; } return s; }'
+
+echo ""
+echo "=== PART 28: 誘導変数の強さの削減テスト ==="
+echo ""
+
+test_gcc 'int a[10]; int main() { int i; int s = 0; for (i = 0; i < 10; i++) a[i] = i * 3; for (i = 0; i < 10; i++) s += a[i]; return s; }'
+test_gcc 'int main() { int b[8]; int i; int t = 0; for (i = 0; i < 8; i++) b[i] = i * i; for (i = 1; i < 7; i++) t += b[i - 1] + b[i + 1] - b[i]; return t; }'
+test_gcc 'int sum(int* p, int n) { int s = 0; int i; for (i = 0; i <= n; i++) s += p[i]; return s; } int main() { int b[5]; int i; for (i = 0; i < 5; i++) b[i] = i + 2; return sum(b, 4); }'
+test_gcc 'int main() { int a[9]; int i; int s = 0; for (i = 0; i < 9; i++) a[i] = i; for (i = 0; i < 9; i += 2) s += a[i]; return s * 10 + i; }'
+test_gcc 'int main() { int a[6]; int i; int s = 0; for (i = 0; i < 6; i++) { a[i] = 5 - i; if (a[i] == 2) break; } return i * 10 + a[i]; }'
+test_gcc 'int main() { int a[6]; int i; int s = 0; for (i = 0; i < 6; i++) a[i] = 6 - i; for (i = 0; i < 6; i++) s += a[i] * i + a[i]; return s; }'
+test_gcc 'int main() { int a[5]; int b[5]; int i; int s = 0; for (i = 4; i >= 0; i--) { a[i] = i; b[i] = a[i] * 2; } for (i = 0; i < 5; i++) { if (a[i] == 3) continue; s += b[i]; } return s; }'
+
+echo ""
+echo "=== PART 29: ループの回転と展開テスト ==="
+echo ""
+
+test_gcc 'int main() { int i = 0; int s = 0; while (i < 10) { s += i; i++; } return s; }'
+test_gcc 'int main() { int n = 0; int s = 0; while (n > 0) s++; for (; n < 0;) s++; return s + 5; }'
+test_gcc_with -O2 'int a[20]; int main() { int i; int s = 0; for (i = 0; i < 20; i++) a[i] = i * 3 + 1; for (i = 0; i < 11; i++) s += a[i]; return s + i; }'
+test_gcc_with -O2 'int sum(int* p, int n) { int s = 0; int i; for (i = 0; i < n; i++) s += p[i] * i; return s; } int main() { int b[9]; int i; int t = 0; for (i = 0; i < 9; i++) b[i] = i + 1; for (i = 0; i <= 9; i++) t += sum(b, i); return t % 256; }'
+test_gcc_with -O2 'int main() { int a[12]; int i; int s = 0; for (i = 0; i < 12; i++) a[i] = i; for (i = 10; i >= 1; i -= 3) s = s * 2 + a[i]; return s + i; }'
+test_gcc_with -O2 'int f(int n) { int i; int s = 0; for (i = n; i > 0; i--) s += i; return s + i; } int main() { return f(0) + f(1) + f(5) + f(7); }'
+test_gcc_with -O2 'int main() { int a[8]; int i; int s = 0; for (i = 0; i <= 6; i += 2) { a[i] = s; a[i + 1] = i; s += a[i + 1]; } return s * 10 + a[7]; }'
+test_gcc_with '-O1 -funroll-loops=3' 'int main() { int i; int s = 0; int n = 10; for (i = 0; i < n; i++) { if (i == 7) break; s += i; } for (i = 2; i < n; i++) s += i; return s; }'
+
+echo ""
+echo "=== PART 30: 到達しない関数・グローバル変数の削除テスト ==="
+echo ""
+
+test_gcc 'int g; int unused[64]; int twice(int x) { return x * 2; } int dead(int n) { unused[0] = n; return dead(n - 1); } int main() { g = 5; return twice(g) + 1; }'
+test_gcc 'int a; int odd(int n) { if (n == 0) return 0; return a + odd(n - 1); } int main() { a = 3; return odd(4); }'
+test_gcc 'int h[4]; int fill(int v) { int i; for (i = 0; i < 4; i++) h[i] = v + i; return 0; } int sum() { return h[0] + h[1] + h[2] + h[3]; } int main() { fill(10); return sum(); }'
+
+echo "Testing dead function and global removal..."
+./mipsc 'int used; int dead_table[100]; int helper(int x) { dead_table[x] = x; printf("dead string\n"); return helper(x + 1); } int main() { used = 7; return used; }' > tmp.s
+if ! grep -q "^helper:" tmp.s && ! grep -q "dead_table" tmp.s && ! grep -q "dead string" tmp.s && grep -q "^used:" tmp.s; then
+    echo "✅ Unreachable functions, globals and strings are not emitted"
+else
+    echo "❌ Unreachable functions, globals or strings are emitted"
+fi
+./mipsc -O0 'int dead_table[100]; int helper() { return 1; } int main() { return 0; }' > tmp.s
+if grep -q "^helper:" tmp.s && grep -q "dead_table" tmp.s; then
+    echo "✅ -O0 keeps every function and global"
+else
+    echo "❌ -O0 dropped a function or global"
+fi
+rm -f tmp.s 2>/dev/null
+
+echo ""
+echo "=== PART 31: 中間表現（SSA形式）とパスマネージャのテスト ==="
+echo ""
+
+test_gcc_with -O2 'int main() { int a = 1; int b = 2; int t; int i; for (i = 0; i < 5; i++) { t = a; a = b; b = t + b; } return a * 10 + b; }'
+test_gcc_with -O2 'int main() { int x = 3; int y = 4; int i; for (i = 0; i < 7; i++) { int t; t = x; x = y; y = t; } return x * 10 + y; }'
+test_gcc_with -O2 'int f(int n) { return n > 3 ? n - 3 : n + 3; } int main() { int i; int j; int s = 0; for (i = 0; i < 6; i++) for (j = i; j < 6; j++) if (i && j % 2 || i == j) s += f(i + j); return s; }'
+test_gcc_with -O2 'int g(int x) { return x + 1; } int main() { int a = 1; int b = 2; int c = 3; int d = 4; int e = 5; int f = 6; int h = 7; int k = 8; int m = 9; int n = 10; a = g(a); return a + b * c + d * e + f * h + k * m + n + g(b + n); }'
+test_gcc_with -O2 'int main() { int a[6]; int* p; int i; int s = 0; p = a; for (i = 0; i < 6; i++) *(p + i) = i * i; while (i > 0) { i--; s = s * 3 + a[i]; } return s % 251; }'
+test_gcc_with '-O1 -fir' 'int gcd(int a, int b) { if (b == 0) return a; return gcd(b, a % b); } int main() { int s = 0; int i; for (i = 1; i < 20; i++) s += gcd(i * 12, 90); return s; }'
+test_gcc_with '-O2 -fdisable-pass=ssa' 'int f(int n) { int i = 0; int s = 0; while (i < n) { s += i * 2; i++; } return s; } int main() { return f(9); }'
+# 除算の後も被除数が生きている
+test_gcc_with '-O2 -fdisable-pass=inline' 'int h3(int a, int b) { int q; q = a / b; return q + a; } int main() { return h3(17, 5); }'
+test_gcc_with '-O2 -fdisable-pass=inline' 'int g(int a, int b) { int s = 0; while (a > 0) { s = s + a % b; a = a - 1; } return s; } int main() { return g(9, 4); }'
+
+echo "Testing pass manager options..."
+./mipsc -O2 -ftime-passes 'int main() { return 0; }' > tmp.s 2> tmp.err
+if grep -q "^regalloc" tmp.err && grep -q "^peephole" tmp.err && grep -q "^total" tmp.err; then
+    echo "✅ -ftime-passes reports each pass"
+else
+    echo "❌ -ftime-passes does not report each pass"
+fi
+./mipsc -O2 -fdump-ir 'int f(int n) { int i; int s = 0; for (i = 0; i < n; i++) s += i; return s; } int main() { return f(3); }' > tmp.s 2> tmp.err
+if grep -q "; after ssa" tmp.err && grep -q "phi" tmp.err; then
+    echo "✅ -fdump-ir shows SSA form"
+else
+    echo "❌ -fdump-ir does not show SSA form"
+fi
+if ./mipsc -O2 -fdisable-pass=regalloc 'int main() { return 0; }' > tmp.s 2> /dev/null; then
+    echo "❌ Required pass was disabled"
+else
+    echo "✅ Required pass cannot be disabled"
+fi
+rm -f tmp.s tmp.err 2>/dev/null
+
+echo ""
+echo "=== PART 32: 値番号付けと読み込みの再利用テスト ==="
+echo ""
+
+test_gcc_with -O2 'int main() { int a[3]; int* p; p = a; a[0] = 1; *p = 5; return a[0] + a[0]; }'
+test_gcc_with -O2 'int g; int set() { g = 9; return 0; } int main() { int x; g = 1; x = g; set(); return x + g; }'
+test_gcc_with -O2 'int g; int f(int* p) { g = 1; *p = 7; return g; } int main() { return f(&g); }'
+test_gcc_with '-O2 -fdisable-pass=inline' 'int f(int* p, int* q) { *p = 1; *q = 2; return *p; } int main() { int a[2]; return f(a, a) * 10 + f(a, a + 1); }'
+test_gcc_with '-O2 -fdisable-pass=inline' 'struct P { int x; int y; }; int norm(struct P* p) { return p->x * p->x + p->y * p->y; } int main() { struct P q; q.x = 3; q.y = 4; return norm(&q); }'
+test_gcc_with '-O2 -fdisable-pass=inline' 'int add(int* a, int* b, int i) { a[i] = a[i] + b[i]; return a[i] * 2 + b[i]; } int main() { int a[3]; int b[3]; a[2] = 5; b[2] = 6; return add(a, b, 2) + add(a, a, 2); }'
+test_gcc_with -O2 'int h[5]; int main() { int i; int s = 0; for (i = 0; i < 5; i++) h[i] = i; for (i = 1; i < 5; i++) { h[i] = h[i] + h[i - 1]; s = s + h[i] * h[i - 1]; } return s % 256; }'
+test_gcc_with -O2 'int main() { int a[2]; int x; a[0] = 3; x = a[0]; printf("%d\n", a[0] = 4); return x * 10 + a[0]; }'
+
+echo "Testing redundant load elimination..."
+./mipsc -O2 -fdisable-pass=inline 'struct P { int x; int y; }; int norm(struct P* p) { return p->x * p->x + p->y * p->y; } int main() { struct P q; q.x = 1; q.y = 2; return norm(&q); }' > tmp.s
+if [ "$(sed -n '/^norm:/,/jr/p' tmp.s | grep -c 'lw ')" = "2" ]; then
+    echo "✅ Each member is loaded once"
+else
+    echo "❌ Members are loaded more than once"
+fi
+rm -f tmp.s 2>/dev/null
+
+echo ""
+echo "=== PART 33: ローカル変数のレジスタ割り当てテスト ==="
+echo ""
+
+test_gcc_with '-O2 -fdisable-pass=inline' 'int inc(int* p) { *p = *p + 1; return 0; } int main() { int x; int y; int* p; x = 3; p = &x; *p = *p + 4; y = x; inc(&y); return x * 10 + y; }'
+test_gcc_with '-O2 -fdisable-pass=inline' 'int sq(int x) { return x * x; } int main() { int i; int s = 0; int t = 1; for (i = 0; i < 6; i++) { s += sq(i); t = t * 2 + sq(s) % 7; } return (s + t) % 256; }'
+test_gcc_with '-O2 -fdisable-pass=inline' 'int f(int a, int b, int c, int d) { int x; int y; int z; int w; if (a == 0) return b + c + d; x = a * 2; y = b * 3; z = c + d; w = x - y; return f(a - 1, x + w, y % 11, z % 13) + x + y + z + w; } int main() { return f(6, 1, 2, 3) % 256; }'
+test_gcc_with -O2 'int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); } int main() { return fib(12) % 256; }'
+test_gcc_with -O2 'int main() { int a; int b; int* p; a = 1; b = 2; p = &a; if (b > 1) p = &b; *p = 9; return a * 10 + b; }'
+
+echo "Testing register-resident locals..."
+./mipsc -O2 'int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); } int main() { return fib(10); }' > tmp.s
+if sed -n '/^fib:/,/^main:/p' tmp.s | grep -q 'sw $s0' && sed -n '/^fib:/,/^main:/p' tmp.s | grep -q 'lw $s0'; then
+    echo "✅ Values live across calls use callee-saved registers"
+else
+    echo "❌ Values live across calls do not use callee-saved registers"
+fi
+./mipsc -O2 -fdisable-pass=inline 'int sum(int n) { int i; int s = 0; for (i = 0; i < n; i++) s += i; return s; } int main() { return sum(10); }' > tmp.s
+if ! sed -n '/^sum:/,/^main:/p' tmp.s | grep -q '$sp'; then
+    echo "✅ Leaf function keeps its locals in registers without a frame"
+else
+    echo "❌ Leaf function allocates a frame"
+fi
+rm -f tmp.s 2>/dev/null
+
+echo ""
+echo "=== PART 34: 命令スケジューリングのテスト ==="
+echo ""
+
+test_gcc_with -O2 'int f(int* a, int n) { int i; int s = 0; for (i = 0; i < n; i++) s = s + a[i] * a[i] + i / 3; return s; } int main() { int a[8]; int i; for (i = 0; i < 8; i++) a[i] = i * 7 % 5; return f(a, 8) % 256; }'
+test_gcc_with '-O2 -mtune=r3000' 'int g[4]; int f(int x, int y) { int p; int q; g[0] = x; g[1] = y; p = x * y; q = x / (y + 1); g[2] = g[0] + g[1]; return p + q % 7 + g[2]; } int main() { return f(13, 5) + f(7, 2); }'
+test_gcc_with '-O2 -mtune=4kc' 'int main() { int a[4]; int i; int s = 1; a[0] = 3; a[1] = 5; a[2] = 7; a[3] = 9; for (i = 0; i < 4; i++) s = s * a[i] % 97 + a[3 - i]; return s; }'
+test_gcc_with '-O1 -fschedule-insns' 'int h(int a, int b) { return a * b + a % b - b / 2; } int main() { int i; int s = 0; for (i = 1; i < 9; i++) s += h(i + 4, i); return s % 256; }'
+test_gcc_with '-O2 -fno-schedule-insns' 'int main() { int x = 6; int y = 7; return x * y; }'
+
+echo "Testing scheduler options..."
+./mipsc -O2 -fsched-verbose 'int f(int* p, int n) { return p[0] * n + p[1] / n; } int main() { int a[2]; a[0] = 4; a[1] = 9; return f(a, 3); }' > tmp.s 2> tmp.err
+if grep -q "stall cycles" tmp.err; then
+    echo "✅ -fsched-verbose reports hidden stall cycles"
+else
+    echo "❌ -fsched-verbose does not report stall cycles"
+fi
+if ./mipsc -O2 -mtune=bogus 'int main() { return 0; }' > tmp.s 2> /dev/null; then
+    echo "❌ Unknown CPU was accepted"
+else
+    echo "✅ Unknown CPU is rejected"
+fi
+rm -f tmp.s tmp.err 2>/dev/null
+
+echo ""
+echo "=== PART 35: switch文のテスト ==="
+echo ""
+
+test_gcc_with -O0 'int f(int c) { switch (c) { case 0: return 3; case 1: return 5; case 2: return 7; case 3: return 11; case 4: return 13; default: return 1; } } int main() { int i; int s = 0; for (i = -1; i < 7; i++) s = s * 3 + f(i); return s % 256; }'
+test_gcc_with -O1 'int f(int c) { int r = 0; switch (c) { case -70000: r = 1; break; case 3: r = 2; case 9: r = r + 3; break; case 500: r = 4; break; case 80000: r = 5; break; default: r = 6; } return r; } int main() { return f(-70000) + f(3) * 10 + f(9) * 20 + f(500) + f(80000) * 2 + f(4); }'
+test_gcc_with -O2 'int f(int c) { switch (c) { case 1: case 2: case 3: return 1; case 4: return 2; case 5: return 3; case 6: return 4; case 300: return 5; case 1000: return 6; case 1001: return 7; case 1002: return 8; case 1004: return 9; } return 0; } int main() { int i; int s = 0; for (i = 0; i < 8; i++) s += f(i); for (i = 998; i < 1006; i++) s = s * 2 + f(i); return (s + f(300)) % 256; }'
+test_gcc_with -O2 'int main() { int i; int s = 0; for (i = 0; i < 12; i++) { switch (i % 4) { case 0: s += 1; continue; case 1: s += 10; break; case 2: { int k; k = 0; while (k < 5) { k++; if (k == 3) break; } s += k * 7; break; } default: s += 2; } s += 1; } return s; }'
+test_gcc_with '-O2 -fdisable-pass=inline' 'int c[12]; int run(int n) { int st[8]; int sp = 0; int pc = 0; while (pc < n) { int op; op = c[pc]; pc++; switch (op) { case 0: st[sp] = c[pc]; sp++; pc++; break; case 1: sp--; st[sp - 1] = st[sp - 1] + st[sp]; break; case 2: sp--; st[sp - 1] = st[sp - 1] * st[sp]; break; case 3: st[sp] = st[sp - 1]; sp++; break; case 4: return st[sp - 1]; default: return 255; } } return 0; } int main() { c[0] = 0; c[1] = 6; c[2] = 3; c[3] = 0; c[4] = 4; c[5] = 1; c[6] = 2; c[7] = 4; return run(8); }'
+test_gcc_with -O2 'int f(int a, int b) { int r = 0; switch (a) { case 1: switch (b) { case 1: r = 11; break; default: r = 19; } break; case 2: r = 20; if (b > 1) break; r = 21; default: r = r + 100; } return r; } int main() { return f(1, 1) + f(1, 2) + f(2, 1) + f(2, 2) + f(3, 0); }'
+test_gcc_with -O2 'int main() { int x = 3; switch (x) { case 1: return 5; case 3: return 7; default: return 9; } }'
+
+echo "Testing switch dispatch..."
+./mipsc -O2 -fdisable-pass=inline 'int f(int c) { switch (c) { case 0: return 3; case 1: return 5; case 2: return 7; case 3: return 11; case 5: return 13; } return 1; } int main() { return f(2); }' > tmp.s
+if grep -q 'jr $v0' tmp.s && grep -q '^\.rdata' tmp.s && grep -q '\.word' tmp.s; then
+    echo "✅ Dense cases use a jump table"
+else
+    echo "❌ Dense cases do not use a jump table"
+fi
+./mipsc -O2 -fdisable-pass=inline 'int f(int c) { switch (c) { case 1: return 3; case 100: return 5; case 10000: return 7; case 1000000: return 11; case -5: return 13; } return 1; } int main() { return f(100); }' > tmp.s
+if ! grep -q '\.rdata' tmp.s && grep -q 'slti' tmp.s; then
+    echo "✅ Sparse cases use a compare tree"
+else
+    echo "❌ Sparse cases do not use a compare tree"
+fi
+if ./mipsc 'int main() { int x; x = 1; switch (x) { case 1: case 1: return 2; } return 0; }' > tmp.s 2> /dev/null; then
+    echo "❌ Duplicate case value was accepted"
+else
+    echo "✅ Duplicate case value is rejected"
+fi
+rm -f tmp.s 2>/dev/null
+
+echo ""
+echo "=== PART 36: if変換（movn/movz）のテスト ==="
+echo ""
+
+test_gcc_with -O1 'int min(int a, int b) { return a < b ? a : b; } int max(int a, int b) { return a > b ? a : b; } int main() { int i; int s = 0; for (i = -5; i < 6; i++) s = s * 3 + min(i, 2) - max(i, -1) + (i == 0 ? 7 : 1) + (!i ? 5 : 2); return s % 256; }'
+test_gcc_with -O2 'int clamp(int x, int lo, int hi) { if (x < lo) x = lo; if (x > hi) x = hi; return x; } int main() { int i; int s = 0; for (i = -30; i < 30; i += 7) s = s * 5 + clamp(i, -10, 12); return (s % 251 + 251) % 251; }'
+test_gcc_with -O2 'int g; int f(int a, int b) { int d; if (a > b) d = a - b; else d = b - a; return d + (a != 3 ? g : a * 2) + (a < 2 ? (b < 3 ? 1 : 2) : 3); } int main() { int i; int s = 0; g = 4; for (i = 0; i < 8; i++) s = s * 2 + f(i, 5 - i); return s % 256; }'
+test_gcc_with '-O1 -fdisable-pass=inline' 'int t; int bump(int v) { t = t + 1; return v; } int f(int x) { int r = 1; if (bump(x) > 2) r = x * 3; return r + (bump(x) < 4 ? x : 9) + t; } int main() { return f(1) + f(5) * 10; }'
+test_gcc_with '-O2 -fno-if-conversion' 'int main() { int a = 3; int b = 8; return a < b ? b - a : a - b; }'
+
+echo "Testing if-conversion..."
+./mipsc -O2 -fdisable-pass=inline 'int min(int a, int b) { return a < b ? a : b; } int main() { return min(3, 4); }' > tmp.s
+if sed -n '/^min:/,/^main:/p' tmp.s | grep -qE 'movn|movz' && ! sed -n '/^min:/,/^main:/p' tmp.s | grep -qE '^\s*b(eq|ne|eqz|nez|ltz|gez|lez|gtz) '; then
+    echo "✅ min() is branchless with -fir"
+else
+    echo "❌ min() still branches with -fir"
+fi
+./mipsc -O1 -fdisable-pass=inline 'int max(int a, int b) { if (a < b) a = b; return a; } int main() { return max(3, 4); }' > tmp.s
+if sed -n '/^max:/,/^main:/p' tmp.s | grep -qE 'movn|movz'; then
+    echo "✅ Conditional assignment uses movn/movz at -O1"
+else
+    echo "❌ Conditional assignment still branches at -O1"
+fi
+./mipsc -O2 -fno-if-conversion -fdisable-pass=inline 'int min(int a, int b) { return a < b ? a : b; } int main() { return min(3, 4); }' > tmp.s
+if ! grep -qE 'movn|movz' tmp.s; then
+    echo "✅ -fno-if-conversion keeps the branch"
+else
+    echo "❌ -fno-if-conversion still emits movn/movz"
+fi
+rm -f tmp.s 2>/dev/null
+
+echo ""
+echo "=== PART 37: 標準出力のバッファリングのテスト ==="
+echo ""
+
+test_gcc_with -O0 'int main() { int i; for (i = 0; i < 5; i++) putchar(97 + i); puts(""); printf("%d\n", 42); return 3; }'
+test_gcc_with -O2 'int main() { int i; int n = 0; for (i = 0; i < 1500; i++) { printf("x%d\n", i % 10); n += i % 7; } return n % 256; }'
+
+echo "Testing buffered stdout..."
+./mipsc -O1 'int main() { int i; for (i = 0; i < 2000; i++) { putchar(48 + i % 10); if (i % 50 == 49) puts("!"); } printf("end\n"); return 0; }' > tmp.s
+if mips-linux-gnu-gcc -mno-abicalls -fno-pic tmp.s -o tmp_buf -nostdlib -static 2>/dev/null; then
+    expected=$(for i in $(seq 0 1999); do printf "%d" $((i % 10)); if [ $((i % 50)) = 49 ]; then echo "!"; fi; done; echo "end")
+    output=$(qemu-mips tmp_buf)
+    writes=$(qemu-mips -strace tmp_buf 2>&1 >/dev/null | grep -c ' write(1,')
+    if [ "$output" = "$expected" ]; then
+        echo "✅ Buffered output matches"
+    else
+        echo "❌ Buffered output differs"
+    fi
+    if [ "$writes" -le 2 ]; then
+        echo "✅ Output written with $writes write syscalls"
+    else
+        echo "❌ Too many write syscalls: $writes"
+    fi
+else
+    echo "❌ Compilation failed"
+fi
+rm -f tmp.s tmp_buf 2>/dev/null
+
+echo ""
+echo "=== PART 38: printfの書式の展開のテスト ==="
+echo ""
+
+test_gcc_with -O0 'int main() { int a = 7; int b = 12; printf("a=%d b=%d sum=%d\n", a, b, a + b); printf("100%% %d\n", b - a); return a * b; }'
+test_gcc_with -O2 'int g; int f(int x) { g = g + x; return x * 3; } int main() { printf("%d,%d;%d\n", f(1), f(2), f(3)); return g; }'
+test_gcc_with -O1 'int main() { char* p; p = "%d\n"; printf(p, 5); printf("0123456789012345678901234567890123456789012345678901234567890123456789 %d\n", 9); return 0; }'
+
+echo "Testing printf specialization..."
+./mipsc -O1 'int main() { int x = 6; int y = 7; printf("%d*%d=%d\n", x, y, x * y); return 0; }' > tmp.s
+if mips-linux-gnu-gcc -mno-abicalls -fno-pic tmp.s -o tmp_pf -nostdlib -static 2>/dev/null && [ "$(qemu-mips tmp_pf)" = "6*7=42" ]; then
+    echo "✅ printf with several %d prints every argument"
+else
+    echo "❌ printf with several %d is wrong"
+fi
+if ! grep -q 'printf_loop' tmp.s; then
+    echo "✅ Literal format is expanded without a scanning loop"
+else
+    echo "❌ Literal format still scanned at run time"
+fi
+rm -f tmp.s tmp_pf 2>/dev/null
+
+echo "Testing printf at the buffer boundary..."
+./mipsc -O1 'int main() { int i; for (i = 0; i < 64; i++) printf("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"); putchar(88); return 0; }' > tmp.s
+if mips-linux-gnu-gcc -mno-abicalls -fno-pic tmp.s -o tmp_pf -nostdlib -static 2>/dev/null; then
+    output=$(qemu-mips tmp_pf)
+    if [ "${#output}" = 4097 ] && [ "${output: -1}" = "X" ]; then
+        echo "✅ putchar after filling the buffer to 4096 bytes is printed"
+    else
+        echo "❌ Output after filling the buffer is wrong (${#output} bytes)"
+    fi
+else
+    echo "❌ Compilation failed"
+fi
+rm -f tmp.s tmp_pf 2>/dev/null
+
+echo ""
+echo "=== PART 39: printfの整数変換と%u/%x/%c/%sのテスト ==="
+echo ""
+
+test_gcc_with -O0 'int main() { int i; int s = 0; for (i = -3; i < 4; i++) { printf("%d %u %x\n", i * 1234567, i, i * 255); s += i; } return s + 5; }'
+test_gcc_with -O2 'int main() { char* s = "ok"; printf("[%s] [%c%c] %s\n", s, 72, 105, "lit"); printf("%d\n", -2147483647 - 1); return 4; }'
+test_gcc_with -O1 'int main() { char* f = "%x-%c-%u\n"; printf(f, 48879, 65, 7); return 9; }'
+
+echo "Testing printf conversions..."
+./mipsc -O1 'int main() { int m = -2147483647 - 1; printf("%d %d %u %x %c%s\n", 0, m, -1, -2, 33, "end"); return 0; }' > tmp.s
+if mips-linux-gnu-gcc -mno-abicalls -fno-pic tmp.s -o tmp_pf -nostdlib -static 2>/dev/null && [ "$(qemu-mips tmp_pf)" = "0 -2147483648 4294967295 fffffffe !end" ]; then
+    echo "✅ printf prints %d/%u/%x/%c/%s"
+else
+    echo "❌ printf conversions are wrong"
+fi
+if grep -q '^\.L_print_dec:' tmp.s && ! grep -qE '^\s*div ' tmp.s; then
+    echo "✅ Integers are converted by the shared routine without div"
+else
+    echo "❌ Integer conversion still uses div"
+fi
+rm -f tmp.s tmp_pf 2>/dev/null
+
+echo "Testing printf conversions at the buffer boundary..."
+./mipsc -O1 'int main() { int i; for (i = 0; i < 63; i++) printf("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"); printf("0123456789abcdef0123456789abcdef0123456789abcdef01234567%x", 305419896); putchar(89); return 0; }' > tmp.s
+if mips-linux-gnu-gcc -mno-abicalls -fno-pic tmp.s -o tmp_pf -nostdlib -static 2>/dev/null; then
+    output=$(qemu-mips tmp_pf)
+    if [ "${#output}" = 4097 ] && [ "${output: -3}" = "78Y" ]; then
+        echo "✅ putchar after a conversion fills the buffer to 4096 bytes is printed"
+    else
+        echo "❌ Output after filling the buffer is wrong (${#output} bytes)"
+    fi
+else
+    echo "❌ Compilation failed"
+fi
+rm -f tmp.s tmp_pf 2>/dev/null
+
+echo ""
+echo "=== PART 40: getcharの入力バッファのテスト ==="
+echo ""
+
+echo "Testing buffered getchar..."
+program='int main() { int c; int n = 0; int s = 0; c = getchar(); while (c != -1) { n++; s = s + c * n; putchar(c); c = getchar(); } printf("%d %d %d\n", n, s, getchar()); return n % 256; }'
+echo "$program" > tmp_gcc.c
+mips-linux-gnu-gcc tmp_gcc.c -o tmp_gcc -static 2>/dev/null
+seq 1 2000 > tmp_input.txt
+printf '\377end' >> tmp_input.txt
+expected=$(qemu-mips tmp_gcc < tmp_input.txt; echo "exit=$?")
+for option in -O0 -O1 -O2; do
+    ./mipsc $option "$program" > tmp.s
+    if mips-linux-gnu-gcc -mno-abicalls -fno-pic tmp.s -o tmp_in -nostdlib -static 2>/dev/null &&
+       [ "$(qemu-mips tmp_in < tmp_input.txt; echo "exit=$?")" = "$expected" ]; then
+        echo "✅ ($option) getchar reads the whole input and returns -1 at EOF"
+    else
+        echo "❌ ($option) getchar output differs"
+    fi
+done
+reads=$(qemu-mips -strace tmp_in < tmp_input.txt 2>&1 >/dev/null | grep -c ' read(0,')
+if [ "$reads" -le 5 ]; then
+    echo "✅ $(wc -c < tmp_input.txt) bytes read with $reads read syscalls"
+else
+    echo "❌ Too many read syscalls: $reads"
+fi
+if [ "$(printf '' | qemu-mips tmp_in)" = "0 0 -1" ]; then
+    echo "✅ Empty input returns -1"
+else
+    echo "❌ Empty input does not return -1"
+fi
+rm -f tmp.s tmp_in tmp_gcc.c tmp_gcc tmp_input.txt 2>/dev/null
+
+echo ""
+echo "=== PART 41: 4バイト単位の文字列関数のテスト ==="
+echo ""
+
+test_gcc_with -O0 'int main() { char* a = "the quick brown fox"; int i; int n = 0; for (i = 0; i < 9; i++) n = n * 2 + strlen(a + i); return n % 256; }'
+test_gcc_with -O1 'int sgn(int x) { return x < 0 ? 2 : x > 0 ? 1 : 0; } int main() { char* a = "abcdefghijklmnop"; char* b = "abcdefghijklmnoq"; int i; int r = 0; for (i = 0; i < 6; i++) r = r * 3 + sgn(strcmp(a + i, b + i)) + sgn(strcmp(a + i, a + i)) + sgn(strcmp(a + i, "abcd")); return r % 256; }'
+test_gcc_with -O2 'char buf[40]; int main() { char* s = "copy me word by word!"; int i; int n = 0; for (i = 0; i < 5; i++) { strcpy(buf + i, s + i); n = n + strlen(buf + i) + strcmp(buf + i, s + i); } return n; }'
+
+echo "Testing word-at-a-time string functions..."
+./mipsc -O1 'int main() { return strlen("hello, world"); }' > tmp.s
+if grep -q '0x80808080' tmp.s && grep -B1 '^\.L_str_' tmp.s | grep -q '\.align 2'; then
+    echo "✅ strlen scans words and string literals are word-aligned"
+else
+    echo "❌ strlen still scans bytes or literals are unaligned"
+fi
+rm -f tmp.s 2>/dev/null
+
 echo ""
 echo "########################################"
 echo "#          テスト完了                    #"